@@ -77,8 +77,8 @@ void Canvas_App::run()
 	auto select = alloc_select(select_size);
 	while (m_running)
 	{
-		auto idx = global_router->select(select);
-		auto msg = global_router->read(select[idx]);
+		auto idx = m_router.select(select);
+		auto msg = m_router.read(select[idx]);
 		auto body = (View::Event*)msg->begin();
 		switch (body->m_evt)
 		{
@@ -62,10 +62,10 @@ void Launcher_App::run()
 	add_front(window);
 
 	//event loop
-	auto mbox = global_router->validate(get_id());
+	auto mbox = m_router.resolve(get_id());
 	while (m_running)
 	{
-		auto msg = mbox->read();
+		auto msg = mbox.read();
 		auto body = (View::Event*)msg->begin();
 		switch (body->m_evt)
 		{
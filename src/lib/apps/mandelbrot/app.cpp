@@ -45,97 +45,107 @@ void Mandelbrot_App::run()
 
 	//select and init workers
 	m_select = alloc_select(select_size);
-	m_entry = global_router->declare(m_select[select_worker], "mandel_worker", "Mandelbrot v0.01");
+	m_entry = m_router.declare(m_select[select_worker], "mandel_worker", Farm::worker_params("Mandelbrot v0.01"));
 	reset();
 
 	//event loop
-	Kernel_Service::timed_mail(m_select[select_timer], std::chrono::milliseconds(1), 0);
+	Kernel_Service::periodic_mail(m_select[select_timer], std::chrono::milliseconds(1), std::chrono::milliseconds(UPDATE_TIMEOUT), 0, m_router);
 	while (m_running)
 	{
-		auto idx = global_router->select(m_select);
-		auto msg = global_router->read(m_select[idx]);
+		auto idx = m_router.select(m_select);
+		auto msg = m_router.read(m_select[idx]);
 		switch (idx)
 		{
 		case select_worker:
 		{
-			//job request, hive off to worker thread
+			//job request, hive off to the executor
 			//note these request can come from anywhere !
 			//we will gladly do the work for anyone.
-			m_thread_pool->enqueue([=, msg_ref = std::move(msg)]
+			//cancels are just noted, the job checks them between rows.
+			//a batch of jobs goes to the executor a job at a time, the replies go back as one.
+			if (m_cancels.note(msg)) break;
+			auto jobs = Farm::unpack(msg);
+			auto replies = std::make_shared<Farm::Replies>(m_router, jobs.size());
+			for (auto i = 0u; i < jobs.size(); ++i)
 			{
-				auto job_body = (Mandelbrot_Job*)msg_ref->begin();
-				auto x = job_body->m_x;
-				auto y = job_body->m_y;
-				auto x1 = job_body->m_x1;
-				auto y1 = job_body->m_y1;
-				auto cw = job_body->m_cw;
-				auto ch = job_body->m_ch;
-				auto cx = job_body->m_cx;
-				auto cy = job_body->m_cy;
-				auto z = job_body->m_z;
-				auto stride = (x1 - x);
-				auto reply = std::make_shared<Msg>(sizeof(Mandelbrot_Job_reply) + stride * (y1 - y));
-				auto reply_body = (Mandelbrot_Job_reply*)reply->begin();
-				//must return job header
-				memcpy(&reply_body->m_worker, &job_body->m_worker, sizeof(Farm::Job));
-				//now our specific data
-				reply_body->m_x = x;
-				reply_body->m_y = y;
-				reply_body->m_x1 = x1;
-				reply_body->m_y1 = y1;
-				for (auto ry = y; ry < y1; ++ry)
+				Executor::global().post([=, this, msg_ref = std::move(jobs[i])]
 				{
-					for (auto rx = x; rx < x1; ++rx)
+					auto job_body = (Mandelbrot_Job*)msg_ref->begin();
+					auto x = job_body->m_x;
+					auto y = job_body->m_y;
+					auto x1 = job_body->m_x1;
+					auto y1 = job_body->m_y1;
+					auto cw = job_body->m_cw;
+					auto ch = job_body->m_ch;
+					auto cx = job_body->m_cx;
+					auto cy = job_body->m_cy;
+					auto z = job_body->m_z;
+					auto stride = (x1 - x);
+					auto reply = std::make_shared<Msg>(sizeof(Mandelbrot_Job_reply) + stride * (y1 - y));
+					auto reply_body = (Mandelbrot_Job_reply*)reply->begin();
+					//must return job header
+					memcpy(&reply_body->m_worker, &job_body->m_worker, sizeof(Farm::Job));
+					//now our specific data
+					reply_body->m_x = x;
+					reply_body->m_y = y;
+					reply_body->m_x1 = x1;
+					reply_body->m_y1 = y1;
+					for (auto ry = y; ry < y1; ++ry)
 					{
-						auto dx = (((((double)rx - (cw / 2.0)) * 2.0) / cw) * z) + cx;
-						auto dy = (((((double)ry - (ch / 2.0)) * 2.0) / ch) * z) + cy;
-						reply_body->m_data[(ry - y) * stride + (rx - x)] = depth(dx, dy);
+						if (m_cancels.cancelled(*job_body))
+						{
+							replies->reply(i, nullptr);
+							return;
+						}
+						for (auto rx = x; rx < x1; ++rx)
+						{
+							auto dx = (((((double)rx - (cw / 2.0)) * 2.0) / cw) * z) + cx;
+							auto dy = (((((double)ry - (ch / 2.0)) * 2.0) / ch) * z) + cy;
+							reply_body->m_data[(ry - y) * stride + (rx - x)] = depth(dx, dy);
+						}
 					}
-				}
-				reply->set_dest(job_body->m_reply);
-				//simulate failure !
-				//if (rand() % 100 < 5) return;
-				global_router->send(reply);
-			});
+					reply->set_dest(job_body->m_reply);
+					//simulate failure !
+					//if (rand() % 100 < 5) { replies->reply(i, nullptr); return; }
+					replies->reply(i, reply);
+				}, Executor::prio_normal, &m_jobs);
+			}
 			break;
 		}
 		case select_reply:
 		{
-			//job reply, validate it's a current job not some old discarded one
-			if (!m_farm->validate_job(msg)) break;
-			auto reply_body = (Mandelbrot_Job_reply*)msg->begin();
-
-			//use the reply data
-			auto x = reply_body->m_x;
-			auto y = reply_body->m_y;
-			auto x1 = reply_body->m_x1;
-			auto y1 = reply_body->m_y1;
-			auto stride = x1 - x;
-			for (auto ry = y; ry < y1; ++ry)
+			//job replies, maybe a batch, the farm drops any that aren't current jobs,
+			//removes completed jobs and maybe sends off more
+			m_farm->complete_jobs(msg, [&] (const std::shared_ptr<Msg> &reply)
 			{
-				for (auto rx = x; rx < x1; ++rx)
+				auto reply_body = (Mandelbrot_Job_reply*)reply->begin();
+
+				//use the reply data
+				auto x = reply_body->m_x;
+				auto y = reply_body->m_y;
+				auto x1 = reply_body->m_x1;
+				auto y1 = reply_body->m_y1;
+				auto stride = x1 - x;
+				for (auto ry = y; ry < y1; ++ry)
 				{
-					uint32_t i = reply_body->m_data[(ry - y) * stride + (rx - x)];
-					uint32_t col = argb_black;
-					if (i != 255)
+					for (auto rx = x; rx < x1; ++rx)
 					{
-						col = col + (i << 16) + ((i & 0x7f) << 9)+ ((i & 0x3f) << 2);
+						uint32_t i = reply_body->m_data[(ry - y) * stride + (rx - x)];
+						uint32_t col = argb_black;
+						if (i != 255)
+						{
+							col = col + (i << 16) + ((i & 0x7f) << 9)+ ((i & 0x3f) << 2);
+						}
+						canvas->m_col = col;
+						canvas->plot(rx, ry);
 					}
-					canvas->m_col = col;
-					canvas->plot(rx, ry);
 				}
-			}
+			});
 			m_dirty = true;
-
-			//remove completed job, maybe send off another
-			m_farm->complete_job(msg);
 			break;
 		}
 		case select_timer:
 		{
-			//restart timer
-			Kernel_Service::timed_mail(m_select[select_timer], std::chrono::milliseconds(UPDATE_TIMEOUT), 0);
-
 			//adjust workforce and jobs
 			m_farm->refresh();
 
@@ -202,8 +212,10 @@ void Mandelbrot_App::run()
 	}
 
 	//tidy up
+	Kernel_Service::timed_mail(m_select[select_timer], std::chrono::milliseconds(0), 0, m_router);
+	m_jobs.wait();
 	sub(window);
-	global_router->forget(m_entry);
+	m_router.forget(m_entry);
 	free_select(m_select);
 }
 
@@ -227,11 +239,11 @@ uint8_t Mandelbrot_App::depth(double x0, double y0) const
 void Mandelbrot_App::reset()
 {
 	//new reply mailbox !
-	global_router->free(m_select[select_reply]);
-	m_select[select_reply] = global_router->alloc();
+	m_router.free(m_select[select_reply]);
+	m_select[select_reply] = m_router.alloc();
 
 	//create farm, will kill old one
-	m_farm = std::make_unique<Farm>("mandel_worker",
+	m_farm = std::make_unique<Farm>(m_router, "mandel_worker",
 		JOB_LIMIT,
 		std::chrono::milliseconds(JOB_TIMEOUT),
 		[&] (auto &worker, std::shared_ptr<Msg> job)
@@ -241,22 +253,22 @@ void Mandelbrot_App::reset()
 			job_body->m_reply = m_select[select_reply];
 		});
 
-	//fill farm job que
-	for (auto y = 0; y < CANVAS_HEIGHT * CANVAS_SCALE; ++y)
+	//scanlines for the farm to cut into jobs
+	m_farm->add_range(0, CANVAS_HEIGHT * CANVAS_SCALE, std::chrono::milliseconds(JOB_TARGET), [&] (uint32_t y, uint32_t y1)
 	{
 		auto job = std::make_shared<Msg>(sizeof(Mandelbrot_Job));
 		auto job_body = (Mandelbrot_Job*)job->begin();
 		job_body->m_x = 0;
 		job_body->m_y = y;
 		job_body->m_x1 = CANVAS_WIDTH * CANVAS_SCALE;
-		job_body->m_y1 = y + 1;
+		job_body->m_y1 = y1;
 		job_body->m_cw = CANVAS_WIDTH * CANVAS_SCALE;
 		job_body->m_ch = CANVAS_HEIGHT * CANVAS_SCALE;
 		job_body->m_cx = m_cx;
 		job_body->m_cy = m_cy;
 		job_body->m_z = m_zoom;
-		m_farm->add_job(job);
-	}
+		return job;
+	});
 
 	//get to work !
 	m_farm->assign_work();
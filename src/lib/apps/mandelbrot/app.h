@@ -2,7 +2,7 @@
 #define MANDELBROT_APP_H
 
 #include "../../services/gui_task.h"
-#include "../../utils/threadpool.h"
+#include "../../utils/executor.h"
 #include "../../task/farm.h"
 
 //task
@@ -15,10 +15,10 @@ private:
 	const uint32_t UPDATE_TIMEOUT = 100;
 	const uint32_t JOB_TIMEOUT = 5000;
 	const uint32_t JOB_LIMIT = 16;
+	const uint32_t JOB_TARGET = 20;
 public:
 	Mandelbrot_App()
 		: GUI_Task()
-		, m_thread_pool(std::make_unique<ThreadPool>(JOB_LIMIT))
 	{}
 	static std::shared_ptr<Mandelbrot_App> create() { return std::make_shared<Mandelbrot_App>(); }
 	void run() override;
@@ -54,7 +54,8 @@ private:
 	};
 	uint8_t depth(double x0, double y0) const;
 	void reset();
-	std::unique_ptr<ThreadPool> m_thread_pool;
+	Job_Group m_jobs;
+	Farm::Cancels m_cancels;
 	std::unique_ptr<Farm> m_farm;
 	std::vector<Net_ID> m_select;
 	std::string m_entry;
@@ -45,82 +45,91 @@ void Raymarch_App::run()
 
 	//select and init workers
 	m_select = alloc_select(select_size);
-	m_entry = global_router->declare(m_select[select_worker], "raymarch_worker", "Raymarch v0.01");
+	m_entry = m_router.declare(m_select[select_worker], "raymarch_worker", Farm::worker_params("Raymarch v0.01"));
 	reset();
 
 	//event loop
-	Kernel_Service::timed_mail(m_select[select_timer], std::chrono::milliseconds(1), 0);
+	Kernel_Service::periodic_mail(m_select[select_timer], std::chrono::milliseconds(1), std::chrono::milliseconds(UPDATE_TIMEOUT), 0, m_router);
 	while (m_running)
 	{
-		auto idx = global_router->select(m_select);
-		auto msg = global_router->read(m_select[idx]);
+		auto idx = m_router.select(m_select);
+		auto msg = m_router.read(m_select[idx]);
 		switch (idx)
 		{
 		case select_worker:
 		{
-			//job request, hive off to worker thread
+			//job request, hive off to the executor
 			//note these request can come from anywhere !
 			//we will gladly do the work for anyone.
-			m_thread_pool->enqueue([=, msg_ref = std::move(msg)]
+			//cancels are just noted, the job checks them between rows.
+			//a batch of jobs goes to the executor a job at a time, the replies go back as one.
+			if (m_cancels.note(msg)) break;
+			auto jobs = Farm::unpack(msg);
+			auto replies = std::make_shared<Farm::Replies>(m_router, jobs.size());
+			for (auto i = 0u; i < jobs.size(); ++i)
 			{
-				auto job_body = (Raymarch_Job*)msg_ref->begin();
-				auto over_sample = job_body->m_over_sample;
-				auto x = job_body->m_x;
-				auto y = job_body->m_y;
-				auto x1 = job_body->m_x1;
-				auto y1 = job_body->m_y1;
-				auto cw = job_body->m_cw;
-				auto ch = job_body->m_ch;
-				auto stride = (x1 - x);
-				auto reply = std::make_shared<Msg>(sizeof(Raymarch_Job_reply) + stride * (y1 - y) * sizeof(uint32_t));
-				auto reply_body = (Raymarch_Job_reply*)reply->begin();
-				//must return job header
-				memcpy(&reply_body->m_worker, &job_body->m_worker, sizeof(Farm::Job));
-				//now our specific data
-				reply_body->m_x = x;
-				reply_body->m_y = y;
-				reply_body->m_x1 = x1;
-				reply_body->m_y1 = y1;
-				render(reply_body, over_sample, x, y, x1, y1, cw, ch);
-				reply->set_dest(job_body->m_reply);
-				//simulate failure !
-				//if (rand() % 100 < 5) return;
-				global_router->send(reply);
-			});
+				Executor::global().post([=, this, msg_ref = std::move(jobs[i])]
+				{
+					auto job_body = (Raymarch_Job*)msg_ref->begin();
+					auto over_sample = job_body->m_over_sample;
+					auto x = job_body->m_x;
+					auto y = job_body->m_y;
+					auto x1 = job_body->m_x1;
+					auto y1 = job_body->m_y1;
+					auto cw = job_body->m_cw;
+					auto ch = job_body->m_ch;
+					auto stride = (x1 - x);
+					auto reply = std::make_shared<Msg>(sizeof(Raymarch_Job_reply) + stride * (y1 - y) * sizeof(uint32_t));
+					auto reply_body = (Raymarch_Job_reply*)reply->begin();
+					//must return job header
+					memcpy(&reply_body->m_worker, &job_body->m_worker, sizeof(Farm::Job));
+					//now our specific data
+					reply_body->m_x = x;
+					reply_body->m_y = y;
+					reply_body->m_x1 = x1;
+					reply_body->m_y1 = y1;
+					if (!render(*job_body, reply_body, over_sample, x, y, x1, y1, cw, ch))
+					{
+						replies->reply(i, nullptr);
+						return;
+					}
+					reply->set_dest(job_body->m_reply);
+					//simulate failure !
+					//if (rand() % 100 < 5) { replies->reply(i, nullptr); return; }
+					replies->reply(i, reply);
+				}, Executor::prio_normal, &m_jobs);
+			}
 			break;
 		}
 		case select_reply:
 		{
-			//job reply, validate it's a current job not some old discarded one
-			if (!m_farm->validate_job(msg)) break;
-			auto reply_body = (Raymarch_Job_reply*)msg->begin();
-
-			//use the reply data
-			auto x = reply_body->m_x;
-			auto y = reply_body->m_y;
-			auto x1 = reply_body->m_x1;
-			auto y1 = reply_body->m_y1;
-			auto stride = x1 - x;
-			for (auto ry = y; ry < y1; ++ry)
+			//job replies, maybe a batch, the farm drops any that aren't current jobs,
+			//removes completed jobs and maybe sends off more
+			m_farm->complete_jobs(msg, [&] (const std::shared_ptr<Msg> &reply)
 			{
-				for (auto rx = x; rx < x1; ++rx)
+				auto reply_body = (Raymarch_Job_reply*)reply->begin();
+
+				//use the reply data
+				auto x = reply_body->m_x;
+				auto y = reply_body->m_y;
+				auto x1 = reply_body->m_x1;
+				auto y1 = reply_body->m_y1;
+				auto stride = x1 - x;
+				for (auto ry = y; ry < y1; ++ry)
 				{
-					uint32_t col = reply_body->m_data[(ry - y) * stride + (rx - x)];
-					canvas->m_col = col;
-					canvas->plot(rx, ry);
+					for (auto rx = x; rx < x1; ++rx)
+					{
+						uint32_t col = reply_body->m_data[(ry - y) * stride + (rx - x)];
+						canvas->m_col = col;
+						canvas->plot(rx, ry);
+					}
 				}
-			}
+			});
 			m_dirty = true;
-
-			//remove completed job, maybe send off another
-			m_farm->complete_job(msg);
 			break;
 		}
 		case select_timer:
 		{
-			//restart timer
-			Kernel_Service::timed_mail(m_select[select_timer], std::chrono::milliseconds(UPDATE_TIMEOUT), 0);
-
 			//adjust workforce and jobs
 			m_farm->refresh();
 
@@ -187,19 +196,21 @@ void Raymarch_App::run()
 	}
 
 	//tidy up
+	Kernel_Service::timed_mail(m_select[select_timer], std::chrono::milliseconds(0), 0, m_router);
+	m_jobs.wait();
 	sub(window);
-	global_router->forget(m_entry);
+	m_router.forget(m_entry);
 	free_select(m_select);
 }
 
 void Raymarch_App::reset()
 {
 	//new reply mailbox !
-	global_router->free(m_select[select_reply]);
-	m_select[select_reply] = global_router->alloc();
+	m_router.free(m_select[select_reply]);
+	m_select[select_reply] = m_router.alloc();
 
 	//create farm, will kill old one
-	m_farm = std::make_unique<Farm>("raymarch_worker",
+	m_farm = std::make_unique<Farm>(m_router, "raymarch_worker",
 		JOB_LIMIT,
 		std::chrono::milliseconds(JOB_TIMEOUT),
 		[&] (auto &worker, std::shared_ptr<Msg> job)
@@ -209,8 +220,8 @@ void Raymarch_App::reset()
 			job_body->m_reply = m_select[select_reply];
 		});
 
-	//fill farm job que
-	for (auto y = 0; y < CANVAS_HEIGHT * CANVAS_SCALE; ++y)
+	//scanlines for the farm to cut into jobs
+	m_farm->add_range(0, CANVAS_HEIGHT * CANVAS_SCALE, std::chrono::milliseconds(JOB_TARGET), [&] (uint32_t y, uint32_t y1)
 	{
 		auto job = std::make_shared<Msg>(sizeof(Raymarch_Job));
 		auto job_body = (Raymarch_Job*)job->begin();
@@ -218,11 +229,11 @@ void Raymarch_App::reset()
 		job_body->m_x = 0;
 		job_body->m_y = y;
 		job_body->m_x1 = CANVAS_WIDTH * CANVAS_SCALE;
-		job_body->m_y1 = y + 1;
+		job_body->m_y1 = y1;
 		job_body->m_cw = CANVAS_WIDTH * CANVAS_SCALE;
 		job_body->m_ch = CANVAS_HEIGHT * CANVAS_SCALE;
-		m_farm->add_job(job);
-	}
+		return job;
+	});
 
 	//get to work !
 	m_farm->assign_work();
@@ -2,7 +2,7 @@
 #define RAYMARCH_APP_H
 
 #include "../../services/gui_task.h"
-#include "../../utils/threadpool.h"
+#include "../../utils/executor.h"
 #include "../../task/farm.h"
 
 //task
@@ -16,10 +16,10 @@ private:
 	const uint32_t UPDATE_TIMEOUT = 500;
 	const uint32_t JOB_TIMEOUT = 5000;
 	const uint32_t JOB_LIMIT = 16;
+	const uint32_t JOB_TARGET = 20;
 public:
 	Raymarch_App()
 		: GUI_Task()
-		, m_thread_pool(std::make_unique<ThreadPool>(JOB_LIMIT))
 	{}
 	static std::shared_ptr<Raymarch_App> create() { return std::make_shared<Raymarch_App>(); }
 	void run() override;
@@ -51,12 +51,13 @@ private:
 		select_timer,
 		select_size,
 	};
-	void render(Raymarch_Job_reply* body, uint32_t over_sample,
+	bool render(const Farm::Job &job, Raymarch_Job_reply* body, uint32_t over_sample,
 		uint32_t x, uint32_t y,
 		uint32_t x1, uint32_t y1,
 		uint32_t cw, uint32_t ch) const;
 	void reset();
-	std::unique_ptr<ThreadPool> m_thread_pool;
+	Job_Group m_jobs;
+	Farm::Cancels m_cancels;
 	std::unique_ptr<Farm> m_farm;
 	std::vector<Net_ID> m_select;
 	std::string m_entry;
@@ -102,7 +102,7 @@ Vec3d scene_ray(Vec3d ray_origin, Vec3d ray_dir)
 	return clamp_v3(color, Vec3d{0.0, 0.0, 0.0}, Vec3d{1.0, 1.0, 1.0});
 }
 
-void Raymarch_App::render(Raymarch_Job_reply* body, uint32_t over_sample,
+bool Raymarch_App::render(const Farm::Job &job, Raymarch_Job_reply* body, uint32_t over_sample,
 		uint32_t x, uint32_t y,
 		uint32_t x1, uint32_t y1,
 		uint32_t cw, uint32_t ch) const
@@ -117,6 +117,7 @@ void Raymarch_App::render(Raymarch_Job_reply* body, uint32_t over_sample,
 		1.0 / (over_sample * over_sample));
 	for (auto ry = y; ry < y1; ++ry)
 	{
+		if (m_cancels.cancelled(job)) return false;
 		auto dy = (ry - h2) / h2;
 		const auto osy_itr = ((((ry + 1) - h2) / h2) - dy) / over_sample;
 		for (auto rx = x; rx < x1; ++rx)
@@ -140,4 +141,5 @@ void Raymarch_App::render(Raymarch_Job_reply* body, uint32_t over_sample,
 			body->m_data[(ry - y) * stride + (rx - x)] = col;
 		}
 	}
+	return true;
 }
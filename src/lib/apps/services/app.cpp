@@ -87,11 +87,11 @@ void Services_App::run()
 	auto old_entries = std::vector<std::string>{};
 	auto old_labels = std::vector<std::shared_ptr<Label>>{};
 	auto select = alloc_select(select_size);
-	Kernel_Service::timed_mail(select[select_timer], std::chrono::milliseconds(100), 0);
+	Kernel_Service::periodic_mail(select[select_timer], std::chrono::milliseconds(100), std::chrono::milliseconds(100), 0, m_router);
 	while (m_running)
 	{
-		auto idx = global_router->select(select);
-		auto msg = global_router->read(select[idx]);
+		auto idx = m_router.select(select);
+		auto msg = m_router.read(select[idx]);
 		switch (idx)
 		{
 		case select_main:
@@ -125,8 +125,7 @@ void Services_App::run()
 		case select_timer:
 		{
 			//any changes to service directory
-			Kernel_Service::timed_mail(select[select_timer], std::chrono::milliseconds(100), 0);
-			auto entries = global_router->enquire("");
+			auto entries = m_router.enquire("");
 			// //filter out "kernel" services as they all have one.
 			// entries.erase(std::remove_if(begin(entries), end(entries), [&] (auto &s)
 			// {
@@ -174,6 +173,7 @@ void Services_App::run()
 	}
 
 	//tidy up
+	Kernel_Service::timed_mail(select[select_timer], std::chrono::milliseconds(0), 0, m_router);
 	sub(window);
 	free_select(select);
 }
@@ -3,82 +3,88 @@
 #include <iostream>
 #include <cstring>
 
-extern std::unique_ptr<Router> global_router;
 extern uint32_t arg_v;
 
-///////////
-//utilities
-///////////
-
-uint32_t jenkins_hash(const uint8_t *key, size_t len);
-void obfuscate(uint8_t *key, size_t len);
-
 ////////////
 //IP Manager
 ////////////
 
-void IP_Link_Manager::run()
+void IP_Link_Manager::start_thread()
 {
 	//create a server or client or do nothing yet, the hub runs a server,
 	//applications usually start up and immediately dial the local hub
-	if (m_ip_addr == "server")
-	{
-		//we are going to be a server
-		asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), IP_LINK_PORT);
-		m_acceptor.open(endpoint.protocol());
-		m_acceptor.bind(endpoint);
-		m_acceptor.listen();
-		accept();
-	}
-	else if (m_ip_addr != "")
+	m_running = true;
+	asio::post(m_io_context, [this]
 	{
-		//we are going to be a client
-		dial(m_ip_addr);
-	}
-
-	while (m_running)
-	{
-		//got dialing to do ?
-		if (!m_dial_que.empty())
+		if (m_ip_addr == "server")
 		{
-			std::lock_guard<std::mutex> l(m_mutex);
-			for (auto &addr : m_dial_que) connect(addr);
-			m_dial_que.clear();
+			//we are going to be a server
+			asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), IP_LINK_PORT);
+			m_acceptor.open(endpoint.protocol());
+			m_acceptor.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+			m_acceptor.bind(endpoint);
+			m_acceptor.listen();
+			accept();
 		}
-
-		//asio run loop/sleep
-		auto start = std::chrono::high_resolution_clock::now();
-		m_io_context.run_for(std::chrono::milliseconds(IP_LINK_MANAGER_POLLING_RATE));
-		auto finish = std::chrono::high_resolution_clock::now();
-		std::chrono::duration<double, std::milli> elapsed = finish - start;
-		if (elapsed.count() < IP_LINK_MANAGER_POLLING_RATE)
+		else if (m_ip_addr != "")
 		{
-			uint32_t sleep = IP_LINK_MANAGER_POLLING_RATE - elapsed.count();
-			std::this_thread::sleep_for(std::chrono::milliseconds(sleep));
+			//we are going to be a client
+			connect(m_ip_addr);
 		}
+	});
+	for (auto i = 0u; i < m_io_threads; ++i) m_threads.emplace_back(&IP_Link_Manager::run, this);
+}
 
-		//purge any dead/closed links
-		m_links.erase(std::remove_if(begin(m_links), end(m_links), [&] (auto &link)
-		{
-			if (link->m_running) return false;
-			if (arg_v > 0) std::cout << "ip_link: purged" << std::endl;
-			link->stop_threads();
-			link->join_threads();
-			return true;
-		}), end(m_links));
-	}
-
-	//close any links
-	for (auto &link : m_links) link->stop_threads();
-	for (auto &link : m_links) link->join_threads();
-	m_links.clear();
+void IP_Link_Manager::run()
+{
+	//io thread, runs the handlers for the acceptor, dials and all the links
+	m_io_context.run();
 }
 
 void IP_Link_Manager::stop_thread()
 {
+	//stop accepting and close all the links
+	std::lock_guard<std::mutex> l(m_mutex);
 	if (!m_running) return;
 	Link_Manager::stop_thread();
+	asio::post(m_io_context, [this]
+	{
+		asio::error_code ec;
+		m_acceptor.close(ec);
+	});
+	for (auto &link : m_links) link->stop_threads();
+}
+
+void IP_Link_Manager::join_thread()
+{
+	//wait for the links to be purged, then let the io threads go
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		m_cv.wait(l, [&]{ return m_links.empty(); });
+	}
+	m_work.reset();
 	m_io_context.stop();
+	for (auto &thread : m_threads) thread.join();
+	m_threads.clear();
+}
+
+void IP_Link_Manager::add_link(std::shared_ptr<asio::ip::tcp::socket> socket)
+{
+	//new link, purged from our list when it closes
+	auto link = std::make_shared<IP_Link>(socket, std::chrono::microseconds(IP_LINK_FLUSH_DEADLINE), m_router);
+	link->m_on_close = [this] (IP_Link *link)
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_links.erase(std::remove_if(begin(m_links), end(m_links), [&] (auto &l) { return l.get() == link; }), end(m_links));
+		if (arg_v > 0) std::cout << "ip_link: purged" << std::endl;
+		m_cv.notify_all();
+	};
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (!m_running) return;
+		m_links.push_back(link);
+	}
+	link->start_threads();
 }
 
 void IP_Link_Manager::accept()
@@ -90,8 +96,7 @@ void IP_Link_Manager::accept()
 		if (!ec)
 		{
 			if (arg_v > 0) std::cout << "accept: connected" << std::endl;
-			m_links.emplace_back(std::make_unique<IP_Link>(socket));
-			m_links.back()->start_threads();
+			add_link(socket);
 		}
 		else
 		{
@@ -103,85 +108,248 @@ void IP_Link_Manager::accept()
 
 void IP_Link_Manager::connect(const std::string &addr)
 {
+	auto socket = std::make_shared<asio::ip::tcp::socket>(m_io_context);
+	auto connected = [socket, this] (const asio::error_code ec)
+	{
+		if (!ec)
+		{
+			if (arg_v > 0) std::cout << "connect: connected" << std::endl;
+			add_link(socket);
+		}
+		else
+		{
+			if (arg_v > 0) std::cout << "connect: error, " << ec.message() << std::endl;
+		}
+	};
 	asio::error_code ec;
 	asio::ip::address ip_address = asio::ip::make_address(addr, ec);
 	if (ec)
 	{
 		//lets try a dns resolve...
-		asio::ip::tcp::resolver::query resolver_query(addr,
-			std::string(IP_LINK_PORT_STRING), asio::ip::tcp::resolver::query::numeric_service);
-		asio::ip::tcp::resolver resolver(m_io_context);
-		asio::ip::tcp::resolver::iterator it = resolver.resolve(resolver_query, ec);
-		if (ec)
+		auto resolver = std::make_shared<asio::ip::tcp::resolver>(m_io_context);
+		resolver->async_resolve(addr, std::string(IP_LINK_PORT_STRING), asio::ip::tcp::resolver::numeric_service,
+			[resolver, socket, connected] (const asio::error_code ec, asio::ip::tcp::resolver::results_type results)
 		{
-			if (arg_v > 0) std::cout << "connect: error, " << ec.message() << std::endl;
-			return;
-		}
-		asio::ip::tcp::resolver::iterator it_end;
-		asio::ip::tcp::endpoint ep = it->endpoint();
-		auto socket = std::make_shared<asio::ip::tcp::socket>(m_io_context);
-		socket->async_connect(ep, [socket, this] (const asio::error_code ec)
-		{
-			if (!ec)
-			{
-				if (arg_v > 0) std::cout << "connect: connected" << std::endl;
-				m_links.emplace_back(std::make_unique<IP_Link>(socket));
-				m_links.back()->start_threads();
-			}
-			else
+			if (ec)
 			{
 				if (arg_v > 0) std::cout << "connect: error, " << ec.message() << std::endl;
+				return;
 			}
+			socket->async_connect(results.begin()->endpoint(), connected);
 		});
 	}
 	else
 	{
 		//use our valididated ip address
 		if (arg_v > 0) std::cout << "connect: waiting..." << std::endl;
-		asio::ip::tcp::endpoint ep(ip_address, IP_LINK_PORT);
-		auto socket = std::make_shared<asio::ip::tcp::socket>(m_io_context);
-		socket->async_connect(ep, [socket, this] (const asio::error_code ec)
-		{
-			if (!ec)
-			{
-				if (arg_v > 0) std::cout << "connect: connected" << std::endl;
-				m_links.emplace_back(std::make_unique<IP_Link>(socket));
-				m_links.back()->start_threads();
-			}
-			else
-			{
-				if (arg_v > 0) std::cout << "connect: error, " << ec.message() << std::endl;
-			}
-		});
+		socket->async_connect(asio::ip::tcp::endpoint(ip_address, IP_LINK_PORT), connected);
 	}
 }
 
 void IP_Link_Manager::dial(const std::string &addr)
 {
-	std::lock_guard<std::mutex> l(m_mutex);
-	m_dial_que.emplace_back(addr);
+	asio::post(m_io_context, [this, addr] { connect(addr); });
 }
 
 /////////
 //IP link
 /////////
 
-//send msg header and body down the link
-bool IP_Link::send(const std::shared_ptr<Msg> &msg)
+IP_Link::IP_Link(std::shared_ptr<asio::ip::tcp::socket> socket, std::chrono::microseconds flush_deadline, Router &router)
+	: Link(router)
+	, m_socket(socket)
+	, m_strand(asio::make_strand(socket->get_executor()))
+	, m_ping_timer(m_strand)
+	, m_flush_timer(m_strand)
+	, m_flush_deadline(flush_deadline)
+{
+	//we do our own coalescing, so no nagle delay, best effort on the rest
+	asio::error_code ec;
+	m_socket->set_option(asio::ip::tcp::no_delay(true), ec);
+	m_socket->set_option(asio::socket_base::keep_alive(true), ec);
+	m_socket->set_option(asio::socket_base::send_buffer_size(IP_LINK_SOCKET_BUFFER_SIZE), ec);
+	m_socket->set_option(asio::socket_base::receive_buffer_size(IP_LINK_SOCKET_BUFFER_SIZE), ec);
+}
+
+void IP_Link::start_threads()
+{
+	//start reading, send a ping straight away to get the Dev_ID exchanged
+	//and keep pinging while we are idle
+	m_running = true;
+	{
+		std::lock_guard<std::mutex> l(m_closed_mutex);
+		m_closed = false;
+	}
+	asio::post(m_strand, [this, self = shared_from_this()]
+	{
+		start_read();
+		start_write(true);
+		start_ping_timer();
+	});
+}
+
+void IP_Link::stop_threads()
+{
+	asio::post(m_strand, [this, self = shared_from_this()] { close(); });
+}
+
+void IP_Link::join_threads()
+{
+	std::unique_lock<std::mutex> l(m_closed_mutex);
+	m_closed_cv.wait(l, [&]{ return m_closed; });
+}
+
+void IP_Link::wake()
+{
+	//the router has msgs for us, it's locked so just post the write
+	asio::post(m_strand, [this, self = shared_from_this()] { start_write(false); });
+}
+
+void IP_Link::close()
+{
+	//drop out of the router, post back any not sent messages and close the socket.
+	//operations still in flight complete with errors and go no further.
+	if (!m_running) return;
+	m_running = false;
+	m_router.sub_link(this);
+	for (auto &msg : m_out_msgs)
+	{
+		if (msg->m_header.m_frag_length) m_router.send(msg);
+	}
+	m_out_msgs.clear();
+	asio::error_code ec;
+	m_ping_timer.cancel();
+	m_flush_timer.cancel();
+	m_socket->close(ec);
+	{
+		std::lock_guard<std::mutex> l(m_closed_mutex);
+		m_closed = true;
+	}
+	m_closed_cv.notify_all();
+	if (m_on_close) m_on_close(this);
+}
+
+void IP_Link::start_ping_timer()
+{
+	m_ping_timer.expires_after(std::chrono::milliseconds(LINK_PING_RATE));
+	m_ping_timer.async_wait(asio::bind_executor(m_strand, [this, self = shared_from_this()] (const asio::error_code ec)
+	{
+		if (ec || !m_running) return;
+		//ping if nothing has gone out since the last tick
+		if (!m_sent) start_write(true);
+		m_sent = false;
+		start_ping_timer();
+	}));
+}
+
+void IP_Link::start_write(bool ping)
+{
+	//send what is on our que, if it's empty the router wakes us when that changes
+	if (!m_running || m_writing) return;
+	auto bytes = m_router.get_next_msgs(m_remote_dev_id, this, m_out_msgs, IP_LINK_MAX_SEND_BYTES);
+	if (m_out_msgs.empty())
+	{
+		//send a ping to get the Dev_ID exchanged
+		if (!ping) return;
+		m_out_msgs.emplace_back(std::make_shared<Msg>());
+	}
+	m_writing = true;
+	if (bytes && bytes < IP_LINK_MAX_SEND_BYTES && m_flush_deadline.count())
+	{
+		//wait for more till the flush deadline
+		m_flush_timer.expires_after(m_flush_deadline);
+		m_flush_timer.async_wait(asio::bind_executor(m_strand, [this, self = shared_from_this(), bytes] (const asio::error_code ec)
+		{
+			if (ec || !m_running)
+			{
+				m_writing = false;
+				return;
+			}
+			m_router.get_next_msgs(m_remote_dev_id, nullptr, m_out_msgs, IP_LINK_MAX_SEND_BYTES - bytes);
+			write_out();
+		}));
+		return;
+	}
+	write_out();
+}
+
+void IP_Link::write_out()
+{
+	//write the out msgs to the socket in one go, then see what's next
+	auto size = pack(m_out_msgs);
+	asio::async_write(*m_socket, asio::buffer(m_send_records.data(), size),
+		asio::bind_executor(m_strand, [this, self = shared_from_this()] (const asio::error_code ec, size_t)
+	{
+		m_writing = false;
+		if (ec) return close();
+		m_out_msgs.clear();
+		m_sent = true;
+		start_write(false);
+	}));
+}
+
+void IP_Link::start_read()
+{
+	//read whatever the socket has got, a read can bring in many records at once
+	make_room();
+	m_socket->async_read_some(asio::buffer(m_receive_chunk->begin() + m_receive_end, m_receive_chunk->size() - m_receive_end),
+		asio::bind_executor(m_strand, [this, self = shared_from_this()] (const asio::error_code ec, size_t len)
+	{
+		if (ec) return close();
+		m_receive_end += len;
+		auto dev_id = m_remote_dev_id;
+		try
+		{
+			//send on any msgs that are not pings
+			std::shared_ptr<Msg> msg;
+			while (next_record(msg))
+			{
+				if (msg && msg->m_header.m_frag_length) m_router.send(msg);
+			}
+		}
+		catch(const std::exception& e)
+		{
+			return close();
+		}
+		//if the peer changed we have a new que to wait on
+		if (dev_id != m_remote_dev_id) start_write(false);
+		start_read();
+	}));
+}
+
+//pack msg header and body as a length prefixed record, calculate the hash and obfuscate.
+//returns the record size.
+uint32_t IP_Link::pack(const std::shared_ptr<Msg> &msg, uint8_t *record)
 {
-	//pack msg into send buffer, calculate the hash and obfuscate
 	uint32_t len = offsetof(Link_Buf, m_msg_body) + msg->m_header.m_frag_length;
-	memcpy(&m_send_buf.m_dev_id, &global_router->get_dev_id(), sizeof(Dev_ID));
-	memcpy((uint8_t*)&m_send_buf.m_msg_header, &msg->m_header, sizeof(Msg_Header));
-	memcpy(&m_send_buf.m_msg_body, msg->begin() + msg->m_header.m_data_offset, msg->m_header.m_frag_length);
-	m_send_buf.m_hash = jenkins_hash((uint8_t*)&m_send_buf.m_dev_id, offsetof(Link_Buf, m_msg_body) - offsetof(Link_Buf, m_dev_id) + msg->m_header.m_frag_length);
-	obfuscate((uint8_t*)&m_send_buf, len);
+	auto buf = record + sizeof(len);
+	memcpy(record, &len, sizeof(len));
+	memcpy(buf + offsetof(Link_Buf, m_dev_id), &m_router.get_dev_id(), sizeof(Dev_ID));
+	memcpy(buf + offsetof(Link_Buf, m_msg_header), &msg->m_header, sizeof(Msg_Header));
+	msg->gather((char*)buf + offsetof(Link_Buf, m_msg_body));
+	encode_frame(buf, len);
+	return sizeof(len) + len;
+}
 
-	//write the buffer to the socket
+//pack the msgs as records one after the other in the send records buffer.
+//returns the total size.
+uint32_t IP_Link::pack(const std::vector<std::shared_ptr<Msg>> &msgs)
+{
+	uint32_t size = 0;
+	for (auto &msg : msgs) size += sizeof(uint32_t) + offsetof(Link_Buf, m_msg_body) + msg->m_header.m_frag_length;
+	if (m_send_records.size() < size) m_send_records.resize(size);
+	auto record = m_send_records.data();
+	for (auto &msg : msgs) record += pack(msg, record);
+	return size;
+}
+
+//send msg headers and bodies down the link
+bool IP_Link::send(const std::vector<std::shared_ptr<Msg>> &msgs)
+{
+	auto size = pack(msgs);
 	try
 	{
-		asio::write(*m_socket, asio::buffer((uint8_t*)&len, sizeof(len)));
-		asio::write(*m_socket, asio::buffer((uint8_t*)&m_send_buf, len));
+		asio::write(*m_socket, asio::buffer(m_send_records.data(), size));
 	}
 	catch(const std::exception& e)
 	{
@@ -191,42 +359,85 @@ bool IP_Link::send(const std::shared_ptr<Msg> &msg)
 	return true;
 }
 
+bool IP_Link::send(const std::shared_ptr<Msg> &msg)
+{
+	return send(std::vector<std::shared_ptr<Msg>>{msg});
+}
+
 std::shared_ptr<Msg> IP_Link::receive()
 {
-	//read the buffer from the socket
-	uint32_t len = 0;
+	//read till we have a whole record in the receive chunk
 	try
 	{
-		asio::read(*m_socket, asio::buffer((uint8_t*)&len, sizeof(len)));
-		asio::read(*m_socket, asio::buffer((uint8_t*)&m_receive_buf, len));
+		std::shared_ptr<Msg> msg;
+		while (!next_record(msg))
+		{
+			make_room();
+			m_receive_end += m_socket->read_some(asio::buffer(m_receive_chunk->begin() + m_receive_end,
+				m_receive_chunk->size() - m_receive_end));
+		}
+		return msg;
 	}
 	catch(const std::exception& e)
 	{
 		m_running = false;
 		return nullptr;
 	}
+}
 
-	//un-obfuscate and calculate the hash
-	obfuscate((uint8_t*)&m_receive_buf, len);
-	auto hash = jenkins_hash((uint8_t*)&m_receive_buf.m_dev_id, len - offsetof(Link_Buf, m_dev_id));
-	if (hash != m_receive_buf.m_hash)
+void IP_Link::make_room()
+{
+	//no room for a max size record ? then move to a fresh chunk, or back to
+	//the start of this one if no msgs are still using it
+	if (m_receive_chunk && m_receive_chunk->size() - m_receive_start >= sizeof(uint32_t) + sizeof(Link_Buf)) return;
+	auto avail = m_receive_end - m_receive_start;
+	auto chunk = m_receive_chunk;
+	if (!chunk || chunk.use_count() > 2) chunk = Msg_Buf::create(IP_LINK_RECEIVE_CHUNK_SIZE);
+	if (avail) memmove(chunk->begin(), m_receive_chunk->begin() + m_receive_start, avail);
+	m_receive_chunk = chunk;
+	m_receive_start = 0;
+	m_receive_end = avail;
+}
+
+//take the next whole record out of the receive chunk, false if there isn't one yet.
+//msg is the record's msg, or null if it failed its hash check. throws on a bad length.
+bool IP_Link::next_record(std::shared_ptr<Msg> &msg)
+{
+	uint32_t len = 0;
+	auto avail = m_receive_end - m_receive_start;
+	if (avail < sizeof(len)) return false;
+	memcpy(&len, m_receive_chunk->begin() + m_receive_start, sizeof(len));
+	if (len < offsetof(Link_Buf, m_msg_body) || len > sizeof(Link_Buf)) throw std::runtime_error("ip_link: bad length");
+	if (avail < sizeof(len) + len) return false;
+
+	//consume the record, un-obfuscate and check the hash
+	auto offset = m_receive_start + (uint32_t)sizeof(len);
+	auto buf = (uint8_t*)m_receive_chunk->begin() + offset;
+	m_receive_start += sizeof(len) + len;
+	auto ok = decode_frame(buf, len);
+	Dev_ID dev_id;
+	Msg_Header header;
+	memcpy(&dev_id, buf + offsetof(Link_Buf, m_dev_id), sizeof(Dev_ID));
+	memcpy((uint8_t*)&header, buf + offsetof(Link_Buf, m_msg_header), sizeof(Msg_Header));
+	if (!ok || header.m_frag_length != len - offsetof(Link_Buf, m_msg_body))
 	{
 		//error with crc hash !!!
 		std::cerr << "ip_link: crc error !" << std::endl;
-		return nullptr;
+		msg = nullptr;
+		return true;
 	}
 
-	//unpack msg from receive buffer
-	auto msg = std::make_shared<Msg>(m_receive_buf.m_msg_header, m_receive_buf.m_msg_body);
+	//msg body is the slice of the receive chunk after the record header
+	msg = std::make_shared<Msg>(header, m_receive_chunk, offset + (uint32_t)offsetof(Link_Buf, m_msg_body));
 
 	//refresh who we are connected to in a unplug/plug scenario.
 	//if the peer device id changes we need to swap the link on the router !
 	//the software equivelent of pulling the lead out and plugging another one in.
-	if (m_receive_buf.m_dev_id != m_remote_dev_id)
+	if (dev_id != m_remote_dev_id)
 	{
-		m_remote_dev_id = m_receive_buf.m_dev_id;
-		global_router->sub_link(this);
-		global_router->add_link(this, m_remote_dev_id);
+		m_remote_dev_id = dev_id;
+		m_router.sub_link(this);
+		m_router.add_link(this, m_remote_dev_id);
 	}
-	return msg;
+	return true;
 }
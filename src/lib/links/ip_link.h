@@ -3,48 +3,96 @@
 
 #include "link.h"
 #include <asio.hpp>
+#include <functional>
 
-class IP_Link : public Link
+//ip link.
+//ip links have no threads of their own, all the links of a manager are async socket
+//operations run by a small shared pool of io threads, each link on its own strand.
+//sends drain whatever is ready on the peer que, up to a limit, and write it as a run
+//of length prefixed records with a single socket write, optionally waiting up to the
+//flush deadline for more msgs to turn up. when the que is empty the router wakes the
+//link as soon as somthing is qued for it.
+//reads take as much as the socket has into a pool chunk and parse the records out of
+//it, msg bodies are slices of that chunk.
+class IP_Link : public Link, public std::enable_shared_from_this<IP_Link>
 {
 public:
-	IP_Link(std::shared_ptr<asio::ip::tcp::socket> socket)
-		: Link()
-		, m_socket(socket)
-	{}
+	IP_Link(std::shared_ptr<asio::ip::tcp::socket> socket,
+			std::chrono::microseconds flush_deadline = std::chrono::microseconds(IP_LINK_FLUSH_DEADLINE),
+			Router &router = *global_router);
+	//no threads, these start, stop and wait for the async operations.
+	//links must be owned by a shared_ptr, the operations hold a reference.
+	void start_threads() override;
+	void stop_threads() override;
+	void join_threads() override;
+	void wake() override;
+	//called on an io thread when the link has closed
+	std::function<void(IP_Link*)> m_on_close;
 	std::shared_ptr<asio::ip::tcp::socket> m_socket;
 protected:
+	//blocking send/receive, for driving a link by hand
 	virtual bool send(const std::shared_ptr<Msg> &msg) override;
 	virtual std::shared_ptr<Msg> receive() override;
+	bool send(const std::vector<std::shared_ptr<Msg>> &msgs);
+	uint32_t pack(const std::vector<std::shared_ptr<Msg>> &msgs);
+	uint32_t pack(const std::shared_ptr<Msg> &msg, uint8_t *record);
+	void make_room();
+	bool next_record(std::shared_ptr<Msg> &msg);
+	//async operations, only ever run on the strand
+	void start_read();
+	void start_write(bool ping);
+	void start_ping_timer();
+	void write_out();
+	void close();
+	asio::strand<asio::ip::tcp::socket::executor_type> m_strand;
+	asio::steady_timer m_ping_timer;
+	asio::steady_timer m_flush_timer;
+	std::chrono::microseconds m_flush_deadline;
+	std::vector<std::shared_ptr<Msg>> m_out_msgs;
+	std::vector<uint8_t> m_send_records;
+	bool m_writing = false;
+	bool m_sent = false;
+	std::shared_ptr<Msg_Buf> m_receive_chunk;
+	uint32_t m_receive_start = 0;
+	uint32_t m_receive_end = 0;
+	std::mutex m_closed_mutex;
+	std::condition_variable m_closed_cv;
+	bool m_closed = true;
 };
 
+//ip link manager.
+//accepts, dials and link purges are all events on the io context, the io threads
+//just run it.
 class IP_Link_Manager : public Link_Manager
 {
 public:
-	IP_Link_Manager(const std::string &ip_addr)
-		: Link_Manager()
-		, m_ip_addr(ip_addr)
+	IP_Link_Manager(const std::string &ip_addr, uint32_t io_threads = IP_LINK_IO_THREADS, Router &router = *global_router)
+		: Link_Manager(router)
 		, m_io_context()
+		, m_work(asio::make_work_guard(m_io_context))
 		, m_acceptor(m_io_context)
+		, m_ip_addr(ip_addr)
+		, m_io_threads(io_threads)
 	{}
-	void start_thread() override
-	{
-		m_running = true;
-		m_thread = std::thread(&IP_Link_Manager::run, this);
-	}
+	void start_thread() override;
 	void stop_thread() override;
-	void join_thread() override { if (m_thread.joinable()) m_thread.join(); }
+	void join_thread() override;
 	void dial(const std::string &addr);
 private:
 	void run() override;
 	void accept();
 	void connect(const std::string &addr);
-	std::mutex m_mutex;
-	std::thread m_thread;
-	std::vector<std::unique_ptr<IP_Link>> m_links;
-	std::vector<std::string> m_dial_que;
-	std::string m_ip_addr;
+	void add_link(std::shared_ptr<asio::ip::tcp::socket> socket);
+	//the io context goes last, so links held by its handlers go before it does
 	asio::io_context m_io_context;
+	asio::executor_work_guard<asio::io_context::executor_type> m_work;
 	asio::ip::tcp::acceptor m_acceptor;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::vector<std::thread> m_threads;
+	std::vector<std::shared_ptr<IP_Link>> m_links;
+	std::string m_ip_addr;
+	uint32_t m_io_threads;
 };
 
 #endif
@@ -1,7 +1,18 @@
 #include "link.h"
 #include "../mail/router.h"
+#include <cstring>
 
-extern std::unique_ptr<Router> global_router;
+///////////
+//utilities
+///////////
+
+uint32_t jenkins_hash(const uint8_t *key, size_t len);
+void obfuscate(uint8_t *buf, size_t len, size_t pos);
+uint32_t obfuscate_crc32c(uint8_t *buf, size_t len, size_t pos, bool decode);
+
+//where the hashed part of a frame and the wire flags live
+const uint32_t FRAME_HASHED = offsetof(Link_Buf, m_dev_id);
+const uint32_t FRAME_FLAGS = offsetof(Link_Buf, m_msg_header) + offsetof(Msg_Header, m_wire_flags);
 
 ////////
 // links
@@ -14,7 +25,7 @@ void Link::run_send()
 	while (m_running)
 	{
 		//do we have outgoing messages ?
-		out_msg = global_router->get_next_msg(m_remote_dev_id, std::chrono::milliseconds(LINK_PING_RATE));
+		out_msg = m_router.get_next_msg(m_remote_dev_id, std::chrono::milliseconds(LINK_PING_RATE));
 		if (!m_running) break;
 		if (out_msg)
 		{
@@ -29,7 +40,7 @@ void Link::run_send()
 		}
 	}
 	//post any not sent message back to the router
-	if (out_msg) global_router->send(out_msg);
+	if (out_msg) m_router.send(out_msg);
 }
 
 void Link::run_receive()
@@ -40,13 +51,54 @@ void Link::run_receive()
 		//get any msg from the link and send if not a ping
 		if (auto in_msg = receive())
 		{
-			if (in_msg->m_header.m_frag_length) global_router->send(in_msg);
+			if (in_msg->m_header.m_frag_length) m_router.send(in_msg);
 		}
-		else
+		else if (m_running)
 		{
 			std::this_thread::sleep_for(std::chrono::milliseconds(LINK_PING_RATE));
 		}
 	}
 	//remove link entry from router
-	global_router->sub_link(this);
+	m_router.sub_link(this);
+}
+
+void Link::encode_frame(uint8_t *frame, uint32_t len)
+{
+	//the key stream position of each frame byte is the frame length plus its offset
+	uint32_t flags = m_peer_crc32c ? WIRE_CAN_CRC32C | WIRE_CRC32C : WIRE_CAN_CRC32C;
+	memcpy(frame + FRAME_FLAGS, &flags, sizeof(flags));
+	uint32_t hash;
+	if (flags & WIRE_CRC32C)
+	{
+		hash = obfuscate_crc32c(frame + FRAME_HASHED, len - FRAME_HASHED, len + FRAME_HASHED, false);
+	}
+	else
+	{
+		hash = jenkins_hash(frame + FRAME_HASHED, len - FRAME_HASHED);
+		obfuscate(frame + FRAME_HASHED, len - FRAME_HASHED, len + FRAME_HASHED);
+	}
+	memcpy(frame + offsetof(Link_Buf, m_hash), &hash, sizeof(hash));
+	obfuscate(frame + offsetof(Link_Buf, m_hash), sizeof(hash), len + offsetof(Link_Buf, m_hash));
+}
+
+bool Link::decode_frame(uint8_t *frame, uint32_t len)
+{
+	//peek at the flags to see which hash the sender used
+	uint32_t flags, hash, check;
+	memcpy(&flags, frame + FRAME_FLAGS, sizeof(flags));
+	obfuscate((uint8_t*)&flags, sizeof(flags), len + FRAME_FLAGS);
+	obfuscate(frame + offsetof(Link_Buf, m_hash), sizeof(hash), len + offsetof(Link_Buf, m_hash));
+	memcpy(&hash, frame + offsetof(Link_Buf, m_hash), sizeof(hash));
+	if (flags & WIRE_CRC32C)
+	{
+		check = obfuscate_crc32c(frame + FRAME_HASHED, len - FRAME_HASHED, len + FRAME_HASHED, true);
+	}
+	else
+	{
+		obfuscate(frame + FRAME_HASHED, len - FRAME_HASHED, len + FRAME_HASHED);
+		check = jenkins_hash(frame + FRAME_HASHED, len - FRAME_HASHED);
+	}
+	if (hash != check) return false;
+	m_peer_crc32c = (flags & WIRE_CAN_CRC32C) != 0;
+	return true;
 }
@@ -4,14 +4,24 @@
 #include "../mail/msg.h"
 #include "../settings.h"
 #include <thread>
+#include <atomic>
 
 class Router;
+extern std::unique_ptr<Router> global_router;
+
+//link frame wire flags, in the m_wire_flags of the frame header.
+//old nodes put a fragment offset there, that's always a multiple of MAX_PACKET_SIZE
+//so never has these bits set. old nodes ignore the field on receive.
+const uint32_t WIRE_CRC32C = 1;		//frame hash is a crc32c, else a jenkins hash
+const uint32_t WIRE_CAN_CRC32C = 2;	//sender can check crc32c frames
 
 //links are point to point packet transfer processes.
 //they scan the outgoing msg que for packets that go to their destination.
 //a link sends the header and body to the destination.
 //included is the hash of the link buffer for error detection plus
 //the Dev_ID of the peer who sent it.
+//the body segments are gathered straight into the send buffer, and received
+//packets are read into a pool buffer that the msg body then references.
 struct Link_Buf
 {
 	uint32_t m_hash = 0;
@@ -20,10 +30,14 @@ struct Link_Buf
 	uint8_t m_msg_body[MAX_PACKET_SIZE] = {0};
 };
 
+//links are bound to the router they carry msgs for, that's the global router
+//unless they say otherwise.
 class Link
 {
 public:
-	Link() {}
+	Link(Router &router = *global_router)
+		: m_router(router)
+	{}
 	virtual ~Link() {}
 	virtual void start_threads()
 	{
@@ -39,16 +53,23 @@ public:
 	virtual void stop_threads() { m_running = false; }
 	virtual void run_send();
 	virtual void run_receive();
+	//async links override this, the router calls it when msgs turn up for a link
+	//that found its que empty. it's called with the router locked, so no calling back in !
+	virtual void wake() {}
 	bool m_running = false;
 protected:
 	//send/receive, override these for specific sub class
 	virtual bool send(const std::shared_ptr<Msg> &msg) = 0;
 	virtual std::shared_ptr<Msg> receive() = 0;
+	//frame codec, hash and obfuscate a frame of len bytes in place, or undo and check it.
+	//we send crc32c frames once the peer says it can check them, jenkins frames till then.
+	void encode_frame(uint8_t *frame, uint32_t len);
+	bool decode_frame(uint8_t *frame, uint32_t len);
+	Router &m_router;
 	std::thread m_thread_send;
 	std::thread m_thread_receive;
 	Dev_ID m_remote_dev_id;
-	Link_Buf m_send_buf;
-	Link_Buf m_receive_buf;
+	std::atomic<bool> m_peer_crc32c {false};
 };
 
 //link managers are responsible for the discovery and management of a link subclass.
@@ -56,7 +77,9 @@ protected:
 class Link_Manager
 {
 public:
-	Link_Manager() {}
+	Link_Manager(Router &router = *global_router)
+		: m_router(router)
+	{}
 	virtual ~Link_Manager() {}
 	virtual void start_thread() = 0;
 	virtual void stop_thread() { m_running = false; }
@@ -65,6 +88,7 @@ public:
 protected:
 	//thread executes this run method
 	virtual void run() = 0;
+	Router &m_router;
 };
 
 #endif
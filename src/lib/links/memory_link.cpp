@@ -0,0 +1,84 @@
+#include "memory_link.h"
+#include "../mail/router.h"
+
+/////////////
+//memory link
+/////////////
+
+std::pair<std::unique_ptr<Memory_Link>, std::unique_ptr<Memory_Link>>
+	Memory_Link::create_pair(Router &a, Router &b, const Memory_Link_Params &params)
+{
+	auto a_to_b = std::make_shared<Memory_Channel>();
+	auto b_to_a = std::make_shared<Memory_Channel>();
+	return {std::make_unique<Memory_Link>(a, a_to_b, b_to_a, params),
+			std::make_unique<Memory_Link>(b, b_to_a, a_to_b, params)};
+}
+
+void Memory_Link::stop_threads()
+{
+	//wake our receiver so it sees we are stopping
+	Link::stop_threads();
+	std::lock_guard<std::mutex> l(m_rx->m_mutex);
+	m_rx->m_cv.notify_all();
+}
+
+bool Memory_Link::send(const std::shared_ptr<Msg> &msg)
+{
+	//copy the packet, it's on the line till the bandwidth says it's gone out,
+	//then arrives after the latency. lost packets still use the line.
+	auto now = std::chrono::steady_clock::now();
+	auto len = offsetof(Link_Buf, m_msg_body) + msg->m_header.m_frag_length;
+	auto buf = Msg_Buf::create(msg->m_header.m_frag_length);
+	msg->gather(buf->begin());
+	auto lost = m_params.m_loss > 0.0 && std::uniform_real_distribution<double>(0.0, 1.0)(m_rng) < m_params.m_loss;
+	std::chrono::steady_clock::time_point free_time;
+	{
+		std::lock_guard<std::mutex> l(m_tx->m_mutex);
+		free_time = std::max(now, m_tx->m_free_time);
+		if (m_params.m_bandwidth)
+		{
+			free_time += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double>((double)len / m_params.m_bandwidth));
+		}
+		m_tx->m_free_time = free_time;
+		if (!lost)
+		{
+			m_tx->m_que.emplace_back(Memory_Channel::Packet{free_time + m_params.m_latency,
+				m_router.get_dev_id(), std::make_shared<Msg>(msg->m_header, buf, 0)});
+			m_tx->m_cv.notify_one();
+		}
+	}
+	//the line is ours till then
+	std::this_thread::sleep_until(free_time);
+	return true;
+}
+
+std::shared_ptr<Msg> Memory_Link::receive()
+{
+	//wait for the next packet to arrive, null if we are stopping
+	Memory_Channel::Packet packet;
+	{
+		std::unique_lock<std::mutex> l(m_rx->m_mutex);
+		for (;;)
+		{
+			if (!m_running) return nullptr;
+			if (m_rx->m_que.empty()) m_rx->m_cv.wait(l);
+			else if (m_rx->m_que.front().m_time > std::chrono::steady_clock::now())
+			{
+				m_rx->m_cv.wait_until(l, m_rx->m_que.front().m_time);
+			}
+			else break;
+		}
+		packet = std::move(m_rx->m_que.front());
+		m_rx->m_que.pop_front();
+	}
+
+	//refresh who we are connected to, swap the link on the router if it's changed
+	if (packet.m_dev_id != m_remote_dev_id)
+	{
+		m_remote_dev_id = packet.m_dev_id;
+		m_router.sub_link(this);
+		m_router.add_link(this, m_remote_dev_id);
+	}
+	return packet.m_msg;
+}
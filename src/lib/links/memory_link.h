@@ -0,0 +1,66 @@
+#ifndef MEMORY_LINK_H
+#define MEMORY_LINK_H
+
+#include "link.h"
+#include <deque>
+#include <random>
+
+//memory link line characteristics
+struct Memory_Link_Params
+{
+	//one way delay
+	std::chrono::microseconds m_latency {0};
+	//bytes per second, 0 is no limit
+	uint64_t m_bandwidth = 0;
+	//chance of a packet being dropped, 0 to 1
+	double m_loss = 0.0;
+};
+
+//one direction of a memory link pair
+struct Memory_Channel
+{
+	struct Packet
+	{
+		//time it turns up at the far end
+		std::chrono::steady_clock::time_point m_time;
+		Dev_ID m_dev_id;
+		std::shared_ptr<Msg> m_msg;
+	};
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::deque<Packet> m_que;
+	//time the line is free to send the next packet
+	std::chrono::steady_clock::time_point m_free_time;
+};
+
+//memory link.
+//in process link between two routers, for simulating a network of nodes in a
+//single process. packets are copied, as they would be over a wire, and arrive
+//after the latency, no faster than the bandwidth allows, or not at all.
+class Memory_Link : public Link
+{
+public:
+	Memory_Link(Router &router,
+			std::shared_ptr<Memory_Channel> tx,
+			std::shared_ptr<Memory_Channel> rx,
+			const Memory_Link_Params &params)
+		: Link(router)
+		, m_tx(tx)
+		, m_rx(rx)
+		, m_params(params)
+		, m_rng(std::random_device{}())
+	{}
+	//create a connected pair of links between two routers
+	static std::pair<std::unique_ptr<Memory_Link>, std::unique_ptr<Memory_Link>>
+		create_pair(Router &a, Router &b, const Memory_Link_Params &params = {});
+	void stop_threads() override;
+protected:
+	virtual bool send(const std::shared_ptr<Msg> &msg) override;
+	virtual std::shared_ptr<Msg> receive() override;
+	std::shared_ptr<Memory_Channel> m_tx;
+	std::shared_ptr<Memory_Channel> m_rx;
+	Memory_Link_Params m_params;
+	std::mt19937 m_rng;
+};
+
+#endif
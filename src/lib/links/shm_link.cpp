@@ -0,0 +1,519 @@
+#include "shm_link.h"
+#include "../mail/router.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <unistd.h>
+#include <climits>
+#endif
+
+extern uint32_t arg_v;
+
+#ifdef __linux__
+
+///////////
+//utilities
+///////////
+
+const uint32_t SHM_LINK_MAGIC = 0x4c4d4853;
+const uint32_t SHM_RING_MASK = SHM_LINK_RING_SIZE - 1;
+static_assert((SHM_LINK_RING_SIZE & SHM_RING_MASK) == 0, "shm link ring size must be a power of 2");
+
+//one direction of a link. positions are free running byte counts, the reader owns
+//the head and the writer the tail, each on its own cache line with its waiting flag.
+//records are a uint32_t frame length then the frame, padded to 4 bytes. frames never
+//wrap, a zero length means skip to the start of the ring.
+struct Shm_Ring
+{
+	alignas(64) std::atomic<uint32_t> m_head;
+	std::atomic<uint32_t> m_reader_waiting;
+	alignas(64) std::atomic<uint32_t> m_tail;
+	std::atomic<uint32_t> m_writer_waiting;
+	alignas(64) uint8_t m_data[SHM_LINK_RING_SIZE];
+};
+
+//ring 0 is client to server, ring 1 is server to client
+struct Shm_Segment
+{
+	uint32_t m_magic;
+	uint32_t m_ring_size;
+	Shm_Ring m_rings[2];
+};
+
+//not the private futex ops, the words are shared with another process
+void futex_wait(std::atomic<uint32_t> &word, uint32_t val, uint32_t ms)
+{
+	timespec ts {ms / 1000, (long)(ms % 1000) * 1000000};
+	syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAIT, val, &ts, nullptr, 0);
+}
+
+void futex_wake(std::atomic<uint32_t> &word)
+{
+	syscall(SYS_futex, (uint32_t*)&word, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+uint32_t record_size(uint32_t len)
+{
+	return (sizeof(uint32_t) + len + 3) & ~3;
+}
+
+bool send_fd(int socket, int fd)
+{
+	char byte = 0;
+	iovec iov {&byte, 1};
+	char control[CMSG_SPACE(sizeof(int))] = {0};
+	msghdr msg {};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	auto cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+	return sendmsg(socket, &msg, MSG_NOSIGNAL) == 1;
+}
+
+int receive_fd(int socket)
+{
+	char byte;
+	iovec iov {&byte, 1};
+	char control[CMSG_SPACE(sizeof(int))] = {0};
+	msghdr msg {};
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof(control);
+	if (recvmsg(socket, &msg, MSG_CMSG_CLOEXEC) != 1) return -1;
+	auto cmsg = CMSG_FIRSTHDR(&msg);
+	if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) return -1;
+	int fd;
+	memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+	return fd;
+}
+
+sockaddr_un rendezvous_addr()
+{
+	sockaddr_un addr {};
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, SHM_LINK_PATH, sizeof(addr.sun_path) - 1);
+	return addr;
+}
+
+/////////////
+//Shm Manager
+/////////////
+
+void Shm_Link_Manager::run()
+{
+	if (m_mode == "server")
+	{
+		//we are going to be a server, take over any stale rendezvous
+		auto addr = rendezvous_addr();
+		unlink(addr.sun_path);
+		m_listen = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		if (m_listen < 0
+			|| bind(m_listen, (sockaddr*)&addr, sizeof(addr)) != 0
+			|| listen(m_listen, 16) != 0)
+		{
+			std::cerr << "shm_link: can't listen on " << SHM_LINK_PATH << std::endl;
+		}
+	}
+
+	while (m_running)
+	{
+		//server waits for peers, clients keep a link to the server up
+		if (m_mode == "server") accept();
+		else
+		{
+			if (m_links.empty()) connect();
+			std::this_thread::sleep_for(std::chrono::milliseconds(SHM_LINK_MANAGER_POLLING_RATE));
+		}
+
+		//purge any dead/closed links
+		m_links.erase(std::remove_if(begin(m_links), end(m_links), [&] (auto &link)
+		{
+			if (link->m_running) return false;
+			if (arg_v > 0) std::cout << "shm_link: purged" << std::endl;
+			link->stop_threads();
+			link->join_threads();
+			return true;
+		}), end(m_links));
+	}
+
+	//close any links
+	for (auto &link : m_links) link->stop_threads();
+	for (auto &link : m_links) link->join_threads();
+	m_links.clear();
+	if (m_listen >= 0)
+	{
+		close(m_listen);
+		unlink(SHM_LINK_PATH);
+	}
+}
+
+void Shm_Link_Manager::accept()
+{
+	//wait till the next polling time for a peer to turn up with its segment
+	pollfd pfd {m_listen, POLLIN, 0};
+	if (m_listen < 0 || poll(&pfd, 1, SHM_LINK_MANAGER_POLLING_RATE) <= 0)
+	{
+		if (m_listen < 0) std::this_thread::sleep_for(std::chrono::milliseconds(SHM_LINK_MANAGER_POLLING_RATE));
+		return;
+	}
+	auto sock = ::accept4(m_listen, nullptr, nullptr, SOCK_CLOEXEC);
+	if (sock < 0) return;
+	auto fd = receive_fd(sock);
+	auto segment = fd < 0 ? nullptr : Shm_Link::open_segment(fd);
+	if (fd >= 0) close(fd);
+	if (!segment)
+	{
+		if (arg_v > 0) std::cout << "accept: error, bad segment" << std::endl;
+		close(sock);
+		return;
+	}
+	if (arg_v > 0) std::cout << "accept: connected" << std::endl;
+	m_links.emplace_back(std::make_unique<Shm_Link>(segment, sock, true, m_router));
+	m_links.back()->start_threads();
+}
+
+void Shm_Link_Manager::connect()
+{
+	//dial the local server, create the segment and pass it over
+	auto addr = rendezvous_addr();
+	auto sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (sock < 0) return;
+	if (::connect(sock, (sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		close(sock);
+		return;
+	}
+	int fd;
+	auto segment = Shm_Link::create_segment(fd);
+	if (!segment || !send_fd(sock, fd))
+	{
+		if (arg_v > 0) std::cout << "connect: error, can't pass segment" << std::endl;
+		if (segment) munmap(segment, sizeof(Shm_Segment));
+		if (segment) close(fd);
+		close(sock);
+		return;
+	}
+	close(fd);
+	if (arg_v > 0) std::cout << "connect: connected" << std::endl;
+	m_links.emplace_back(std::make_unique<Shm_Link>(segment, sock, false, m_router));
+	m_links.back()->start_threads();
+}
+
+//////////
+//Shm link
+//////////
+
+Shm_Segment *Shm_Link::create_segment(int &fd)
+{
+	//fresh pages are zero filled, so the rings start empty
+	fd = memfd_create("chrysalib_shm_link", MFD_CLOEXEC);
+	if (fd < 0) return nullptr;
+	if (ftruncate(fd, sizeof(Shm_Segment)) != 0)
+	{
+		close(fd);
+		return nullptr;
+	}
+	auto addr = mmap(nullptr, sizeof(Shm_Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED)
+	{
+		close(fd);
+		return nullptr;
+	}
+	auto segment = (Shm_Segment*)addr;
+	segment->m_ring_size = SHM_LINK_RING_SIZE;
+	segment->m_magic = SHM_LINK_MAGIC;
+	return segment;
+}
+
+Shm_Segment *Shm_Link::open_segment(int fd)
+{
+	//check it's a segment we know how to use
+	struct stat info;
+	if (fstat(fd, &info) != 0 || (size_t)info.st_size != sizeof(Shm_Segment)) return nullptr;
+	auto addr = mmap(nullptr, sizeof(Shm_Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (addr == MAP_FAILED) return nullptr;
+	auto segment = (Shm_Segment*)addr;
+	if (segment->m_magic != SHM_LINK_MAGIC || segment->m_ring_size != SHM_LINK_RING_SIZE)
+	{
+		munmap(addr, sizeof(Shm_Segment));
+		return nullptr;
+	}
+	return segment;
+}
+
+Shm_Link::Shm_Link(Shm_Segment *segment, int socket, bool server, Router &router)
+	: Link(router)
+	, m_segment(segment)
+	, m_tx(&segment->m_rings[server ? 1 : 0])
+	, m_rx(&segment->m_rings[server ? 0 : 1])
+	, m_socket(socket)
+{}
+
+Shm_Link::~Shm_Link()
+{
+	munmap(m_segment, sizeof(Shm_Segment));
+	close(m_socket);
+}
+
+void Shm_Link::stop_threads()
+{
+	//wake our threads if they are asleep on the rings
+	Link::stop_threads();
+	futex_wake(m_rx->m_tail);
+	futex_wake(m_tx->m_head);
+}
+
+void Shm_Link::run_send()
+{
+	//link driver send loop, drains what is ready on our que into the ring
+	//and wakes the peer once for the lot
+	while (m_running)
+	{
+		m_router.get_next_msgs(m_remote_dev_id, std::chrono::milliseconds(LINK_PING_RATE), m_out_msgs, SHM_LINK_MAX_SEND_BYTES);
+		if (!m_running) break;
+		//send a ping to get the Dev_ID exchanged
+		if (m_out_msgs.empty()) m_out_msgs.emplace_back(std::make_shared<Msg>());
+		if (!send(m_out_msgs)) break;
+	}
+	//post any not sent messages back to the router
+	for (auto &msg : m_out_msgs)
+	{
+		if (msg->m_header.m_frag_length) m_router.send(msg);
+	}
+	m_out_msgs.clear();
+}
+
+void Shm_Link::run_receive()
+{
+	//link driver receive loop, till we stop or the peer goes
+	while (m_running)
+	{
+		//get any msg from the link and send if not a ping
+		if (auto in_msg = receive())
+		{
+			if (in_msg->m_header.m_frag_length) m_router.send(in_msg);
+		}
+	}
+	//let the sender see we are done, remove link entry from router
+	futex_wake(m_tx->m_head);
+	m_router.sub_link(this);
+}
+
+//write msg headers and bodies to the ring, the ones written are taken off the list.
+//false if the link went down first.
+bool Shm_Link::send(std::vector<std::shared_ptr<Msg>> &msgs)
+{
+	auto ok = true;
+	auto sent = 0u;
+	auto tail = m_tx->m_tail.load(std::memory_order_relaxed);
+	auto head = m_tx->m_head.load(std::memory_order_acquire);
+	for (auto &msg : msgs)
+	{
+		uint32_t len = offsetof(Link_Buf, m_msg_body) + msg->m_header.m_frag_length;
+		auto size = record_size(len);
+		auto skip = SHM_LINK_RING_SIZE - (tail & SHM_RING_MASK);
+		if (skip >= size) skip = 0;
+		while (ok && SHM_LINK_RING_SIZE - (tail - head) < skip + size)
+		{
+			//full, let the reader have what we have so far and wait for room
+			publish(tail);
+			ok = wait_space(head);
+		}
+		if (!ok) break;
+		if (skip)
+		{
+			memset(m_tx->m_data + (tail & SHM_RING_MASK), 0, sizeof(len));
+			tail += skip;
+		}
+		auto record = m_tx->m_data + (tail & SHM_RING_MASK);
+		auto buf = record + sizeof(len);
+		memcpy(record, &len, sizeof(len));
+		memset(buf + offsetof(Link_Buf, m_hash), 0, sizeof(uint32_t));
+		memcpy(buf + offsetof(Link_Buf, m_dev_id), &m_router.get_dev_id(), sizeof(Dev_ID));
+		memcpy(buf + offsetof(Link_Buf, m_msg_header), &msg->m_header, sizeof(Msg_Header));
+		msg->gather((char*)buf + offsetof(Link_Buf, m_msg_body));
+		tail += size;
+		sent++;
+	}
+	publish(tail);
+	msgs.erase(begin(msgs), begin(msgs) + sent);
+	return ok;
+}
+
+bool Shm_Link::send(const std::shared_ptr<Msg> &msg)
+{
+	std::vector<std::shared_ptr<Msg>> msgs {msg};
+	return send(msgs);
+}
+
+void Shm_Link::publish(uint32_t tail)
+{
+	//make the records visible, wake the reader if it's asleep
+	m_tx->m_tail.store(tail);
+	if (m_tx->m_reader_waiting.load()) futex_wake(m_tx->m_tail);
+}
+
+bool Shm_Link::wait_space(uint32_t &head)
+{
+	//sleep till the reader moves its head on, or the ping rate so we can see if we stopped
+	auto old = head;
+	m_tx->m_writer_waiting.store(1);
+	head = m_tx->m_head.load();
+	if (head == old) futex_wait(m_tx->m_head, old, LINK_PING_RATE);
+	m_tx->m_writer_waiting.store(0, std::memory_order_relaxed);
+	head = m_tx->m_head.load(std::memory_order_acquire);
+	return m_running;
+}
+
+void Shm_Link::release()
+{
+	//give the space we have read back to the writer, wake it if it's waiting for it
+	m_rx->m_head.store(m_rx_head);
+	m_rx_released = m_rx_head;
+	if (m_rx->m_writer_waiting.load()) futex_wake(m_rx->m_head);
+}
+
+bool Shm_Link::wait_data()
+{
+	//caught up, hand back the space and sleep till there's more.
+	//if nothing turns up by the ping rate check the peer is still there.
+	release();
+	for (;;)
+	{
+		m_rx->m_reader_waiting.store(1);
+		m_rx_tail = m_rx->m_tail.load();
+		if (m_rx_tail == m_rx_head) futex_wait(m_rx->m_tail, m_rx_head, LINK_PING_RATE);
+		m_rx->m_reader_waiting.store(0, std::memory_order_relaxed);
+		m_rx_tail = m_rx->m_tail.load(std::memory_order_acquire);
+		if (m_rx_tail != m_rx_head) return true;
+		if (!m_running) return false;
+		if (peer_gone())
+		{
+			if (arg_v > 0) std::cout << "shm_link: peer gone" << std::endl;
+			m_running = false;
+			return false;
+		}
+	}
+}
+
+bool Shm_Link::peer_gone()
+{
+	//the peer never writes to the socket, so readable or hung up means it closed
+	pollfd pfd {m_socket, POLLIN, 0};
+	return poll(&pfd, 1, 0) != 0;
+}
+
+std::shared_ptr<Msg> Shm_Link::receive()
+{
+	for (;;)
+	{
+		//wait for a record
+		if (m_rx_head == m_rx_tail && !wait_data()) return nullptr;
+		uint32_t len;
+		auto record = m_rx->m_data + (m_rx_head & SHM_RING_MASK);
+		memcpy(&len, record, sizeof(len));
+		if (!len)
+		{
+			//skip to the start of the ring
+			m_rx_head += SHM_LINK_RING_SIZE - (m_rx_head & SHM_RING_MASK);
+			continue;
+		}
+		Dev_ID dev_id;
+		Msg_Header header;
+		auto buf = record + sizeof(len);
+		auto ok = len >= offsetof(Link_Buf, m_msg_body) && len <= sizeof(Link_Buf)
+			&& (m_rx_head & SHM_RING_MASK) + record_size(len) <= SHM_LINK_RING_SIZE;
+		if (ok)
+		{
+			memcpy(&dev_id, buf + offsetof(Link_Buf, m_dev_id), sizeof(Dev_ID));
+			memcpy((uint8_t*)&header, buf + offsetof(Link_Buf, m_msg_header), sizeof(Msg_Header));
+			ok = header.m_frag_length == len - offsetof(Link_Buf, m_msg_body);
+		}
+		if (!ok)
+		{
+			//the peer is broken, not much else we can do
+			std::cerr << "shm_link: bad length !" << std::endl;
+			m_running = false;
+			return nullptr;
+		}
+
+		//copy the body out to a pool chunk, msg bodies are slices of it.
+		//move to a fresh chunk when this one is full, or reuse it if no msgs still are.
+		auto frag_length = header.m_frag_length;
+		if (!m_receive_chunk || m_receive_end + frag_length > m_receive_chunk->size())
+		{
+			if (!m_receive_chunk || m_receive_chunk.use_count() > 1) m_receive_chunk = Msg_Buf::create(IP_LINK_RECEIVE_CHUNK_SIZE);
+			m_receive_end = 0;
+		}
+		memcpy(m_receive_chunk->begin() + m_receive_end, buf + offsetof(Link_Buf, m_msg_body), frag_length);
+		auto msg = std::make_shared<Msg>(header, m_receive_chunk, m_receive_end);
+		m_receive_end += (frag_length + 7) & ~7;
+
+		//consume the record, only hand the space back every so often
+		m_rx_head += record_size(len);
+		if (m_rx_head - m_rx_released >= SHM_LINK_RING_SIZE / 4) release();
+
+		//refresh who we are connected to in a unplug/plug scenario.
+		//if the peer device id changes we need to swap the link on the router !
+		if (dev_id != m_remote_dev_id)
+		{
+			m_remote_dev_id = dev_id;
+			m_router.sub_link(this);
+			m_router.add_link(this, m_remote_dev_id);
+		}
+		return msg;
+	}
+}
+
+#else
+
+////////////////////////////////////
+//no shared memory link on this host
+////////////////////////////////////
+
+void Shm_Link_Manager::run()
+{
+	if (arg_v > 0) std::cout << "shm_link: not supported on this platform" << std::endl;
+}
+
+void Shm_Link_Manager::accept() {}
+void Shm_Link_Manager::connect() {}
+Shm_Segment *Shm_Link::create_segment(int &fd) { return nullptr; }
+Shm_Segment *Shm_Link::open_segment(int fd) { return nullptr; }
+
+Shm_Link::Shm_Link(Shm_Segment *segment, int socket, bool server, Router &router)
+	: Link(router)
+	, m_segment(segment)
+	, m_tx(nullptr)
+	, m_rx(nullptr)
+	, m_socket(socket)
+{}
+
+Shm_Link::~Shm_Link() {}
+void Shm_Link::stop_threads() { Link::stop_threads(); }
+void Shm_Link::run_send() {}
+void Shm_Link::run_receive() {}
+bool Shm_Link::send(std::vector<std::shared_ptr<Msg>> &msgs) { return false; }
+bool Shm_Link::send(const std::shared_ptr<Msg> &msg) { return false; }
+std::shared_ptr<Msg> Shm_Link::receive() { return nullptr; }
+void Shm_Link::publish(uint32_t tail) {}
+bool Shm_Link::wait_space(uint32_t &head) { return false; }
+bool Shm_Link::wait_data() { return false; }
+void Shm_Link::release() {}
+bool Shm_Link::peer_gone() { return true; }
+
+#endif
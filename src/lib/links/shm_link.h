@@ -0,0 +1,76 @@
+#ifndef SHM_LINK_H
+#define SHM_LINK_H
+
+#include "link.h"
+#include <vector>
+
+struct Shm_Ring;
+struct Shm_Segment;
+
+//shared memory link.
+//for peers on the same host, the hub and the app nodes on a machine. each direction is
+//a single producer single consumer ring of length prefixed Link_Buf frames in a shared
+//memory segment. no hash or obfuscation, it's our own memory not a wire.
+//readers and writers only sleep, on a futex, when the ring is empty or full, and the
+//other side only makes the wake call if they are asleep.
+//the unix socket the segment was passed over stays open, when it closes the peer has gone.
+//linux only, elsewhere the manager does nothing.
+class Shm_Link : public Link
+{
+public:
+	Shm_Link(Shm_Segment *segment, int socket, bool server, Router &router = *global_router);
+	~Shm_Link();
+	void stop_threads() override;
+	void run_send() override;
+	void run_receive() override;
+	//create a segment, fd is the handle to pass to the peer. map a segment from a handle.
+	static Shm_Segment *create_segment(int &fd);
+	static Shm_Segment *open_segment(int fd);
+protected:
+	virtual bool send(const std::shared_ptr<Msg> &msg) override;
+	virtual std::shared_ptr<Msg> receive() override;
+	bool send(std::vector<std::shared_ptr<Msg>> &msgs);
+	bool wait_space(uint32_t &head);
+	bool wait_data();
+	void publish(uint32_t tail);
+	void release();
+	bool peer_gone();
+	Shm_Segment *m_segment;
+	Shm_Ring *m_tx;
+	Shm_Ring *m_rx;
+	int m_socket;
+	std::vector<std::shared_ptr<Msg>> m_out_msgs;
+	uint32_t m_rx_head = 0;
+	uint32_t m_rx_tail = 0;
+	uint32_t m_rx_released = 0;
+	std::shared_ptr<Msg_Buf> m_receive_chunk;
+	uint32_t m_receive_end = 0;
+};
+
+//shm link manager.
+//a "server" listens on the rendezvous socket, anything else keeps a link to it up.
+//the client creates the segment and passes it over the socket.
+class Shm_Link_Manager : public Link_Manager
+{
+public:
+	Shm_Link_Manager(const std::string &mode, Router &router = *global_router)
+		: Link_Manager(router)
+		, m_mode(mode)
+	{}
+	void start_thread() override
+	{
+		m_running = true;
+		m_thread = std::thread(&Shm_Link_Manager::run, this);
+	}
+	void join_thread() override { if (m_thread.joinable()) m_thread.join(); }
+private:
+	void run() override;
+	void accept();
+	void connect();
+	std::thread m_thread;
+	std::vector<std::unique_ptr<Shm_Link>> m_links;
+	std::string m_mode;
+	int m_listen = -1;
+};
+
+#endif
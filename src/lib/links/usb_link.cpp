@@ -5,16 +5,12 @@
 #include <algorithm>
 #include <cstring>
 
-extern std::unique_ptr<Router> global_router;
 extern uint32_t arg_v;
 
 ///////////
 //utilities
 ///////////
 
-uint32_t jenkins_hash(const uint8_t *key, size_t len);
-void obfuscate(uint8_t *key, size_t len);
-
 std::string get_usb_dev_inst_path(libusb_device *device)
 {
 	std::string path;
@@ -93,7 +89,7 @@ void USB_Link_Manager::run()
 			else
 			{
 				//not found the device, so start up a new link
-				m_links.emplace_back(std::make_unique<USB_Link>(device));
+				m_links.emplace_back(std::make_unique<USB_Link>(device, m_router));
 				m_links.back()->start_threads();
 			}
 		}
@@ -167,16 +163,15 @@ void USB_Link::close()
 bool USB_Link::send(const std::shared_ptr<Msg> &msg)
 {
 	//pack msg into send buffer, calculate the hash and obfuscate
-	memcpy(&m_send_buf.m_dev_id, &global_router->get_dev_id(), sizeof(Dev_ID));
+	int32_t len = offsetof(Link_Buf, m_msg_body) + msg->m_header.m_frag_length;
+	memcpy(&m_send_buf.m_dev_id, &m_router.get_dev_id(), sizeof(Dev_ID));
 	memcpy((uint8_t*)&m_send_buf.m_msg_header, &msg->m_header, sizeof(Msg_Header));
-	memcpy(m_send_buf.m_msg_body, msg->begin() + msg->m_header.m_data_offset, msg->m_header.m_frag_length);
-	m_send_buf.m_hash = jenkins_hash((uint8_t*)&m_send_buf.m_dev_id, offsetof(Link_Buf, m_msg_body) - offsetof(Link_Buf, m_dev_id) + msg->m_header.m_frag_length);
-	obfuscate((uint8_t*)&m_send_buf, offsetof(Link_Buf, m_msg_body) + msg->m_header.m_frag_length);
+	msg->gather((char*)m_send_buf.m_msg_body);
+	encode_frame((uint8_t*)&m_send_buf, len);
 
 	//send the buffer down the link
 	auto error = 0;
 	auto sent = 0;
-	int32_t len = offsetof(Link_Buf, m_msg_body) + msg->m_header.m_frag_length;
 	do
 	{
 		//send down link, retry till no error or exiting
@@ -188,37 +183,39 @@ bool USB_Link::send(const std::shared_ptr<Msg> &msg)
 
 std::shared_ptr<Msg> USB_Link::receive()
 {
-	//receive the buffer from the link
+	//receive the buffer from the link, straight into a msg buffer
 	auto error = 0;
 	auto len = 0;
+	auto buf = Msg_Buf::create(sizeof(Link_Buf));
+	auto receive_buf = (Link_Buf*)buf->begin();
 	do
 	{
 		error = libusb_bulk_transfer(m_libusb_device_handle, LIBUSB_ENDPOINT_IN | m_device_instance.m_info.m_bulk_in_addr,
-			(uint8_t*)&m_receive_buf, sizeof(m_receive_buf), &len, USB_BULK_TRANSFER_TIMEOUT);
+			(uint8_t*)receive_buf, sizeof(Link_Buf), &len, USB_BULK_TRANSFER_TIMEOUT);
 	} while (m_running && error != LIBUSB_SUCCESS && error != LIBUSB_ERROR_NO_DEVICE);
 	if (error != LIBUSB_SUCCESS) return nullptr;
+	if (len < (int)offsetof(Link_Buf, m_msg_body)) return nullptr;
 
-	//un-obfuscate and calculate the hash
-	obfuscate((uint8_t*)&m_receive_buf, len);
-	auto hash = jenkins_hash((uint8_t*)&m_receive_buf.m_dev_id, len - offsetof(Link_Buf, m_dev_id));
-	if (hash != m_receive_buf.m_hash)
+	//un-obfuscate and check the hash
+	if (!decode_frame((uint8_t*)receive_buf, len)
+		|| receive_buf->m_msg_header.m_frag_length != len - offsetof(Link_Buf, m_msg_body))
 	{
 		//error with crc hash !!!
 		std::cerr << "usb_link: crc error !" << std::endl;
 		return nullptr;
 	}
 
-	//unpack msg from receive buffer
-	auto msg = std::make_shared<Msg>(m_receive_buf.m_msg_header, m_receive_buf.m_msg_body);
+	//msg body is the slice of the receive buffer after the header
+	auto msg = std::make_shared<Msg>(receive_buf->m_msg_header, buf, (uint32_t)offsetof(Link_Buf, m_msg_body));
 
 	//refresh who we are connected to in a unplug/plug scenario.
 	//if the peer device id changes we need to swap the link on the router !
 	//the software equivelent of pulling the lead out and plugging another one in.
-	if (m_receive_buf.m_dev_id != m_remote_dev_id)
+	if (receive_buf->m_dev_id != m_remote_dev_id)
 	{
-		m_remote_dev_id = m_receive_buf.m_dev_id;
-		global_router->sub_link(this);
-		global_router->add_link(this, m_remote_dev_id);
+		m_remote_dev_id = receive_buf->m_dev_id;
+		m_router.sub_link(this);
+		m_router.add_link(this, m_remote_dev_id);
 	}
 	return msg;
 }
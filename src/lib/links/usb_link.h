@@ -32,8 +32,8 @@ struct USBDeviceInstance
 class USB_Link : public Link
 {
 public:
-	USB_Link(const USBDeviceInstance &device)
-		: Link()
+	USB_Link(const USBDeviceInstance &device, Router &router = *global_router)
+		: Link(router)
 		, m_device_instance(device)
 	{
 		m_device_instance.m_flag = true;
@@ -48,13 +48,14 @@ protected:
 private:
 	USBDeviceInstance m_device_instance;
 	libusb_device_handle *m_libusb_device_handle;
+	Link_Buf m_send_buf;
 };
 
 class USB_Link_Manager : public Link_Manager
 {
 public:
-	USB_Link_Manager()
-		: Link_Manager()
+	USB_Link_Manager(Router &router = *global_router)
+		: Link_Manager(router)
 	{}
 	void start_thread() override
 	{
@@ -2,6 +2,9 @@
 #define MAILBOX_H
 
 #include <list>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <string>
 #include <vector>
 #include <map>
@@ -14,6 +17,7 @@
 //when a mailbox id is freed its ID will not be reused for a long time.
 //this is to ensure that when a mailbox is destroyed any mail directed to that mailbox
 //(which may still be in flight in the network) will be cleanly discarded.
+//the router packs a table slot index and a slot generation into the id.
 struct Mailbox_ID
 {
 	Mailbox_ID() {}
@@ -43,10 +47,12 @@ struct Mailbox_ID
 };
 
 //thread sync.
+//wake() is virtual so a coroutine can be scheduled rather than a thread woken.
 class Sync
 {
 public:
 	Sync() {}
+	virtual ~Sync() {}
 	void wait()
 	{
 		//suspend caller until notified
@@ -54,7 +60,7 @@ public:
 		while (m_state) m_cv.wait(l);
 		m_state = true;
 	}
-	void wake()
+	virtual void wake()
 	{
 		//wake any suspended caller
 		std::lock_guard<std::mutex> l(m_mutex);
@@ -67,10 +73,81 @@ private:
 	bool m_state = true;
 };
 
+//lock free multi producer, single consumer que.
+//a fixed ring of cells, each with a sequence number, so producers claim a cell
+//with a single CAS and publish it with a release store, no allocation per post.
+//push() fails if the ring is full, the owner must then fall back on something else.
+template<class T, size_t N = 64>
+class Mpsc_Que
+{
+	static_assert((N & (N - 1)) == 0, "Mpsc_Que size must be a power of 2 !");
+public:
+	Mpsc_Que()
+	{
+		for (auto i = 0u; i < N; ++i) m_cells[i].m_seq.store(i, std::memory_order_relaxed);
+	}
+	bool push(T &data)
+	{
+		//any thread, false if que full
+		auto pos = m_head.load(std::memory_order_relaxed);
+		Cell *cell;
+		for (;;)
+		{
+			cell = &m_cells[pos & (N - 1)];
+			auto seq = cell->m_seq.load(std::memory_order_acquire);
+			auto diff = (intptr_t)seq - (intptr_t)pos;
+			if (diff == 0)
+			{
+				if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+			}
+			else if (diff < 0) return false;
+			else pos = m_head.load(std::memory_order_relaxed);
+		}
+		cell->m_data = std::move(data);
+		cell->m_seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+	bool pop(T &data)
+	{
+		//consumer thread only, false if next cell not yet published
+		auto pos = m_tail.load(std::memory_order_relaxed);
+		auto &cell = m_cells[pos & (N - 1)];
+		if (cell.m_seq.load(std::memory_order_acquire) != pos + 1) return false;
+		data = std::move(cell.m_data);
+		cell.m_seq.store(pos + N, std::memory_order_release);
+		m_tail.store(pos + 1, std::memory_order_relaxed);
+		return true;
+	}
+	bool ready() const
+	{
+		//next cell is published
+		auto pos = m_tail.load(std::memory_order_relaxed);
+		return m_cells[pos & (N - 1)].m_seq.load(std::memory_order_acquire) == pos + 1;
+	}
+	bool idle() const
+	{
+		//no cells published or claimed
+		return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_relaxed);
+	}
+private:
+	struct Cell
+	{
+		std::atomic<size_t> m_seq;
+		T m_data;
+	};
+	std::array<Cell, N> m_cells;
+	alignas(64) std::atomic<size_t> m_head {0};
+	alignas(64) std::atomic<size_t> m_tail {0};
+};
+
 //mailbox for thread data exchange.
 //abilty for a thread to post an object into a receiver thread que.
 //the sending thread does not block and the receiver can read or filter the que
 //as it wishes.
+//posts go into a lock free ring, only if the ring is full does a sender take the
+//lock and spill into the overflow list. once anything has spilled all senders go
+//to the overflow list till the reader drains it, so each sender's mail stays in order.
+//the lock is otherwise only taken to wake a reader that is suspended or selecting.
 template<class T>
 class Mbox
 {
@@ -79,16 +156,15 @@ public:
 	T poll()
 	{
 		//nullptr if que empty
-		std::lock_guard<std::mutex> l(m_mutex);
-		if (m_mail.empty()) return nullptr;
-		auto msg = std::move(m_mail.front());
-		m_mail.pop_front();
-		return msg;
+		T msg;
+		if (pop(msg)) return msg;
+		return nullptr;
 	}
 	void filter(std::vector<T> &out, std::function<bool(T&)> filter)
 	{
 		//read all that pass filter test
-		std::lock_guard<std::mutex> l(m_mutex);
+		T msg;
+		while (pop_shared(msg)) m_mail.emplace_back(std::move(msg));
 		for (auto itr = begin(m_mail); itr != end(m_mail);)
 		{
 			if (filter(*itr))
@@ -102,42 +178,108 @@ public:
 	T read()
 	{
 		//suspend caller if que empty
-		std::unique_lock<std::mutex> l(m_mutex);
-		while (m_mail.empty()) m_cv.wait(l);
-		auto msg = std::move(m_mail.front());
-		m_mail.pop_front();
+		T msg;
+		while (!pop(msg))
+		{
+			std::unique_lock<std::mutex> l(m_mutex);
+			m_waiting.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			while (empty_no_lock()) m_cv.wait(l);
+			m_waiting.store(false, std::memory_order_relaxed);
+		}
 		return msg;
 	}
 	T read(std::chrono::milliseconds timeout)
 	{
 		//suspend caller if que empty, nullptr if timer expires
-		std::unique_lock<std::mutex> l(m_mutex);
-		if (m_mail.empty())
+		T msg;
+		if (pop(msg)) return msg;
 		{
-			m_cv.wait_for(l, timeout, [&]{ return !m_mail.empty(); });
-			if (m_mail.empty()) return nullptr;
+			std::unique_lock<std::mutex> l(m_mutex);
+			m_waiting.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			m_cv.wait_for(l, timeout, [&]{ return !empty_no_lock(); });
+			m_waiting.store(false, std::memory_order_relaxed);
 		}
-		auto msg = std::move(m_mail.front());
-		m_mail.pop_front();
-		return msg;
+		if (pop(msg)) return msg;
+		return nullptr;
 	}
 	void post(T &msg)
 	{
 		//wake any suspended caller
-		std::lock_guard<std::mutex> l(m_mutex);
-		m_mail.emplace_back(std::move(msg));
-		if (m_select) m_select->wake();
-		m_cv.notify_one();
+		if (m_spilled.load(std::memory_order_acquire) || !m_que.push(msg))
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			m_overflow.emplace_back(std::move(msg));
+			m_spilled.fetch_add(1, std::memory_order_release);
+			wake_no_lock();
+			return;
+		}
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_waiting.load(std::memory_order_relaxed)
+			|| m_select.load(std::memory_order_relaxed))
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			wake_no_lock();
+		}
 	}
-	auto empty() const { return m_mail.empty(); }
+	void clear()
+	{
+		//discard all mail
+		T msg;
+		while (pop(msg));
+	}
+	auto empty() const { return empty_no_lock(); }
 	void lock() { m_mutex.lock(); }
 	void unlock() { m_mutex.unlock(); }
-	void set_select(Sync *select) { m_select = select; }
+	void set_select(Sync *select)
+	{
+		//call with the lock held
+		m_select.store(select, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+	}
 private:
+	bool empty_no_lock() const
+	{
+		//overflow mail only counts once the ring has nothing claimed in it
+		return m_mail.empty() && !m_que.ready()
+			&& !(m_spilled.load(std::memory_order_acquire) && m_que.idle());
+	}
+	bool pop(T &msg)
+	{
+		//consumer thread only, our own leftovers from filter() come first
+		if (!m_mail.empty())
+		{
+			msg = std::move(m_mail.front());
+			m_mail.pop_front();
+			return true;
+		}
+		return pop_shared(msg);
+	}
+	bool pop_shared(T &msg)
+	{
+		if (m_que.pop(msg)) return true;
+		if (!m_spilled.load(std::memory_order_acquire) || !m_que.idle()) return false;
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (m_overflow.empty()) return false;
+		msg = std::move(m_overflow.front());
+		m_overflow.pop_front();
+		m_spilled.fetch_sub(1, std::memory_order_release);
+		return true;
+	}
+	void wake_no_lock()
+	{
+		if (auto select = m_select.load(std::memory_order_relaxed)) select->wake();
+		if (m_waiting.load(std::memory_order_relaxed)) m_cv.notify_one();
+	}
 	mutable std::mutex m_mutex;
 	std::condition_variable m_cv;
+	Mpsc_Que<T> m_que;
 	std::list<T> m_mail;
-	Sync *m_select = nullptr;
+	std::list<T> m_overflow;
+	std::atomic<uint32_t> m_spilled {0};
+	std::atomic<bool> m_waiting {false};
+	std::atomic<Sync*> m_select {nullptr};
 };
 
 #endif
@@ -0,0 +1,110 @@
+#include "msg.h"
+#include <algorithm>
+
+//////
+// msg
+//////
+
+bool Msg::operator==(const Msg &p) const
+{
+	//walk both segment chains
+	if (m_size != p.m_size) return false;
+	auto itr = p.seg_begin();
+	auto pos = 0u;
+	for (auto seg = seg_begin(); seg != seg_end(); ++seg)
+	{
+		for (auto done = 0u; done < seg->m_length;)
+		{
+			auto len = std::min(seg->m_length - done, itr->m_length - pos);
+			if (memcmp(seg->begin() + done, itr->begin() + pos, len)) return false;
+			done += len;
+			pos += len;
+			if (pos == itr->m_length) { ++itr; pos = 0; }
+		}
+	}
+	return true;
+}
+
+void Msg::add_seg(Msg_Seg &&seg)
+{
+	//first segment lives inline, after that they all go in the vector
+	if (!seg.m_length) return;
+	if (!m_size) m_seg = std::move(seg);
+	else
+	{
+		if (m_segs.empty()) m_segs.emplace_back(std::move(m_seg));
+		m_segs.emplace_back(std::move(seg));
+	}
+	m_size += m_segs.empty() ? m_seg.m_length : m_segs.back().m_length;
+}
+
+char *Msg::flatten()
+{
+	//nothing to do if empty or already flat
+	if (!m_size) return nullptr;
+	if (m_segs.empty()) return m_seg.begin();
+	auto buf = Msg_Buf::create(m_size);
+	gather(buf->begin());
+	m_segs.clear();
+	m_seg = Msg_Seg{buf, 0, m_size};
+	return buf->begin();
+}
+
+void Msg::gather(char *dst) const
+{
+	for (auto seg = seg_begin(); seg != seg_end(); ++seg)
+	{
+		memcpy(dst, seg->begin(), seg->m_length);
+		dst += seg->m_length;
+	}
+}
+
+void Msg::slice(Msg &msg, uint32_t offset, uint32_t length) const
+{
+	for (auto seg = seg_begin(); length && seg != seg_end(); ++seg)
+	{
+		if (offset >= seg->m_length)
+		{
+			offset -= seg->m_length;
+			continue;
+		}
+		auto len = std::min(length, seg->m_length - offset);
+		msg.add_seg(Msg_Seg{seg->m_buf, seg->m_offset + offset, len});
+		length -= len;
+		offset = 0;
+	}
+}
+
+Msg *Msg::append(const char *data, uint32_t len)
+{
+	//grow the last buffer in place if nobody else can see it
+	if (!len) return this;
+	auto &seg = m_segs.empty() ? m_seg : m_segs.back();
+	if (m_size && seg.m_buf.use_count() == 1 && seg.m_offset + seg.m_length == seg.m_buf->size())
+	{
+		seg.m_buf->append(data, len);
+		seg.m_length += len;
+		m_size += len;
+	}
+	else add_seg(Msg_Seg{Msg_Buf::create(data, len), 0, len});
+	m_header.m_frag_length = m_header.m_total_length = m_size;
+	return this;
+}
+
+Msg *Msg::append(const Msg &msg)
+{
+	for (auto seg = msg.seg_begin(); seg != msg.seg_end(); ++seg) add_seg(Msg_Seg(*seg));
+	m_header.m_frag_length = m_header.m_total_length = m_size;
+	return this;
+}
+
+Msg *Msg::append(Msg &&msg)
+{
+	//steal the segments, saves the ref count traffic
+	if (msg.m_segs.empty()) add_seg(std::move(msg.m_seg));
+	else for (auto &seg : msg.m_segs) add_seg(std::move(seg));
+	msg.m_segs.clear();
+	msg.m_size = 0;
+	m_header.m_frag_length = m_header.m_total_length = m_size;
+	return this;
+}
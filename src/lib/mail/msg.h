@@ -2,6 +2,8 @@
 #define MSG_H
 
 #include "net.h"
+#include "msg_buf.h"
+#include <vector>
 
 //message header, used for all messages, including fragments of parcels.
 //parcels are messages that are bigger than the max msg packet size.
@@ -21,12 +23,22 @@ struct Msg_Header
 		, m_frag_offset(header.m_frag_offset)
 		, m_total_length(header.m_total_length)
 	{}
+	//as the copy, wire flags belong to the link frame they came in, so are not copied
+	Msg_Header &operator=(const Msg_Header &header)
+	{
+		m_dest = header.m_dest;
+		m_src = header.m_src;
+		m_frag_length = header.m_frag_length;
+		m_frag_offset = header.m_frag_offset;
+		m_wire_flags = 0;
+		m_total_length = header.m_total_length;
+		return *this;
+	}
 	Msg_Header(const Net_ID &dst, const Net_ID &src, uint32_t total_len, uint32_t frag_len, uint32_t frag_offset)
 		: m_dest(dst)
 		, m_src(src)
 		, m_frag_length(frag_len)
 		, m_frag_offset(frag_offset)
-		, m_data_offset(frag_offset)
 		, m_total_length(total_len)
 	{}
 	//the destination id info.
@@ -39,61 +51,89 @@ struct Msg_Header
 	//info describing this packet
 	uint32_t m_frag_length = 0;
 	uint32_t m_frag_offset = 0;
-	uint32_t m_data_offset = 0;
+	//link wire format flags, only meaningful inside a link frame.
+	//this was the data offset, old nodes still put the fragment offset here.
+	uint32_t m_wire_flags = 0;
 	uint32_t m_total_length = 0;
 };
 
+//body segment, a slice of a shared message buffer
+struct Msg_Seg
+{
+	char *begin() const { return m_buf->begin() + m_offset; }
+	char *end() const { return begin() + m_length; }
+	std::shared_ptr<Msg_Buf> m_buf;
+	uint32_t m_offset = 0;
+	uint32_t m_length = 0;
+};
+
+using Msg_Segs = std::vector<Msg_Seg, Msg_Pool_Allocator<Msg_Seg>>;
+
 //message is just a header and body data.
-//the body is a shared pointer so that fragments can be created, and broadcasting can be done,
-//without having to copy the body data.
+//the body is a chain of segments that reference shared buffers, so that fragments
+//can be created, broadcasting can be done, received packets can be delivered and
+//parcels reassembled, all without having to copy the body data.
+//links write the segments out as they are, begin() flattens the body into one
+//contiguous buffer for code that wants to cast a struct over it.
+//the body buffer comes from the Msg_Pool and is NOT zero filled, so a body struct with
+//non trivial members must be constructed in place before use.
 //useful append methods are provided to ease populating a msg body.
 class Msg
 {
 public:
-	Msg() : m_data(std::make_shared<std::string>())
-	{}
-	Msg(std::shared_ptr<std::string> data)
+	Msg() {}
+	Msg(std::shared_ptr<Msg_Buf> data)
 		: m_header((uint32_t)data->size())
-		, m_data(data)
-	{}
-	Msg(std::shared_ptr<std::string> data, const Net_ID &dst, const Net_ID &src, uint32_t frag_len, uint32_t frag_offset)
-		: m_header(dst, src, (uint32_t)data->size(), frag_len, frag_offset)
-		, m_data(data)
-	{}
-	//the fill constructors used here wastes time, need to work out how to
-	//tell C++ to allocate the buffer but not bother to zero it !
+	{
+		add_seg(Msg_Seg{data, 0, (uint32_t)data->size()});
+	}
+	Msg(const Msg &msg, const Net_ID &dst, const Net_ID &src, uint32_t frag_len, uint32_t frag_offset)
+		: m_header(dst, src, msg.m_header.m_total_length, frag_len, frag_offset)
+	{
+		msg.slice(*this, frag_offset, frag_len);
+	}
 	Msg(size_t length)
 		: m_header((uint32_t)length)
-		, m_data(std::make_shared<std::string>(length, '\0'))
-	{}
-	Msg(const Msg_Header &header, const uint8_t *buf)
+	{
+		if (length) add_seg(Msg_Seg{Msg_Buf::create(length), 0, (uint32_t)length});
+	}
+	Msg(const Msg_Header &header, std::shared_ptr<Msg_Buf> buf, uint32_t offset)
 		: m_header(header)
-		, m_data(std::make_shared<std::string>((const char*)buf, header.m_frag_length))
-	{}
+	{
+		add_seg(Msg_Seg{buf, offset, header.m_frag_length});
+	}
 	//can be compared ! Very important when using mbox->filter() method to roll up etc
-	bool operator==(const Msg &p) const { return *m_data == *p.m_data; }
-	//return the begining and end of the body data
-	auto begin() { return m_data->size() ? &(*m_data->begin()) : nullptr; }
-	auto end() { return begin() + m_data->size(); }
+	bool operator==(const Msg &p) const;
+	//return the begining and end of the body data, flattened if need be
+	auto begin() { return flatten(); }
+	auto end() { return begin() + m_size; }
+	//body size
+	uint32_t size() const { return m_size; }
+	//body segments, a single segment is held inline
+	const Msg_Seg *seg_begin() const { return m_segs.empty() ? &m_seg : m_segs.data(); }
+	const Msg_Seg *seg_end() const { return m_segs.empty() ? &m_seg + (m_size ? 1 : 0) : m_segs.data() + m_segs.size(); }
+	//join the body segments into a single buffer, returns the start of the data
+	char *flatten();
+	//copy the body segments out to a buffer
+	void gather(char *dst) const;
+	//add the segments covering a range of this body to another msg
+	void slice(Msg &msg, uint32_t offset, uint32_t length) const;
 	//set destination Net_ID, the delivery address
 	auto set_dest(const Net_ID &id) { m_header.m_dest = id; return this; }
 	//append some string to the body data
-	auto append(const std::string &data)
-	{
-		m_data->append(data);
-		m_header.m_frag_length = m_header.m_total_length = (uint32_t)m_data->size();
-		return this;
-	}
+	auto append(const std::string &data) { return append(data.data(), (uint32_t)data.size()); }
 	//append some raw bytes to the body data
-	auto append(const char *data, uint32_t len)
-	{
-		m_data->append(data, len);
-		m_header.m_frag_length = m_header.m_total_length = (uint32_t)m_data->size();
-		return this;
-	}
+	Msg *append(const char *data, uint32_t len);
+	//append the body segments of another msg
+	Msg *append(const Msg &msg);
+	Msg *append(Msg &&msg);
 	//msg info
 	Msg_Header m_header;
-	std::shared_ptr<std::string> m_data;
+private:
+	void add_seg(Msg_Seg &&seg);
+	Msg_Seg m_seg;
+	Msg_Segs m_segs;
+	uint32_t m_size = 0;
 };
 
 #endif
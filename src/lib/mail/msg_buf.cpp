@@ -0,0 +1,153 @@
+#include "msg_buf.h"
+#include "../settings.h"
+#include <vector>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+
+///////////////
+// buffer pool
+///////////////
+
+//size classes are 64 bytes up to 1MB, bigger buffers go straight to the heap
+const size_t MIN_BUF_SIZE = 64;
+const uint32_t NUM_BUF_CLASSES = 15;
+//thread cache limits and the batch size swapped with the depot
+const size_t CACHE_LIMIT = 64;
+const size_t CACHE_BATCH = 32;
+//depot limits for the cached and the large classes
+const size_t DEPOT_LIMIT = 4096;
+const size_t DEPOT_LARGE_LIMIT = 8;
+
+static std::atomic<uint64_t> sys_allocs {0};
+//set once this threads cache has been destroyed
+static thread_local bool cache_gone = false;
+
+static uint32_t size_class(size_t size)
+{
+	auto c = 0u;
+	for (auto s = MIN_BUF_SIZE; s < size && c < NUM_BUF_CLASSES; s <<= 1) ++c;
+	return c;
+}
+
+static bool is_cached(uint32_t c)
+{
+	//room for a whole link packet, header and all
+	return (MIN_BUF_SIZE << c) <= MAX_PACKET_SIZE * 2 && !cache_gone;
+}
+
+static char *sys_alloc(size_t size)
+{
+	sys_allocs++;
+	return (char*)::operator new(size);
+}
+
+struct Pool_Depot
+{
+	std::mutex m_mutex;
+	std::array<std::vector<char*>, NUM_BUF_CLASSES> m_free;
+};
+
+static Pool_Depot &depot()
+{
+	//never destroyed, msgs held by globals get freed during static destruction
+	static auto depot = new Pool_Depot;
+	return *depot;
+}
+
+struct Pool_Cache
+{
+	~Pool_Cache()
+	{
+		//thread is exiting, hand everything back to the depot
+		cache_gone = true;
+		auto &d = depot();
+		std::lock_guard<std::mutex> l(d.m_mutex);
+		for (auto c = 0u; c < NUM_BUF_CLASSES; ++c)
+		{
+			d.m_free[c].insert(end(d.m_free[c]), begin(m_free[c]), end(m_free[c]));
+		}
+	}
+	std::array<std::vector<char*>, NUM_BUF_CLASSES> m_free;
+};
+
+static Pool_Cache &cache()
+{
+	static thread_local Pool_Cache cache;
+	return cache;
+}
+
+char *Msg_Pool::alloc(size_t size, size_t &capacity)
+{
+	auto c = size_class(size);
+	if (c == NUM_BUF_CLASSES)
+	{
+		//too big to pool
+		capacity = size;
+		return sys_alloc(size);
+	}
+	capacity = MIN_BUF_SIZE << c;
+	auto &d = depot();
+	if (is_cached(c))
+	{
+		//thread cache, refill a batch from the depot if dry
+		auto &free_list = cache().m_free[c];
+		if (free_list.empty())
+		{
+			std::lock_guard<std::mutex> l(d.m_mutex);
+			auto &depot_list = d.m_free[c];
+			auto n = std::min(CACHE_BATCH, depot_list.size());
+			free_list.insert(end(free_list), end(depot_list) - n, end(depot_list));
+			depot_list.resize(depot_list.size() - n);
+		}
+		if (free_list.empty()) return sys_alloc(capacity);
+		auto buf = free_list.back();
+		free_list.pop_back();
+		return buf;
+	}
+	//large class, depot only
+	std::lock_guard<std::mutex> l(d.m_mutex);
+	auto &depot_list = d.m_free[c];
+	if (depot_list.empty()) return sys_alloc(capacity);
+	auto buf = depot_list.back();
+	depot_list.pop_back();
+	return buf;
+}
+
+void Msg_Pool::free(char *buf, size_t size)
+{
+	auto c = size_class(size);
+	if (c == NUM_BUF_CLASSES)
+	{
+		::operator delete(buf);
+		return;
+	}
+	auto &d = depot();
+	if (is_cached(c))
+	{
+		//thread cache, spill a batch to the depot if too big
+		auto &free_list = cache().m_free[c];
+		free_list.push_back(buf);
+		if (free_list.size() <= CACHE_LIMIT) return;
+		std::lock_guard<std::mutex> l(d.m_mutex);
+		auto &depot_list = d.m_free[c];
+		for (auto i = 0u; i < CACHE_BATCH; ++i)
+		{
+			if (depot_list.size() < DEPOT_LIMIT) depot_list.push_back(free_list.back());
+			else ::operator delete(free_list.back());
+			free_list.pop_back();
+		}
+		return;
+	}
+	//large class, depot only
+	std::lock_guard<std::mutex> l(d.m_mutex);
+	auto &depot_list = d.m_free[c];
+	if (depot_list.size() < DEPOT_LARGE_LIMIT) depot_list.push_back(buf);
+	else ::operator delete(buf);
+}
+
+uint64_t Msg_Pool::get_sys_allocs()
+{
+	return sys_allocs;
+}
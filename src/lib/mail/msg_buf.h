@@ -0,0 +1,141 @@
+#ifndef MSG_BUF_H
+#define MSG_BUF_H
+
+#include <string>
+#include <memory>
+#include <new>
+#include <cstring>
+#include <algorithm>
+
+//message buffer pool.
+//buffers come in power of 2 size classes from 64 bytes up. classes that can hold a
+//whole link packet have a per thread cache, so the usual alloc/free is a vector push/pop.
+//caches swap batches with a shared depot when they run dry or get too big, which is
+//how buffers that are allocated on one thread and freed on another find their way back.
+//larger classes only live in the depot, and only a few of each are kept.
+//buffers are never zero filled !
+class Msg_Pool
+{
+public:
+	//allocate a buffer of at least size bytes, capacity is set to its real size
+	static char *alloc(size_t size, size_t &capacity);
+	//return a buffer to the pool, size can be the size asked for or the capacity
+	static void free(char *buf, size_t size);
+	//number of buffers that had to come from the system heap
+	static uint64_t get_sys_allocs();
+};
+
+//allocator that gets its memory from the Msg_Pool, used so that the
+//shared_ptr control blocks of message buffers come from the pool as well.
+template<class T>
+class Msg_Pool_Allocator
+{
+public:
+	using value_type = T;
+	Msg_Pool_Allocator() noexcept {}
+	template<class U>
+	Msg_Pool_Allocator(const Msg_Pool_Allocator<U>&) noexcept {}
+	T *allocate(size_t n)
+	{
+		size_t capacity;
+		return (T*)Msg_Pool::alloc(n * sizeof(T), capacity);
+	}
+	void deallocate(T *ptr, size_t n) noexcept
+	{
+		Msg_Pool::free((char*)ptr, n * sizeof(T));
+	}
+	template<class U>
+	bool operator==(const Msg_Pool_Allocator<U>&) const noexcept { return true; }
+	template<class U>
+	bool operator!=(const Msg_Pool_Allocator<U>&) const noexcept { return false; }
+};
+
+//message body buffer.
+//a byte buffer from the Msg_Pool, the contents are not initialised.
+//use the create methods, they allocate the buffer and its shared_ptr from the pool.
+//a view looks into memory something else owns, a file mapping say, and holds that
+//owner till it goes. growing a view copies it out into a pool buffer.
+class Msg_Buf
+{
+public:
+	Msg_Buf() {}
+	Msg_Buf(size_t size)
+		: m_size(size)
+	{
+		if (size) m_buf = Msg_Pool::alloc(size, m_capacity);
+	}
+	Msg_Buf(const char *data, size_t size)
+		: Msg_Buf(size)
+	{
+		if (size) memcpy(m_buf, data, size);
+	}
+	Msg_Buf(char *data, size_t size, std::shared_ptr<const void> owner)
+		: m_buf(data)
+		, m_size(size)
+		, m_owner(std::move(owner))
+	{}
+	Msg_Buf(const Msg_Buf &) = delete;
+	Msg_Buf &operator=(const Msg_Buf &) = delete;
+	~Msg_Buf() { if (m_buf && !m_owner) Msg_Pool::free(m_buf, m_capacity); }
+	static auto create(size_t size = 0)
+	{
+		return std::allocate_shared<Msg_Buf>(Msg_Pool_Allocator<Msg_Buf>(), size);
+	}
+	static auto create(const char *data, size_t size)
+	{
+		return std::allocate_shared<Msg_Buf>(Msg_Pool_Allocator<Msg_Buf>(), data, size);
+	}
+	static auto create(const std::string &data)
+	{
+		return create(data.data(), data.size());
+	}
+	static auto create_view(char *data, size_t size, std::shared_ptr<const void> owner)
+	{
+		return std::allocate_shared<Msg_Buf>(Msg_Pool_Allocator<Msg_Buf>(), data, size, std::move(owner));
+	}
+	//can be compared !
+	bool operator==(const Msg_Buf &o) const
+	{
+		return m_size == o.m_size && (!m_size || memcmp(m_buf, o.m_buf, m_size) == 0);
+	}
+	auto size() const { return m_size; }
+	auto data() const { return m_buf; }
+	auto begin() const { return m_buf; }
+	auto end() const { return m_buf + m_size; }
+	//grow or shrink, any new bytes are not initialised.
+	//growth at least doubles, past the pool classes alloc gives just what's asked
+	Msg_Buf &resize(size_t size)
+	{
+		if (size > m_capacity)
+		{
+			size_t capacity;
+			auto buf = Msg_Pool::alloc(std::max(size, m_capacity * 2), capacity);
+			if (m_buf)
+			{
+				memcpy(buf, m_buf, m_size);
+				if (!m_owner) Msg_Pool::free(m_buf, m_capacity);
+			}
+			m_buf = buf;
+			m_capacity = capacity;
+			m_owner.reset();
+		}
+		m_size = size;
+		return *this;
+	}
+	Msg_Buf &append(const char *data, size_t len)
+	{
+		auto size = m_size;
+		resize(size + len);
+		if (len) memcpy(m_buf + size, data, len);
+		return *this;
+	}
+	Msg_Buf &append(const std::string &data) { return append(data.data(), data.size()); }
+	Msg_Buf &push_back(char c) { return append(&c, 1); }
+private:
+	char *m_buf = nullptr;
+	size_t m_size = 0;
+	size_t m_capacity = 0;
+	std::shared_ptr<const void> m_owner;
+};
+
+#endif
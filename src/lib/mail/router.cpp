@@ -10,52 +10,87 @@
 
 Net_ID Router::alloc()
 {
-	//allocate a new net id and enter the associated mailbox into the validation map.
-	//it gets the next mailbox id that does not allready exist and which will not repeat
-	//for a very long time.
+	//allocate a new net id and enter the associated mailbox into the mailbox table.
+	//freed slots are reused oldest first, and only once enough of them are free, so
+	//together with the slot generation an id will not repeat for a very long time.
 	std::lock_guard<std::mutex> l(m_mutex);
-	while (m_next_mailbox_id.m_id == MAX_ID
-		|| m_mailboxes.find(m_next_mailbox_id) != end(m_mailboxes)) m_next_mailbox_id.m_id++;
-	auto id = m_next_mailbox_id;
-	m_mailboxes[id];
-	m_next_mailbox_id.m_id++;
-	return Net_ID(m_device_id, id);
+	uint32_t index;
+	if (m_free_slots.size() > MAILBOX_MIN_FREE_SLOTS
+		|| (m_num_slots == MAILBOX_TABLE_SIZE && !m_free_slots.empty()))
+	{
+		index = m_free_slots.front();
+		m_free_slots.pop_front();
+	}
+	else if (m_num_slots < MAILBOX_TABLE_SIZE)
+	{
+		index = m_num_slots++;
+		if (index % MAILBOX_CHUNK_SIZE == 0)
+		{
+			m_mailbox_chunks[index / MAILBOX_CHUNK_SIZE].store(new Mailbox_Slot[MAILBOX_CHUNK_SIZE], std::memory_order_release);
+		}
+	}
+	else throw std::runtime_error("mailbox table full");
+	auto &slot = m_mailbox_chunks[index / MAILBOX_CHUNK_SIZE].load(std::memory_order_relaxed)[index % MAILBOX_CHUNK_SIZE];
+	//discard any mail left from the last owner, the mailbox has no reader now
+	//as nothing holds a valid id for it, so we can be its consumer
+	slot.m_mbox.clear();
+	auto id = ((slot.m_gen & 0xffff) << 16) + index;
+	if (id == MAX_ID) id = ((++slot.m_gen & 0xffff) << 16) + index;
+	slot.m_id.store(id, std::memory_order_release);
+	return Net_ID(m_device_id, Mailbox_ID{id});
 }
 
 void Router::free(const Net_ID &id)
 {
-	//free the mailbox associated with this net id
+	//free the mailbox associated with this net id.
+	//bump the slot generation, any mail left in it goes when the slot is reused,
+	//the reader may be another thread and only it can read the mailbox till then.
 	std::lock_guard<std::mutex> l(m_mutex);
-	auto itr = m_mailboxes.find(id.m_mailbox_id);
-	if (itr != end(m_mailboxes)) m_mailboxes.erase(itr);
+	auto slot = find_slot(id.m_mailbox_id);
+	if (!slot) return;
+	slot->m_id.store(MAX_ID, std::memory_order_release);
+	slot->m_gen++;
+	m_free_slots.push_back(id.m_mailbox_id.m_id & 0xffff);
 }
 
-Mbox<std::shared_ptr<Msg>> *Router::validate_no_lock(const Net_ID &id)
+Mailbox_Slot *Router::find_slot(const Mailbox_ID &id)
+{
+	//find the table slot that holds this mailbox id, no lock needed as slots are
+	//never moved or deleted while the router lives. nullptr if not found.
+	if (id.m_id == MAX_ID) return nullptr;
+	auto index = id.m_id & 0xffff;
+	auto chunk = m_mailbox_chunks[index / MAILBOX_CHUNK_SIZE].load(std::memory_order_acquire);
+	if (!chunk) return nullptr;
+	auto slot = &chunk[index % MAILBOX_CHUNK_SIZE];
+	return slot->m_id.load(std::memory_order_acquire) == id.m_id ? slot : nullptr;
+}
+
+Mbox<std::shared_ptr<Msg>> *Router::validate(const Net_ID &id)
 {
 	//validate that this net id has a mailbox associated with it.
 	//return the mailbox if so, otherwise nullptr.
-	auto itr = m_mailboxes.find(id.m_mailbox_id);
-	return itr == end(m_mailboxes) ? nullptr : &itr->second;
+	auto slot = find_slot(id.m_mailbox_id);
+	return slot ? &slot->m_mbox : nullptr;
 }
 
-Mbox<std::shared_ptr<Msg>> *Router::validate(const Net_ID &id)
+Mailbox_Handle Router::resolve(const Net_ID &id)
 {
-	std::lock_guard<std::mutex> l(m_mutex);
-	return validate_no_lock(id);
+	//resolve this net id to a handle that can be read without the router
+	auto slot = find_slot(id.m_mailbox_id);
+	return slot ? Mailbox_Handle(slot, id.m_mailbox_id) : Mailbox_Handle();
 }
 
 int32_t Router::poll(const std::vector<Net_ID> &ids)
 {
 	//given a list of net id's check to see if any of them contain mail.
 	//return the index of the first one that does, else -1.
-	std::lock_guard<std::mutex> l(m_mutex);
-	std::vector<Mbox<std::shared_ptr<Msg>>*> mailboxes;
-	mailboxes.reserve(ids.size());
-	for (auto &id : ids) mailboxes.push_back(validate_no_lock(id));
-	auto itr = std::find_if(begin(mailboxes), end(mailboxes),
-		[&] (auto &mbox) { return !mbox->empty(); });
-	if (itr == end(mailboxes)) return -1;
-	return itr - begin(mailboxes);
+	auto itr = std::find_if(begin(ids), end(ids), [&] (auto &id)
+	{
+		auto mbox = validate(id);
+		return mbox && !mbox->empty();
+	});
+	if (itr == end(ids)) return -1;
+	return itr - begin(ids);
 }
 
 int32_t Router::select(const std::vector<Net_ID> &ids)
@@ -64,10 +99,7 @@ int32_t Router::select(const std::vector<Net_ID> &ids)
 	//returns the index of the first mailbox that has mail.
 	std::vector<Mbox<std::shared_ptr<Msg>>*> mailboxes;
 	mailboxes.reserve(ids.size());
-	{
-		std::lock_guard<std::mutex> l(m_mutex);
-		for (auto &id : ids) mailboxes.push_back(validate_no_lock(id));
-	}
+	for (auto &id : ids) mailboxes.push_back(validate(id));
 	auto itr = std::find_if(begin(mailboxes), end(mailboxes),
 		[&] (auto &mbox) { return !mbox->empty(); });
 	if (itr != end(mailboxes)) return itr - begin(mailboxes);
@@ -79,15 +111,21 @@ int32_t Router::select(const std::vector<Net_ID> &ids)
 		mbox->set_select(&select);
 	}
 	for (auto &mbox : mailboxes) mbox->unlock();
-	select.wait();
+	//mail may have been posted before the select was set,
+	//and a wake can arrive before the mail is fully published
+	for (;;)
+	{
+		itr = std::find_if(begin(mailboxes), end(mailboxes),
+			[&] (auto &mbox) { return !mbox->empty(); });
+		if (itr != end(mailboxes)) break;
+		select.wait();
+	}
 	for (auto &mbox : mailboxes)
 	{
 		mbox->lock();
 		mbox->set_select(nullptr);
+		mbox->unlock();
 	}
-	itr = std::find_if(begin(mailboxes), end(mailboxes),
-		[&] (auto &mbox) { return !mbox->empty(); });
-	for (auto &mbox : mailboxes) mbox->unlock();
 	return itr - begin(mailboxes);
 }
 
@@ -108,23 +146,23 @@ void Router::run()
 		if (!m_running) break;
 
 		//flood service directory to the network
-		auto body = std::make_shared<std::string>(sizeof(Kernel_Service::Event_directory), '\0');
-		auto event_body = (Kernel_Service::Event_directory*)&*(body->begin());
+		auto body = Msg_Buf::create(sizeof(Kernel_Service::Event_directory));
+		auto event_body = (Kernel_Service::Event_directory*)body->begin();
 		event_body->m_evt = Kernel_Service::evt_directory;
-		event_body->m_src = global_router->alloc_src();
-		event_body->m_via = global_router->get_dev_id();
+		event_body->m_src = alloc_src();
+		event_body->m_via = get_dev_id();
 		event_body->m_hops = 0;
 		{
 			std::lock_guard<std::mutex> l(m_mutex);
-			auto &dir_struct = m_directory[global_router->get_dev_id()];
-			for (auto &entry : dir_struct.m_services) body->append(entry).append("\n");
+			auto &dir_struct = m_directory[get_dev_id()];
+			for (auto &entry : dir_struct.m_services) body->append(entry).push_back('\n');
 		}
 		//broadcast to the list of known router peers
-		for (auto &peer : global_router->get_peers())
+		for (auto &peer : get_peers())
 		{
 			auto msg = std::make_shared<Msg>(body);
 			msg->set_dest(Net_ID(peer, Mailbox_ID{0}));
-			global_router->send(msg);
+			send(msg);
 		}
 
 		//purge old external directory entires and routes
@@ -149,7 +187,7 @@ std::string Router::declare(const Net_ID &id, const std::string &service, const
 	auto entry = service + "," + id.to_string() + "," + params;
 	auto wake = this;
 	std::lock_guard<std::mutex> l(m_mutex);
-	m_directory[global_router->get_dev_id()].m_services.insert(entry);
+	m_directory[get_dev_id()].m_services.insert(entry);
 	m_wake_mbox.post(wake);
 	return entry;
 }
@@ -160,15 +198,15 @@ void Router::forget(const std::string &entry)
 	//wake the manager thread to make it flood out the new state.
 	auto wake = this;
 	std::lock_guard<std::mutex> l(m_mutex);
-	m_directory[global_router->get_dev_id()].m_services.erase(entry);
+	m_directory[get_dev_id()].m_services.erase(entry);
 	m_wake_mbox.post(wake);
 }
 
-bool Router::update_dir(const std::string &body)
+bool Router::update_dir(Msg &msg)
 {
 	//update our service directory based on this ping message body
-	auto event_body = (Kernel_Service::Event_directory*)&(*begin(body));
-	auto event_body_end = &(*begin(body)) + body.size();
+	auto event_body = (Kernel_Service::Event_directory*)msg.begin();
+	auto event_body_end = msg.end();
 	std::lock_guard<std::mutex> l(m_mutex);
 	auto &dir_struct = m_directory[event_body->m_src.m_device_id];
 	//not a new session, so ignore !
@@ -178,7 +216,7 @@ bool Router::update_dir(const std::string &body)
 	dir_struct.m_services.clear();
 	//split the body into separate service entry strings.
 	//insert them into the directory.
-	for (auto &entry : split_string(std::string((const char*)event_body->m_data, event_body_end), "\n"))
+	for (auto &entry : split_string(std::string(event_body->m_data, event_body_end), "\n"))
 	{
 		dir_struct.m_services.insert(entry);
 	}
@@ -193,7 +231,7 @@ void Router::purge_dir()
 	auto itr = begin(m_directory);
 	while (itr != end (m_directory))
 	{
-		if (global_router->get_dev_id() != itr->first
+		if (get_dev_id() != itr->first
 			&& now - itr->second.m_time_modified >= std::chrono::milliseconds(MAX_DIRECTORY_AGE))
 		{
 			itr = m_directory.erase(itr);
@@ -244,27 +282,44 @@ void Router::send(std::shared_ptr<Msg> &msg)
 	if (msg->m_header.m_dest.m_device_id == m_device_id)
 	{
 		//yes so validate the mbox id
-		auto mbox = validate_no_lock(msg->m_header.m_dest.m_mailbox_id);
+		auto mbox = validate(msg->m_header.m_dest.m_mailbox_id);
 		if (!mbox) return;
 		//is this only a fragment of parcel ?
 		if (msg->m_header.m_frag_length < msg->m_header.m_total_length)
 		{
-			//look up parcel, create if not found, parcel.first will be 0 if just created.
+			//look up parcel, create if not found
 			auto &parcel = m_parcels[msg->m_header.m_src];
-			if (!parcel.second.m_msg)
+			if (!parcel.m_msg)
 			{
 				//timestamp for purgeing
-				auto now = std::chrono::high_resolution_clock::now();
-				parcel.second = Que_Item{now, std::make_shared<Msg>(msg->m_header.m_total_length)};
+				parcel.m_time = std::chrono::high_resolution_clock::now();
+				parcel.m_msg = std::make_shared<Msg>();
+				parcel.m_msg->m_header.m_total_length = msg->m_header.m_total_length;
+			}
+			//chain on this slice and any early ones it lets through, do we now have it all ?
+			auto &body = *parcel.m_msg;
+			if (msg->m_header.m_frag_offset != body.size())
+			{
+				if (msg->m_header.m_frag_offset > body.size()) parcel.m_early[msg->m_header.m_frag_offset] = std::move(msg);
+				return;
 			}
-			//fill in this slice, do we now have it all ?
-			memcpy(parcel.second.m_msg->begin() + msg->m_header.m_frag_offset, msg->begin(), msg->m_header.m_frag_length);
-			parcel.first += msg->m_header.m_frag_length;
-			if (parcel.first != msg->m_header.m_total_length) return;
+			auto append = [&] (std::shared_ptr<Msg> &frag)
+			{
+				//nobody else has this fragment, so take its segments
+				if (frag.use_count() == 1) body.append(std::move(*frag));
+				else body.append(*frag);
+			};
+			append(msg);
+			for (auto itr = begin(parcel.m_early); itr != end(parcel.m_early) && itr->first == body.size();)
+			{
+				append(itr->second);
+				itr = parcel.m_early.erase(itr);
+			}
+			if (body.size() != msg->m_header.m_total_length) return;
 			//got it all now, so remove it and post the full message
 			auto src = msg->m_header.m_src;
 			auto dst = msg->m_header.m_dest;
-			msg = std::move(parcel.second.m_msg);
+			msg = std::move(parcel.m_msg);
 			msg->set_dest(dst);
 			m_parcels.erase(src);
 		}
@@ -282,24 +337,72 @@ void Router::send(std::shared_ptr<Msg> &msg)
 			for (auto frag_offset = 0u; frag_offset < msg->m_header.m_frag_length;)
 			{
 				auto frag_size = std::min(MAX_PACKET_SIZE, msg->m_header.m_frag_length - frag_offset);
-				m_outgoing_msg_que.emplace_back(Que_Item{now, std::make_shared<Msg>(msg->m_data, msg->m_header.m_dest, src, frag_size, frag_offset)});
+				que_no_lock(Que_Item{now, std::make_shared<Msg>(*msg, msg->m_header.m_dest, src, frag_size, frag_offset)});
 				frag_offset += frag_size;
 			}
 		}
 		else
 		{
-			//que on the outgoing messages que
-			m_outgoing_msg_que.emplace_back(Que_Item{now, std::move(msg)});
+			//que on the outgoing messages que of the next hop
+			que_no_lock(Que_Item{now, std::move(msg)});
 		}
-		//wake the links to get them sending
-		m_cv.notify_all();
 	}
 }
 
+const Dev_ID *Router::next_hop_no_lock(const Dev_ID &dest)
+{
+	//direct peers go straight to their own que, otherwise pick the least loaded
+	//peer que out of the viable routes, nullptr if no route is known yet
+	auto pitr = m_peer_ques.find(dest);
+	if (pitr != end(m_peer_ques) && pitr->second.m_links) return &pitr->first;
+	auto ritr = m_routes.find(dest);
+	if (ritr == end(m_routes)) return nullptr;
+	const Dev_ID *via = nullptr;
+	auto load = size_t(-1);
+	for (auto &peer : ritr->second.m_vias)
+	{
+		pitr = m_peer_ques.find(peer);
+		if (pitr == end(m_peer_ques) || !pitr->second.m_links) continue;
+		if (pitr->second.m_que.size() < load)
+		{
+			via = &pitr->first;
+			load = pitr->second.m_que.size();
+		}
+	}
+	return via;
+}
+
+void Router::que_no_lock(Que_Item &&qi)
+{
+	//route the item onto its next hop que and wake one of the links to that peer,
+	//or hold it till a route turns up
+	auto via = next_hop_no_lock(qi.m_msg->m_header.m_dest.m_device_id);
+	if (!via)
+	{
+		m_unrouted_que.emplace_back(std::move(qi));
+		return;
+	}
+	auto &peer_que = m_peer_ques[*via];
+	peer_que.m_que.emplace_back(std::move(qi));
+	if (peer_que.m_waiters) peer_que.m_cv.notify_one();
+	if (!peer_que.m_wake_links.empty())
+	{
+		peer_que.m_wake_links.back()->wake();
+		peer_que.m_wake_links.pop_back();
+	}
+}
+
+void Router::reroute_no_lock()
+{
+	//the routes or links have changed, try again with the held messages
+	auto unrouted = std::move(m_unrouted_que);
+	m_unrouted_que.clear();
+	for (auto &qi : unrouted) que_no_lock(std::move(qi));
+}
+
 std::shared_ptr<Msg> Router::read(const Net_ID &id)
 {
-	auto mbox = global_router->validate(id);
-	return mbox->read();
+	return resolve(id).read();
 }
 
 Net_ID Router::alloc_src_no_lock()
@@ -315,10 +418,10 @@ Net_ID Router::alloc_src()
 	return alloc_src_no_lock();
 }
 
-bool Router::update_route(const std::string &body)
+bool Router::update_route(Msg &msg)
 {
 	//update our routing table based on this ping message body
-	auto event_body = (Kernel_Service::Event_directory*)&(*begin(body));
+	auto event_body = (Kernel_Service::Event_directory*)msg.begin();
 	std::lock_guard<std::mutex> l(m_mutex);
 	auto &route_struct = m_routes[event_body->m_src.m_device_id];
 	//ignore if it's from an old session !
@@ -344,6 +447,7 @@ bool Router::update_route(const std::string &body)
 		//equally good route, so add this as a viable route
 		route_struct.m_vias.insert(event_body->m_via);
 	}
+	if (!m_unrouted_que.empty()) reroute_no_lock();
 	return true;
 }
 
@@ -365,17 +469,27 @@ void Router::purge_routes()
 	}
 
 	//purge stale messages and parcels
-	for (auto itr = begin(m_outgoing_msg_que); itr != end (m_outgoing_msg_que);)
+	auto purge_que = [&] (std::list<Que_Item> &que)
 	{
-		if (now - itr->m_time >= std::chrono::milliseconds(MAX_MESSAGE_AGE))
+		que.remove_if([&] (const auto &qi)
 		{
-			itr = m_outgoing_msg_que.erase(itr);
+			return now - qi.m_time >= std::chrono::milliseconds(MAX_MESSAGE_AGE);
+		});
+	};
+	purge_que(m_unrouted_que);
+	for (auto itr = begin(m_peer_ques); itr != end (m_peer_ques);)
+	{
+		auto &peer_que = itr->second;
+		purge_que(peer_que.m_que);
+		if (!peer_que.m_links && !peer_que.m_waiters && peer_que.m_que.empty())
+		{
+			itr = m_peer_ques.erase(itr);
 		}
 		else itr++;
 	}
 	for (auto itr = begin(m_parcels); itr != end (m_parcels);)
 	{
-		if (now - itr->second.second.m_time >= std::chrono::milliseconds(MAX_PARCEL_AGE))
+		if (now - itr->second.m_time >= std::chrono::milliseconds(MAX_PARCEL_AGE))
 		{
 			itr = m_parcels.erase(itr);
 		}
@@ -386,40 +500,98 @@ void Router::purge_routes()
 std::shared_ptr<Msg> Router::get_next_msg(const Dev_ID &dest, std::chrono::milliseconds timeout)
 {
 	//get next message bound for the destination device else nullptr
+	std::unique_lock<std::mutex> l(m_mutex);
+	auto &peer_que = m_peer_ques[dest];
 	auto poll_que = [&]() -> std::shared_ptr<Msg>
 	{
-		auto itr = std::find_if(begin(m_outgoing_msg_que), end(m_outgoing_msg_que), [&] (const auto &qi)
-		{
-			if (dest == qi.m_msg->m_header.m_dest.m_device_id) return true;
-			auto &route_struct = m_routes[qi.m_msg->m_header.m_dest.m_device_id];
-			return route_struct.m_vias.find(dest) != end(route_struct.m_vias);
-		});
-		if (itr == end(m_outgoing_msg_que)) return nullptr;
-		auto msg = std::move((*itr).m_msg);
-		m_outgoing_msg_que.erase(itr);
+		if (peer_que.m_que.empty()) return nullptr;
+		auto msg = std::move(peer_que.m_que.front().m_msg);
+		peer_que.m_que.pop_front();
 		return msg;
 	};
-	//if there is no viable message for this destination then block till somthing
-	//new turns up on the que
-	std::unique_lock<std::mutex> l(m_mutex);
+	//if there is no message for this destination then block till somthing
+	//new turns up on its que
 	auto msg = poll_que();
-	if (!msg) m_cv.wait_for(l, timeout, [&]{ return (msg = poll_que()) != nullptr; });
+	if (!msg)
+	{
+		peer_que.m_waiters++;
+		peer_que.m_cv.wait_for(l, timeout, [&]{ return (msg = poll_que()) != nullptr; });
+		peer_que.m_waiters--;
+	}
 	return msg;
 }
 
+uint32_t Router::take_msgs_no_lock(Peer_Que &peer_que, std::vector<std::shared_ptr<Msg>> &msgs, uint32_t max_bytes)
+{
+	//take messages off the que, up to max_bytes of body data but always at least one
+	auto bytes = 0u;
+	while (!peer_que.m_que.empty())
+	{
+		auto &msg = peer_que.m_que.front().m_msg;
+		if (bytes && bytes + msg->m_header.m_frag_length > max_bytes) break;
+		bytes += msg->m_header.m_frag_length;
+		msgs.emplace_back(std::move(msg));
+		peer_que.m_que.pop_front();
+	}
+	return bytes;
+}
+
+uint32_t Router::get_next_msgs(const Dev_ID &dest, std::chrono::microseconds timeout, std::vector<std::shared_ptr<Msg>> &msgs, uint32_t max_bytes)
+{
+	//append the messages bound for the destination device, up to max_bytes of body
+	//data. if there are none then block till somthing new turns up on its que.
+	//returns the body bytes added.
+	std::unique_lock<std::mutex> l(m_mutex);
+	auto &peer_que = m_peer_ques[dest];
+	if (peer_que.m_que.empty())
+	{
+		peer_que.m_waiters++;
+		peer_que.m_cv.wait_for(l, timeout, [&]{ return !peer_que.m_que.empty(); });
+		peer_que.m_waiters--;
+	}
+	return take_msgs_no_lock(peer_que, msgs, max_bytes);
+}
+
+uint32_t Router::get_next_msgs(const Dev_ID &dest, Link *link, std::vector<std::shared_ptr<Msg>> &msgs, uint32_t max_bytes)
+{
+	//non blocking version for async links. if there are no messages then the link,
+	//if given, is called back with Link::wake() once when somthing turns up on the que.
+	std::lock_guard<std::mutex> l(m_mutex);
+	auto &peer_que = m_peer_ques[dest];
+	if (peer_que.m_que.empty())
+	{
+		auto &wake_links = peer_que.m_wake_links;
+		if (link && std::find(begin(wake_links), end(wake_links), link) == end(wake_links)) wake_links.push_back(link);
+		return 0;
+	}
+	return take_msgs_no_lock(peer_que, msgs, max_bytes);
+}
+
 void Router::add_link(Link *link, const Dev_ID &id)
 {
 	//new link driver entry that can send to given peer
 	std::lock_guard<std::mutex> l(m_mutex);
 	m_links[link] = id;
+	if (m_peer_ques[id].m_links++ == 0 && !m_unrouted_que.empty()) reroute_no_lock();
 }
 
 void Router::sub_link(Link *link)
 {
-	//remove link driver entry
+	//remove link driver entry, and any wake up it's waiting for.
+	//if that was the last link to the peer then its que has to find another way.
 	std::lock_guard<std::mutex> l(m_mutex);
+	for (auto &peer_que : m_peer_ques)
+	{
+		auto &wake_links = peer_que.second.m_wake_links;
+		wake_links.erase(std::remove(begin(wake_links), end(wake_links), link), end(wake_links));
+	}
 	auto itr = m_links.find(link);
-	if (itr != end(m_links)) m_links.erase(itr);
+	if (itr == end(m_links)) return;
+	auto &peer_que = m_peer_ques[itr->second];
+	m_links.erase(itr);
+	if (--peer_que.m_links) return;
+	m_unrouted_que.splice(end(m_unrouted_que), peer_que.m_que);
+	reroute_no_lock();
 }
 
 std::vector<Dev_ID> Router::get_peers()
@@ -437,7 +609,7 @@ std::vector<Dev_ID> Router::get_peers()
 	return peers;
 }
 
-void Router::broadcast(const std::vector<std::string> &services, std::shared_ptr<std::string> &body, const Net_ID &id)
+void Router::broadcast(const std::vector<std::string> &services, std::shared_ptr<Msg_Buf> &body, const Net_ID &id)
 {
 	//utility to broadcast a message body to a given list of services.
 	//optionally ignore a given service, for example yourself.
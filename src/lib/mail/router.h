@@ -6,6 +6,7 @@
 #include <thread>
 #include <list>
 #include <set>
+#include <deque>
 
 //router class, holds registered peer links and routes messages.
 
@@ -49,6 +50,68 @@ struct Que_Item
 	std::shared_ptr<Msg> m_msg;
 };
 
+//parcel being reassembled.
+//fragments are chained onto the parcel msg in offset order, any that turn up
+//ahead of their turn wait in the early map.
+struct Parcel
+{
+	//creation time
+	std::chrono::high_resolution_clock::time_point m_time;
+	//parcel so far
+	std::shared_ptr<Msg> m_msg;
+	std::map<uint32_t, std::shared_ptr<Msg>> m_early;
+};
+
+//outgoing message que for a next hop peer.
+//messages are routed into a peer que as they are sent, so a link only ever looks
+//at its own que and only the links to that peer are woken.
+struct Peer_Que
+{
+	//messages to go via this peer
+	std::list<Que_Item> m_que;
+	//link threads waiting on this peer
+	std::condition_variable m_cv;
+	uint32_t m_waiters = 0;
+	//async links waiting on this peer, woken with Link::wake()
+	std::vector<Link*> m_wake_links;
+	//number of links to this peer
+	uint32_t m_links = 0;
+};
+
+//mailbox table slot.
+//a mailbox id is the slot index in the low 16 bits and the slot generation in the
+//high 16 bits, the generation is bumped each time the slot is freed, so a stale id
+//no longer matches the slot and any mail for it is discarded.
+struct Mailbox_Slot
+{
+	//id of the mailbox in this slot, MAX_ID if free
+	std::atomic<uint32_t> m_id {MAX_ID};
+	uint32_t m_gen = 0;
+	Mbox<std::shared_ptr<Msg>> m_mbox;
+};
+
+//resolved mailbox, get one from Router::resolve() and then read from it without
+//going through the router. it checks the slot generation on every use so it goes
+//invalid, rather than reading someone else's mail, once the mailbox is freed.
+class Mailbox_Handle
+{
+public:
+	Mailbox_Handle() {}
+	Mailbox_Handle(Mailbox_Slot *slot, const Mailbox_ID &id)
+		: m_slot(slot)
+		, m_id(id)
+	{}
+	bool valid() const { return m_slot && m_slot->m_id.load(std::memory_order_acquire) == m_id.m_id; }
+	Mbox<std::shared_ptr<Msg>> *get_mbox() const { return valid() ? &m_slot->m_mbox : nullptr; }
+	std::shared_ptr<Msg> read() { return valid() ? m_slot->m_mbox.read() : nullptr; }
+	std::shared_ptr<Msg> read(std::chrono::milliseconds timeout) { return valid() ? m_slot->m_mbox.read(timeout) : nullptr; }
+	std::shared_ptr<Msg> poll() { return valid() ? m_slot->m_mbox.poll() : nullptr; }
+	bool empty() const { return !valid() || m_slot->m_mbox.empty(); }
+private:
+	Mailbox_Slot *m_slot = nullptr;
+	Mailbox_ID m_id;
+};
+
 //the router is allocated a unique device id on creation and coordinates the routing
 //and delivery of all messages
 class Router
@@ -67,6 +130,7 @@ public:
 		//stop directory manager
 		stop_thread();
 		m_thread.join();
+		for (auto &chunk : m_mailbox_chunks) delete[] chunk.load();
 	}
 	void run();
 	void stop_thread();
@@ -78,6 +142,7 @@ public:
 	Net_ID alloc();
 	void free(const Net_ID &id);
 	Mbox<std::shared_ptr<Msg>> *validate(const Net_ID &id);
+	Mailbox_Handle resolve(const Net_ID &id);
 	//read, poll and select
 	std::shared_ptr<Msg> read(const Net_ID &id);
 	int32_t poll(const std::vector<Net_ID> &ids);
@@ -87,36 +152,44 @@ public:
 	void forget(const std::string &entry);
 	std::vector<std::string> enquire(const std::string &prefix);
 	std::vector<std::string> enquire(const Dev_ID &dev_id, const std::string &prefix);
-	bool update_dir(const std::string &body);
+	bool update_dir(Msg &msg);
 	//service broadcast helper
-	void broadcast(const std::vector<std::string> &services, std::shared_ptr<std::string> &body, const Net_ID &id = {{0}, 0});
+	void broadcast(const std::vector<std::string> &services, std::shared_ptr<Msg_Buf> &body, const Net_ID &id = {{0}, 0});
 	//registered peer links
 	void add_link(Link *link, const Dev_ID &id);
 	void sub_link(Link *link);
 	std::vector<Dev_ID> get_peers();
 	//routing management
 	std::shared_ptr<Msg> get_next_msg(const Dev_ID &dest, std::chrono::milliseconds timeout = std::chrono::milliseconds(0));
-	bool update_route(const std::string &body);
+	uint32_t get_next_msgs(const Dev_ID &dest, std::chrono::microseconds timeout, std::vector<std::shared_ptr<Msg>> &msgs, uint32_t max_bytes);
+	uint32_t get_next_msgs(const Dev_ID &dest, Link *link, std::vector<std::shared_ptr<Msg>> &msgs, uint32_t max_bytes);
+	bool update_route(Msg &msg);
 	bool m_running = false;
 private:
 	void purge_routes();
 	void purge_dir();
-	Mbox<std::shared_ptr<Msg>> *validate_no_lock(const Net_ID &id);
+	Mailbox_Slot *find_slot(const Mailbox_ID &id);
 	Net_ID alloc_src_no_lock();
 	Net_ID alloc_src();
+	const Dev_ID *next_hop_no_lock(const Dev_ID &dest);
+	void que_no_lock(Que_Item &&qi);
+	uint32_t take_msgs_no_lock(Peer_Que &peer_que, std::vector<std::shared_ptr<Msg>> &msgs, uint32_t max_bytes);
+	void reroute_no_lock();
 	std::mutex m_mutex;
 	std::thread m_thread;
-	std::condition_variable m_cv;
 	const Dev_ID m_device_id;
 	Mailbox_ID m_next_parcel_id;
-	std::map<Net_ID, std::pair<uint32_t, Que_Item>> m_parcels;
-	std::list<Que_Item> m_outgoing_msg_que;
+	std::map<Net_ID, Parcel> m_parcels;
+	std::map<Dev_ID, Peer_Que> m_peer_ques;
+	std::list<Que_Item> m_unrouted_que;
 	std::map<Link*, Dev_ID> m_links;
 	std::map<Dev_ID, Route> m_routes;
 	std::map<Dev_ID, Directory> m_directory;
 	Mbox<Router*> m_wake_mbox;
-	Mailbox_ID m_next_mailbox_id;
-	std::map<Mailbox_ID, Mbox<std::shared_ptr<Msg>>> m_mailboxes;
+	static const uint32_t MAILBOX_CHUNK_SIZE = 256;
+	std::array<std::atomic<Mailbox_Slot*>, MAILBOX_TABLE_SIZE / MAILBOX_CHUNK_SIZE> m_mailbox_chunks {};
+	std::deque<uint32_t> m_free_slots;
+	uint32_t m_num_slots = 0;
 };
 
 #endif
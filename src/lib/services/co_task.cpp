@@ -0,0 +1,202 @@
+#include "co_task.h"
+#include "kernel_service.h"
+#include <algorithm>
+
+//////////
+// co task
+//////////
+
+void Co_Waker::wake()
+{
+	//if the coroutine has finished suspending put it back on its run que,
+	//if not it will see it's been woken and not suspend
+	if (m_state.exchange(state_woken, std::memory_order_acq_rel) == state_waiting) m_worker->post(m_handle);
+}
+
+Co_Select::Co_Select(Router &router, const std::vector<Net_ID> &ids, Co_Worker *worker)
+{
+	m_mailboxes.reserve(ids.size());
+	for (auto &id : ids) m_mailboxes.push_back(router.validate(id));
+	m_waker.m_worker = worker;
+}
+
+int32_t Co_Select::find()
+{
+	auto itr = std::find_if(begin(m_mailboxes), end(m_mailboxes),
+		[&] (auto &mbox) { return !mbox->empty(); });
+	if (itr == end(m_mailboxes)) return -1;
+	return itr - begin(m_mailboxes);
+}
+
+bool Co_Select::await_ready()
+{
+	m_index = find();
+	return m_index != -1;
+}
+
+bool Co_Select::await_suspend(std::coroutine_handle<> handle)
+{
+	//no mailbox has mail, so ask them all to wake us
+	m_waker.m_handle = handle;
+	for (auto &mbox : m_mailboxes)
+	{
+		mbox->lock();
+		mbox->set_select(&m_waker);
+	}
+	for (auto &mbox : m_mailboxes) mbox->unlock();
+	m_selecting = true;
+	//mail may have been posted before the select was set
+	if (find() != -1)
+	{
+		m_waker.m_state.store(Co_Waker::state_woken, std::memory_order_relaxed);
+		return false;
+	}
+	//suspend, unless a wake got in first. once we are waiting the coroutine can
+	//be resumed at any time so don't touch anything after this.
+	auto state = (uint32_t)Co_Waker::state_suspending;
+	return m_waker.m_state.compare_exchange_strong(state, Co_Waker::state_waiting, std::memory_order_acq_rel);
+}
+
+int32_t Co_Select::await_resume()
+{
+	if (m_selecting)
+	{
+		for (auto &mbox : m_mailboxes)
+		{
+			mbox->lock();
+			mbox->set_select(nullptr);
+			mbox->unlock();
+		}
+		//a wake can arrive before the mail is fully published,
+		//the sender is part way through its post so give it the cpu
+		while ((m_index = find()) == -1) std::this_thread::yield();
+	}
+	return m_index;
+}
+
+void Co_Task::stop()
+{
+	if (!m_running) return;
+	m_running = false;
+	//wake the coroutine with an exit message
+	auto msg = std::make_shared<Msg>(sizeof(Event));
+	msg->set_dest(m_net_id);
+	auto event_body = (Event*)msg->begin();
+	event_body->m_evt = evt_exit;
+	m_router.send(msg);
+}
+
+Co_Read Co_Task::sleep(std::chrono::milliseconds timeout)
+{
+	//timed mail to our own timer mailbox, resume when it arrives
+	if (m_timer_id.m_mailbox_id.m_id == MAX_ID) m_timer_id = m_router.alloc();
+	Kernel_Service::timed_mail(m_timer_id, timeout, 0, m_router);
+	return read(m_timer_id);
+}
+
+std::vector<Net_ID> Co_Task::alloc_select(uint32_t size)
+{
+	auto select = std::vector<Net_ID>{m_net_id};
+	for (auto i = 1u; i < size; ++i) select.emplace_back(m_router.alloc());
+	return select;
+}
+
+void Co_Task::free_select(std::vector<Net_ID> &select)
+{
+	std::for_each(begin(select) + 1, end(select), [&] (const auto &id) { m_router.free(id); });
+	select.clear();
+}
+
+////////////
+// co worker
+////////////
+
+void Co_Worker::post(std::coroutine_handle<> handle)
+{
+	//any thread, add to the run que
+	std::lock_guard<std::mutex> l(m_mutex);
+	m_que.push_back(handle);
+	if (m_que.size() == 1) m_cv.notify_one();
+}
+
+void Co_Worker::run()
+{
+	//resume coroutines till stopped, destroy them when done
+	std::deque<std::coroutine_handle<>> que;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> l(m_mutex);
+			while (m_running && m_que.empty()) m_cv.wait(l);
+			if (!m_running) break;
+			std::swap(que, m_que);
+		}
+		for (auto &handle : que)
+		{
+			handle.resume();
+			if (!handle.done()) continue;
+			handle.destroy();
+			m_live->fetch_sub(1, std::memory_order_release);
+		}
+		que.clear();
+	}
+}
+
+///////////////
+// co scheduler
+///////////////
+
+Co_Scheduler::Co_Scheduler(uint32_t threads)
+{
+	for (auto i = 0u; i < threads; ++i)
+	{
+		m_workers.emplace_back(std::make_unique<Co_Worker>());
+		m_workers.back()->m_live = &m_live;
+	}
+}
+
+Co_Scheduler::~Co_Scheduler()
+{
+	stop_threads();
+	join_threads();
+}
+
+void Co_Scheduler::start_threads()
+{
+	for (auto &worker : m_workers)
+	{
+		if (worker->m_running) continue;
+		worker->m_running = true;
+		worker->m_thread = std::thread(&Co_Worker::run, worker.get());
+	}
+}
+
+void Co_Scheduler::stop_threads()
+{
+	for (auto &worker : m_workers)
+	{
+		std::lock_guard<std::mutex> l(worker->m_mutex);
+		worker->m_running = false;
+		worker->m_cv.notify_one();
+	}
+}
+
+void Co_Scheduler::join_threads()
+{
+	for (auto &worker : m_workers)
+	{
+		if (worker->m_thread.joinable()) worker->m_thread.join();
+	}
+}
+
+void Co_Scheduler::start_task(const std::shared_ptr<Co_Task> &task)
+{
+	//bind to the next worker, the coroutine holds the task till it's done
+	auto worker = m_workers[m_next++ % m_workers.size()].get();
+	task->m_worker = worker;
+	task->m_running = true;
+	auto co = task->run();
+	co.m_handle.promise().m_task = task;
+	m_live.fetch_add(1, std::memory_order_relaxed);
+	worker->post(co.m_handle);
+}
@@ -0,0 +1,166 @@
+#ifndef CO_TASK_H
+#define CO_TASK_H
+
+#include "../mail/router.h"
+#include <coroutine>
+
+extern std::unique_ptr<Router> global_router;
+
+class Co_Task;
+class Co_Worker;
+
+//coroutine returned by Co_Task::run().
+//it starts suspended, the scheduler resumes it on the worker the task is bound to
+//and destroys it once it's done.
+struct Co_Routine
+{
+	struct promise_type
+	{
+		Co_Routine get_return_object() { return Co_Routine{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+		std::suspend_always initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+		//keeps the task alive while it runs
+		std::shared_ptr<Co_Task> m_task;
+	};
+	std::coroutine_handle<promise_type> m_handle;
+};
+
+//mailbox waker for a suspended coroutine.
+//the mailboxes call wake() under their lock, rather than waking a thread it puts the
+//coroutine back on its worker's run que. the suspend and a wake can race, whoever
+//gets there second does the resume, so it only ever happens once.
+class Co_Waker : public Sync
+{
+public:
+	enum
+	{
+		state_suspending,
+		state_waiting,
+		state_woken,
+	};
+	void wake() override;
+	std::coroutine_handle<> m_handle;
+	Co_Worker *m_worker = nullptr;
+	std::atomic<uint32_t> m_state {state_suspending};
+};
+
+//awaitable mailbox select.
+//ready at once if any mailbox has mail, else the coroutine is suspended till one
+//does. resumes with the index of the first mailbox that has mail.
+class Co_Select
+{
+public:
+	Co_Select(Router &router, const std::vector<Net_ID> &ids, Co_Worker *worker);
+	bool await_ready();
+	bool await_suspend(std::coroutine_handle<> handle);
+	int32_t await_resume();
+protected:
+	int32_t find();
+	std::vector<Mbox<std::shared_ptr<Msg>>*> m_mailboxes;
+	Co_Waker m_waker;
+	int32_t m_index = -1;
+	bool m_selecting = false;
+};
+
+//awaitable mailbox read, resumes with the next msg
+class Co_Read : public Co_Select
+{
+public:
+	Co_Read(Router &router, const Net_ID &id, Co_Worker *worker)
+		: Co_Select(router, {id}, worker)
+	{}
+	std::shared_ptr<Msg> await_resume()
+	{
+		Co_Select::await_resume();
+		return m_mailboxes[0]->poll();
+	}
+};
+
+//coroutine task class.
+//like Task, but run() is a coroutine and the task is multiplexed onto a
+//Co_Scheduler worker thread, rather than having a thread of its own.
+//co_await read(), select() or sleep() suspends the coroutine, never the thread.
+//don't call anything that blocks the thread, Kernel_Service::start_task etc, from run().
+class Co_Task : public std::enable_shared_from_this<Co_Task>
+{
+	friend class Co_Scheduler;
+public:
+	enum
+	{
+		evt_exit, //must be first !
+	};
+	struct Event
+	{
+		uint64_t m_evt;
+	};
+	Co_Task(Router &router = *global_router)
+		: m_router(router)
+		, m_net_id(router.alloc())
+	{}
+	virtual ~Co_Task()
+	{
+		//free the task mailboxes
+		if (m_timer_id.m_mailbox_id.m_id != MAX_ID) m_router.free(m_timer_id);
+		m_router.free(m_net_id);
+	}
+	//responce handling
+	void stop();
+	const Net_ID &get_id() const { return m_net_id; }
+	Router &get_router() const { return m_router; }
+	bool m_running = false;
+protected:
+	Co_Read read(const Net_ID &id) { return Co_Read(m_router, id, m_worker); }
+	Co_Select select(const std::vector<Net_ID> &ids) { return Co_Select(m_router, ids, m_worker); }
+	Co_Read sleep(std::chrono::milliseconds timeout);
+	std::vector<Net_ID> alloc_select(uint32_t size);
+	void free_select(std::vector<Net_ID> &select);
+	virtual Co_Routine run() = 0;
+	Router &m_router;
+	const Net_ID m_net_id;
+	Net_ID m_timer_id {{0}, MAX_ID};
+	Co_Worker *m_worker = nullptr;
+};
+
+//coroutine worker, a thread and the run que of the tasks bound to it
+class Co_Worker
+{
+	friend class Co_Scheduler;
+public:
+	void post(std::coroutine_handle<> handle);
+private:
+	void run();
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::deque<std::coroutine_handle<>> m_que;
+	std::thread m_thread;
+	std::atomic<uint32_t> *m_live = nullptr;
+	bool m_running = false;
+};
+
+//coroutine scheduler.
+//M:N, any number of Co_Task's on a worker thread per core. tasks are bound to a
+//worker round robin when started and stay on it, so a coroutine is only ever
+//resumed by the one thread.
+//thread per task Task's and Co_Task's can live side by side and mail each other.
+//stop the tasks and wait for size() to get to 0 before stopping the threads, a
+//coroutine left suspended is never destroyed.
+class Co_Scheduler
+{
+public:
+	Co_Scheduler(uint32_t threads = std::max(std::thread::hardware_concurrency(), 1u));
+	~Co_Scheduler();
+	void start_threads();
+	void stop_threads();
+	void join_threads();
+	void start_task(const std::shared_ptr<Co_Task> &task);
+	//number of tasks not yet finished
+	uint32_t size() const { return m_live.load(std::memory_order_acquire); }
+private:
+	std::vector<std::unique_ptr<Co_Worker>> m_workers;
+	std::atomic<uint32_t> m_live {0};
+	uint32_t m_next = 0;
+};
+
+#endif
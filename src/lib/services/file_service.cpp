@@ -1,42 +1,1956 @@
 #include "file_service.h"
+#include "../utils/executor.h"
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <cstdio>
+#include <cmath>
+#include <deque>
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <filesystem>
+#include <set>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+///////////
+// file map
+///////////
+
+//source file mapped into memory.
+//chunks are msg bufs that look straight into the mapping, each holds the map so it
+//stays till the last of them has gone, out over a link or to a local receiver.
+//no mmap on windows, chunks are read into pool bufs there.
+class File_Map : public std::enable_shared_from_this<File_Map>
+{
+public:
+	File_Map(const std::string &name)
+	{
+#ifdef _WIN32
+		m_file.open(name, std::ifstream::ate | std::ifstream::binary);
+		if (m_file.is_open()) m_size = (uint64_t)m_file.tellg();
+#else
+		auto fd = ::open(name.c_str(), O_RDONLY);
+		if (fd == -1) return;
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0)
+		{
+			auto addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (addr != MAP_FAILED)
+			{
+				//we go through it front to back, so read ahead
+				madvise(addr, st.st_size, MADV_SEQUENTIAL);
+				m_data = (char*)addr;
+				m_size = st.st_size;
+			}
+		}
+		close(fd);
+#endif
+	}
+	~File_Map()
+	{
+#ifndef _WIN32
+		if (m_data) munmap(m_data, m_size);
+#endif
+	}
+	//0 if empty or it couldn't be opened
+	uint64_t size() const { return m_size; }
+	std::shared_ptr<Msg_Buf> chunk(uint64_t offset, uint64_t length)
+	{
+#ifdef _WIN32
+		auto buf = Msg_Buf::create(length);
+		m_file.seekg(offset);
+		m_file.read(buf->begin(), length);
+		return buf;
+#else
+		return Msg_Buf::create_view(m_data + offset, length, shared_from_this());
+#endif
+	}
+private:
+#ifdef _WIN32
+	std::ifstream m_file;
+#else
+	char *m_data = nullptr;
+#endif
+	uint64_t m_size = 0;
+};
+
+///////////////
+// block hashes
+///////////////
+
+//rolling hash of a block, rsync's, a is the sum of the bytes and b the sum of the
+//a's, so sliding the block on a byte is a few adds
+class Rolling_Hash
+{
+public:
+	Rolling_Hash(const char *data, uint32_t length)
+		: m_length(length)
+	{
+		for (auto i = 0u; i < length; ++i)
+		{
+			m_a += (uint8_t)data[i];
+			m_b += m_a;
+		}
+	}
+	void roll(char out, char in)
+	{
+		m_a += (uint8_t)in - (uint8_t)out;
+		m_b += m_a - m_length * (uint8_t)out;
+	}
+	uint32_t value() const { return (m_b << 16) | (m_a & 0xffff); }
+private:
+	uint32_t m_a = 0;
+	uint32_t m_b = 0;
+	uint32_t m_length;
+};
+
+//strong hash, xxhash64, of a stream fed in pieces, the same value as one go over
+//the whole, whole 32 byte stripes go straight through, the rest waits in m_buf
+class Strong_Hash
+{
+public:
+	Strong_Hash &update(const char *data, uint64_t length)
+	{
+		m_length += length;
+		if (m_buffered)
+		{
+			auto len = std::min(length, (uint64_t)(32 - m_buffered));
+			memcpy(m_buf + m_buffered, data, len);
+			m_buffered += len;
+			data += len;
+			length -= len;
+			if (m_buffered < 32) return *this;
+			stripe(m_buf);
+			m_buffered = 0;
+		}
+		for (; length >= 32; data += 32, length -= 32) stripe(data);
+		memcpy(m_buf, data, length);
+		m_buffered = length;
+		return *this;
+	}
+	uint64_t value() const
+	{
+		uint64_t h;
+		if (m_length >= 32)
+		{
+			h = rotl(m_v[0], 1) + rotl(m_v[1], 7) + rotl(m_v[2], 12) + rotl(m_v[3], 18);
+			for (auto i = 0; i < 4; ++i) h = (h ^ round(0, m_v[i])) * p1 + p4;
+		}
+		else h = p5;
+		h += m_length;
+		auto data = m_buf;
+		auto end = m_buf + m_buffered;
+		for (; data + 8 <= end; data += 8) h = rotl(h ^ round(0, read64(data)), 27) * p1 + p4;
+		if (data + 4 <= end)
+		{
+			uint32_t v;
+			memcpy(&v, data, 4);
+			h = rotl(h ^ (v * p1), 23) * p2 + p3;
+			data += 4;
+		}
+		for (; data < end; ++data) h = rotl(h ^ ((uint8_t)*data * p5), 11) * p1;
+		h = (h ^ (h >> 33)) * p2;
+		h = (h ^ (h >> 29)) * p3;
+		return h ^ (h >> 32);
+	}
+private:
+	static const uint64_t p1 = 11400714785074694791ULL, p2 = 14029467366897019727ULL,
+		p3 = 1609587929392813521ULL, p4 = 9650029242287828579ULL, p5 = 2870177450012600261ULL;
+	static uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+	static uint64_t round(uint64_t acc, uint64_t in) { return rotl(acc + in * p2, 31) * p1; }
+	static uint64_t read64(const char *p) { uint64_t v; memcpy(&v, p, 8); return v; }
+	void stripe(const char *data)
+	{
+		for (auto i = 0; i < 4; ++i) m_v[i] = round(m_v[i], read64(data + i * 8));
+	}
+	uint64_t m_v[4] = {p1 + p2, p2, 0, 0 - p1};
+	uint64_t m_length = 0;
+	char m_buf[32];
+	uint32_t m_buffered = 0;
+};
+
+//strong hash of a block
+uint64_t strong_hash(const char *data, uint64_t length)
+{
+	return Strong_Hash().update(data, length).value();
+}
+
+File_Service::block_hash hash_block(const char *data, uint32_t length)
+{
+	return File_Service::block_hash{strong_hash(data, length), Rolling_Hash(data, length).value(), length};
+}
+
+bool same_block(const File_Service::block_hash &a, const File_Service::block_hash &b)
+{
+	return a.m_strong == b.m_strong && a.m_weak == b.m_weak && a.m_length == b.m_length;
+}
+
+//////////////
+// file writer
+//////////////
+
+//destination file written in place.
+//chunks go straight to their offset in a temp file next to the destination, sized
+//up front, which is renamed over the destination once they are all there. no one
+//sees a half written file and nothing has to be copied at the end.
+//a transfer that doesn't finish leaves the temp, and a checkpoint next to it of
+//the chunks that had arrived, for the next try to pick up from.
+class File_Writer
+{
+public:
+	File_Writer(const std::string &name, uint64_t size, bool resume = false)
+		: m_name(name)
+		, m_temp(name + ".part")
+		, m_size(size)
+	{
+		//a fresh start makes any old checkpoint a lie
+		if (!resume) std::remove(checkpoint_name(name).c_str());
+#ifdef _WIN32
+		m_file.open(m_temp, std::ofstream::out | std::ofstream::binary | (resume ? std::ofstream::in : std::ofstream::trunc));
+		m_ok = m_file.is_open();
+#else
+		m_fd = ::open(m_temp.c_str(), O_WRONLY | O_CREAT | (resume ? 0 : O_TRUNC), 0644);
+		if (m_fd == -1) return;
+#ifdef __linux__
+		//take the blocks now, the file won't fragment and a full disk shows up here
+		m_ok = posix_fallocate(m_fd, 0, size) == 0;
+#endif
+		if (!m_ok) m_ok = ftruncate(m_fd, size) == 0;
+#endif
+	}
+	~File_Writer()
+	{
+		//not committed, the temp stays for a resume
+		close();
+	}
+	bool is_open() const { return m_ok; }
+	const std::string &temp_name() const { return m_temp; }
+	static std::string checkpoint_name(const std::string &name) { return name + ".part.ckpt"; }
+	//chunks a checkpoint says are in the temp, a bit each, empty if there's none for
+	//this size of file
+	static std::vector<uint64_t> checkpoint(const std::string &name, uint64_t size, uint64_t chunk_length)
+	{
+		auto file = std::ifstream(checkpoint_name(name), std::ifstream::binary);
+		uint64_t head[3];
+		auto chunks = (size + chunk_length - 1) / chunk_length;
+		if (!file.read((char*)head, sizeof(head))
+			|| head[0] != size || head[1] != chunk_length || head[2] != chunks) return {};
+		auto arrived = std::vector<uint64_t>((chunks + 63) / 64);
+		if (!file.read((char*)arrived.data(), arrived.size() * sizeof(uint64_t))) return {};
+		return arrived;
+	}
+	//note which chunks are in the temp
+	void checkpoint(const std::vector<uint64_t> &arrived, uint64_t chunk_length)
+	{
+		uint64_t head[3] = {m_size, chunk_length, (m_size + chunk_length - 1) / chunk_length};
+		auto file = std::ofstream(checkpoint_name(m_name), std::ofstream::binary | std::ofstream::trunc);
+		file.write((char*)head, sizeof(head));
+		file.write((char*)arrived.data(), arrived.size() * sizeof(uint64_t));
+	}
+	//write the body of a msg past its header, a segment at a time so a chunk
+	//that came straight from a mapping isn't flattened first
+	void write(uint64_t offset, const Msg &msg, uint32_t skip)
+	{
+		for (auto seg = msg.seg_begin(); m_ok && seg != msg.seg_end(); ++seg)
+		{
+			if (skip >= seg->m_length)
+			{
+				skip -= seg->m_length;
+				continue;
+			}
+			auto len = (size_t)(seg->m_length - skip);
+			write(offset, seg->begin() + skip, len);
+			offset += len;
+			skip = 0;
+		}
+	}
+	void write(uint64_t offset, const char *data, size_t len)
+	{
+#ifdef _WIN32
+		m_file.seekp(offset);
+		m_ok = m_ok && (bool)m_file.write(data, len);
+#else
+		while (m_ok && len)
+		{
+			auto n = pwrite(m_fd, data, len, offset);
+			if (n <= 0 && errno == EINTR) continue;
+			if (n <= 0)
+			{
+				m_ok = false;
+				break;
+			}
+			data += n;
+			len -= n;
+			offset += n;
+		}
+#endif
+	}
+	//close and rename over the destination, false if anything failed
+	bool commit()
+	{
+		auto ok = close() && m_ok;
+		if (ok && std::rename(m_temp.c_str(), m_name.c_str()))
+		{
+			//windows won't rename over a file
+			std::remove(m_name.c_str());
+			ok = std::rename(m_temp.c_str(), m_name.c_str()) == 0;
+		}
+		if (!ok) std::remove(m_temp.c_str());
+		std::remove(checkpoint_name(m_name).c_str());
+		m_ok = false;
+		return ok;
+	}
+private:
+	bool close()
+	{
+		//true if it was open
+#ifdef _WIN32
+		if (!m_file.is_open()) return false;
+		m_file.close();
+		return true;
+#else
+		if (m_fd == -1) return false;
+		::close(m_fd);
+		m_fd = -1;
+		return true;
+#endif
+	}
+	std::string m_name;
+	std::string m_temp;
+	uint64_t m_size;
+#ifdef _WIN32
+	std::ofstream m_file;
+#else
+	int m_fd = -1;
+#endif
+	bool m_ok = false;
+};
+
+//blocks of a manifest that are in an old copy of the file, anywhere in it, are
+//copied from there into the writer. it rolls a block's worth of the old copy along a
+//byte at a time till the rolling hash is one we want and the strong hash agrees,
+//then jumps the block. a filter on the rolling hash keeps most bytes off the map.
+void find_blocks(const char *data, uint64_t size, const std::vector<File_Service::block_hash> &hashes,
+	uint64_t block_length, std::vector<bool> &have, File_Writer &file)
+{
+	auto wanted = std::unordered_multimap<uint32_t, uint64_t>{};
+	auto filter = std::vector<bool>(1 << 20);
+	for (auto block = uint64_t(0); block < hashes.size(); ++block)
+	{
+		if (have[block] || hashes[block].m_length != block_length) continue;
+		wanted.emplace(hashes[block].m_weak, block);
+		filter[hashes[block].m_weak & 0xfffff] = true;
+	}
+	auto found = [&] (uint64_t pos, uint32_t weak)
+	{
+		auto range = wanted.equal_range(weak);
+		if (range.first == range.second) return false;
+		auto hash = File_Service::block_hash{strong_hash(data + pos, block_length), weak, (uint32_t)block_length};
+		auto hit = false;
+		for (auto itr = range.first; itr != range.second;)
+		{
+			if (!same_block(hash, hashes[itr->second]))
+			{
+				++itr;
+				continue;
+			}
+			have[itr->second] = true;
+			file.write(itr->second * block_length, data + pos, block_length);
+			itr = wanted.erase(itr);
+			hit = true;
+		}
+		return hit;
+	};
+	for (auto pos = uint64_t(0); !wanted.empty() && pos + block_length <= size;)
+	{
+		auto roll = Rolling_Hash(data + pos, (uint32_t)block_length);
+		for (;;)
+		{
+			auto weak = roll.value();
+			if (filter[weak & 0xfffff] && found(pos, weak))
+			{
+				pos += block_length;
+				break;
+			}
+			if (pos + block_length >= size)
+			{
+				pos = size;
+				break;
+			}
+			roll.roll(data[pos], data[pos + block_length]);
+			pos++;
+		}
+	}
+	//a short last block can only be at the end, or where it was
+	if (hashes.empty() || have.back() || hashes.back().m_length == block_length) return;
+	auto last = hashes.size() - 1;
+	auto length = hashes.back().m_length;
+	for (auto pos : {last * block_length, size - length})
+	{
+		if (length > size || pos + length > size) continue;
+		if (!same_block(hash_block(data + pos, length), hashes.back())) continue;
+		have.back() = true;
+		file.write(last * block_length, data + pos, length);
+		return;
+	}
+}
 
 //////////////
-// files utils
+// send window
 //////////////
 
-void file_copy(const std::string &src, const std::string &dst);
+//sliding window over the chunks of a file being sent.
+//acks say every chunk before the first hole has arrived, and which after it have,
+//only the chunks that went missing are sent again. a chunk is lost once 3 sent
+//after it have been acked, or one sent a while after it has, or nothing has been
+//acked for an rto.
+//the window grows as tcp's does, doubling each rtt then a chunk per rtt, but keeps
+//on doubling while the rtt says there's room on the line for more. a loss
+//cuts it back to what the acks say is getting through in the least rtt we've seen,
+//so a lossy line isn't taken for a full one, and it backs off when the rtt climbs
+//so far over that least rtt that a window's worth of our chunks must be sat in
+//ques on the way.
+//chunks the receiver said it has before we started are taken as acked, never sent,
+//as are any it cancels.
+class Send_Window
+{
+public:
+	Send_Window(uint64_t chunks, const std::vector<bool> &have = {})
+		: m_have(have)
+		, m_chunks(chunks)
+	{
+		skip();
+	}
+	//next chunk to send, false if the window is full or there is none
+	bool next(uint64_t &seq)
+	{
+		if (m_flight >= (uint64_t)m_cwnd) return false;
+		while (!m_lost.empty())
+		{
+			seq = m_lost.front();
+			m_lost.pop_front();
+			if (seq >= m_base && chunk(seq).m_state == state_lost) return true;
+		}
+		skip();
+		//don't get further ahead than an ack can see
+		if (m_next == m_chunks || m_next - m_base >= FILE_CHUNK_SACK_SIZE) return false;
+		m_window.emplace_back();
+		seq = m_next++;
+		return true;
+	}
+	void sent(uint64_t seq)
+	{
+		auto &c = chunk(seq);
+		c.m_resent = c.m_state == state_lost;
+		c.m_state = state_flight;
+		c.m_order = ++m_order;
+		c.m_time = std::chrono::steady_clock::now();
+		m_in_order.emplace_back(seq, c.m_order);
+		m_flight++;
+	}
+	void ack(const File_Service::send_file_ack &ack)
+	{
+		//rtt from the chunk that sent the ack, unless it's been sent twice
+		if (ack.m_seq >= m_base && ack.m_seq < m_next)
+		{
+			auto &c = chunk(ack.m_seq);
+			if (c.m_state == state_flight && !c.m_resent) sample(std::chrono::steady_clock::now() - c.m_time);
+			acked(ack.m_seq);
+		}
+		for (auto seq = m_base; seq < std::min(ack.m_next, m_next); ++seq) acked(seq);
+		//a late ack from a swarm receiver can be for a run before this one
+		for (auto i = 0u; i < FILE_CHUNK_SACK_SIZE && ack.m_next + 1 + i < m_next; ++i)
+		{
+			if (ack.m_next + 1 + i < m_base) continue;
+			if (ack.m_sack[i / 64] & (1ULL << (i % 64))) acked(ack.m_next + 1 + i);
+		}
+		slide();
+		//chunks sent 3 or more before the latest one acked, or a quarter rtt before, are lost
+		auto reorder = std::chrono::duration<double, std::milli>(m_min_rtt / 4);
+		while (!m_in_order.empty())
+		{
+			auto [seq, order] = m_in_order.front();
+			auto live = seq >= m_base && chunk(seq).m_order == order;
+			if (live && order + 3 > m_acked_order
+				&& (order >= m_acked_order || chunk(seq).m_time + reorder >= m_acked_time)) break;
+			m_in_order.pop_front();
+			if (live && chunk(seq).m_state == state_flight) lost(seq);
+		}
+		//rate the acks are coming back at, chunks per ms, measured over an rtt
+		auto now = std::chrono::steady_clock::now();
+		std::chrono::duration<double, std::milli> elapsed = now - m_rate_time;
+		if (m_srtt && elapsed.count() >= m_srtt)
+		{
+			auto rate = (m_delivered - m_rate_delivered) / elapsed.count();
+			m_rate = m_rate ? 0.75 * m_rate + 0.25 * rate : rate;
+			m_rate_delivered = m_delivered;
+			m_rate_time = now;
+		}
+		m_backoff = 1;
+	}
+	void timeout()
+	{
+		//nothing heard for an rto, all in flight are lost, start again from a small window
+		for (auto &[seq, order] : m_in_order)
+		{
+			if (seq >= m_base && chunk(seq).m_order == order && chunk(seq).m_state == state_flight) lost(seq);
+		}
+		m_in_order.clear();
+		m_ssthresh = std::max(m_rate ? m_rate * m_min_rtt : m_cwnd / 2, min_window);
+		m_cwnd = min_window;
+		m_backoff = std::min(m_backoff * 2, 64u);
+	}
+	//chunks the receiver no longer wants from us count as acked
+	void cancel(const std::vector<bool> &chunks)
+	{
+		for (auto seq = m_base; seq < m_next; ++seq)
+		{
+			auto &c = chunk(seq);
+			if (!chunks[seq] || c.m_state == state_acked) continue;
+			if (c.m_state == state_flight) m_flight--;
+			c.m_state = state_acked;
+		}
+		m_have.resize(m_chunks);
+		for (auto seq = m_next; seq < m_chunks; ++seq) if (chunks[seq]) m_have[seq] = true;
+		skip();
+	}
+	bool done() const { return m_base == m_chunks; }
+	std::chrono::milliseconds rto() const
+	{
+		//a whole window can go out at once, so no acks come back for an rtt
+		auto rto = m_srtt ? std::max(std::max(m_srtt + 4 * m_rttvar, m_srtt * 2), 1.0) : 1000.0;
+		return std::chrono::milliseconds((uint64_t)std::min(std::ceil(rto) * m_backoff, (double)FILE_TRANSFER_TIMEOUT));
+	}
+private:
+	enum
+	{
+		state_unsent,
+		state_flight,
+		state_lost,
+		state_acked,
+	};
+	struct Chunk
+	{
+		std::chrono::steady_clock::time_point m_time;
+		uint64_t m_order = 0;
+		uint8_t m_state = state_unsent;
+		bool m_resent = false;
+	};
+	static constexpr double min_window = 2.0;
+	Chunk &chunk(uint64_t seq) { return m_window[seq - m_base]; }
+	void slide()
+	{
+		while (!m_window.empty() && m_window.front().m_state == state_acked)
+		{
+			m_window.pop_front();
+			m_base++;
+		}
+	}
+	void skip()
+	{
+		while (m_next < m_have.size() && m_have[m_next])
+		{
+			m_window.emplace_back();
+			m_window.back().m_state = state_acked;
+			m_next++;
+		}
+		slide();
+	}
+	void acked(uint64_t seq)
+	{
+		auto &c = chunk(seq);
+		if (c.m_state == state_acked) return;
+		if (c.m_state == state_flight) m_flight--;
+		c.m_state = state_acked;
+		m_delivered++;
+		if (c.m_order > m_acked_order)
+		{
+			m_acked_order = c.m_order;
+			m_acked_time = c.m_time;
+		}
+		//grow, unless our chunks are queuing
+		if (m_queuing) return;
+		if (m_cwnd < m_ssthresh || m_room) m_cwnd += 1.0;
+		else m_cwnd += 1.0 / m_cwnd;
+		m_cwnd = std::min(m_cwnd, (double)FILE_CHUNK_MAX_WINDOW_SIZE);
+	}
+	void lost(uint64_t seq)
+	{
+		chunk(seq).m_state = state_lost;
+		m_flight--;
+		m_lost.push_back(seq);
+		//cut back once per window, not for every chunk it lost, to what's getting
+		//through, or by half till we know
+		if (chunk(seq).m_order <= m_recover_order) return;
+		m_recover_order = m_order;
+		m_ssthresh = std::max(m_rate ? m_rate * m_min_rtt : m_cwnd / 2, min_window);
+		m_cwnd = std::min(m_cwnd, m_ssthresh);
+	}
+	void sample(std::chrono::duration<double, std::milli> rtt)
+	{
+		if (!m_srtt)
+		{
+			m_srtt = m_min_rtt = rtt.count();
+			m_rttvar = m_srtt / 2;
+		}
+		else
+		{
+			m_rttvar = 0.75 * m_rttvar + 0.25 * std::abs(m_srtt - rtt.count());
+			m_srtt = 0.875 * m_srtt + 0.125 * rtt.count();
+			m_min_rtt = std::min(m_min_rtt, rtt.count());
+		}
+		//chunks sat in ques, rather than on the wire, give back a chunk per rtt
+		auto queued = m_cwnd * (1.0 - m_min_rtt / m_srtt);
+		m_room = queued < FILE_CHUNK_WINDOW_SIZE / 4;
+		m_queuing = queued > FILE_CHUNK_WINDOW_SIZE;
+		if (!m_queuing) return;
+		m_cwnd = std::max(m_cwnd - 1.0 / m_cwnd, min_window);
+		m_ssthresh = std::min(m_ssthresh, m_cwnd);
+	}
+	//chunks from m_base to m_next, and the in flight ones in the order they went
+	std::deque<Chunk> m_window;
+	std::vector<bool> m_have;
+	std::deque<std::pair<uint64_t, uint64_t>> m_in_order;
+	std::deque<uint64_t> m_lost;
+	uint64_t m_chunks;
+	uint64_t m_base = 0;
+	uint64_t m_next = 0;
+	uint64_t m_flight = 0;
+	uint64_t m_order = 0;
+	uint64_t m_acked_order = 0;
+	uint64_t m_recover_order = 0;
+	uint64_t m_delivered = 0;
+	uint64_t m_rate_delivered = 0;
+	std::chrono::steady_clock::time_point m_acked_time;
+	std::chrono::steady_clock::time_point m_rate_time = std::chrono::steady_clock::now();
+	double m_cwnd = FILE_CHUNK_WINDOW_SIZE;
+	double m_ssthresh = FILE_CHUNK_MAX_WINDOW_SIZE;
+	double m_srtt = 0;
+	double m_rttvar = 0;
+	double m_min_rtt = 0;
+	double m_rate = 0;
+	uint32_t m_backoff = 1;
+	bool m_room = false;
+	bool m_queuing = false;
+};
+
+//chunks of the blocks set in a have
+std::vector<bool> have_chunks(const File_Service::send_file_have &have, uint64_t blocks, uint64_t chunks)
+{
+	auto out = std::vector<bool>(chunks);
+	for (auto block = uint64_t(0); block < std::min(have.m_blocks, blocks); ++block)
+	{
+		if (!(have.m_have[block / 64] & (1ULL << (block % 64)))) continue;
+		auto last = std::min((block + 1) * FILE_BLOCK_CHUNKS, chunks);
+		for (auto seq = block * FILE_BLOCK_CHUNKS; seq < last; ++seq) out[seq] = true;
+	}
+	return out;
+}
+
+/////////////////
+// receive window
+/////////////////
+
+//chunks of a file being received, from one source or a swarm of them.
+//each source is given a run of whole blocks to send and is acked against it, so its
+//acks say what has come of what it was asked for. a swarm source gets its next run
+//queued once it's half way through this one, so the faster ones end up sending more.
+//when there are no runs left, one that's run dry takes over what another has queued,
+//or the back half of what it has still to send, or all of it if it has stopped.
+class Receive_Window
+{
+public:
+	struct Run
+	{
+		uint64_t m_lo = 0;
+		uint64_t m_hi = 0;
+	};
+	struct Source
+	{
+		Net_ID m_ack;
+		Run m_run;
+		Run m_queued;
+		//first chunk of the run not arrived
+		uint64_t m_next = 0;
+		uint32_t m_unacked = 0;
+		//blocks not to send, as of the last run given it
+		std::vector<uint64_t> m_have;
+		uint64_t m_seq = 0;
+		bool m_more = false;
+		std::chrono::steady_clock::time_point m_heard = std::chrono::steady_clock::now();
+	};
+	Receive_Window(uint64_t total, uint64_t chunk_length, const std::vector<bool> &have = {})
+		: m_total(total)
+		, m_chunk_length(chunk_length)
+		, m_chunks((total + chunk_length - 1) / chunk_length)
+		, m_blocks((m_chunks + FILE_BLOCK_CHUNKS - 1) / FILE_BLOCK_CHUNKS)
+		, m_arrived((m_chunks + 63) / 64)
+	{
+		for (auto block = uint64_t(0); block < have.size(); ++block)
+		{
+			if (!have[block]) continue;
+			auto last = std::min((block + 1) * FILE_BLOCK_CHUNKS, m_chunks);
+			for (auto seq = block * FILE_BLOCK_CHUNKS; seq < last; ++seq) arrive(seq);
+		}
+	}
+	uint64_t chunks() const { return m_chunks; }
+	uint64_t amount() const { return m_amount; }
+	bool complete() const { return m_amount == m_total; }
+	const std::vector<uint64_t> &arrived() const { return m_arrived; }
+	//note a chunk, false if we had it
+	bool arrive(uint64_t seq)
+	{
+		if (arrived(seq)) return false;
+		m_arrived[seq / 64] |= 1ULL << (seq % 64);
+		m_amount += std::min(m_chunk_length, m_total - seq * m_chunk_length);
+		return true;
+	}
+	std::deque<Source> &sources() { return m_sources; }
+	Source *find(const Net_ID &ack)
+	{
+		auto itr = std::find_if(begin(m_sources), end(m_sources), [&] (auto &source) { return source.m_ack == ack; });
+		return itr == end(m_sources) ? nullptr : &*itr;
+	}
+	Source &add(const Net_ID &ack, bool swarm)
+	{
+		auto &source = m_sources.emplace_back();
+		source.m_ack = ack;
+		source.m_more = swarm;
+		return source;
+	}
+	//the whole file from the one source, now, or once it has our have
+	void whole(Source &source) { source.m_run = Run{0, m_chunks}; }
+	void give_whole(Source &source) { give(source, Run{0, m_chunks}); }
+	//nothing more to send, or never was
+	void release(Source &source)
+	{
+		source.m_have.assign((m_blocks + 63) / 64, ~0ULL);
+		source.m_more = false;
+		source.m_seq++;
+	}
+	//a chunk from a source, it has started on its queued run if it's from that
+	void from(Source &source, uint64_t seq)
+	{
+		source.m_heard = std::chrono::steady_clock::now();
+		if (seq < source.m_queued.m_lo || seq >= source.m_queued.m_hi) return;
+		source.m_run = source.m_queued;
+		source.m_queued = {};
+		source.m_next = source.m_run.m_lo;
+	}
+	bool in_order(Source &source, uint64_t seq)
+	{
+		advance(source);
+		return seq == source.m_next;
+	}
+	bool run_done(Source &source)
+	{
+		advance(source);
+		return source.m_next == source.m_run.m_hi;
+	}
+	//what has come of the source's run, and which chunks after that
+	void ack(Source &source, File_Service::send_file_ack &ack)
+	{
+		advance(source);
+		ack.m_next = source.m_next;
+		for (auto i = 0u; i < FILE_CHUNK_SACK_SIZE / 64; ++i) ack.m_sack[i] = bits(source.m_next + 1 + i * 64);
+	}
+	//queue the next run with a swarm source that's half way through its run, false if
+	//it isn't or there's nothing for it. a run taken from another is to be cancelled there.
+	bool assign(Source &source, Source *&victim, std::vector<uint64_t> &cancel)
+	{
+		victim = nullptr;
+		if (!source.m_more || source.m_queued.m_hi > source.m_queued.m_lo) return false;
+		advance(source);
+		auto &run = source.m_run;
+		if ((source.m_next - run.m_lo) * 2 < run.m_hi - run.m_lo) return false;
+		//runs are whole blocks, skip any we have all of
+		while (m_cursor < m_blocks && block_done(m_cursor)) m_cursor++;
+		if (m_cursor < m_blocks)
+		{
+			auto last = std::min(m_cursor + FILE_SWARM_RUN_BLOCKS, m_blocks);
+			give(source, Run{m_cursor * FILE_BLOCK_CHUNKS, std::min(last * FILE_BLOCK_CHUNKS, m_chunks)});
+			m_cursor = last;
+			return true;
+		}
+		//none left, help the one with the most still to send once we're done
+		if (source.m_next < run.m_hi) return false;
+		auto most = uint64_t(0);
+		for (auto &other : m_sources)
+		{
+			//one that's done with its run is about to start on what it has queued
+			advance(other);
+			if (&other == &source || other.m_next >= other.m_run.m_hi) continue;
+			auto left = other.m_run.m_hi - other.m_next + other.m_queued.m_hi - other.m_queued.m_lo;
+			if (left <= most) continue;
+			most = left;
+			victim = &other;
+		}
+		if (!victim) return false;
+		auto take = Run{};
+		if (victim->m_queued.m_hi > victim->m_queued.m_lo)
+		{
+			take = victim->m_queued;
+			victim->m_queued = {};
+		}
+		else
+		{
+			auto lo = victim->m_next / FILE_BLOCK_CHUNKS;
+			auto hi = (victim->m_run.m_hi + FILE_BLOCK_CHUNKS - 1) / FILE_BLOCK_CHUNKS;
+			auto stalled = std::chrono::steady_clock::now() - victim->m_heard >= std::chrono::milliseconds(FILE_SWARM_STALL_TIMEOUT);
+			if (stalled) take = Run{lo * FILE_BLOCK_CHUNKS, victim->m_run.m_hi};
+			else if (hi - lo >= 2) take = Run{(lo + (hi - lo) / 2) * FILE_BLOCK_CHUNKS, victim->m_run.m_hi};
+			else
+			{
+				victim = nullptr;
+				return false;
+			}
+			victim->m_run.m_hi = std::max(take.m_lo, victim->m_next);
+		}
+		cancel.assign((m_blocks + 63) / 64, 0);
+		for (auto block = take.m_lo / FILE_BLOCK_CHUNKS; block * FILE_BLOCK_CHUNKS < take.m_hi; ++block)
+		{
+			cancel[block / 64] |= 1ULL << (block % 64);
+		}
+		for (auto i = 0u; i < cancel.size(); ++i) victim->m_have[i] |= cancel[i];
+		give(source, take);
+		return true;
+	}
+private:
+	bool arrived(uint64_t seq) const { return m_arrived[seq / 64] & (1ULL << (seq % 64)); }
+	//the 64 arrived bits from pos on
+	uint64_t bits(uint64_t pos) const
+	{
+		if (pos >= m_chunks) return 0;
+		auto word = pos / 64, shift = pos % 64;
+		auto value = m_arrived[word] >> shift;
+		if (shift && word + 1 < m_arrived.size()) value |= m_arrived[word + 1] << (64 - shift);
+		return value;
+	}
+	bool block_done(uint64_t block) const
+	{
+		auto first = block * FILE_BLOCK_CHUNKS;
+		auto count = std::min((uint64_t)FILE_BLOCK_CHUNKS, m_chunks - first);
+		auto mask = count == 64 ? ~0ULL : (1ULL << count) - 1;
+		return (bits(first) & mask) == mask;
+	}
+	void advance(Source &source)
+	{
+		while (source.m_next < source.m_run.m_hi && arrived(source.m_next)) source.m_next++;
+	}
+	void give(Source &source, const Run &run)
+	{
+		//not to send, everything but the blocks of the run we don't have all of
+		source.m_queued = run;
+		source.m_have.assign((m_blocks + 63) / 64, 0);
+		for (auto block = uint64_t(0); block < m_blocks; ++block)
+		{
+			auto in_run = block * FILE_BLOCK_CHUNKS >= run.m_lo && block * FILE_BLOCK_CHUNKS < run.m_hi;
+			if (!in_run || block_done(block)) source.m_have[block / 64] |= 1ULL << (block % 64);
+		}
+		source.m_seq++;
+	}
+	std::deque<Source> m_sources;
+	uint64_t m_total;
+	uint64_t m_chunk_length;
+	uint64_t m_chunks;
+	uint64_t m_blocks;
+	std::vector<uint64_t> m_arrived;
+	uint64_t m_amount = 0;
+	uint64_t m_cursor = 0;
+};
+
+//////////
+// sending
+//////////
+
+//a file being sent out of a mapping, as many chunks as the window lets us have in
+//flight, when the engine asks for them.
+//a receiver that has an old copy, or some of this one, or is pulling from more than
+//us, is sent the block hashes first, worked out off the engine, till it says which
+//blocks not to send. a swarm receiver sends our next run before we're done with
+//this one.
+class File_Service::Send_Job : public Transfer_Engine::Job
+{
+public:
+	Send_Job(File_Service &service, const std::shared_ptr<Msg> &msg)
+		: Job(service.m_router)
+		, m_service(service)
+	{
+		auto event = (Event_send_file*)msg->begin();
+		m_reply = event->m_reply;
+		m_manifest = event->m_manifest != 0;
+		//prepend the path prefix ?
+		m_filename = std::string((char*)event + sizeof(Event_send_file), msg->end());
+		if (m_filename.find('/') == std::string::npos) m_filename = service.in_file_path() + m_filename;
+		//chunks are sent straight out of the mapping, no read into a msg
+		m_map = std::make_shared<File_Map>(m_filename);
+		m_total = m_map->size();
+		m_chunks = (m_total + m_length - 1) / m_length;
+		//small files go ahead of the rest, big ones after
+		m_peer = m_reply.m_device_id;
+		m_prio = m_total <= FILE_SMALL_SIZE ? Transfer_Engine::prio_high
+			: m_total >= FILE_LARGE_SIZE ? Transfer_Engine::prio_low
+			: Transfer_Engine::prio_normal;
+	}
+	bool run() override
+	{
+		auto now = std::chrono::steady_clock::now();
+		if (m_state == state_start)
+		{
+			//we will time how long things take
+			m_start = std::chrono::high_resolution_clock::now();
+			m_heard = now;
+			if (!m_total) return nofile();
+			if (!m_manifest)
+			{
+				m_window = Send_Window(m_chunks);
+				m_state = state_send;
+				return next(now);
+			}
+			m_state = state_hash;
+			Executor::global().post([this]
+			{
+				auto block_length = m_length * FILE_BLOCK_CHUNKS;
+				for (auto offset = uint64_t(0); offset < m_total; offset += block_length)
+				{
+					auto block_len = (uint32_t)std::min(block_length, m_total - offset);
+					m_hashes.push_back(hash_block(m_map->chunk(offset, block_len)->begin(), block_len));
+				}
+				wake(m_hashed);
+			});
+			m_wake = now + m_service.keepalive();
+			return true;
+		}
+		if (m_state == state_hash)
+		{
+			if (!m_hashed.load(std::memory_order_acquire))
+			{
+				if (now >= m_wake) busy(now);
+				return true;
+			}
+			m_state = state_manifest;
+			m_heard = now;
+			send_manifest(now);
+			return true;
+		}
+		if (m_state == state_manifest)
+		{
+			//the manifest goes again, less often each time, till the have comes back,
+			//word that it's still scanning means it got there
+			auto have_msg = m_mbox->poll();
+			while (have_msg && ((send_file_have*)have_msg->begin())->m_type == type_busy)
+			{
+				m_heard = now;
+				m_wake = now + m_wait;
+				have_msg = m_mbox->poll();
+			}
+			if (!have_msg)
+			{
+				if (now < m_wake) return true;
+				if (now - m_heard >= m_service.timeout()) return error();
+				m_wait *= 2;
+				send_manifest(now);
+				return true;
+			}
+			m_heard = now;
+			auto have_body = (send_file_have*)have_msg->begin();
+			m_blocks = m_hashes.size();
+			m_window = Send_Window(m_chunks, have_chunks(*have_body, m_blocks, m_chunks));
+			m_have_seq = have_body->m_seq;
+			m_more = have_body->m_more;
+			m_state = state_send;
+			while (auto msg = m_mbox->poll()) take(msg);
+			return next(now);
+		}
+		//take the acks, if there are none it's been an rto since we heard
+		auto heard = false;
+		while (auto msg = m_mbox->poll())
+		{
+			take(msg);
+			heard = true;
+		}
+		if (heard) m_heard = now;
+		else if (now < m_wake) return true;
+		else if (!m_window.done())
+		{
+			if (now - m_heard >= m_service.timeout()) return error();
+			m_window.timeout();
+		}
+		//gone quiet while we waited to be given more, it's done with us
+		else if (!m_next_run) return finish();
+		return next(now);
+	}
+	uint32_t send() override
+	{
+		auto seq = uint64_t(0);
+		if (!m_window.next(seq)) return 0;
+		//header
+		auto offset = seq * m_length;
+		auto chunk_length = std::min(m_length, m_total - offset);
+		auto chunk_msg = std::make_shared<Msg>(sizeof(send_file_chunk));
+		chunk_msg->set_dest(m_reply);
+		auto reply_body = (send_file_chunk*)chunk_msg->begin();
+		reply_body->m_ack = m_id;
+		reply_body->m_type = type_chunk;
+		reply_body->m_seq = seq;
+		reply_body->m_total = m_total;
+		reply_body->m_length = chunk_length;
+		reply_body->m_offset = offset;
+		//body
+		chunk_msg->append(Msg(m_map->chunk(offset, chunk_length)));
+		m_window.sent(seq);
+		m_router.send(chunk_msg);
+		m_wake = std::chrono::steady_clock::now() + m_window.rto();
+		return (uint32_t)(sizeof(send_file_chunk) + chunk_length);
+	}
+private:
+	enum
+	{
+		state_start,
+		state_hash,
+		state_manifest,
+		state_send,
+	};
+	//still hashing, let the receiver know we're here
+	void busy(Transfer_Engine::Time now)
+	{
+		auto msg = std::make_shared<Msg>(sizeof(send_file_chunk));
+		msg->set_dest(m_reply);
+		auto busy_body = (send_file_chunk*)msg->begin();
+		busy_body->m_ack = m_id;
+		busy_body->m_type = type_busy;
+		busy_body->m_total = m_total;
+		m_router.send(msg);
+		m_wake = now + m_service.keepalive();
+	}
+	void send_manifest(Transfer_Engine::Time now)
+	{
+		auto manifest_msg = std::make_shared<Msg>(sizeof(send_file_manifest));
+		manifest_msg->set_dest(m_reply);
+		auto manifest = (send_file_manifest*)manifest_msg->begin();
+		manifest->m_ack = m_id;
+		manifest->m_type = type_manifest;
+		manifest->m_src = m_service.m_net_id;
+		manifest->m_total = m_total;
+		manifest->m_chunk_length = m_length;
+		manifest->m_block_length = m_length * FILE_BLOCK_CHUNKS;
+		manifest->m_blocks = m_hashes.size();
+		manifest_msg->append((const char*)m_hashes.data(), (uint32_t)(m_hashes.size() * sizeof(block_hash)));
+		m_router.send(manifest_msg);
+		m_wake = now + m_wait;
+	}
+	void take(const std::shared_ptr<Msg> &msg)
+	{
+		auto ack_body = (send_file_ack*)msg->begin();
+		if (ack_body->m_type == type_ack) return m_window.ack(*ack_body);
+		if (ack_body->m_type == type_busy) return;
+		//haves repeated for manifests sent twice are of no more use
+		auto have_body = (send_file_have*)msg->begin();
+		if (have_body->m_seq < m_have_seq) return;
+		if (have_body->m_type == type_cancel)
+		{
+			m_window.cancel(have_chunks(*have_body, m_blocks, m_chunks));
+			if (!m_next_run) return;
+			auto next_body = (send_file_have*)m_next_run->begin();
+			for (auto i = 0u; i < (m_blocks + 63) / 64; ++i) next_body->m_have[i] |= have_body->m_have[i];
+			return;
+		}
+		if (have_body->m_seq == m_have_seq) return;
+		m_have_seq = have_body->m_seq;
+		m_next_run = msg;
+		//the last one says it's done with us
+		if (!have_body->m_more) m_window.cancel(have_chunks(*have_body, m_blocks, m_chunks));
+	}
+	bool next(Transfer_Engine::Time now)
+	{
+		//on to the next run once this one's done, or wait to be given one
+		while (m_window.done())
+		{
+			if (!m_next_run)
+			{
+				if (!m_more) return finish();
+				m_ready = false;
+				m_wake = m_heard + m_service.timeout();
+				return true;
+			}
+			auto have_body = (send_file_have*)m_next_run->begin();
+			m_window = Send_Window(m_chunks, have_chunks(*have_body, m_blocks, m_chunks));
+			m_more = have_body->m_more;
+			m_next_run.reset();
+		}
+		m_ready = true;
+		m_wake = now + m_window.rto();
+		return true;
+	}
+	bool nofile()
+	{
+		//no such file or empty file, so reply with 0 total manifest or msg
+		if (m_manifest)
+		{
+			auto manifest_msg = std::make_shared<Msg>(sizeof(send_file_manifest));
+			manifest_msg->set_dest(m_reply);
+			auto manifest = (send_file_manifest*)manifest_msg->begin();
+			manifest->m_type = type_manifest;
+			manifest->m_src = m_service.m_net_id;
+			manifest->m_total = 0;
+			m_router.send(manifest_msg);
+		}
+		else
+		{
+			auto chunk_msg = std::make_shared<Msg>(sizeof(send_file_chunk));
+			chunk_msg->set_dest(m_reply);
+			auto reply_body = (send_file_chunk*)chunk_msg->begin();
+			reply_body->m_type = type_chunk;
+			reply_body->m_total = 0;
+			m_router.send(chunk_msg);
+		}
+		return finish();
+	}
+	bool finish()
+	{
+		//log how long that took, the map goes with the last chunk
+		auto finish = std::chrono::high_resolution_clock::now();
+		std::chrono::duration<double, std::milli> elapsed = finish - m_start;
+		auto log = std::ostringstream();
+		log << "Sent File: " << m_filename << std::endl << "Time: " << elapsed.count()/1000.0 << " seconds";
+		m_service.out_log(log.str());
+		return false;
+	}
+	bool error()
+	{
+		auto log = std::ostringstream();
+		log << "Send File Error: " << m_filename;
+		m_service.out_log(log.str());
+		return false;
+	}
+	File_Service &m_service;
+	Net_ID m_reply;
+	bool m_manifest;
+	std::string m_filename;
+	std::shared_ptr<File_Map> m_map;
+	uint64_t m_total;
+	const uint64_t m_length = MAX_PACKET_SIZE - sizeof(send_file_chunk);
+	uint64_t m_chunks;
+	uint64_t m_blocks = 0;
+	std::vector<block_hash> m_hashes;
+	std::atomic<bool> m_hashed {false};
+	Send_Window m_window {0};
+	std::shared_ptr<Msg> m_next_run;
+	uint64_t m_have_seq = 0;
+	bool m_more = false;
+	uint32_t m_state = state_start;
+	std::chrono::milliseconds m_wait {1000};
+	Transfer_Engine::Time m_heard;
+	std::chrono::high_resolution_clock::time_point m_start;
+};
+
+////////////
+// receiving
+////////////
+
+//a file being received, from one source or a swarm of them, into a File_Writer.
+//the request goes to the source, and in a swarm to the other file services as well.
+//the manifest from the source we were asked to use has the checkpoint, and any old
+//copy, looked through for its blocks off the engine before the have goes back.
+class File_Service::Receive_Job : public Transfer_Engine::Job
+{
+public:
+	Receive_Job(File_Service &service, const std::shared_ptr<Msg> &msg)
+		: Job(service.m_router)
+		, m_service(service)
+	{
+		auto event = (Event_transfer_file*)msg->begin();
+		m_src = event->m_src;
+		m_origin = event->m_origin;
+		m_swarm = event->m_swarm != 0;
+		m_files = split_string(std::string((char*)event + sizeof(Event_transfer_file), msg->end()), "\n");
+		if (m_files[0].find('/') == std::string::npos) m_files[0] = service.in_file_path() + m_files[0];
+	}
+	bool run() override
+	{
+		auto now = std::chrono::steady_clock::now();
+		if (m_state == state_start)
+		{
+			request();
+			m_state = state_receive;
+			m_heard = now;
+			m_wake = now + read_timeout();
+			return true;
+		}
+		if (m_state == state_scan)
+		{
+			if (!m_scanned.load(std::memory_order_acquire))
+			{
+				if (now >= m_wake) busy(now);
+				return true;
+			}
+			if (!scanned()) return error();
+			m_state = state_receive;
+			m_heard = now;
+			m_wake = now + read_timeout();
+			if (m_window->complete()) return complete();
+		}
+		//take the chunks, mail after the manifest we scan for waits till that's done
+		auto heard = false;
+		while (m_state == state_receive)
+		{
+			auto msg = m_mbox->poll();
+			if (!msg) break;
+			heard = true;
+			if (!take(msg)) return false;
+			if (m_window && m_window->complete()) return complete();
+		}
+		if (m_state == state_scan) return true;
+		//the origin hears from us now and then, not just every 10%
+		if (now - m_reported >= m_service.keepalive()) report(m_progress);
+		if (heard) m_heard = now;
+		else if (now < m_wake) return true;
+		else
+		{
+			//a swarm looks round its sources now and then as well
+			if (now - m_heard >= m_service.timeout()) return error();
+			if (m_window) for (auto &source : m_window->sources()) assign(source);
+		}
+		m_wake = now + read_timeout();
+		return true;
+	}
+private:
+	enum
+	{
+		state_start,
+		state_receive,
+		state_scan,
+	};
+	std::chrono::milliseconds read_timeout() const
+	{
+		return m_swarm ? std::chrono::milliseconds(FILE_SWARM_STALL_TIMEOUT / 4) : m_service.timeout();
+	}
+	void request()
+	{
+		//an old copy, or part of this one from a try that didn't finish, is
+		//worth asking for a manifest for, and a swarm needs them to tell which
+		//sources have the same file
+		m_basis = std::make_shared<File_Map>(m_files[0]);
+		auto want_manifest = m_swarm || m_basis->size() || std::ifstream(File_Writer::checkpoint_name(m_files[0])).is_open();
+		//send off the file request, in a swarm to the other file services as well
+		auto sources = std::vector<Net_ID>{m_src};
+		if (m_swarm)
+		{
+			for (auto &entry : m_router.enquire("file_service,"))
+			{
+				if (sources.size() == FILE_SWARM_MAX_SOURCES) break;
+				auto id = Net_ID::from_string(split_string(entry, ",")[1]);
+				if (id != m_src && id != m_service.m_net_id) sources.push_back(id);
+			}
+		}
+		for (auto &src : sources)
+		{
+			auto msg = std::make_shared<Msg>(sizeof(Event_send_file));
+			msg->set_dest(src);
+			auto event_body = (Event_send_file*)msg->begin();
+			event_body->m_evt = evt_send_file;
+			event_body->m_reply = m_id;
+			event_body->m_manifest = want_manifest;
+			msg->append(m_files[1]);
+			m_router.send(msg);
+		}
+	}
+	//false if the job is over, for good or bad
+	bool take(std::shared_ptr<Msg> &chunk_msg)
+	{
+		//header, chunks from a local sender are a header segment and the data
+		auto seg = chunk_msg->seg_begin();
+		auto chunk_body = (send_file_chunk*)(seg->m_length >= sizeof(send_file_chunk) ? seg->begin() : chunk_msg->begin());
+		//the sender is still hashing
+		if (chunk_body->m_type == type_busy) return true;
+		if (chunk_body->m_type == type_manifest)
+		{
+			auto manifest = (send_file_manifest*)chunk_msg->begin();
+			if (m_window)
+			{
+				join(manifest);
+				return true;
+			}
+			if (manifest->m_src != m_src)
+			{
+				m_early.push_back(chunk_msg);
+				return true;
+			}
+			//no such file
+			if (!manifest->m_total) return false;
+			m_total = manifest->m_total;
+			m_chunk_length = manifest->m_chunk_length;
+			m_block_length = manifest->m_block_length;
+			m_hashes.assign(manifest->m_hashes, manifest->m_hashes + manifest->m_blocks);
+			m_primary = manifest->m_ack;
+			//look for its blocks off the engine, nothing more can go till then
+			m_state = state_scan;
+			m_wake = std::chrono::steady_clock::now() + m_service.keepalive();
+			Executor::global().post([this]
+			{
+				scan();
+				wake(m_scanned);
+			});
+			return true;
+		}
+		//no such file
+		if (chunk_body->m_total == 0) return false;
+		//first time we know the total size we open the file for writing the chunks
+		if (!m_window)
+		{
+			m_total = chunk_body->m_total;
+			m_file = std::make_unique<File_Writer>(m_files[0], m_total);
+			if (!m_file->is_open()) return error();
+			m_window = std::make_unique<Receive_Window>(m_total, m_chunk_length);
+			m_window->whole(m_window->add(chunk_body->m_ack, false));
+		}
+		auto source = m_window->find(chunk_body->m_ack);
+		auto seq = chunk_body->m_seq;
+		if (!source || seq >= m_window->chunks()) return true;
+		//where a chunk goes comes from its seq, not what the sender says, and it
+		//must hold just that chunk, else it's dropped as if it never came
+		auto offset = seq * m_chunk_length;
+		if (chunk_msg->size() != sizeof(send_file_chunk) + std::min(m_chunk_length, m_total - offset)) return true;
+		//write this chunks data into the file, unless we have it already
+		m_window->from(*source, seq);
+		auto in_order = m_window->in_order(*source, seq);
+		auto fresh = m_window->arrive(seq);
+		if (fresh)
+		{
+			m_file->write(offset, *chunk_msg, sizeof(send_file_chunk));
+			//note what's in the temp now and then, so a crash doesn't lose it all
+			if (++m_fresh_chunks % FILE_CHECKPOINT_CHUNKS == 0) m_file->checkpoint(m_window->arrived(), m_chunk_length);
+		}
+		//ack every other chunk, or at once if it's out of order or a repeat,
+		//or if there are no more chunks waiting to be read
+		if (!fresh || !in_order || ++source->m_unacked >= 2 || m_mbox->empty() || m_window->run_done(*source))
+		{
+			source->m_unacked = 0;
+			auto ack = std::make_shared<Msg>(sizeof(send_file_ack));
+			ack->set_dest(chunk_body->m_ack);
+			auto ack_body = (send_file_ack*)ack->begin();
+			ack_body->m_type = type_ack;
+			ack_body->m_seq = seq;
+			m_window->ack(*source, *ack_body);
+			m_router.send(ack);
+		}
+		if (m_swarm) assign(*source);
+		//send a progress report to origin every 10%
+		auto new_progress = (int32_t)(m_window->amount() * 100 / m_total);
+		if (new_progress - m_progress >= 10) report(m_progress = new_progress);
+		return true;
+	}
+	void report(int32_t progress)
+	{
+		auto msg = std::make_shared<Msg>(sizeof(transfer_file_progress));
+		msg->set_dest(m_origin);
+		auto ack_struct = (transfer_file_progress*)msg->begin();
+		ack_struct->m_progress = progress;
+		m_router.send(msg);
+		m_reported = std::chrono::steady_clock::now();
+	}
+	//still scanning, let the sender and the origin know we're here
+	void busy(Transfer_Engine::Time now)
+	{
+		auto msg = std::make_shared<Msg>(sizeof(send_file_have));
+		msg->set_dest(m_primary);
+		auto busy_body = (send_file_have*)msg->begin();
+		busy_body->m_type = type_busy;
+		m_router.send(msg);
+		report(m_progress);
+		m_wake = now + m_service.keepalive();
+	}
+	//off the engine, the blocks we have, and the writer
+	void scan()
+	{
+		m_have.assign(m_hashes.size(), false);
+		//blocks a checkpoint says made it into the temp last time, that
+		//still hash right, stay where they are
+		auto resumed = File_Writer::checkpoint(m_files[0], m_total, m_chunk_length);
+		auto resume = false;
+		if (!resumed.empty())
+		{
+			auto part = std::make_shared<File_Map>(m_files[0] + ".part");
+			auto chunks = (m_total + m_chunk_length - 1) / m_chunk_length;
+			for (auto block = uint64_t(0); part->size() == m_total && block < m_hashes.size(); ++block)
+			{
+				auto last = std::min((block + 1) * FILE_BLOCK_CHUNKS, chunks);
+				auto all = true;
+				for (auto seq = block * FILE_BLOCK_CHUNKS; all && seq < last; ++seq) all = resumed[seq / 64] & (1ULL << (seq % 64));
+				if (!all) continue;
+				auto data = part->chunk(block * m_block_length, m_hashes[block].m_length);
+				m_have[block] = same_block(hash_block(data->begin(), m_hashes[block].m_length), m_hashes[block]);
+				resume |= m_have[block];
+			}
+		}
+		m_file = std::make_unique<File_Writer>(m_files[0], m_total, resume);
+		if (!m_file->is_open()) return;
+		//then any others that are in the old copy, wherever they are in it
+		if (m_basis->size())
+		{
+			auto data = m_basis->chunk(0, m_basis->size());
+			find_blocks(data->begin(), m_basis->size(), m_hashes, m_block_length, m_have, *m_file);
+		}
+		m_basis.reset();
+	}
+	bool scanned()
+	{
+		if (!m_file->is_open()) return false;
+		//tell the sender, it sends the manifest again if this gets lost
+		m_window = std::make_unique<Receive_Window>(m_total, m_chunk_length, m_have);
+		auto &source = m_window->add(m_primary, m_swarm);
+		if (m_swarm) assign(source);
+		else
+		{
+			m_window->give_whole(source);
+			send_have(source, type_have, source.m_have);
+		}
+		for (auto &msg : m_early) join((send_file_manifest*)msg->begin());
+		m_early.clear();
+		return true;
+	}
+	void send_have(Receive_Window::Source &source, uint64_t type, const std::vector<uint64_t> &blocks)
+	{
+		auto have_msg = std::make_shared<Msg>(sizeof(send_file_have));
+		have_msg->set_dest(source.m_ack);
+		auto have_body = (send_file_have*)have_msg->begin();
+		have_body->m_type = type;
+		have_body->m_seq = source.m_seq;
+		have_body->m_more = source.m_more;
+		have_body->m_blocks = m_hashes.size();
+		have_msg->append((const char*)blocks.data(), (uint32_t)(blocks.size() * sizeof(uint64_t)));
+		m_router.send(have_msg);
+	}
+	//give a swarm source its next run if it's ready for one
+	void assign(Receive_Window::Source &source)
+	{
+		auto victim = (Receive_Window::Source*)nullptr;
+		auto cancel = std::vector<uint64_t>{};
+		if (!m_window->assign(source, victim, cancel)) return;
+		send_have(source, type_have, source.m_have);
+		if (victim) send_have(*victim, type_cancel, cancel);
+	}
+	//a manifest from one of the others, it joins the swarm if it's the same file
+	void join(send_file_manifest *manifest)
+	{
+		//one we know sends it again if our have went missing
+		if (auto source = m_window->find(manifest->m_ack)) return send_have(*source, type_have, source->m_have);
+		if (!manifest->m_total) return;
+		auto &source = m_window->add(manifest->m_ack, true);
+		if (manifest->m_total == m_total && manifest->m_chunk_length == m_chunk_length
+			&& manifest->m_blocks == m_hashes.size()
+			&& !memcmp(manifest->m_hashes, m_hashes.data(), m_hashes.size() * sizeof(block_hash))) return assign(source);
+		m_window->release(source);
+		send_have(source, type_have, source.m_have);
+	}
+	bool complete()
+	{
+		//swap it in for the destination
+		if (!m_file->commit())
+		{
+			m_file.reset();
+			return error();
+		}
+		//let the swarm go
+		for (auto &source : m_window->sources())
+		{
+			if (!source.m_more) continue;
+			m_window->release(source);
+			send_have(source, type_have, source.m_have);
+		}
+		//and let the origin know it's done
+		report(-1);
+		return false;
+	}
+	bool error()
+	{
+		//keep what we have for the next try
+		if (m_file && m_window) m_file->checkpoint(m_window->arrived(), m_chunk_length);
+		auto log = std::ostringstream();
+		log << "Transfer File Error: " << m_files[0] << " <- " << m_files[1];
+		m_service.out_log(log.str());
+		return false;
+	}
+	File_Service &m_service;
+	Net_ID m_src;
+	Net_ID m_origin;
+	bool m_swarm;
+	std::vector<std::string> m_files;
+	std::shared_ptr<File_Map> m_basis;
+	std::unique_ptr<File_Writer> m_file;
+	std::unique_ptr<Receive_Window> m_window;
+	uint64_t m_chunk_length = MAX_PACKET_SIZE - sizeof(send_file_chunk);
+	uint64_t m_block_length = 0;
+	uint64_t m_total = 0;
+	uint32_t m_fresh_chunks = 0;
+	int32_t m_progress = 0;
+	//the manifest of the source we were asked to use, the blocks of it we have, and
+	//any manifests from others that turned up before it
+	std::vector<block_hash> m_hashes;
+	std::vector<bool> m_have;
+	Net_ID m_primary;
+	std::vector<std::shared_ptr<Msg>> m_early;
+	std::atomic<bool> m_scanned {false};
+	uint32_t m_state = state_start;
+	Transfer_Engine::Time m_heard;
+	Transfer_Engine::Time m_reported;
+};
+
+//////////
+// origins
+//////////
+
+//a transfer we asked for, between any two file services, the progress reports
+//come back here
+class File_Service::Origin_Job : public Transfer_Engine::Job
+{
+public:
+	Origin_Job(File_Service &service, const Net_ID &dst_id, const Net_ID &src_id, const std::string &dst_name, const std::string &src_name, int32_t ctx, bool swarm)
+		: Job(service.m_router)
+		, m_service(service)
+		, m_dst_id(dst_id)
+		, m_src_id(src_id)
+		, m_dst_name(dst_name)
+		, m_src_name(src_name)
+		, m_ctx(ctx)
+		, m_swarm(swarm)
+	{}
+	bool run() override
+	{
+		auto now = std::chrono::steady_clock::now();
+		if (!m_started)
+		{
+			//send off the transfer request
+			m_started = true;
+			auto msg = std::make_shared<Msg>(sizeof(Event_transfer_file));
+			msg->set_dest(m_dst_id);
+			auto event_body = (Event_transfer_file*)msg->begin();
+			event_body->m_evt = evt_transfer_file;
+			event_body->m_src = m_src_id;
+			event_body->m_origin = m_id;
+			event_body->m_ctx = m_ctx;
+			event_body->m_swarm = m_swarm;
+			msg->append(m_dst_name)->append("\n")->append(m_src_name);
+			m_router.send(msg);
+			m_wake = now + m_service.timeout();
+			return true;
+		}
+		//read progress reports
+		while (auto prog_msg = m_mbox->poll())
+		{
+			auto prog_body = (transfer_file_progress*)prog_msg->begin();
+			if (prog_body->m_progress == -1)
+			{
+				//all has finished
+				auto log = std::ostringstream();
+				log << "File Transfer OK: " << m_dst_name << " <- " << m_src_name;
+				m_service.out_log(log.str());
+				m_service.out_ok(m_dst_id, m_src_id, m_dst_name, m_src_name, m_ctx);
+				return false;
+			}
+			//call the subclass to update a progress bar etc
+			m_service.out_progress(m_dst_id, m_src_id, m_dst_name, m_src_name, m_ctx, prog_body->m_progress);
+			m_wake = now + m_service.timeout();
+		}
+		if (now < m_wake) return true;
+		//if we don't see any reports for a long time
+		//then assume that it's not going to happen
+		auto log = std::ostringstream();
+		log << "File Transfer Error: " << m_dst_name << " <- " << m_src_name;
+		m_service.out_log(log.str());
+		m_service.out_error(m_dst_id, m_src_id, m_dst_name, m_src_name, m_ctx);
+		return false;
+	}
+private:
+	File_Service &m_service;
+	Net_ID m_dst_id;
+	Net_ID m_src_id;
+	std::string m_dst_name;
+	std::string m_src_name;
+	int32_t m_ctx;
+	bool m_swarm;
+	bool m_started = false;
+};
+
+/////////////
+// file index
+/////////////
+
+//size and mtime, ns since the epoch, of a regular file, false if it isn't one
+bool stat_file(const std::string &name, uint64_t &size, int64_t &mtime)
+{
+#ifdef _WIN32
+	auto ec = std::error_code();
+	if (!std::filesystem::is_regular_file(name, ec)) return false;
+	size = std::filesystem::file_size(name, ec);
+	auto time = std::filesystem::last_write_time(name, ec);
+	if (ec) return false;
+	mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::file_clock::to_sys(time).time_since_epoch()).count();
+#else
+	struct stat st;
+	if (::stat(name.c_str(), &st) || !S_ISREG(st.st_mode)) return false;
+	size = st.st_size;
+#ifdef __APPLE__
+	mtime = st.st_mtimespec.tv_sec * 1000000000LL + st.st_mtimespec.tv_nsec;
+#else
+	mtime = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#endif
+#endif
+	return true;
+}
+
+//the files in our folder that start with our prefix, what in_file_path() puts in front
+//of a name, sorted by name, with their size, mtime and a hash of the whole file.
+//lists are paged out of it, a lower bound and a walk, rather than the folder being
+//read for each. it's kept up to date from inotify, or a look over the folder now and
+//then where there's none, and the changes are batched and sent to the watchers
+//whose prefix they match. the first look over the folder, and hashes a file at a
+//time, are done on its own thread, not the service's. lists asked for before that
+//first look is done wait for it, hashes go out as a change like any other.
+//transfer temps aren't listed.
+class File_Service::Index
+{
+public:
+	Index(File_Service &service, const std::string &path)
+		: m_service(service)
+	{
+		auto slash = path.rfind('/');
+		m_folder = slash == std::string::npos ? "." : slash ? path.substr(0, slash) : "/";
+		m_path = slash == std::string::npos ? "" : path.substr(0, slash + 1);
+		m_prefix = path.substr(slash == std::string::npos ? 0 : slash + 1);
+#ifdef __linux__
+		//watch before the first look, so nothing can change unseen between
+		m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (m_fd != -1 && inotify_add_watch(m_fd, m_folder.c_str(),
+			IN_CREATE | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF) == -1)
+		{
+			::close(m_fd);
+			m_fd = -1;
+		}
+#endif
+		m_thread = std::thread(&Index::run, this);
+	}
+	~Index()
+	{
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			m_running = false;
+			m_cv.notify_one();
+		}
+		m_thread.join();
+#ifdef __linux__
+		if (m_fd != -1) ::close(m_fd);
+#endif
+	}
+	struct List
+	{
+		Net_ID m_reply;
+		std::string m_prefix;
+		std::string m_after;
+		uint32_t m_count;
+	};
+	//send a page of the files starting with the prefix, after the name given,
+	//now, or once the first look is done
+	void list(const List &list)
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (m_ready) page(list);
+		else m_lists.push_back(list);
+	}
+	void watch(const Net_ID &id, const std::string &prefix, bool on)
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (!on) m_watches.erase(id);
+		else m_watches[id] = {prefix, std::chrono::steady_clock::now() + std::chrono::milliseconds(FILE_LIST_WATCH_LEASE)};
+	}
+private:
+	struct Meta
+	{
+		uint64_t m_size;
+		int64_t m_mtime;
+		uint64_t m_hash;
+	};
+	struct Watch
+	{
+		std::string m_prefix;
+		std::chrono::steady_clock::time_point m_expires;
+	};
+	static File_Info info(const std::string &name, const Meta &meta)
+	{
+		return {name, meta.m_size, meta.m_mtime, meta.m_hash, false};
+	}
+	bool listed(const std::string &name) const
+	{
+		return name.size() > m_prefix.size() && name.starts_with(m_prefix)
+			&& !name.ends_with(".part") && !name.ends_with(".part.ckpt");
+	}
+	//send a page of a list, the lock is held
+	void page(const List &list)
+	{
+		auto page = std::vector<File_Info>{};
+		auto itr = list.m_after.empty() || list.m_after < list.m_prefix ? m_files.lower_bound(list.m_prefix) : m_files.upper_bound(list.m_after);
+		for (; itr != end(m_files) && itr->first.starts_with(list.m_prefix) && page.size() < list.m_count; ++itr)
+		{
+			page.emplace_back(info(itr->first, itr->second));
+		}
+		auto more = itr != end(m_files) && itr->first.starts_with(list.m_prefix);
+		m_service.set_file_list(list.m_reply, page, m_version, more);
+	}
+	void run()
+	{
+		//the first look, no one can be told of changes till it's done
+		scan();
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			m_changes.clear();
+			m_ready = true;
+			for (auto &list : m_lists) page(list);
+			m_lists.clear();
+		}
+		auto flush = std::chrono::steady_clock::now() + std::chrono::milliseconds(FILE_LIST_SETTLE);
+		auto rescan = std::chrono::steady_clock::now() + std::chrono::milliseconds(FILE_LIST_RESCAN);
+		for (;;)
+		{
+			{
+				//sleep till the next batch is due, not at all if there's hashing to do
+				std::unique_lock<std::mutex> l(m_mutex);
+				if (!m_running) return;
+				if (m_unhashed.empty()) m_cv.wait_until(l, flush);
+				if (!m_running) return;
+			}
+			auto now = std::chrono::steady_clock::now();
+			if (now >= flush)
+			{
+				flush = now + std::chrono::milliseconds(FILE_LIST_SETTLE);
+				if (!events() && now >= rescan)
+				{
+					rescan = now + std::chrono::milliseconds(FILE_LIST_RESCAN);
+					scan();
+				}
+				publish(now);
+			}
+			if (!m_unhashed.empty()) hash();
+		}
+	}
+	//read what inotify has for us and update those files, false if it can't tell us
+	bool events()
+	{
+#ifdef __linux__
+		if (m_fd == -1) return false;
+		alignas(inotify_event) char buf[16384];
+		auto names = std::set<std::string>{};
+		auto overflow = false;
+		for (;;)
+		{
+			auto len = read(m_fd, buf, sizeof(buf));
+			if (len <= 0) break;
+			for (auto ptr = buf; ptr < buf + len; ptr += sizeof(inotify_event) + ((inotify_event*)ptr)->len)
+			{
+				auto event = (inotify_event*)ptr;
+				if (event->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) overflow = true;
+				else if (event->len && listed(event->name)) names.insert(event->name);
+			}
+		}
+		//the folder's gone, we look over it now and then from here on
+		if (overflow && access(m_folder.c_str(), F_OK))
+		{
+			::close(m_fd);
+			m_fd = -1;
+		}
+		if (overflow) scan();
+		else for (auto &name : names) update(name);
+		return true;
+#else
+		return false;
+#endif
+	}
+	//look over the whole folder, it's the first look, or we may have missed something
+	void scan()
+	{
+		auto files = std::map<std::string, Meta>{};
+		auto ec = std::error_code();
+		for (auto itr = std::filesystem::directory_iterator(m_folder, ec); !ec && itr != std::filesystem::directory_iterator(); itr.increment(ec))
+		{
+			auto name = itr->path().filename().string();
+			auto meta = Meta{0, 0, 0};
+			if (listed(name) && stat_file(m_path + name, meta.m_size, meta.m_mtime)) files.emplace(name.substr(m_prefix.size()), meta);
+		}
+		std::lock_guard<std::mutex> l(m_mutex);
+		for (auto &[name, meta] : m_files)
+		{
+			if (files.count(name)) continue;
+			auto &change = m_changes[name] = info(name, meta);
+			change.m_removed = true;
+		}
+		for (auto &[name, meta] : files)
+		{
+			auto itr = m_files.find(name);
+			if (itr != end(m_files) && itr->second.m_size == meta.m_size && itr->second.m_mtime == meta.m_mtime)
+			{
+				meta.m_hash = itr->second.m_hash;
+				continue;
+			}
+			m_changes[name] = info(name, meta);
+			m_unhashed.insert(name);
+		}
+		m_files = std::move(files);
+	}
+	//one file that inotify says has changed
+	void update(const std::string &file)
+	{
+		auto name = file.substr(m_prefix.size());
+		auto meta = Meta{0, 0, 0};
+		auto exists = stat_file(m_path + file, meta.m_size, meta.m_mtime);
+		std::lock_guard<std::mutex> l(m_mutex);
+		auto itr = m_files.find(name);
+		if (!exists)
+		{
+			if (itr == end(m_files)) return;
+			auto &change = m_changes[name] = info(name, itr->second);
+			change.m_removed = true;
+			m_files.erase(itr);
+			return;
+		}
+		if (itr != end(m_files) && itr->second.m_size == meta.m_size && itr->second.m_mtime == meta.m_mtime) return;
+		m_files[name] = meta;
+		m_changes[name] = info(name, meta);
+		m_unhashed.insert(name);
+	}
+	//hash one file, unless it has changed again while we did
+	void hash()
+	{
+		auto name = std::string();
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			name = *begin(m_unhashed);
+			m_unhashed.erase(begin(m_unhashed));
+		}
+		auto meta = Meta{0, 0, 0};
+		if (!stat_file(m_path + m_prefix + name, meta.m_size, meta.m_mtime)) return;
+		//read, not mapped, others can cut the file short under us at any time
+		auto file = std::ifstream(m_path + m_prefix + name, std::ifstream::binary);
+		if (!file.is_open()) return;
+		m_read.resize(FILE_LIST_HASH_READ);
+		auto hash = Strong_Hash();
+		auto length = uint64_t(0);
+		while (file.read(m_read.data(), m_read.size()) || file.gcount())
+		{
+			hash.update(m_read.data(), file.gcount());
+			length += file.gcount();
+		}
+		if (length != meta.m_size) return;
+		meta.m_hash = hash.value();
+		std::lock_guard<std::mutex> l(m_mutex);
+		auto itr = m_files.find(name);
+		if (itr == end(m_files) || itr->second.m_size != meta.m_size || itr->second.m_mtime != meta.m_mtime) return;
+		itr->second.m_hash = meta.m_hash;
+		m_changes[name] = info(name, meta);
+	}
+	//a batch of changes to each watcher, in parts of a page or less
+	void publish(std::chrono::steady_clock::time_point now)
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		std::erase_if(m_watches, [&] (auto &watch) { return watch.second.m_expires <= now; });
+		if (m_changes.empty()) return;
+		m_version++;
+		auto part = std::vector<File_Info>{};
+		for (auto &[id, watch] : m_watches)
+		{
+			auto itr = m_changes.lower_bound(watch.m_prefix);
+			for (; itr != end(m_changes) && itr->first.starts_with(watch.m_prefix); ++itr)
+			{
+				if (part.size() == FILE_LIST_PAGE)
+				{
+					m_service.set_file_list(id, part, m_version, true, true);
+					part.clear();
+				}
+				part.push_back(itr->second);
+			}
+			if (!part.empty()) m_service.set_file_list(id, part, m_version, false, true);
+			part.clear();
+		}
+		m_changes.clear();
+	}
+	File_Service &m_service;
+	std::string m_folder;
+	std::string m_path;
+	std::string m_prefix;
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_running = true;
+	bool m_ready = false;
+	std::vector<List> m_lists;
+	//by name, less the prefix
+	std::map<std::string, Meta> m_files;
+	std::map<std::string, File_Info> m_changes;
+	std::set<std::string> m_unhashed;
+	std::vector<char> m_read;
+	std::map<Net_ID, Watch> m_watches;
+	uint64_t m_version = 0;
+#ifdef __linux__
+	int m_fd = -1;
+#endif
+};
 
 ///////////////
 // file service
 ///////////////
 
+File_Service::File_Service(Router &router)
+	: Service(router)
+{}
+
+File_Service::~File_Service()
+{
+	//don't go till our transfers have
+	m_engine.wait();
+}
+
 void File_Service::run()
 {
 	//get my mailbox address, id was allocated in the constructor
-	auto mbox = global_router->validate(m_net_id);
-	auto entry = global_router->declare(m_net_id, "file_service", "File Service v0.1");
+	auto mbox = m_router.resolve(m_net_id);
+	auto entry = m_router.declare(m_net_id, "file_service", "File Service v0.1");
 
 	//event loop
 	while (m_running)
 	{
-		auto msg = mbox->read();
+		auto msg = mbox.read();
 		auto body = (Event*)msg->begin();
 		auto body_end = msg->end();
 		switch (body->m_evt)
 		{
 		case evt_get_file_list:
 		{
-			//get the file list from the subclass
-			//the subclass method should just push strings into the given vector
-			//for each file in the exported folder
-			auto file_list = std::vector<std::string>{};
-			in_file_list(file_list);
+			//a page out of the index, the prefix and the name to start after follow
+			//the struct
+			if (!m_index) m_index = std::make_unique<Index>(*this, in_file_path());
 			auto event = (Event_get_file_list*)body;
-			set_file_list(event->m_reply, file_list);
+			//the prefix length comes off the wire, keep it inside the msg
+			auto data_end = std::max(body_end, (char*)event->m_data);
+			auto prefix_length = std::min(event->m_prefix_length, (uint64_t)(data_end - event->m_data));
+			auto prefix = std::string(event->m_data, prefix_length);
+			auto after = std::string(event->m_data + prefix_length, data_end);
+			auto count = event->m_count ? (uint32_t)std::min(event->m_count, (uint64_t)FILE_LIST_PAGE) : FILE_LIST_PAGE;
+			m_index->list({event->m_reply, prefix, after, count});
+			break;
+		}
+		case evt_watch_file_list:
+		{
+			if (!m_index) m_index = std::make_unique<Index>(*this, in_file_path());
+			auto event = (Event_watch_file_list*)body;
+			m_index->watch(event->m_reply, std::string(event->m_prefix, body_end), event->m_watch != 0);
 			break;
 		}
 		case evt_set_file_list:
@@ -44,195 +1958,32 @@ void File_Service::run()
 			//set file list, done this way so it can be a push event as well as requested
 			//the subclass on the receiver will probably put this info into a UI widget etc
 			auto event = (Event_set_file_list*)body;
-			auto file_list = split_string(std::string(event->m_data, body_end), "\n");
+			//entries are appended after the struct, padding and all
+			auto file_list = std::vector<File_Info>{};
+			for (auto data = event->m_data; data + sizeof(file_list_entry) <= body_end;)
+			{
+				auto entry = (file_list_entry*)data;
+				//a name that runs off the end of the msg ends the list
+				if (entry->m_length > (uint64_t)(body_end - entry->m_name)) break;
+				file_list.push_back({std::string(entry->m_name, entry->m_length), entry->m_size, entry->m_mtime, entry->m_hash, entry->m_removed != 0});
+				data += (sizeof(file_list_entry) + entry->m_length + 7) & ~7;
+			}
 			//now call out to whoever wants this
-			out_file_list(event->m_src, file_list);
+			if (event->m_changes) out_file_changes(event->m_src, file_list, event->m_version, event->m_more != 0);
+			else out_file_list(event->m_src, file_list, event->m_version, event->m_more != 0);
 			break;
 		}
 		case evt_send_file:
 		{
-			//big job so hive off into a thread from the thread pool,
-			//while this thread goes back to reading incoming agent requests.
-			//it's not only the size of the job but the fact that this responder
-			//can block due to flow control !
-			m_thread_pool1->enqueue([=, msg_ref = std::move(msg)]
-			{
-				//we will time how long things take
-				auto start = std::chrono::high_resolution_clock::now();
-
-				auto event = (Event_send_file*)body;
-				//prepend the path prefix ?
-				auto filename = std::string(event->m_name, body_end);
-				if (filename.find('/') == std::string::npos) filename = in_file_path() + filename;
-				auto fs = std::ifstream(filename, std::ifstream::ate | std::ifstream::binary);
-				if (fs.is_open())
-				{
-					//get length of file:
-					auto total = (uint64_t)fs.tellg();
-					fs.seekg (0, fs.beg);
-					if (total == 0)
-					{
-						//dont waste energy on 0 length files !
-						fs.close();
-						goto nofile;
-					}
-					//temp Net_ID mailbox for acks
-					auto ack_id = global_router->alloc();
-					auto ack_mbox = global_router->validate(ack_id);
-					//read file and send as chunks over to the destination
-					//with an ack window based flow control
-					auto offset = uint64_t(0);
-					auto num_packets = 0u;
-					auto length = (uint64_t)(MAX_PACKET_SIZE - sizeof(send_file_chunk));
-					while (offset < total)
-					{
-						//header
-						auto chunk_length = std::min(length, total - offset);
-						auto chunk_msg = std::make_shared<Msg>(sizeof(send_file_chunk) + chunk_length);
-						chunk_msg->set_dest(event->m_reply);
-						//body
-						auto reply_body = (send_file_chunk*)chunk_msg->begin();
-						reply_body->m_ack = ack_id;
-						reply_body->m_total = total;
-						reply_body->m_length = chunk_length;
-						reply_body->m_offset = offset;
-						fs.read(reply_body->m_data, chunk_length);
-						global_router->send(chunk_msg);
-						offset += chunk_length;
-						//do we need to consume an ack before moving on ?
-						if (++num_packets >= FILE_CHUNK_WINDOW_SIZE)
-						{
-							//consume an ack msg, block till we get one or timeout !
-							num_packets = 0;
-							if (!ack_mbox->read(std::chrono::milliseconds(FILE_TRANSFER_TIMEOUT)))
-							{
-								auto log = std::ostringstream();
-								log << "Send File Error: " << filename;
-								out_log(log.str());
-								fs.close();
-								global_router->free(ack_id);
-								return;
-							}
-						}
-					}
-					//close file and free the temp ack mailbox
-					fs.close();
-					global_router->free(ack_id);
-				}
-				else
-				{
-				nofile:
-					//no such file or empty file, so reply with 0 total msg
-					auto chunk_msg = std::make_shared<Msg>(sizeof(send_file_chunk));
-					chunk_msg->set_dest(event->m_reply);
-					//body
-					auto reply_body = (send_file_chunk*)chunk_msg->begin();
-					reply_body->m_total = 0;
-					global_router->send(chunk_msg);
-				}
-
-				//log how long that took
-				auto finish = std::chrono::high_resolution_clock::now();
-				std::chrono::duration<double, std::milli> elapsed = finish - start;
-				auto log = std::ostringstream();
-				log << "Sent File: " << filename << std::endl << "Time: " << elapsed.count()/1000.0 << " seconds";
-				out_log(log.str());
-			});
+			//big job so hand it to the engine, while this thread goes back to reading
+			//incoming agent requests
+			m_engine.add(std::make_unique<Send_Job>(*this, msg));
 			break;
 		}
 		case evt_transfer_file:
 		{
-			//big job so hive off into a thread from the thread pool.
-			m_thread_pool1->enqueue([=, msg_ref = std::move(msg)]
-			{
-				auto event = (Event_transfer_file*)body;
-				//temp mailbox to await reply chunks
-				auto rep_id = global_router->alloc();
-				auto mbox = global_router->validate(rep_id);
-				//send off the file request
-				auto files = split_string(std::string(event->m_data, body_end), "\n");
-				auto msg = std::make_shared<Msg>(sizeof(Event_send_file));
-				msg->set_dest(event->m_src);
-				auto event_body = (Event_send_file*)msg->begin();
-				event_body->m_evt = evt_send_file;
-				event_body->m_reply = rep_id;
-				msg->append(files[1]);
-				global_router->send(msg);
-
-				//wait for all the reply chunks
-				auto tmpname = std::string{};
-				auto fs = std::ofstream();
-				auto total = uint64_t(0);
-				auto amount = uint64_t(0);
-				auto offset = uint64_t(0);
-				auto num_packets = FILE_CHUNK_WINDOW_SIZE;
-				auto progress = 0;
-				do
-				{
-					//read chunk
-					auto chunk_msg = mbox->read(std::chrono::milliseconds(FILE_TRANSFER_TIMEOUT));
-					if (!chunk_msg)
-					{
-						auto log = std::ostringstream();
-						log << "Transfer File Error: " << files[0] << " <- " << files[1];
-						out_log(log.str());
-						fs.close();
-						global_router->free(rep_id);
-						return;
-					}
-					auto chunk_body = (send_file_chunk*)chunk_msg->begin();
-					if (chunk_body->m_total == 0) goto nofile1;
-					//first time we know the total size we open a temp file for writing the chunks
-					if (!total)
-					{
-						//create some temp filename for the reply chunks
-						total = chunk_body->m_total;
-						tmpname = in_temp_file();
-						fs.open(tmpname, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
-					}
-					//write this chunks data into the file
-					if (offset != chunk_body->m_offset) fs.seekp(chunk_body->m_offset);
-					fs.write(chunk_body->m_data, chunk_body->m_length);
-					offset = chunk_body->m_offset + chunk_body->m_length;
-					amount += chunk_body->m_length;
-					//do we need to send an ack ?
-					if (++num_packets >= FILE_CHUNK_WINDOW_SIZE)
-					{
-						num_packets = 0;
-						static auto tag = std::make_shared<std::string>("ack");
-						auto ack = std::make_shared<Msg>(tag);
-						ack->set_dest(chunk_body->m_ack);
-						global_router->send(ack);
-					}
-					//send a progress report to origin every 10%
-					auto new_progress = (int32_t)(amount * 100 / total);
-					if (new_progress - progress >= 10)
-					{
-						msg = std::make_shared<Msg>(sizeof(transfer_file_progress));
-						msg->set_dest(event->m_origin);
-						auto ack_struct = (transfer_file_progress*)msg->begin();
-						ack_struct->m_progress = progress = new_progress;
-						global_router->send(msg);
-					}
-				} while (amount < total);
-				fs.close();
-				//copy temp over the destination and send OK msg
-				if (files[0].find('/') == std::string::npos) files[0] = in_file_path() + files[0];
-				std::remove(files[0].data());
-				file_copy(tmpname, files[0]);
-				std::remove(tmpname.data());
-				//and let the origin know it's done
-				msg = std::make_shared<Msg>(sizeof(transfer_file_progress));
-				msg->set_dest(event->m_origin);
-				{
-					auto ack_struct = (transfer_file_progress*)msg->begin();
-					ack_struct->m_progress = -1;
-					global_router->send(msg);
-				}
-			nofile1:
-				//free temp mailbox
-				global_router->free(rep_id);
-			});
+			//big job so hand it to the engine
+			m_engine.add(std::make_unique<Receive_Job>(*this, msg));
 			break;
 		}
 		default:
@@ -240,86 +1991,89 @@ void File_Service::run()
 		}
 	}
 
-	//forget myself
-	global_router->forget(entry);
+	//forget myself, and stop watching the folder
+	m_router.forget(entry);
+	m_index.reset();
 }
 
 //pushable events
 
-File_Service *File_Service::set_file_list(const Net_ID &net_id, const std::vector<std::string> &file_list)
+File_Service *File_Service::set_file_list(const Net_ID &net_id, const std::vector<File_Info> &file_list, uint64_t version, bool more, bool changes)
 {
-	auto msg = std::make_shared<Msg>(sizeof(Event_set_file_list));
+	auto size = sizeof(Event_set_file_list);
+	for (auto &file : file_list) size += (sizeof(file_list_entry) + file.m_name.size() + 7) & ~7;
+	auto msg = std::make_shared<Msg>(size);
 	msg->set_dest(net_id);
 	auto event_body = (Event_set_file_list*)msg->begin();
 	event_body->m_evt = evt_set_file_list;
 	event_body->m_src = m_net_id;
-	for (auto &file : file_list) { msg->append(file)->append("\n"); }
-	global_router->send(msg);
+	event_body->m_version = version;
+	event_body->m_more = more;
+	event_body->m_changes = changes;
+	auto data = event_body->m_data;
+	for (auto &file : file_list)
+	{
+		auto entry = (file_list_entry*)data;
+		entry->m_size = file.m_size;
+		entry->m_mtime = file.m_mtime;
+		entry->m_hash = file.m_hash;
+		entry->m_removed = file.m_removed;
+		entry->m_length = file.m_name.size();
+		memcpy(entry->m_name, file.m_name.data(), file.m_name.size());
+		data += (sizeof(file_list_entry) + file.m_name.size() + 7) & ~7;
+	}
+	m_router.send(msg);
 	return this;
 }
 
 //request helpers
 
-File_Service *File_Service::get_file_list(const Net_ID &net_id)
+File_Service *File_Service::get_file_list(const Net_ID &net_id, const std::string &prefix, const std::string &after, uint32_t count)
 {
 	auto msg = std::make_shared<Msg>(sizeof(Event_get_file_list));
 	msg->set_dest(net_id);
 	auto event_body = (Event_get_file_list*)msg->begin();
 	event_body->m_evt = evt_get_file_list;
 	event_body->m_reply = m_net_id;
-	global_router->send(msg);
+	event_body->m_count = count;
+	event_body->m_prefix_length = prefix.size();
+	msg->append(prefix)->append(after);
+	m_router.send(msg);
 	return this;
 }
 
-File_Service *File_Service::transfer_file(const Net_ID &dst_id, const Net_ID &src_id, const std::string &dst_name, const std::string &src_name, int32_t ctx)
+File_Service *File_Service::watch_file_list(const Net_ID &net_id, const std::string &prefix, bool watch)
+{
+	auto msg = std::make_shared<Msg>(sizeof(Event_watch_file_list));
+	msg->set_dest(net_id);
+	auto event_body = (Event_watch_file_list*)msg->begin();
+	event_body->m_evt = evt_watch_file_list;
+	event_body->m_reply = m_net_id;
+	event_body->m_watch = watch;
+	msg->append(prefix);
+	m_router.send(msg);
+	return this;
+}
+
+File_Service *File_Service::transfer_file(const Net_ID &dst_id, const Net_ID &src_id, const std::string &dst_name, const std::string &src_name, int32_t ctx, bool swarm)
 {
-	//big job so hive off into a thread from the thread pool.
 	//this method can be called on ANY file_service object and it will arrange the transfer of a file
 	//from any source and destination file_service while receiving progress reports.
 	//you would most likely ask the file_service who is going to be showing the progress UI !
-	m_thread_pool2->enqueue([=]
-	{
-		//temp mailbox to await progress reports
-		auto origin_id = global_router->alloc();
-		auto mbox = global_router->validate(origin_id);
-		//send off the transfer request
-		auto msg = std::make_shared<Msg>(sizeof(Event_transfer_file));
-		msg->set_dest(dst_id);
-		auto event_body = (Event_transfer_file*)msg->begin();
-		event_body->m_evt = evt_transfer_file;
-		event_body->m_src = src_id;
-		event_body->m_origin = origin_id;
-		msg->append(dst_name)->append("\n")->append(src_name);
-		global_router->send(msg);
-		//wait for progress and confirmation
-		for (;;)
-		{
-			//read progress report
-			auto prog_msg = mbox->read(std::chrono::milliseconds(FILE_TRANSFER_TIMEOUT));
-			if (!prog_msg)
-			{
-				//if we don't see any reports for a long time
-				//then assume that it's not going to happen
-				auto log = std::ostringstream();
-				log << "File Transfer Error: " << dst_name << " <- " << src_name;
-				out_log(log.str());
-				out_error(dst_id, src_id, dst_name, src_name, ctx);
-				break;
-			}
-			auto prog_body = (transfer_file_progress*)prog_msg->begin();
-			if (prog_body->m_progress == -1)
-			{
-				//all has finished
-				auto log = std::ostringstream();
-				log << "File Transfer OK: " << dst_name << " <- " << src_name;
-				out_log(log.str());
-				out_ok(dst_id, src_id, dst_name, src_name, ctx);
-				break;
-			}
-			//call the subclass to update a progress bar etc
-			out_progress(dst_id, src_id, dst_name, src_name, ctx, prog_body->m_progress);
-		}
-		global_router->free(origin_id);
-	});
+	m_engine.add(std::make_unique<Origin_Job>(*this, dst_id, src_id, dst_name, src_name, ctx, swarm));
+	return this;
+}
+
+//local helpers
+
+File_Service *File_Service::set_send_rate(uint64_t rate, uint64_t peer_rate)
+{
+	m_engine.set_rates(rate, peer_rate);
+	return this;
+}
+
+File_Service *File_Service::set_timeout(std::chrono::milliseconds timeout)
+{
+	m_timeout.store(timeout.count(), std::memory_order_relaxed);
 	return this;
 }
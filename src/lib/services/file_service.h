@@ -2,11 +2,13 @@
 #define FILES_SERVICE_H
 
 #include "service.h"
-#include "../utils/threadpool.h"
+#include "transfer_engine.h"
 
 //this is an example service.
 //it is a base class for providing a dropbox read/write type folder service.
-//it uses a threadpool to handle long running requests.
+//it hands long running requests to a transfer engine, which drives them all from
+//one thread, and keeps an index of its folder that file lists are paged out of and
+//that watchers are sent the changes to.
 //this illustrates how you might construct services and helper functions
 //that let clients of that service interact with them.
 class File_Service : public Service
@@ -19,70 +21,175 @@ public:
 		evt_set_file_list,
 		evt_send_file,
 		evt_transfer_file,
+		evt_watch_file_list,
 	};
+	//a file in a list, m_hash is 0 till it's been worked out
+	struct File_Info
+	{
+		std::string m_name;
+		uint64_t m_size = 0;
+		int64_t m_mtime = 0;
+		uint64_t m_hash = 0;
+		bool m_removed = false;
+	};
+	//a page of the files whose names start with the prefix, after the name given if any,
+	//at most m_count of them, and no more than FILE_LIST_PAGE, 0 for that many
 	struct Event_get_file_list : public Event
 	{
 		Net_ID m_reply;
+		uint64_t m_count;
+		uint64_t m_prefix_length;
+		char m_data[];
+	};
+	//a page, or the changes a watcher is sent, as of m_version of the index.
+	//entries follow the struct, each name padded to 8 bytes.
+	//m_more set on a page says there are more files after it, on changes that there
+	//are more parts of them to come
+	struct file_list_entry
+	{
+		uint64_t m_size;
+		int64_t m_mtime;
+		uint64_t m_hash;
+		uint32_t m_removed;
+		uint32_t m_length;
+		char m_name[];
 	};
 	struct Event_set_file_list : public Event
 	{
 		Net_ID m_src;
+		uint64_t m_version;
+		uint32_t m_more;
+		uint32_t m_changes;
 		char m_data[];
 	};
+	//send the changes to the files whose names start with the prefix, from now till
+	//FILE_LIST_WATCH_LEASE after the last time this is asked for, m_watch 0 to stop.
+	//watch then page, changes up to the version of the page are in it
+	struct Event_watch_file_list : public Event
+	{
+		Net_ID m_reply;
+		uint64_t m_watch;
+		char m_prefix[];
+	};
 	struct Event_send_file : public Event
 	{
 		Net_ID m_reply;
+		//not 0 if the receiver has something to build on and wants a manifest first
+		uint64_t m_manifest;
 		char m_name[];
 	};
+	//what comes back to a send file request, and acks to it
+	enum
+	{
+		type_chunk,
+		type_manifest,
+		type_ack,
+		type_have,
+		type_cancel,
+		//sent now and then while hashing or scanning, so the other end doesn't give up
+		type_busy,
+	};
 	struct send_file_chunk
 	{
 		Net_ID m_ack;
+		uint64_t m_type;
+		uint64_t m_seq;
 		uint64_t m_offset;
 		uint64_t m_length;
 		uint64_t m_total;
 		char m_data[];
 	};
+	struct block_hash
+	{
+		uint64_t m_strong;
+		uint32_t m_weak;
+		uint32_t m_length;
+	};
+	//hashes of every FILE_BLOCK_CHUNKS chunks of the file, sent till the have comes back
+	struct send_file_manifest
+	{
+		Net_ID m_ack;
+		uint64_t m_type;
+		//the file service sending, a manifest with a 0 total says it has no such file
+		Net_ID m_src;
+		uint64_t m_total;
+		uint64_t m_chunk_length;
+		uint64_t m_block_length;
+		uint64_t m_blocks;
+		block_hash m_hashes[];
+	};
+	struct send_file_ack
+	{
+		uint64_t m_type;
+		//every chunk before m_next has arrived, bit i of m_sack is chunk m_next + 1 + i
+		uint64_t m_next;
+		//the chunk that sent this ack
+		uint64_t m_seq;
+		uint64_t m_sack[FILE_CHUNK_SACK_SIZE / 64];
+	};
+	//blocks of the manifest not to send, bit i of m_have is block i.
+	//a swarm receiver sends a run at a time, each with a higher m_seq, and m_more set
+	//till it's done with the sender. a cancel takes blocks off what's being sent.
+	struct send_file_have
+	{
+		uint64_t m_type;
+		uint64_t m_seq;
+		uint64_t m_more;
+		uint64_t m_blocks;
+		uint64_t m_have[];
+	};
 	struct Event_transfer_file : public Event
 	{
 		Net_ID m_src;
 		Net_ID m_origin;
 		int32_t m_ctx;
+		//not 0 to pull the file from every file service that has it
+		uint32_t m_swarm;
 		char m_data[];
 	};
 	struct transfer_file_progress
 	{
 		int32_t m_progress;
 	};
-	File_Service()
-		: Service()
-		, m_thread_pool1(std::make_unique<ThreadPool>(2))
-		, m_thread_pool2(std::make_unique<ThreadPool>(1))
-	{}
+	File_Service(Router &router = *global_router);
+	~File_Service();
 	//remote push helper methods
-	File_Service *set_file_list(const Net_ID &net_id, const std::vector<std::string> &file_list);
+	File_Service *set_file_list(const Net_ID &net_id, const std::vector<File_Info> &file_list, uint64_t version, bool more = false, bool changes = false);
 	//request helper methods
-	File_Service *get_file_list(const Net_ID &net_id);
-	File_Service *transfer_file(const Net_ID &dst_id, const Net_ID &src_id, const std::string &dst_name, const std::string &src_name, int32_t ctx);
+	File_Service *get_file_list(const Net_ID &net_id, const std::string &prefix = "", const std::string &after = "", uint32_t count = 0);
+	File_Service *watch_file_list(const Net_ID &net_id, const std::string &prefix = "", bool watch = true);
+	File_Service *transfer_file(const Net_ID &dst_id, const Net_ID &src_id, const std::string &dst_name, const std::string &src_name, int32_t ctx, bool swarm = false);
+	//local helper methods, caps in bytes per second on what we send, 0 for none
+	File_Service *set_send_rate(uint64_t rate, uint64_t peer_rate);
+	//how long a transfer goes without word from the other end before it gives up
+	File_Service *set_timeout(std::chrono::milliseconds timeout);
 private:
-	//note the use of two threadpools, one for the responce and one for the requests
-	//you do not want to deadlock due to all the threads being taken by requests and
-	//then no one can respond to them...
-	std::unique_ptr<ThreadPool> m_thread_pool1;
-	std::unique_ptr<ThreadPool> m_thread_pool2;
+	//the engine's jobs, a file we send, one we receive, and one we asked for
+	class Send_Job;
+	class Receive_Job;
+	class Origin_Job;
+	//the folder index, made the first time a list or watch is asked for
+	class Index;
+	Transfer_Engine m_engine;
+	std::unique_ptr<Index> m_index;
+	//the jobs send keepalives at a quarter of the timeout
+	std::atomic<uint64_t> m_timeout {FILE_TRANSFER_TIMEOUT};
+	std::chrono::milliseconds timeout() const { return std::chrono::milliseconds(m_timeout.load(std::memory_order_relaxed)); }
+	std::chrono::milliseconds keepalive() const { return timeout() / 4; }
 	void run() override;
 protected:
 	//methods for supplying the service with info
-	virtual std::string in_temp_file() { return "temp.tmp"; }
-	virtual void in_file_list(std::vector<std::string> &file_list)
+	//the folder and name prefix of our files, the index lists what's in it
+	virtual std::string in_file_path() { return ""; }
+	//methods for the service to emit results
+	virtual void out_file_list(const Net_ID &src_id, const std::vector<File_Info> &file_list, uint64_t version, bool more)
 	{
-		(void) file_list;
+		(void) file_list; (void) src_id; (void) version; (void) more;
 		return;
 	}
-	virtual std::string in_file_path() { return ""; }
-	//methods for the service to emit results
-	virtual void out_file_list(const Net_ID &src_id, const std::vector<std::string> &file_list)
+	virtual void out_file_changes(const Net_ID &src_id, const std::vector<File_Info> &changes, uint64_t version, bool more)
 	{
-		(void) file_list; (void) src_id;
+		(void) changes; (void) src_id; (void) version; (void) more;
 		return;
 	}
 	virtual void out_error(const Net_ID &dst_id, const Net_ID &src_id, const std::string &dst_name, const std::string &src_name, int32_t ctx)
@@ -19,8 +19,8 @@ SDL_Renderer *GUI_Service::m_renderer = nullptr;
 void GUI_Service::run()
 {
 	//get my mailbox address, id was allocated in the constructor
-	auto mbox = global_router->validate(m_net_id);
-	auto entry = global_router->declare(m_net_id, "gui", "GUI_Service v0.1");
+	auto mbox = m_router.resolve(m_net_id);
+	auto entry = m_router.declare(m_net_id, "gui", "GUI_Service v0.1");
 
 	m_screen = std::make_shared<Backdrop>();
 	m_screen->change(0, 0, 1280, 960)->dirty_all()->def_props({
@@ -48,7 +48,7 @@ void GUI_Service::run()
 	auto app = std::make_shared<Launcher_App>();
 	std::shared_ptr<Msg> msg;
 	Kernel_Service::start_task(app);
-	while ((msg = mbox->poll()) == nullptr)
+	while ((msg = mbox.poll()) == nullptr)
 	{
 		std::this_thread::sleep_for(std::chrono::milliseconds(GUI_FRAME_RATE));
 	}
@@ -57,7 +57,7 @@ void GUI_Service::run()
 	//event loop
 	while (m_running)
 	{
-		while ((msg = mbox->poll()))
+		while ((msg = mbox.poll()))
 		{
 		body:
 			auto body = (Event*)msg->begin();
@@ -71,7 +71,7 @@ void GUI_Service::run()
 				event_body->m_view->dirty_all();
 				auto reply = std::make_shared<Msg>();
 				reply->set_dest(event_body->m_reply);
-				global_router->send(reply);
+				m_router.send(reply);
 				break;
 			}
 			case evt_add_back:
@@ -82,7 +82,7 @@ void GUI_Service::run()
 				event_body->m_view->dirty_all();
 				auto reply = std::make_shared<Msg>();
 				reply->set_dest(event_body->m_reply);
-				global_router->send(reply);
+				m_router.send(reply);
 				break;
 			}
 			case evt_sub:
@@ -93,7 +93,7 @@ void GUI_Service::run()
 				event_body->m_view->sub();
 				auto reply = std::make_shared<Msg>();
 				reply->set_dest(event_body->m_reply);
-				global_router->send(reply);
+				m_router.send(reply);
 				break;
 			}
 			case evt_locate:
@@ -138,7 +138,7 @@ void GUI_Service::run()
 				reply_body->m_bounds.m_y = y;
 				reply_body->m_bounds.m_w = w;
 				reply_body->m_bounds.m_h = h;
-				global_router->send(reply);
+				m_router.send(reply);
 				break;
 			}
 			default:
@@ -197,13 +197,13 @@ void GUI_Service::run()
 	});
 
 	//forget myself
-	global_router->forget(entry);
+	m_router.forget(entry);
 
 	//stop myself !!!
 	Kernel_Service::stop_task(shared_from_this());
 	Kernel_Service::join_task(shared_from_this());
 	//ask kernel to exit !!!
-	Kernel_Service::exit();
+	Kernel_Service::exit(m_router);
 }
 
 void GUI_Service::composit()
@@ -418,7 +418,7 @@ GUI_Service *GUI_Service::quit(const SDL_Event &e)
 			msg->set_dest(owner);
 			event_body->m_evt = evt_exit;
 			event_body->m_type = ev_type_gui;
-			global_router->send(msg);
+			m_router.send(msg);
 		}
 	}
 	return this;
@@ -440,7 +440,7 @@ View *GUI_Service::set_mouse_id()
 				msg->set_dest(owner);
 				event_body->m_type = ev_type_exit;
 				event_body->m_evt = m_mouse_id;
-				global_router->send(msg);
+				m_router.send(msg);
 			}
 		}
 		m_mouse_id = mouse_id;
@@ -452,7 +452,7 @@ View *GUI_Service::set_mouse_id()
 			msg->set_dest(owner);
 			event_body->m_type = ev_type_enter;
 			event_body->m_evt = m_mouse_id;
-			global_router->send(msg);
+			m_router.send(msg);
 		}
 	}
 	return view;
@@ -472,7 +472,7 @@ GUI_Service *GUI_Service::mouse_wheel(const SDL_MouseWheelEvent &e)
 		event_body->m_x = e.x;
 		event_body->m_y = e.y;
 		event_body->m_direction = e.direction;
-		global_router->send(msg);
+		m_router.send(msg);
 	}
 	return this;
 }
@@ -497,7 +497,7 @@ GUI_Service *GUI_Service::mouse_button_down(const SDL_MouseButtonEvent &e)
 		event_body->m_ry = m_mouse_y - view->m_ctx.m_y;
 		event_body->m_buttons = m_mouse_buttons;
 		event_body->m_count = e.clicks;
-		global_router->send(msg);
+		m_router.send(msg);
 	}
 	return this;
 }
@@ -523,7 +523,7 @@ GUI_Service *GUI_Service::mouse_button_up(const SDL_MouseButtonEvent &e)
 			event_body->m_ry = m_mouse_y - view->m_ctx.m_y;
 			event_body->m_buttons = m_mouse_buttons;
 			event_body->m_count = e.clicks;
-			global_router->send(msg);
+			m_router.send(msg);
 		}
 	}
 	return this;
@@ -551,7 +551,7 @@ GUI_Service *GUI_Service::mouse_motion(const SDL_MouseMotionEvent &e)
 			event_body->m_ry = m_mouse_y - view->m_ctx.m_y;
 			event_body->m_buttons = m_mouse_buttons;
 			event_body->m_count = 0;
-			global_router->send(msg);
+			m_router.send(msg);
 		}
 	}
 	return this;
@@ -586,7 +586,7 @@ GUI_Service *GUI_Service::key_down(const SDL_KeyboardEvent &e)
 		event_body->m_keycode = key_code;
 		event_body->m_key = cook_key(key_code, key, mod);
 		event_body->m_mod = mod;
-		global_router->send(msg);
+		m_router.send(msg);
 	}
 	return this;
 }
@@ -608,7 +608,7 @@ GUI_Service *GUI_Service::window_event(const SDL_WindowEvent &e)
 				msg->set_dest(owner);
 				event_body->m_type = ev_type_gui;
 				event_body->m_evt = child->get_id();
-				global_router->send(msg);
+				m_router.send(msg);
 			}
 		}
 		m_screen->set_flags(view_flag_dirty_all | view_flag_screen, view_flag_dirty_all | view_flag_screen);
@@ -45,8 +45,8 @@ public:
 	{
 		view_bounds m_bounds;
 	};
-	GUI_Service()
-		: Service()
+	GUI_Service(Router &router = *global_router)
+		: Service(router)
 	{}
 	void run() override;
 	void composit();
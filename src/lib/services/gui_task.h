@@ -8,8 +8,8 @@
 class GUI_Task : public Task
 {
 public:
-	GUI_Task()
-		: Task()
+	GUI_Task(Router &router = *global_router)
+		: Task(router)
 	{}
 	enum
 	{
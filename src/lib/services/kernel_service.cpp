@@ -13,24 +13,20 @@ extern std::thread::id global_kernel_thread_id;
 void Kernel_Service::run()
 {
 	//get my mailbox address, id was allocated in the constructor
-	auto mbox = global_router->validate(m_net_id);
-	auto entry = global_router->declare(m_net_id, "kernel", "Kernel_Service v0.1");
-
-	//current time
-	auto now = std::chrono::high_resolution_clock::now();
+	auto mbox = m_router.resolve(m_net_id);
+	auto entry = m_router.declare(m_net_id, "kernel", "Kernel_Service v0.1");
 
 	//event loop
 	while (m_running)
 	{
-		//read and wake for next timer time
-		auto delay = std::chrono::milliseconds(1000000);
-		if (!m_timer.empty())
+		//read and wake for next timer time, or just read if there isn't one
+		std::shared_ptr<Msg> msg;
+		if (m_timers.empty()) msg = mbox.read();
+		else
 		{
-			auto time = ((Event_timed_mail*)m_timer.front()->begin())->m_time;
-			delay = std::chrono::duration_cast<std::chrono::milliseconds>(time - now);
-			delay = std::min(delay, std::chrono::milliseconds(1));
+			auto delay = std::chrono::ceil<std::chrono::milliseconds>(m_timers.next_time() - std::chrono::steady_clock::now());
+			msg = delay.count() > 0 ? mbox.read(delay) : mbox.poll();
 		}
-		auto msg = mbox->read(delay);
 		if (msg)
 		{
 			auto body = (Event*)msg->begin();
@@ -44,22 +40,23 @@ void Kernel_Service::run()
 			case evt_directory:
 			{
 				//directory update, flood filling
-				if (global_router->update_route(*msg->m_data)
-					&& global_router->update_dir(*msg->m_data))
+				if (m_router.update_route(*msg)
+					&& m_router.update_dir(*msg))
 				{
 					//new session so flood to peers
 					auto event_body = (Event_directory*)body;
 					auto via = event_body->m_via;
 					//fill in the new via and increment the distance as we flood out !
-					event_body->m_via = global_router->get_dev_id();
+					event_body->m_via = m_router.get_dev_id();
 					event_body->m_hops++;
-					for (auto &peer : global_router->get_peers())
+					for (auto &peer : m_router.get_peers())
 					{
 						//don't send to peer who sent it to me !
 						if (peer == via) continue;
-						auto flood_msg = std::make_shared<Msg>(msg->m_data);
+						auto flood_msg = std::make_shared<Msg>();
+						flood_msg->append(*msg);
 						flood_msg->set_dest(Net_ID(peer, Mailbox_ID{0}));
-						global_router->send(flood_msg);
+						m_router.send(flood_msg);
 					}
 				}
 				break;
@@ -74,7 +71,7 @@ void Kernel_Service::run()
 				auto reply_body = (start_task_reply*)reply->begin();
 				reply->set_dest(event_body->m_reply);
 				reply_body->m_task = event_body->m_task->get_id();
-				global_router->send(reply);
+				m_router.send(reply);
 				break;
 			}
 			case evt_stop_task:
@@ -106,31 +103,21 @@ void Kernel_Service::run()
 			}
 			case evt_timed_mail:
 			{
-				//timed mail
+				//timed mail, remove any timer this replaces
 				auto event_body = (Event_timed_mail*)body;
-				if (event_body->m_timeout != std::chrono::milliseconds(0))
+				auto key = std::make_pair(event_body->m_mbox, event_body->m_id);
+				auto itr = m_timer_handles.find(key);
+				if (itr != end(m_timer_handles))
 				{
-					//insert timer
-					auto time = std::chrono::high_resolution_clock::now()
-						+ event_body->m_timeout;
-					event_body->m_time = time;
-					auto itr = std::find_if(begin(m_timer), end(m_timer), [&] (auto &msg)
-					{
-						auto body = (Event_timed_mail*)msg->begin();
-						return body->m_time <= time;
-					});
-					m_timer.insert(itr, msg);
+					m_timers.cancel(itr->second);
+					m_timer_handles.erase(itr);
 				}
-				else
+				if (event_body->m_timeout.count() || event_body->m_period.count())
 				{
-					//remove timer
-					auto &mb = event_body->m_mbox;
-					auto itr = std::find_if(begin(m_timer), end(m_timer), [&] (auto &msg)
-					{
-						auto body = (Event_timed_mail*)msg->begin();
-						return body->m_mbox == mb;
-					});
-					if (itr != end(m_timer)) m_timer.erase(itr);
+					//insert timer
+					auto time = std::chrono::steady_clock::now() + event_body->m_timeout;
+					m_timer_handles[key] = m_timers.arm(time, Timer{event_body->m_mbox,
+						event_body->m_id, event_body->m_timeout, event_body->m_period});
 				}
 				break;
 			}
@@ -139,53 +126,66 @@ void Kernel_Service::run()
 			}
 		}
 
-		//check timer list
-		now = std::chrono::high_resolution_clock::now();
-		for (auto itr = begin(m_timer); itr != end(m_timer);)
+		//send any timers that are due
+		auto now = std::chrono::steady_clock::now();
+		while (!m_timers.empty() && m_timers.next_time() <= now)
 		{
-			auto tmsg = *itr;
-			auto body = (Event_timed_mail*)tmsg->begin();
-			if (body->m_time <= now)
+			auto time = m_timers.next_time();
+			auto timer = m_timers.pop();
+			auto key = std::make_pair(timer.m_mbox, timer.m_id);
+			if (timer.m_period.count())
 			{
-				itr = m_timer.erase(itr);
-				tmsg->set_dest(body->m_mbox);
-				global_router->send(tmsg);
+				//periodic, due again a period on, skipping any we have missed
+				time += timer.m_period;
+				if (time <= now) time += ((now - time) / timer.m_period + 1) * timer.m_period;
+				m_timer_handles[key] = m_timers.arm(time, timer);
 			}
-			else ++itr;
+			else m_timer_handles.erase(key);
+			auto tmsg = std::make_shared<Msg>(sizeof(Event_timed_mail));
+			auto event_body = (Event_timed_mail*)tmsg->begin();
+			event_body->m_evt = evt_timed_mail;
+			event_body->m_mbox = timer.m_mbox;
+			event_body->m_time = std::chrono::high_resolution_clock::now();
+			event_body->m_timeout = timer.m_timeout;
+			event_body->m_id = timer.m_id;
+			event_body->m_period = timer.m_period;
+			tmsg->set_dest(timer.m_mbox);
+			m_router.send(tmsg);
 		}
 	}
 
 	//forget myself
-	global_router->forget(entry);
+	m_router.forget(entry);
 }
 
-void Kernel_Service::exit()
+void Kernel_Service::exit(Router &router)
 {
 	//send task stop request
 	//kernel will exit !!!
 	auto msg = std::make_shared<Msg>(sizeof(Kernel_Service::Event));
 	auto event_body = (Kernel_Service::Event*)msg->begin();
-	msg->set_dest(Net_ID(global_router->get_dev_id(), Mailbox_ID{0}));
+	msg->set_dest(Net_ID(router.get_dev_id(), Mailbox_ID{0}));
 	event_body->m_evt = Kernel_Service::evt_exit;
-	global_router->send(msg);
+	router.send(msg);
 }
 
 Net_ID Kernel_Service::start_task(std::shared_ptr<Task> task)
 {
 	//send task start request
 	//kernel will call start_thread
-	auto reply_id = global_router->alloc();
-	auto reply_mbox = global_router->validate(reply_id);
+	auto &router = task->get_router();
+	auto reply_id = router.alloc();
+	auto reply_mbox = router.validate(reply_id);
 	auto msg = std::make_shared<Msg>(sizeof(Kernel_Service::Event_start_task));
-	auto event_body = (Kernel_Service::Event_start_task*)msg->begin();
-	msg->set_dest(Net_ID(global_router->get_dev_id(), Mailbox_ID{0}));
+	auto event_body = new (msg->begin()) Kernel_Service::Event_start_task();
+	msg->set_dest(Net_ID(router.get_dev_id(), Mailbox_ID{0}));
 	event_body->m_evt = Kernel_Service::evt_start_task;
 	event_body->m_reply = reply_id;
 	event_body->m_task = task;
-	global_router->send(msg);
+	router.send(msg);
 	//wait for reply
 	auto reply = reply_mbox->read();
-	global_router->free(reply_id);
+	router.free(reply_id);
 	auto reply_body = (Kernel_Service::start_task_reply*)reply->begin();
 	return reply_body->m_task;
 }
@@ -194,37 +194,46 @@ void Kernel_Service::stop_task(std::shared_ptr<Task> task)
 {
 	//send task stop request
 	//kernel will call stop_thread
+	auto &router = task->get_router();
 	auto msg = std::make_shared<Msg>(sizeof(Kernel_Service::Event_stop_task));
-	auto event_body = (Kernel_Service::Event_stop_task*)msg->begin();
-	msg->set_dest(Net_ID(global_router->get_dev_id(), Mailbox_ID{0}));
+	auto event_body = new (msg->begin()) Kernel_Service::Event_stop_task();
+	msg->set_dest(Net_ID(router.get_dev_id(), Mailbox_ID{0}));
 	event_body->m_evt = Kernel_Service::evt_stop_task;
 	event_body->m_task = task;
-	global_router->send(msg);
+	router.send(msg);
 }
 
 void Kernel_Service::join_task(std::shared_ptr<Task> task)
 {
 	//send task join request
 	//kernel will call join_thread
+	auto &router = task->get_router();
 	auto msg = std::make_shared<Msg>(sizeof(Kernel_Service::Event_stop_task));
-	auto event_body = (Kernel_Service::Event_stop_task*)msg->begin();
-	msg->set_dest(Net_ID(global_router->get_dev_id(), Mailbox_ID{0}));
+	auto event_body = new (msg->begin()) Kernel_Service::Event_stop_task();
+	msg->set_dest(Net_ID(router.get_dev_id(), Mailbox_ID{0}));
 	event_body->m_evt = Kernel_Service::evt_stop_task;
 	event_body->m_task = task;
-	global_router->send(msg);
+	router.send(msg);
+}
+
+void Kernel_Service::timed_mail(const Net_ID &reply, std::chrono::milliseconds timeout, uint64_t id, Router &router)
+{
+	//one shot timed mail request, a timeout of 0 cancels
+	periodic_mail(reply, timeout, std::chrono::milliseconds(0), id, router);
 }
 
-void Kernel_Service::timed_mail(const Net_ID &reply, std::chrono::milliseconds timeout, uint64_t id)
+void Kernel_Service::periodic_mail(const Net_ID &reply, std::chrono::milliseconds timeout, std::chrono::milliseconds period, uint64_t id, Router &router)
 {
-	//timed mail request
+	//timed mail request, first after the timeout then every period if not 0
 	auto msg = std::make_shared<Msg>(sizeof(Kernel_Service::Event_timed_mail));
 	auto event_body = (Kernel_Service::Event_timed_mail*)msg->begin();
-	msg->set_dest(Net_ID(global_router->get_dev_id(), Mailbox_ID{0}));
+	msg->set_dest(Net_ID(router.get_dev_id(), Mailbox_ID{0}));
 	event_body->m_evt = Kernel_Service::evt_timed_mail;
 	event_body->m_mbox = reply;
 	event_body->m_timeout = timeout;
 	event_body->m_id = id;
-	global_router->send(msg);
+	event_body->m_period = period;
+	router.send(msg);
 }
 
 void Kernel_Service::callback(std::function<void()> callback)
@@ -240,7 +249,7 @@ void Kernel_Service::callback(std::function<void()> callback)
 		//send callback request
 		Sync sync;
 		auto msg = std::make_shared<Msg>(sizeof(Kernel_Service::Event_callback));
-		auto event_body = (Kernel_Service::Event_callback*)msg->begin();
+		auto event_body = new (msg->begin()) Kernel_Service::Event_callback();
 		msg->set_dest(Net_ID(global_router->get_dev_id(), Mailbox_ID{0}));
 		event_body->m_evt = Kernel_Service::evt_callback;
 		event_body->m_sync = &sync;
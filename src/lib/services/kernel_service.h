@@ -2,15 +2,20 @@
 #define KERNEL_H
 
 #include "service.h"
+#include "../utils/timer_heap.h"
 #include <list>
+#include <map>
 
 class Task;
 
 //kernel service.
 //this is the very first service to be run, therfore mailbox id 0.
 //this is critical as routers talk to each other via this kernel service.
-//currently the only thing the kernel service does is maintain the distributed
-//service directory.
+//it maintains the distributed service directory, starts and stops tasks and
+//sends timed mail.
+//timers are kept in a heap and the kernel sleeps till the next one is due.
+//a timer is known by its mailbox and id, arming one again replaces it, and a
+//timeout and period of 0 cancels it.
 class Kernel_Service : public Service
 {
 public:
@@ -59,19 +64,29 @@ public:
 		std::chrono::high_resolution_clock::time_point m_time;
 		std::chrono::milliseconds m_timeout;
 		uint64_t m_id;
+		std::chrono::milliseconds m_period;
 	};
-	Kernel_Service()
-		: Service()
+	Kernel_Service(Router &router = *global_router)
+		: Service(router)
 	{}
 	void run() override;
 	static void callback(std::function<void()> callback);
-	static void exit();
+	static void exit(Router &router = *global_router);
 	static Net_ID start_task(std::shared_ptr<Task> task);
 	static void stop_task(std::shared_ptr<Task> task);
 	static void join_task(std::shared_ptr<Task> task);
-	static void timed_mail(const Net_ID &reply, std::chrono::milliseconds timeout, uint64_t id);
+	static void timed_mail(const Net_ID &reply, std::chrono::milliseconds timeout, uint64_t id, Router &router = *global_router);
+	static void periodic_mail(const Net_ID &reply, std::chrono::milliseconds timeout, std::chrono::milliseconds period, uint64_t id, Router &router = *global_router);
 private:
-	std::list<std::shared_ptr<Msg>> m_timer;
+	struct Timer
+	{
+		Net_ID m_mbox;
+		uint64_t m_id = 0;
+		std::chrono::milliseconds m_timeout;
+		std::chrono::milliseconds m_period;
+	};
+	Timer_Heap<Timer> m_timers;
+	std::map<std::pair<Net_ID, uint64_t>, Timer_Heap<Timer>::Handle> m_timer_handles;
 	std::list<std::shared_ptr<Task>> m_tasks;
 };
 
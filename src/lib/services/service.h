@@ -7,8 +7,8 @@
 class Service : public Task
 {
 public:
-	Service()
-		: Task()
+	Service(Router &router = *global_router)
+		: Task(router)
 	{}
 };
 
@@ -28,7 +28,7 @@ void Task::stop_thread()
 	msg->set_dest(m_net_id);
 	auto event_body = (Event*)msg->begin();
 	event_body->m_evt = evt_exit;
-	global_router->send(msg);
+	m_router.send(msg);
 }
 
 void Task::join_thread()
@@ -39,12 +39,12 @@ void Task::join_thread()
 std::vector<Net_ID> Task::alloc_select(uint32_t size)
 {
 	auto select = std::vector<Net_ID>{m_net_id};
-	for (auto i = 1; i < size; ++i) select.emplace_back(global_router->alloc());
+	for (auto i = 1; i < size; ++i) select.emplace_back(m_router.alloc());
 	return select;
 }
 
 void Task::free_select(std::vector<Net_ID> &select)
 {
-	std::for_each(begin(select) + 1, end(select), [&] (const auto &id) { global_router->free(id); });
+	std::for_each(begin(select) + 1, end(select), [&] (const auto &id) { m_router.free(id); });
 	select.clear();
 }
@@ -5,7 +5,9 @@
 
 extern std::unique_ptr<Router> global_router;
 
-//task class, thread executes the run method
+//task class, thread executes the run method.
+//tasks are bound to the router they get their mailbox from, the global router
+//unless they say otherwise.
 class Task : public std::enable_shared_from_this<Task>
 {
 public:
@@ -17,25 +19,28 @@ public:
 	{
 		uint64_t m_evt;
 	};
-	Task()
-		: m_net_id(global_router->alloc())
+	Task(Router &router = *global_router)
+		: m_router(router)
+		, m_net_id(router.alloc())
 	{}
 	virtual ~Task()
 	{
 		//free the task mailbox
-		global_router->free(m_net_id);
+		m_router.free(m_net_id);
 	}
 	//responce handling
 	void start_thread();
 	void stop_thread();
 	void join_thread();
 	const Net_ID &get_id() const { return m_net_id; }
+	Router &get_router() const { return m_router; }
 	bool m_running = false;
 protected:
 	std::vector<Net_ID> alloc_select(uint32_t size);
 	void free_select(std::vector<Net_ID> &select);
 	void run_then_join();
 	virtual void run() = 0;
+	Router &m_router;
 	const Net_ID m_net_id;
 	std::thread m_thread;
 };
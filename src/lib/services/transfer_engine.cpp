@@ -0,0 +1,241 @@
+#include "transfer_engine.h"
+#include <algorithm>
+
+//////////////////
+// transfer engine
+//////////////////
+
+void Transfer_Engine::Job::Waker::wake()
+{
+	//mailboxes call this under their lock, only the first wake till the engine has
+	//taken it goes any further
+	if (m_queued.exchange(true, std::memory_order_acq_rel)) return;
+	std::lock_guard<std::mutex> l(m_engine->m_mutex);
+	if (m_job) m_engine->m_woken.push_back(m_job);
+	else m_engine->m_wake = true;
+	m_engine->m_cv.notify_one();
+}
+
+void Transfer_Engine::Job::Waker::wake(std::atomic<bool> &done)
+{
+	std::lock_guard<std::mutex> l(m_engine->m_mutex);
+	done.store(true, std::memory_order_release);
+	if (m_queued.exchange(true, std::memory_order_acq_rel)) return;
+	m_engine->m_woken.push_back(m_job);
+	m_engine->m_cv.notify_one();
+}
+
+Transfer_Engine::Transfer_Engine()
+	: m_rate(FILE_SEND_RATE)
+	, m_peer_rate(FILE_PEER_SEND_RATE)
+{
+	m_waker.m_engine = this;
+	m_thread = std::thread(&Transfer_Engine::run, this);
+}
+
+Transfer_Engine::~Transfer_Engine()
+{
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_running = false;
+		m_cv.notify_one();
+	}
+	m_thread.join();
+}
+
+void Transfer_Engine::add(std::unique_ptr<Job> job)
+{
+	job->m_waker.m_engine = this;
+	job->m_waker.m_job = job.get();
+	std::lock_guard<std::mutex> l(m_mutex);
+	m_added.emplace_back(std::move(job));
+	m_count++;
+	m_cv.notify_one();
+}
+
+void Transfer_Engine::wait()
+{
+	std::unique_lock<std::mutex> l(m_mutex);
+	while (m_count) m_idle.wait(l);
+}
+
+bool Transfer_Engine::Bucket::empty(Time now, uint64_t rate)
+{
+	if (!rate)
+	{
+		m_tokens = 0;
+		return false;
+	}
+	std::chrono::duration<double> elapsed = now - m_time;
+	m_tokens = std::min(m_tokens + elapsed.count() * rate, (double)rate * FILE_SEND_BURST / 1000);
+	m_time = now;
+	return m_tokens <= 0;
+}
+
+Transfer_Engine::Time Transfer_Engine::Bucket::due(uint64_t rate) const
+{
+	return m_time + std::chrono::ceil<std::chrono::steady_clock::duration>(std::chrono::duration<double>(-m_tokens / rate));
+}
+
+void Transfer_Engine::run()
+{
+	auto added = std::vector<std::unique_ptr<Job>>{};
+	auto woken = std::vector<Job*>{};
+	auto send_due = Time::max();
+	for (;;)
+	{
+		{
+			//sleep till there's mail, a wake time comes, or the rates let a send go
+			std::unique_lock<std::mutex> l(m_mutex);
+			for (;;)
+			{
+				if (!m_added.empty() || !m_woken.empty() || m_wake) break;
+				if (!m_running && !m_count) return;
+				auto due = std::min(send_due, m_timers.empty() ? Time::max() : m_timers.next_time());
+				if (due == Time::max()) m_cv.wait(l);
+				else if (m_cv.wait_until(l, due) == std::cv_status::timeout) break;
+			}
+			m_wake = false;
+			m_waker.m_queued.store(false, std::memory_order_relaxed);
+			std::swap(added, m_added);
+			std::swap(woken, m_woken);
+		}
+		//new jobs have their mailbox wake us from now on, and run once to start
+		for (auto &job : added)
+		{
+			job->m_mbox->lock();
+			job->m_mbox->set_select(&job->m_waker);
+			job->m_mbox->unlock();
+			woken.push_back(job.get());
+			m_jobs.emplace(job.get(), std::move(job));
+		}
+		added.clear();
+		for (auto job : woken)
+		{
+			job->m_waker.m_queued.store(false, std::memory_order_release);
+			step(job);
+		}
+		woken.clear();
+		auto now = std::chrono::steady_clock::now();
+		while (!m_timers.empty() && m_timers.next_time() <= now)
+		{
+			auto job = m_timers.pop();
+			job->m_timer = ~0ULL;
+			step(job);
+		}
+		send_due = send(std::chrono::steady_clock::now());
+		//let go of the jobs that are done, once nothing can wake them
+		for (auto job : m_done)
+		{
+			job->m_mbox->lock();
+			job->m_mbox->set_select(nullptr);
+			job->m_mbox->unlock();
+			{
+				std::lock_guard<std::mutex> l(m_mutex);
+				m_woken.erase(std::remove(begin(m_woken), end(m_woken), job), end(m_woken));
+			}
+			m_jobs.erase(job);
+			std::lock_guard<std::mutex> l(m_mutex);
+			if (--m_count == 0) m_idle.notify_all();
+		}
+		m_done.clear();
+	}
+}
+
+void Transfer_Engine::step(Job *job)
+{
+	if (job->m_done) return;
+	if (!job->run()) return finish(job);
+	arm(job);
+	if (!job->m_ready || job->m_active) return;
+	//a send with chunks to go joins the back of its band
+	if (!job->m_peered)
+	{
+		job->m_peered = true;
+		m_peers[job->m_peer].m_jobs++;
+	}
+	job->m_active = true;
+	m_bands[job->m_prio].push_back(job);
+}
+
+void Transfer_Engine::arm(Job *job)
+{
+	//move the job's timer to its wake time, if it's not there already
+	if (m_timers.find(job->m_timer) && job->m_armed == job->m_wake) return;
+	m_timers.cancel(job->m_timer);
+	job->m_timer = ~0ULL;
+	job->m_armed = job->m_wake;
+	if (job->m_wake != Time::max()) job->m_timer = m_timers.arm(job->m_wake, job);
+}
+
+void Transfer_Engine::finish(Job *job)
+{
+	job->m_done = true;
+	m_timers.cancel(job->m_timer);
+	if (job->m_active)
+	{
+		auto &band = m_bands[job->m_prio];
+		band.erase(std::find(begin(band), end(band), job));
+	}
+	if (job->m_peered)
+	{
+		auto itr = m_peers.find(job->m_peer);
+		if (--itr->second.m_jobs == 0) m_peers.erase(itr);
+	}
+	m_done.push_back(job);
+}
+
+Transfer_Engine::Time Transfer_Engine::send(Time now)
+{
+	//deficit round robin within a band, a band only gets a look in once those above it
+	//have nothing to send, or only sends to peers that are over their rate.
+	//returns when a rate will next let something go.
+	auto rate = m_rate.load(std::memory_order_relaxed);
+	auto peer_rate = m_peer_rate.load(std::memory_order_relaxed);
+	auto due = Time::max();
+	for (auto &band : m_bands)
+	{
+		auto blocked = size_t(0);
+		while (band.size() > blocked)
+		{
+			if (m_bucket.empty(now, rate)) return m_bucket.due(rate);
+			auto job = band.front();
+			band.pop_front();
+			auto &peer = m_peers.find(job->m_peer)->second;
+			if (peer.empty(now, peer_rate))
+			{
+				//this peer has had its share for now, others may not have
+				due = std::min(due, peer.due(peer_rate));
+				band.push_back(job);
+				blocked++;
+				continue;
+			}
+			blocked = 0;
+			job->m_deficit = std::min(job->m_deficit + (int64_t)FILE_SEND_QUANTUM, (int64_t)FILE_SEND_QUANTUM);
+			auto sent = false;
+			while (job->m_deficit > 0 && !m_bucket.empty(now, rate) && !peer.empty(now, peer_rate))
+			{
+				auto bytes = job->send();
+				if (!bytes)
+				{
+					job->m_ready = false;
+					break;
+				}
+				job->m_deficit -= bytes;
+				m_bucket.m_tokens -= bytes;
+				peer.m_tokens -= bytes;
+				sent = true;
+			}
+			if (sent) arm(job);
+			if (job->m_ready)
+			{
+				band.push_back(job);
+				continue;
+			}
+			//nothing more to go till its next acks
+			job->m_active = false;
+			job->m_deficit = 0;
+		}
+	}
+	return due;
+}
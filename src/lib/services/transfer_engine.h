@@ -0,0 +1,133 @@
+#ifndef TRANSFER_ENGINE_H
+#define TRANSFER_ENGINE_H
+
+#include "../mail/router.h"
+#include "../utils/timer_heap.h"
+#include <map>
+
+//transfer engine.
+//drives any number of transfers from the one thread, none of them blocks or has a
+//thread of its own. a job is run when mail comes to its mailbox, when its wake time
+//comes, or when work it handed off elsewhere wakes it, and does what it can without
+//waiting. sends don't put their chunks out themselves, the engine asks them for
+//one at a time, deficit round robin between the sends of a priority, and higher
+//priorities before lower, within a byte rate for all of them and another for each
+//peer. the rates are token buckets, a send can overdraw by its last chunk and the
+//bucket has to refill past 0 before anything more goes.
+class Transfer_Engine
+{
+public:
+	enum
+	{
+		prio_high,
+		prio_normal,
+		prio_low,
+		prio_size,
+	};
+	typedef std::chrono::steady_clock::time_point Time;
+	//a job the engine drives, a file being sent, received or watched
+	class Job
+	{
+		friend class Transfer_Engine;
+	public:
+		Job(Router &router)
+			: m_router(router)
+			, m_id(router.alloc())
+			, m_mbox(router.validate(m_id))
+		{}
+		virtual ~Job()
+		{
+			//free the job mailbox
+			m_router.free(m_id);
+		}
+		//mail has come, or the wake time has, false once the job is done
+		virtual bool run() = 0;
+		//put out the next chunk, its size in bytes, 0 if there's nothing to send now
+		virtual uint32_t send() { return 0; }
+		//run again soon, from any thread
+		void wake() { m_waker.wake(); }
+		//work handed off elsewhere is done, the flag is set under the engine lock so
+		//the job can't be let go of till this has returned
+		void wake(std::atomic<bool> &done) { m_waker.wake(done); }
+	protected:
+		Router &m_router;
+		const Net_ID m_id;
+		Mbox<std::shared_ptr<Msg>> *m_mbox;
+		//when to run with no mail, never if it's max
+		Time m_wake = Time::max();
+		//sends only, true when it may have chunks to go, the band it goes in and the
+		//peer it shares a rate with
+		bool m_ready = false;
+		uint32_t m_prio = prio_normal;
+		Dev_ID m_peer;
+	private:
+		//mailbox waker, puts the job on the engine's run list
+		class Waker : public Sync
+		{
+		public:
+			void wake() override;
+			void wake(std::atomic<bool> &done);
+			Transfer_Engine *m_engine = nullptr;
+			Job *m_job = nullptr;
+			std::atomic<bool> m_queued {false};
+		};
+		Waker m_waker;
+		Timer_Heap<Job*>::Handle m_timer = ~0ULL;
+		Time m_armed;
+		int64_t m_deficit = 0;
+		bool m_active = false;
+		bool m_peered = false;
+		bool m_done = false;
+	};
+	Transfer_Engine();
+	~Transfer_Engine();
+	//any thread, the engine owns the job from now on
+	void add(std::unique_ptr<Job> job);
+	//bytes per second of all sends and of the sends to each peer, 0 for no cap
+	void set_rates(uint64_t rate, uint64_t peer_rate)
+	{
+		m_rate.store(rate, std::memory_order_relaxed);
+		m_peer_rate.store(peer_rate, std::memory_order_relaxed);
+		m_waker.wake();
+	}
+	//block till there are no jobs left
+	void wait();
+private:
+	struct Bucket
+	{
+		//refill for the time gone, true if we're in debt
+		bool empty(Time now, uint64_t rate);
+		//when it will be out of debt
+		Time due(uint64_t rate) const;
+		double m_tokens = 0;
+		Time m_time;
+		uint32_t m_jobs = 0;
+	};
+	void run();
+	void step(Job *job);
+	void arm(Job *job);
+	void finish(Job *job);
+	Time send(Time now);
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::condition_variable m_idle;
+	std::vector<std::unique_ptr<Job>> m_added;
+	std::vector<Job*> m_woken;
+	uint32_t m_count = 0;
+	//engine thread only from here on
+	std::map<Job*, std::unique_ptr<Job>> m_jobs;
+	std::vector<Job*> m_done;
+	Timer_Heap<Job*> m_timers;
+	std::array<std::deque<Job*>, prio_size> m_bands;
+	Bucket m_bucket;
+	std::map<Dev_ID, Bucket> m_peers;
+	std::atomic<uint64_t> m_rate;
+	std::atomic<uint64_t> m_peer_rate;
+	//wakes the engine itself, when rates change
+	Job::Waker m_waker;
+	std::thread m_thread;
+	bool m_running = true;
+	bool m_wake = false;
+};
+
+#endif
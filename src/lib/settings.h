@@ -5,25 +5,75 @@
 
 //max mailbox id
 const uint32_t MAX_ID = 4294967295;
+//mailbox table size, and how many slots must be free before the oldest is reused
+const uint32_t MAILBOX_TABLE_SIZE = 65536;
+const uint32_t MAILBOX_MIN_FREE_SLOTS = 256;
 //maximum packet size
 const uint32_t MAX_PACKET_SIZE = 4096;
-//number of file chunks that can be in flight
+//number of file chunks in flight at the start of a transfer, and the most there can be
 const uint32_t FILE_CHUNK_WINDOW_SIZE = 32;
+const uint32_t FILE_CHUNK_MAX_WINDOW_SIZE = 1024;
+//chunks past the first missing one a file ack can say have arrived, multiple of 64
+const uint32_t FILE_CHUNK_SACK_SIZE = 1024;
+//file chunks per block of a delta manifest, each block has a rolling and a strong hash
+const uint32_t FILE_BLOCK_CHUNKS = 16;
+//new file chunks a receiver takes between checkpoints of a part written file
+const uint32_t FILE_CHECKPOINT_CHUNKS = 4096;
+//blocks a swarm source is given to send at a time, and the most sources a swarm asks
+const uint32_t FILE_SWARM_RUN_BLOCKS = 16;
+const uint32_t FILE_SWARM_MAX_SOURCES = 8;
+//file send rate caps in bytes per second, of all sends and of those to any one peer,
+//0 for no cap, and how many ms worth of a rate can go at once
+const uint64_t FILE_SEND_RATE = 0;
+const uint64_t FILE_PEER_SEND_RATE = 0;
+const uint32_t FILE_SEND_BURST = 10;
+//bytes a file send gets each turn of the round robin between sends
+const uint32_t FILE_SEND_QUANTUM = 16 * MAX_PACKET_SIZE;
+//files this size or under are sent ahead of the rest, and this size or over after them
+const uint64_t FILE_SMALL_SIZE = 1000000;
+const uint64_t FILE_LARGE_SIZE = 100000000;
+//file list pages are at most this many files, changes to the folder are batched for
+//this many ms before they go out to its watchers, and a watch lasts this many ms
+//unless it's asked for again
+const uint32_t FILE_LIST_PAGE = 1000;
+const uint32_t FILE_LIST_SETTLE = 100;
+const uint32_t FILE_LIST_WATCH_LEASE = 60000;
+//ms between looks over the folder where there's no inotify
+const uint32_t FILE_LIST_RESCAN = 2000;
+//bytes read at a time as the file list hashes a file
+const uint32_t FILE_LIST_HASH_READ = 1048576;
 //ip link server port
 const uint32_t IP_LINK_PORT = 3333;
 #define IP_LINK_PORT_STRING "3333"
+//ip link send coalescing, max bytes of msgs packed into one socket write
+const uint32_t IP_LINK_MAX_SEND_BYTES = 65536;
+//time in us an ip link send waits for more msgs to coalesce, 0 is flush what is ready
+const uint32_t IP_LINK_FLUSH_DEADLINE = 0;
+//ip link receive chunk size, frames are parsed out of chunks read from the socket
+const uint32_t IP_LINK_RECEIVE_CHUNK_SIZE = 65536;
+//ip link socket buffer sizes
+const uint32_t IP_LINK_SOCKET_BUFFER_SIZE = 262144;
+//ip link manager io threads, shared by all its links
+const uint32_t IP_LINK_IO_THREADS = 2;
+//shm link ring size in bytes, each direction, must be a power of 2
+const uint32_t SHM_LINK_RING_SIZE = 1048576;
+//shm link send batching, max bytes of msgs written to the ring per wake of the peer
+const uint32_t SHM_LINK_MAX_SEND_BYTES = 65536;
+//shm link rendezvous, the hub listens on this unix socket for same host peers
+#define SHM_LINK_PATH "/tmp/chrysalib_shm_link"
 //timeouts and rates in ms
 const uint32_t MAX_DIRECTORY_AGE = 10000;
 const uint32_t MAX_ROUTE_AGE = 10000;
 const uint32_t MAX_MESSAGE_AGE = 5000;
 const uint32_t MAX_PARCEL_AGE = 10000;
 const uint32_t FILE_TRANSFER_TIMEOUT = 10000;
+const uint32_t FILE_SWARM_STALL_TIMEOUT = 1000;
 const uint32_t USB_BULK_TRANSFER_TIMEOUT = 100;
 const uint32_t GUI_FRAME_RATE = 1000/60;
 const uint32_t SELECT_POLLING_RATE = 10;
 const uint32_t LINK_PING_RATE = 1000;
 const uint32_t DIRECTORY_PING_RATE = 5000;
-const uint32_t IP_LINK_MANAGER_POLLING_RATE = 1000;
 const uint32_t USB_LINK_MANAGER_POLLING_RATE = 1000;
+const uint32_t SHM_LINK_MANAGER_POLLING_RATE = 1000;
 
 #endif
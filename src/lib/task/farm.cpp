@@ -2,172 +2,544 @@
 #include "../mail/router.h"
 #include <chrono>
 #include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
 
-extern std::unique_ptr<Router> global_router;
+Farm::Farm(Router &router,
+	const std::string &service_prefix,
+	uint32_t job_limit,
+	std::chrono::milliseconds timeout,
+	std::function<void(const Net_ID &, std::shared_ptr<Msg> job)> dispatch)
+	: m_router(router)
+	, m_service_prefix(service_prefix)
+	, m_dispatch(dispatch)
+	, m_timeout(timeout)
+	, m_job_limit(job_limit)
+	, m_id(router.alloc())
+{}
+
+Farm::~Farm()
+{
+	//cancel whatever we still have out, our id is never used again
+	for (auto &worker : m_workers)
+	{
+		if (!worker.second.m_keys.empty()) cancel(worker.first, type_cancel_farm, 0);
+	}
+	m_router.free(m_id);
+}
 
 void Farm::add_job(std::shared_ptr<Msg> job)
 {
-	m_jobs_ready.emplace_back(job);
+	m_jobs_ready.emplace_back(ready{job, 0});
+}
+
+void Farm::add_range(uint32_t start, uint32_t end, std::chrono::milliseconds target,
+	std::function<std::shared_ptr<Msg>(uint32_t start, uint32_t end)> make_job)
+{
+	m_range_start = start;
+	m_range_end = end;
+	m_target = target;
+	m_make_job = make_job;
+	for (auto &worker : m_workers) limit(worker.first, worker.second);
 }
 
 bool Farm::validate_job(std::shared_ptr<Msg> job)
 {
+	//a single reply, not a batch, to a job still out
 	auto reply_body = (Job*)job->begin();
-	auto worker = reply_body->m_worker;
-	auto key = reply_body->m_key;
-	auto itr = m_jobs_assigned.find(worker);
-	if (itr == end(m_jobs_assigned)) return false;
-	auto &tickets = itr->second;
-	auto titr = std::find_if(begin(tickets), end(tickets), [&] (auto &ticket)
+	if (reply_body->m_type != type_job) return false;
+	auto itr = m_jobs_assigned.find(reply_body->m_key);
+	return itr != end(m_jobs_assigned) && itr->second.m_worker == reply_body->m_worker;
+}
+
+std::string Farm::worker_params(const std::string &params)
+{
+	//per core score is millions of dependent multiply adds a second, timed once
+	static auto score = []
 	{
-		auto job_body = (Job*)ticket.m_job->begin();
-		return key == job_body->m_key;
-	});
-	return titr != end(tickets);
+		const auto ops = 4000000u;
+		auto x = 1.0;
+		auto start = std::chrono::steady_clock::now();
+		for (auto i = 0u; i < ops; ++i) x = x * 0.9999999 + 0.0000001;
+		std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+		volatile auto sink = x;
+		(void)sink;
+		return (uint32_t)(ops / std::max(elapsed.count(), 1.0));
+	}();
+	auto cores = std::max(std::thread::hardware_concurrency(), 1u);
+	return params + ",cores=" + std::to_string(cores) + ",score=" + std::to_string(score);
 }
 
-std::vector<Net_ID> Farm::census()
+std::vector<Farm::advert> Farm::census()
 {
-	auto census = std::vector<Net_ID>{};
-	auto entries = global_router->enquire(m_service_prefix);
+	//service,net_id,params then any key=value fields
+	auto census = std::vector<advert>{};
+	auto entries = m_router.enquire(m_service_prefix);
 	for (auto &e : entries)
 	{
 		auto fields = split_string(e, ",");
-		census.push_back(Net_ID::from_string(fields[1]));
+		auto worker = advert{Net_ID::from_string(fields[1])};
+		for (auto i = 3u; i < fields.size(); ++i)
+		{
+			if (fields[i].starts_with("cores=")) worker.m_cores = std::atoi(fields[i].c_str() + 6);
+			else if (fields[i].starts_with("score=")) worker.m_score = std::atof(fields[i].c_str() + 6);
+		}
+		census.push_back(worker);
 	}
 	return census;
 }
 
-void Farm::joiners(const std::vector<Net_ID> &census)
+bool Farm::joiners(const std::vector<advert> &census)
 {
-	std::copy_if(begin(census), end(census), std::back_inserter(m_workers), [&] (auto &worker)
+	auto joined = false;
+	for (auto &worker : census)
 	{
-		auto itr = std::find(begin(m_workers), end(m_workers), worker);
-		if (itr == end(m_workers))
-		{
-			add_worker(worker);
-			return true;
-		}
-		return false;
-	});
+		if (m_workers.find(worker.m_id) != end(m_workers)) continue;
+		add_worker(worker);
+		joined = true;
+	}
+	return joined;
 }
 
-void Farm::leavers(const std::vector<Net_ID> &census)
+bool Farm::leavers(const std::vector<advert> &census)
 {
-	m_workers.erase(std::remove_if(begin(m_workers), end(m_workers), [&] (auto &worker)
+	auto present = std::set<Net_ID>{};
+	for (auto &worker : census) present.insert(worker.m_id);
+	auto left = false;
+	for (auto itr = begin(m_workers); itr != end(m_workers);)
 	{
-		auto itr = std::find(begin(census), end(census), worker);
-		if (itr == end(census))
-		{
-			sub_worker(worker);
-			return true;
-		}
-		return false;
-	}), end(m_workers));
+		auto worker = itr->first;
+		++itr;
+		if (present.find(worker) != end(present)) continue;
+		sub_worker(worker);
+		left = true;
+	}
+	return left;
 }
 
-void Farm::add_worker(const Net_ID &worker)
+void Farm::add_worker(const advert &worker)
 {
-	if (m_jobs_ready.empty()) return;
-	dispatch(worker, m_jobs_ready.front());
-	m_jobs_ready.pop_front();
+	auto &jobs = m_workers[worker.m_id];
+	jobs.m_cores = worker.m_cores;
+	jobs.m_score = worker.m_score;
+	jobs.m_local = worker.m_id.m_device_id == m_router.get_dev_id();
 }
 
 void Farm::sub_worker(const Net_ID &worker)
 {
-	auto itr = m_jobs_assigned.find(worker);
-	if (itr != end(m_jobs_assigned))
+	//put its jobs back on the ready list
+	auto itr = m_workers.find(worker);
+	if (itr == end(m_workers)) return;
+	auto keys = std::move(itr->second.m_keys);
+	for (auto key : keys)
+	{
+		auto ticket = m_jobs_assigned.find(key);
+		m_deadlines.cancel(ticket->second.m_deadline);
+		//unless its copy is still out
+		auto twin = m_jobs_assigned.find(ticket->second.m_twin);
+		if (twin != end(m_jobs_assigned)) twin->second.m_twin = NO_TWIN;
+		else m_jobs_ready.emplace_back(ready{std::move(ticket->second.m_job), ticket->second.m_units});
+		m_jobs_by_age.erase(key);
+		m_jobs_assigned.erase(ticket);
+	}
+	if (itr->second.m_ranked) m_workers_by_rank.erase(std::make_pair(itr->second.m_rank, worker));
+	m_workers.erase(itr);
+}
+
+bool Farm::next_job(const Farm::worker &jobs, size_t out, ready &job)
+{
+	//ready jobs first, then a cut of the range sized for this worker
+	if (!m_jobs_ready.empty())
 	{
-		auto &tickets = itr->second;
-		std::for_each(begin(tickets), end(tickets), [&] (auto &t)
+		job = std::move(m_jobs_ready.front());
+		m_jobs_ready.pop_front();
+		return true;
+	}
+	auto left = m_range_end - m_range_start;
+	if (!left) return !out && spare_job(jobs, job);
+	//enough to keep a core busy for the target time, or to cover its share of the
+	//round trip when it's far away, but no more than half its share of what's left.
+	//one unit till we know how fast it is, then no more than double its last cut,
+	//the rate it was measured at may not hold for the units ahead.
+	auto units = 1.0;
+	if (jobs.m_rate > 0.0)
+	{
+		auto time = std::max((double)m_target.count(), jobs.m_rtt / m_job_limit);
+		units = std::min({jobs.m_rate * time / std::max(jobs.m_cores, 1u), 2.0 * jobs.m_cut, left / (2.0 * m_workers.size())});
+	}
+	auto cut = (uint32_t)std::clamp(std::ceil(units), 1.0, (double)left);
+	job = ready{m_make_job(m_range_start, m_range_start + cut), cut};
+	m_range_start += cut;
+	return true;
+}
+
+bool Farm::spare_job(const Farm::worker &jobs, ready &job)
+{
+	//nothing left to hand out, so copy the oldest job still out on another worker,
+	//that has no copy, if it's been out more than twice as long as either worker
+	//takes for a job, it's stuck not just queued
+	if (!m_speculate) return false;
+	auto now = std::chrono::steady_clock::now();
+	for (auto key : m_jobs_by_age)
+	{
+		auto &ticket = m_jobs_assigned[key];
+		if (ticket.m_jobs == &jobs) continue;
+		auto age = std::chrono::duration<double, std::milli>(now - ticket.m_time).count();
+		if (age < 2.0 * std::max({jobs.m_rtt, ticket.m_jobs->m_rtt, (double)m_target.count()})) return false;
+		auto copy = std::make_shared<Msg>(ticket.m_job->size());
+		memcpy(copy->begin(), ticket.m_job->begin(), ticket.m_job->size());
+		job = ready{copy, ticket.m_units, key};
+		m_jobs_by_age.erase(key);
+		return true;
+	}
+	return false;
+}
+
+void Farm::cancel(const Net_ID &worker, uint32_t type, uint32_t key)
+{
+	auto msg = std::make_shared<Msg>(sizeof(Job));
+	auto msg_body = (Job*)msg->begin();
+	msg_body->m_worker = worker;
+	msg_body->m_farm = m_id;
+	msg_body->m_key = key;
+	msg_body->m_type = type;
+	msg->set_dest(worker);
+	m_router.send(msg);
+}
+
+void Farm::shares()
+{
+	//share of the job limit by advertised capacity, relative to the average,
+	//those that don't advertise get the average
+	auto total = 0.0;
+	auto known = 0u;
+	for (auto &worker : m_workers)
+	{
+		if (!worker.second.m_cores || worker.second.m_score <= 0.0) continue;
+		total += worker.second.m_cores * worker.second.m_score;
+		known++;
+	}
+	for (auto &worker : m_workers)
+	{
+		auto &jobs = worker.second;
+		auto share = 1.0;
+		if (known && jobs.m_cores && jobs.m_score > 0.0) share = jobs.m_cores * jobs.m_score * known / total;
+		jobs.m_share = std::clamp((uint32_t)std::lround(m_job_limit * share), 1u, 4 * m_job_limit);
+		limit(worker.first, jobs);
+	}
+}
+
+void Farm::limit(const Net_ID &worker, Farm::worker &jobs)
+{
+	//cutting a range, a cut per core and as many more as fit in its round trip.
+	//else its share of the job limit.
+	if (m_make_job)
+	{
+		auto cover = jobs.m_min_rtt / std::max((double)m_target.count(), 1.0);
+		jobs.m_limit = std::max(jobs.m_cores, 1u) + std::clamp((uint32_t)cover, 1u, m_job_limit);
+	}
+	else jobs.m_limit = jobs.m_share;
+	rank(worker, jobs);
+}
+
+void Farm::rank(const Net_ID &worker, Farm::worker &jobs)
+{
+	//workers with room, ordered by how full they'd be with one more job. those on
+	//other devices go behind by the part of their round trip that's the link, as
+	//near as the local workers show, or wholly till we've heard from them.
+	auto room = jobs.m_keys.size() < jobs.m_limit;
+	auto rank = 0.0;
+	if (room)
+	{
+		rank = (jobs.m_keys.size() + 1.0) / jobs.m_limit;
+		if (!jobs.m_local)
 		{
-			m_jobs_ready.emplace_back(std::move(t.m_job));
-		});
-		m_jobs_assigned.erase(itr);
+			if (jobs.m_min_rtt <= 0.0) rank += 1.0;
+			else if (m_local_rtt > 0.0) rank += std::max(0.0, 1.0 - m_local_rtt / jobs.m_min_rtt);
+		}
 	}
+	if (room == jobs.m_ranked && rank == jobs.m_rank) return;
+	if (jobs.m_ranked) m_workers_by_rank.erase(std::make_pair(jobs.m_rank, worker));
+	if (room) m_workers_by_rank.emplace(rank, worker);
+	jobs.m_ranked = room;
+	jobs.m_rank = rank;
 }
 
-void Farm::dispatch(const Net_ID &worker, std::shared_ptr<Msg> job)
+void Farm::dispatch(const Net_ID &worker, Farm::worker &jobs, ready &&job)
 {
-	auto now = std::chrono::high_resolution_clock::now();
-	m_jobs_assigned[worker].push_back(ticket{job, now});
-	auto job_body = (Job*)job->begin();
+	send(worker, jobs, std::move(job));
+	rank(worker, jobs);
+}
+
+void Farm::send(const Net_ID &worker, Farm::worker &jobs, ready &&job)
+{
+	auto key = m_job_key++;
+	jobs.m_keys.insert(key);
+	auto now = std::chrono::steady_clock::now();
+	auto deadline = m_deadlines.arm(now + m_timeout, key);
+	m_jobs_assigned[key] = ticket{job.m_job, job.m_units, worker, &jobs, deadline, now, job.m_twin};
+	if (job.m_twin != NO_TWIN) m_jobs_assigned[job.m_twin].m_twin = key;
+	//keys go up with time, so the jobs with no copy are kept oldest first
+	if (job.m_twin == NO_TWIN) m_jobs_by_age.emplace_hint(end(m_jobs_by_age), key);
+	auto job_body = (Job*)job.m_job->begin();
 	job_body->m_worker = worker;
-	job_body->m_key = m_job_key++;
-	m_dispatch(worker, job);
-	job->set_dest(worker);
-	global_router->send(job);
+	job_body->m_farm = m_id;
+	job_body->m_key = key;
+	job_body->m_type = type_job;
+	m_dispatch(worker, job.m_job);
+	m_outbox.emplace_back(worker, job.m_job);
 }
 
-void Farm::restart()
+void Farm::flush()
 {
-	auto now = std::chrono::high_resolution_clock::now();
-	for (auto &itr : m_jobs_assigned)
+	//send what's waiting, a batch msg per run of jobs for the same worker
+	if (m_outbox.size() > 1)
+	{
+		std::stable_sort(begin(m_outbox), end(m_outbox), [] (auto &a, auto &b) { return a.first < b.first; });
+	}
+	std::vector<std::shared_ptr<Msg>> batch;
+	for (auto itr = begin(m_outbox); itr != end(m_outbox);)
 	{
-		auto &tickets = itr.second;
-		for (auto titr = begin(tickets); titr != end(tickets);)
+		auto &worker = itr->first;
+		batch.clear();
+		for (; itr != end(m_outbox) && itr->first == worker && batch.size() < m_batch; ++itr)
 		{
-			auto then = titr->m_time;
-			auto age = std::chrono::duration_cast<std::chrono::milliseconds>(now - then);
-			if (age > m_timeout)
-			{
-				m_jobs_ready.emplace_front(titr->m_job);
-				titr = tickets.erase(titr);
-			}
-			else ++titr;
+			batch.push_back(itr->second);
 		}
+		auto msg = batch.size() == 1 ? batch[0] : pack(batch);
+		msg->set_dest(worker);
+		m_router.send(msg);
+	}
+	m_outbox.clear();
+}
+
+Farm::ready Farm::retire(uint32_t key)
+{
+	//take a job off its worker, its deadline has already gone
+	auto ticket = m_jobs_assigned.find(key);
+	auto job = ready{std::move(ticket->second.m_job), ticket->second.m_units};
+	auto twin = m_jobs_assigned.find(ticket->second.m_twin);
+	if (twin != end(m_jobs_assigned)) twin->second.m_twin = NO_TWIN;
+	auto worker = ticket->second.m_worker;
+	auto &jobs = *ticket->second.m_jobs;
+	jobs.m_keys.erase(key);
+	m_jobs_by_age.erase(key);
+	m_jobs_assigned.erase(ticket);
+	rank(worker, jobs);
+	return job;
+}
+
+void Farm::restart()
+{
+	auto now = std::chrono::steady_clock::now();
+	while (!m_deadlines.empty() && m_deadlines.next_time() <= now)
+	{
+		//no need to redo it if its copy is still out
+		auto key = m_deadlines.pop();
+		auto twin = m_jobs_assigned[key].m_twin;
+		auto job = retire(key);
+		if (twin == NO_TWIN) m_jobs_ready.emplace_front(std::move(job));
 	}
 }
 
 void Farm::assign_work()
 {
-	if (m_jobs_ready.empty()) return;
-	for (auto itr = begin(m_jobs_ready); itr != end(m_jobs_ready);)
+	ready job;
+	while (!m_workers_by_rank.empty())
 	{
-		const Net_ID *worker = nullptr;
-		size_t cnt = 1000000;
-		for (auto &entry : m_jobs_assigned)
-		{
-			auto c = entry.second.size();
-			if (c < m_job_limit && c < cnt)
-			{
-				worker = &entry.first;
-				cnt = entry.second.size();
-			}
-		}
-		if (cnt == 1000000) return;		
-		dispatch(*worker, *itr);
-		itr = m_jobs_ready.erase(itr);
+		auto worker = begin(m_workers_by_rank)->second;
+		auto &jobs = m_workers[worker];
+		if (!next_job(jobs, jobs.m_keys.size(), job)) break;
+		dispatch(worker, jobs, std::move(job));
 	}
+	flush();
 }
 
 void Farm::complete_job(std::shared_ptr<Msg> job)
 {
+	complete(job);
+	flush();
+}
+
+void Farm::complete_jobs(const std::shared_ptr<Msg> &msg, const std::function<void(const std::shared_ptr<Msg> &reply)> &use)
+{
+	//the next jobs for the worker go back out together
+	auto done = [&] (const std::shared_ptr<Msg> &reply)
+	{
+		if (!validate_job(reply)) return;
+		use(reply);
+		complete(reply);
+	};
+	if (((Job*)msg->begin())->m_type != type_batch) done(msg);
+	else for (auto &reply : unpack(msg)) done(reply);
+	flush();
+}
+
+void Farm::complete(std::shared_ptr<Msg> job)
+{
+	if (!validate_job(job)) return;
 	auto job_body = (Job*)job->begin();
-	auto worker = job_body->m_worker;
 	auto key = job_body->m_key;
-	auto itr = m_jobs_assigned.find(worker);
-	if (itr != end(m_jobs_assigned))
+	auto itr = m_jobs_assigned.find(key);
+	auto worker = itr->second.m_worker;
+	auto &jobs = *itr->second.m_jobs;
+	m_deadlines.cancel(itr->second.m_deadline);
+
+	//first of a pair of copies back wins, the other is cancelled
+	auto twin = itr->second.m_twin;
+	if (twin != NO_TWIN)
+	{
+		auto &other = m_jobs_assigned[twin];
+		cancel(other.m_worker, type_cancel_job, twin);
+		m_deadlines.cancel(other.m_deadline);
+		retire(twin);
+	}
+
+	//update its round trip time, and its rate from the units done since its last
+	//reply, or over the round trip if it's been idle
+	auto now = std::chrono::steady_clock::now();
+	auto rtt = std::chrono::duration<double, std::milli>(now - itr->second.m_time).count();
+	auto since = std::chrono::duration<double, std::milli>(now - jobs.m_last_done).count();
+	auto rate = itr->second.m_units / std::max(std::min(rtt, since), 0.001);
+	jobs.m_rtt = jobs.m_rtt > 0.0 ? jobs.m_rtt * 0.75 + rtt * 0.25 : rtt;
+	if (jobs.m_min_rtt <= 0.0 || rtt < jobs.m_min_rtt)
+	{
+		jobs.m_min_rtt = rtt;
+		if (jobs.m_local && (m_local_rtt <= 0.0 || rtt < m_local_rtt)) m_local_rtt = rtt;
+		limit(worker, jobs);
+	}
+	if (itr->second.m_units)
+	{
+		jobs.m_rate = jobs.m_rate > 0.0 ? jobs.m_rate * 0.75 + rate * 0.25 : rate;
+		jobs.m_cut = itr->second.m_units;
+	}
+	jobs.m_last_done = now;
+
+	ready next;
+	auto out = jobs.m_keys.size() - 1;
+	if (out >= jobs.m_limit || !next_job(jobs, out, next)) retire(key);
+	else
+	{
+		//straight on to the next, its rank stays the same
+		jobs.m_keys.erase(key);
+		m_jobs_by_age.erase(key);
+		m_jobs_assigned.erase(itr);
+		send(worker, jobs, std::move(next));
+	}
+	//the loser has room now
+	if (twin != NO_TWIN) assign_work();
+}
+
+//batch msgs are a job header, with the count as the key, then each msg as its
+//length and its body. everything 8 byte aligned, so the bodies can be used in place.
+static uint32_t batch_align(size_t size)
+{
+	return (uint32_t)((size + 7) & ~7);
+}
+
+std::shared_ptr<Msg> Farm::pack(const std::vector<std::shared_ptr<Msg>> &msgs)
+{
+	auto size = batch_align(sizeof(Job));
+	for (auto &msg : msgs) size += 8 + batch_align(msg->size());
+	auto batch = std::make_shared<Msg>(size);
+	auto data = batch->begin();
+	memset(data, 0, size);
+	//worker and farm from the first
+	auto batch_body = (Job*)data;
+	memcpy(batch_body, msgs[0]->begin(), sizeof(Job));
+	batch_body->m_key = (uint32_t)msgs.size();
+	batch_body->m_type = type_batch;
+	auto pos = batch_align(sizeof(Job));
+	for (auto &msg : msgs)
+	{
+		*(uint32_t*)(data + pos) = msg->size();
+		msg->gather(data + pos + 8);
+		pos += 8 + batch_align(msg->size());
+	}
+	return batch;
+}
+
+std::vector<std::shared_ptr<Msg>> Farm::unpack(const std::shared_ptr<Msg> &msg)
+{
+	//slices of the batch body, not copies
+	auto msg_body = (Job*)msg->begin();
+	if (msg->size() < sizeof(Job) || msg_body->m_type != type_batch) return {msg};
+	auto msgs = std::vector<std::shared_ptr<Msg>>{};
+	msgs.reserve(msg_body->m_key);
+	auto pos = batch_align(sizeof(Job));
+	for (auto i = 0u; i < msg_body->m_key && pos + 8 <= msg->size(); ++i)
+	{
+		auto len = *(uint32_t*)(msg->begin() + pos);
+		pos += 8;
+		if (len > msg->size() - pos) break;
+		auto part = std::make_shared<Msg>();
+		msg->slice(*part, pos, len);
+		part->m_header = Msg_Header(len);
+		msgs.push_back(part);
+		pos += batch_align(len);
+	}
+	return msgs;
+}
+
+void Farm::Replies::reply(size_t index, std::shared_ptr<Msg> reply)
+{
+	std::vector<std::shared_ptr<Msg>> replies;
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_replies[index] = std::move(reply);
+		if (--m_left) return;
+		for (auto &msg : m_replies) if (msg) replies.push_back(std::move(msg));
+	}
+	if (replies.empty()) return;
+	auto msg = replies.size() == 1 ? replies[0] : pack(replies);
+	msg->set_dest(replies[0]->m_header.m_dest);
+	m_router.send(msg);
+}
+
+bool Farm::Cancels::note(const std::shared_ptr<Msg> &msg)
+{
+	auto msg_body = (Job*)msg->begin();
+	if (msg_body->m_type != type_cancel_job && msg_body->m_type != type_cancel_farm) return false;
+	std::lock_guard<std::mutex> l(m_mutex);
+	if (msg_body->m_type == type_cancel_farm)
 	{
-		auto &tickets = itr->second;
-		auto titr = std::find_if(begin(tickets), end(tickets), [&] (auto &ticket)
+		if (m_farms.insert(msg_body->m_farm).second) m_farms_order.push_back(msg_body->m_farm);
+		if (m_farms_order.size() > MAX_FARMS)
 		{
-			auto job_body = (Job*)ticket.m_job->begin();
-			return key == job_body->m_key;
-		});
-		if (titr == end(tickets)) return;
-		tickets.erase(titr);
-		if (m_jobs_ready.empty()) return;
-		dispatch(worker, m_jobs_ready.front());
-		m_jobs_ready.pop_front();
+			m_farms.erase(m_farms_order.front());
+			m_farms_order.pop_front();
+		}
 	}
+	else
+	{
+		auto job = std::make_pair(msg_body->m_farm, msg_body->m_key);
+		if (m_jobs.insert(job).second) m_jobs_order.push_back(job);
+		if (m_jobs_order.size() > MAX_JOBS)
+		{
+			m_jobs.erase(m_jobs_order.front());
+			m_jobs_order.pop_front();
+		}
+	}
+	m_noted.store(true, std::memory_order_release);
+	return true;
+}
+
+bool Farm::Cancels::cancelled(const Job &job) const
+{
+	//nothing to lock till the first cancel
+	if (!m_noted.load(std::memory_order_acquire)) return false;
+	std::lock_guard<std::mutex> l(m_mutex);
+	return m_farms.find(job.m_farm) != end(m_farms)
+		|| m_jobs.find(std::make_pair(job.m_farm, job.m_key)) != end(m_jobs);
 }
 
 void Farm::refresh()
 {
 	auto workers = census();
 	restart();
-	leavers(workers);
-	joiners(workers);
+	auto left = leavers(workers);
+	auto joined = joiners(workers);
+	if (left || joined) shares();
 	assign_work();
 }
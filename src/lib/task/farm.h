@@ -2,53 +2,202 @@
 #define FARM_H
 
 #include "../mail/msg.h"
+#include "../utils/timer_heap.h"
 #include <vector>
-#include <list>
+#include <deque>
 #include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <atomic>
 
+class Router;
+
+//farm of jobs handed out to the workers that the router's directory lists.
+//workers advertise their cores and a per core score in their directory params, see
+//worker_params(), and each gets a share of the jobs in flight by its capacity.
+//workers with room are kept ordered by how full they are, with those on other
+//devices held back by how much of their round trip is the link, or wholly till
+//they've replied, so the first wave goes to local workers. tickets are found by
+//job key and timed out from a deadline heap. nothing scans all the jobs or
+//workers, except the census and when the workforce changes.
+//work can also be given as a range of units, eg. scanlines, that the farm cuts into
+//jobs as workers have room. each worker's rate and round trip time are tracked and
+//a cut is sized to keep it busy for the target time, and no more than its share of
+//what's left, so the cuts get finer towards the end and no one is left straggling.
+//a worker has a cut out per core, plus as many as its round trip covers, and a cut
+//no more than doubles its last.
+//once there's nothing left to hand out, an idle worker is given a copy of the oldest
+//job still out, if it's been out twice as long as its workers take for a job. the
+//first reply wins and the other copy is cancelled. when the farm goes, the jobs it
+//still has out are cancelled, workers check for cancels with Farm::Cancels.
+//jobs going to the same worker in one go are packed into batch msgs, workers can
+//reply to a batch in one msg with Farm::Replies, complete_jobs() takes either.
+//tickets and deadlines are still per job.
 class Farm
 {
 public:
+	enum
+	{
+		type_job,
+		type_cancel_job,
+		type_cancel_farm,
+		type_batch,
+	};
 	struct Job
 	{
 		Net_ID m_worker;
+		Net_ID m_farm;
 		uint32_t m_key;
+		uint32_t m_type;
+	};
+	//worker side gathering of the replies to a batch of jobs, the last reply in
+	//sends them all as one msg. give a nullptr for a job that has no reply.
+	class Replies
+	{
+	public:
+		Replies(Router &router, size_t count)
+			: m_router(router)
+			, m_replies(count)
+			, m_left(count)
+		{}
+		void reply(size_t index, std::shared_ptr<Msg> reply);
+	private:
+		Router &m_router;
+		std::mutex m_mutex;
+		std::vector<std::shared_ptr<Msg>> m_replies;
+		size_t m_left;
+	};
+	//worker side record of cancels.
+	//note() takes cancel msgs, the worker loop checks cancelled() between rows.
+	//only the most recent cancels are kept, a cancel for a job that's long gone
+	//falls off the end.
+	class Cancels
+	{
+	public:
+		//false if it's not a cancel msg
+		bool note(const std::shared_ptr<Msg> &msg);
+		bool cancelled(const Job &job) const;
+	private:
+		const size_t MAX_FARMS = 64;
+		const size_t MAX_JOBS = 1024;
+		mutable std::mutex m_mutex;
+		std::atomic<bool> m_noted {false};
+		std::set<Net_ID> m_farms;
+		std::deque<Net_ID> m_farms_order;
+		std::set<std::pair<Net_ID, uint32_t>> m_jobs;
+		std::deque<std::pair<Net_ID, uint32_t>> m_jobs_order;
 	};
-	Farm(const std::string &service_prefix,
+	Farm(Router &router,
+		const std::string &service_prefix,
 		uint32_t job_limit,
 		std::chrono::milliseconds timeout,
-		std::function<void(const Net_ID &, std::shared_ptr<Msg> job)> dispatch)
-		: m_service_prefix(service_prefix)
-		, m_job_limit(job_limit)
-		, m_timeout(timeout)
-		, m_dispatch(dispatch)
-	{}
+		std::function<void(const Net_ID &, std::shared_ptr<Msg> job)> dispatch);
+	~Farm();
 	void add_job(std::shared_ptr<Msg> job);
+	void add_range(uint32_t start, uint32_t end, std::chrono::milliseconds target,
+		std::function<std::shared_ptr<Msg>(uint32_t start, uint32_t end)> make_job);
 	bool validate_job(std::shared_ptr<Msg> job);
 	void complete_job(std::shared_ptr<Msg> job);
+	//complete a reply, or a batch of them, use() is called for each valid one
+	void complete_jobs(const std::shared_ptr<Msg> &msg, const std::function<void(const std::shared_ptr<Msg> &reply)> &use);
 	void assign_work();
 	void refresh();
+	//copy stragglers onto idle workers, on by default
+	void speculate(bool on) { m_speculate = on; }
+	//most jobs in a batch msg, 1 for no batching
+	void batch(uint32_t jobs) { m_batch = std::max(jobs, 1u); }
+	//pack msgs into a batch msg, unpack a msg that may be a batch
+	static std::shared_ptr<Msg> pack(const std::vector<std::shared_ptr<Msg>> &msgs);
+	static std::vector<std::shared_ptr<Msg>> unpack(const std::shared_ptr<Msg> &msg);
+	//directory params for a worker, these params plus its cores and score
+	static std::string worker_params(const std::string &params);
 private:
+	static const uint32_t NO_TWIN = -1;
+	struct advert
+	{
+		Net_ID m_id;
+		//0 if not advertised
+		uint32_t m_cores = 0;
+		double m_score = 0.0;
+	};
+	struct worker
+	{
+		std::unordered_set<uint32_t> m_keys;
+		uint32_t m_cores = 0;
+		double m_score = 0.0;
+		bool m_local = false;
+		//jobs out by its share of the capacity, and the most it can have out
+		uint32_t m_share = 0;
+		uint32_t m_limit = 0;
+		//place in the dispatch order, if it has room
+		double m_rank = 0.0;
+		bool m_ranked = false;
+		//units per ms and round trip ms, 0 till the first job comes back
+		double m_rate = 0.0;
+		double m_rtt = 0.0;
+		double m_min_rtt = 0.0;
+		//units in the last cut it finished
+		uint32_t m_cut = 0;
+		std::chrono::steady_clock::time_point m_last_done;
+	};
+	struct ready
+	{
+		std::shared_ptr<Msg> m_job;
+		uint32_t m_units = 0;
+		//key of the job this is a copy of
+		uint32_t m_twin = NO_TWIN;
+	};
 	struct ticket
 	{
 		std::shared_ptr<Msg> m_job;
-		std::chrono::high_resolution_clock::time_point m_time;
+		uint32_t m_units;
+		Net_ID m_worker;
+		worker *m_jobs;
+		Timer_Heap<uint32_t>::Handle m_deadline;
+		std::chrono::steady_clock::time_point m_time;
+		uint32_t m_twin;
 	};
-	std::vector<Net_ID> census();
-	void joiners(const std::vector<Net_ID> &census);
-	void leavers(const std::vector<Net_ID> &census);
-	void add_worker(const Net_ID &worker);
+	std::vector<advert> census();
+	bool joiners(const std::vector<advert> &census);
+	bool leavers(const std::vector<advert> &census);
+	void add_worker(const advert &worker);
 	void sub_worker(const Net_ID &worker);
-	void dispatch(const Net_ID &worker, std::shared_ptr<Msg> job);
+	bool next_job(const Farm::worker &jobs, size_t out, ready &job);
+	bool spare_job(const Farm::worker &jobs, ready &job);
+	void cancel(const Net_ID &worker, uint32_t type, uint32_t key);
+	void dispatch(const Net_ID &worker, Farm::worker &jobs, ready &&job);
+	void send(const Net_ID &worker, Farm::worker &jobs, ready &&job);
+	void flush();
+	void complete(std::shared_ptr<Msg> job);
+	void shares();
+	void limit(const Net_ID &worker, Farm::worker &jobs);
+	void rank(const Net_ID &worker, Farm::worker &jobs);
+	ready retire(uint32_t key);
 	void restart();
-	std::vector<Net_ID> m_workers;
-	std::list<std::shared_ptr<Msg>> m_jobs_ready;
-	std::map<Net_ID, std::list<ticket>> m_jobs_assigned;
+	Router &m_router;
+	std::map<Net_ID, worker> m_workers;
+	std::set<std::pair<double, Net_ID>> m_workers_by_rank;
+	std::deque<ready> m_jobs_ready;
+	std::unordered_map<uint32_t, ticket> m_jobs_assigned;
+	std::set<uint32_t> m_jobs_by_age;
+	std::vector<std::pair<Net_ID, std::shared_ptr<Msg>>> m_outbox;
+	Timer_Heap<uint32_t> m_deadlines;
 	const std::string m_service_prefix;
 	const std::function<void(const Net_ID &worker, std::shared_ptr<Msg> job)> m_dispatch;
 	const std::chrono::milliseconds m_timeout;
 	const uint32_t m_job_limit;
 	uint32_t m_job_key = 0;
+	std::function<std::shared_ptr<Msg>(uint32_t start, uint32_t end)> m_make_job;
+	std::chrono::milliseconds m_target {0};
+	uint32_t m_range_start = 0;
+	uint32_t m_range_end = 0;
+	//shortest round trip of any local worker
+	double m_local_rtt = 0.0;
+	const Net_ID m_id;
+	bool m_speculate = true;
+	uint32_t m_batch = 16;
 };
 
 #endif
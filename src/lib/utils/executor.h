@@ -0,0 +1,186 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <array>
+#include <deque>
+#include <map>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+//count of an owner's jobs in flight, so it can wait for them all to finish
+//before it goes away.
+class Job_Group
+{
+	friend class Executor;
+public:
+	void wait()
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		while (m_count) m_cv.wait(l);
+	}
+private:
+	void add()
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_count++;
+	}
+	void done()
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		if (--m_count == 0) m_cv.notify_all();
+	}
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	uint32_t m_count = 0;
+};
+
+//work stealing executor.
+//each worker has a deque per priority class, jobs posted from a worker go on its
+//own deque and it takes its newest first, jobs posted from anywhere else are dealt
+//round robin. a worker with nothing to do steals the oldest job from the others.
+//higher priority jobs are always taken, or stolen, before lower ones.
+//post() is fire and forget, no future or packaged task is made.
+//global() is shared by the whole process, one worker per core, for jobs that
+//compute. jobs that block, on flow control or a reply, should go on a named pool
+//so they can't starve everyone else, or each other.
+//workers finish any jobs left before the executor goes.
+class Executor
+{
+public:
+	enum
+	{
+		prio_high,
+		prio_normal,
+		prio_low,
+		prio_size,
+	};
+	typedef std::function<void()> Job;
+	Executor(uint32_t threads = std::max(std::thread::hardware_concurrency(), 1u))
+	{
+		for (auto i = 0u; i < threads; ++i) m_workers.emplace_back(std::make_unique<Worker>());
+		for (auto i = 0u; i < threads; ++i) m_workers[i]->m_thread = std::thread(&Executor::run, this, i);
+	}
+	~Executor()
+	{
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			m_running = false;
+			m_cv.notify_all();
+		}
+		for (auto &worker : m_workers) worker->m_thread.join();
+	}
+	//the process wide executor
+	static Executor &global()
+	{
+		static Executor executor;
+		return executor;
+	}
+	//named sub pool, created with this many threads the first time it's asked for
+	static Executor &pool(const std::string &name, uint32_t threads)
+	{
+		static std::mutex mutex;
+		static std::map<std::string, std::unique_ptr<Executor>> pools;
+		std::lock_guard<std::mutex> l(mutex);
+		auto &executor = pools[name];
+		if (!executor) executor = std::make_unique<Executor>(threads);
+		return *executor;
+	}
+	void post(Job job, uint32_t prio = prio_normal, Job_Group *group = nullptr)
+	{
+		if (group) group->add();
+		auto index = t_executor == this ? t_index
+			: m_next.fetch_add(1, std::memory_order_relaxed) % m_workers.size();
+		auto &worker = *m_workers[index];
+		{
+			std::lock_guard<std::mutex> l(worker.m_mutex);
+			worker.m_ques[prio].emplace_back(Item{std::move(job), group});
+		}
+		//wake a sleeper if there is one
+		m_pending.fetch_add(1, std::memory_order_seq_cst);
+		if (m_sleepers.load(std::memory_order_seq_cst))
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			m_cv.notify_one();
+		}
+	}
+	auto size() const { return m_workers.size(); }
+private:
+	struct Item
+	{
+		Job m_job;
+		Job_Group *m_group;
+	};
+	struct Worker
+	{
+		std::mutex m_mutex;
+		std::array<std::deque<Item>, prio_size> m_ques;
+		std::thread m_thread;
+	};
+	bool take(uint32_t index, Item &item)
+	{
+		//our own newest first, then the oldest of the others, a priority at a time
+		auto size = (uint32_t)m_workers.size();
+		for (auto prio = 0u; prio < prio_size; ++prio)
+		{
+			for (auto i = 0u; i < size; ++i)
+			{
+				auto &worker = *m_workers[(index + i) % size];
+				std::lock_guard<std::mutex> l(worker.m_mutex);
+				auto &que = worker.m_ques[prio];
+				if (que.empty()) continue;
+				if (i == 0)
+				{
+					item = std::move(que.back());
+					que.pop_back();
+				}
+				else
+				{
+					item = std::move(que.front());
+					que.pop_front();
+				}
+				return true;
+			}
+		}
+		return false;
+	}
+	void run(uint32_t index)
+	{
+		t_executor = this;
+		t_index = index;
+		Item item;
+		for (;;)
+		{
+			if (take(index, item))
+			{
+				m_pending.fetch_sub(1, std::memory_order_relaxed);
+				item.m_job();
+				item.m_job = nullptr;
+				if (item.m_group) item.m_group->done();
+				continue;
+			}
+			//nothing to do, sleep till there is, or we are done
+			std::unique_lock<std::mutex> l(m_mutex);
+			m_sleepers.fetch_add(1, std::memory_order_seq_cst);
+			while (m_running && !m_pending.load(std::memory_order_seq_cst)) m_cv.wait(l);
+			m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+			if (!m_running && !m_pending.load(std::memory_order_relaxed)) return;
+		}
+	}
+	std::vector<std::unique_ptr<Worker>> m_workers;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::atomic<uint64_t> m_pending {0};
+	std::atomic<uint32_t> m_sleepers {0};
+	std::atomic<uint32_t> m_next {0};
+	bool m_running = true;
+	static inline thread_local Executor *t_executor = nullptr;
+	static inline thread_local uint32_t t_index = 0;
+};
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef TIMER_HEAP_H
+#define TIMER_HEAP_H
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include <cstdint>
+
+//////////////////////
+// timer heap template
+//////////////////////
+
+//4-ary min heap of timers with handles.
+//a handle is a slot index in the low 32 bits and the slot generation in the high
+//32 bits, the generation is bumped when the timer goes, so a stale handle can be
+//cancelled without harm. slots know where their timer is in the heap, so a cancel
+//goes straight to it. 4 children per node keeps the heap shallow and each sift
+//down looks at one cache line of times.
+template<class T, class Clock = std::chrono::steady_clock>
+class Timer_Heap
+{
+public:
+	typedef uint64_t Handle;
+	//arm a timer, returns its handle
+	Handle arm(typename Clock::time_point time, const T &data)
+	{
+		uint32_t slot;
+		if (m_free.empty())
+		{
+			slot = (uint32_t)m_slots.size();
+			m_slots.emplace_back();
+		}
+		else
+		{
+			slot = m_free.back();
+			m_free.pop_back();
+		}
+		m_slots[slot].m_data = data;
+		m_heap.push_back(Entry{time, slot});
+		up((uint32_t)m_heap.size() - 1);
+		return ((Handle)m_slots[slot].m_gen << 32) + slot;
+	}
+	//cancel a timer, false if it has already gone
+	bool cancel(Handle handle)
+	{
+		auto slot = (uint32_t)handle;
+		if (slot >= m_slots.size() || m_slots[slot].m_gen != (uint32_t)(handle >> 32)) return false;
+		remove(m_slots[slot].m_pos);
+		return true;
+	}
+	//data of a live timer, nullptr if it has gone
+	T *find(Handle handle)
+	{
+		auto slot = (uint32_t)handle;
+		if (slot >= m_slots.size() || m_slots[slot].m_gen != (uint32_t)(handle >> 32)) return nullptr;
+		return &m_slots[slot].m_data;
+	}
+	bool empty() const { return m_heap.empty(); }
+	size_t size() const { return m_heap.size(); }
+	//time of the next timer to go, heap must not be empty
+	typename Clock::time_point next_time() const { return m_heap.front().m_time; }
+	//take the next timer to go, heap must not be empty
+	T pop()
+	{
+		auto data = std::move(m_slots[m_heap.front().m_slot].m_data);
+		remove(0);
+		return data;
+	}
+private:
+	struct Entry
+	{
+		typename Clock::time_point m_time;
+		uint32_t m_slot;
+	};
+	struct Slot
+	{
+		uint32_t m_pos = 0;
+		uint32_t m_gen = 0;
+		T m_data;
+	};
+	void place(uint32_t pos, const Entry &entry)
+	{
+		m_heap[pos] = entry;
+		m_slots[entry.m_slot].m_pos = pos;
+	}
+	void up(uint32_t pos)
+	{
+		auto entry = m_heap[pos];
+		while (pos)
+		{
+			auto parent = (pos - 1) / 4;
+			if (!(entry.m_time < m_heap[parent].m_time)) break;
+			place(pos, m_heap[parent]);
+			pos = parent;
+		}
+		place(pos, entry);
+	}
+	void down(uint32_t pos)
+	{
+		auto entry = m_heap[pos];
+		auto size = (uint32_t)m_heap.size();
+		for (;;)
+		{
+			auto first = pos * 4 + 1;
+			if (first >= size) break;
+			auto last = std::min(first + 4, size);
+			auto min = first;
+			for (auto child = first + 1; child < last; ++child)
+			{
+				if (m_heap[child].m_time < m_heap[min].m_time) min = child;
+			}
+			if (!(m_heap[min].m_time < entry.m_time)) break;
+			place(pos, m_heap[min]);
+			pos = min;
+		}
+		place(pos, entry);
+	}
+	void remove(uint32_t pos)
+	{
+		//free the slot, fill the hole with the last entry and restore the order
+		auto slot = m_heap[pos].m_slot;
+		m_slots[slot].m_gen++;
+		m_slots[slot].m_data = T();
+		m_free.push_back(slot);
+		auto last = m_heap.back();
+		m_heap.pop_back();
+		if (pos == m_heap.size()) return;
+		m_heap[pos] = last;
+		if (pos && last.m_time < m_heap[(pos - 1) / 4].m_time) up(pos);
+		else down(pos);
+	}
+	std::vector<Entry> m_heap;
+	std::vector<Slot> m_slots;
+	std::vector<uint32_t> m_free;
+};
+
+#endif
@@ -4,6 +4,20 @@
 #include <fstream>
 #include <algorithm>
 #include <iterator>
+#include <cstring>
+
+//x86_64 always has SSE2, SSE4.2 is checked for at runtime
+#if defined(__x86_64__) || defined(_M_X64)
+	#define UTILS_X64
+	#include <emmintrin.h>
+	#include <nmmintrin.h>
+	#if defined(_MSC_VER)
+		#include <intrin.h>
+		#define TARGET_SSE42
+	#else
+		#define TARGET_SSE42 __attribute__((target("sse4.2")))
+	#endif
+#endif
 
 //////////////
 // files utils
@@ -221,79 +235,226 @@ uint32_t jenkins_hash(const uint8_t *key, size_t len)
 	return hash;
 }
 
+//crc32c (castagnoli) tables for slicing by 8, used when there is no crc32 instruction
+static const auto crc32c_table = []
+{
+	auto table = std::array<std::array<uint32_t, 256>, 8>{};
+	for (uint32_t i = 0; i < 256; ++i)
+	{
+		auto crc = i;
+		for (auto j = 0; j < 8; ++j) crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 1)));
+		table[0][i] = crc;
+	}
+	for (uint32_t i = 0; i < 256; ++i)
+	{
+		for (auto k = 1; k < 8; ++k) table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
+	}
+	return table;
+}();
+
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *buf, size_t len)
+{
+	auto &t = crc32c_table;
+	for (; len >= 8; buf += 8, len -= 8)
+	{
+		uint32_t lo, hi;
+		memcpy(&lo, buf, sizeof(lo));
+		memcpy(&hi, buf + 4, sizeof(hi));
+		lo ^= crc;
+		crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+			^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+	}
+	while (len--) crc = (crc >> 8) ^ t[0][(crc ^ *buf++) & 0xff];
+	return crc;
+}
+
+#ifdef UTILS_X64
+static bool cpu_has_sse42()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 20)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+static const bool has_sse42 = cpu_has_sse42();
+
+TARGET_SSE42 static uint32_t crc32c_hw(uint32_t crc, const uint8_t *buf, size_t len)
+{
+	uint64_t crc64 = crc;
+	for (; len >= 8; buf += 8, len -= 8)
+	{
+		uint64_t data;
+		memcpy(&data, buf, sizeof(data));
+		crc64 = _mm_crc32_u64(crc64, data);
+	}
+	crc = (uint32_t)crc64;
+	while (len--) crc = _mm_crc32_u8(crc, *buf++);
+	return crc;
+}
+#endif
+
+//used for link buffer error detection, newer wire format
+uint32_t crc32c(const uint8_t *buf, size_t len)
+{
+#ifdef UTILS_X64
+	if (has_sse42) return ~crc32c_hw(0xffffffff, buf, len);
+#endif
+	return ~crc32c_sw(0xffffffff, buf, len);
+}
+
 //////////
 // buffers
 //////////
 
-void obfuscate(uint8_t *key, size_t len)
+static const auto crypto_data = std::array<uint8_t, 1024>
+{
+	0x52, 0x68, 0x68, 0xf5, 0xc7, 0x59, 0x23, 0x68, 0x30, 0x2e, 0x02, 0xa8, 0x43, 0x97, 0x6f, 0xb8,
+	0x89, 0x97, 0x0d, 0x45, 0x81, 0x28, 0x42, 0x58, 0xf1, 0x1a, 0x5d, 0xee, 0x00, 0xb7, 0xbf, 0x41,
+	0x65, 0x98, 0x57, 0x23, 0x1d, 0x2d, 0x45, 0x41, 0x2d, 0xcc, 0x31, 0x9b, 0x7b, 0x0f, 0x3b, 0xfd,
+	0x9b, 0x81, 0x45, 0x50, 0xac, 0x49, 0x1c, 0xf9, 0x48, 0x48, 0x6b, 0x1d, 0x25, 0x1b, 0x32, 0x73,
+	0x76, 0xb5, 0x94, 0x6b, 0xc1, 0x24, 0xe9, 0xd1, 0xfa, 0x61, 0xc4, 0xf0, 0x47, 0xba, 0xb1, 0x71,
+	0x86, 0x29, 0x4e, 0x16, 0x24, 0x9a, 0x9c, 0x99, 0x38, 0x13, 0x1e, 0x9f, 0xbc, 0x81, 0x51, 0xbe,
+	0x3f, 0x49, 0x99, 0xc0, 0x39, 0xef, 0xf8, 0x81, 0x0a, 0xff, 0x7f, 0x1a, 0xc6, 0xae, 0x6d, 0x94,
+	0xb5, 0x1d, 0xa0, 0xee, 0x1d, 0x02, 0x4c, 0xb1, 0xa7, 0x80, 0xa7, 0x89, 0xe4, 0xd7, 0x8e, 0xfb,
+	0x52, 0x3f, 0x0d, 0xba, 0x06, 0x81, 0x48, 0xe9, 0xdd, 0x83, 0x2b, 0x0c, 0xe6, 0xbb, 0xc6, 0xad,
+	0x67, 0x2e, 0x21, 0x2c, 0x79, 0x0c, 0x4b, 0xf8, 0x05, 0x36, 0x39, 0x31, 0x18, 0xa1, 0x8d, 0x43,
+	0x4d, 0x0d, 0x9d, 0x78, 0xa1, 0x2e, 0xb0, 0x0b, 0xd4, 0x45, 0x4f, 0x33, 0x0d, 0xda, 0xf5, 0x08,
+	0x1f, 0x16, 0xd5, 0x02, 0xca, 0x6c, 0x28, 0x61, 0xf0, 0x5d, 0xfc, 0xf2, 0x24, 0x64, 0x23, 0xb7,
+	0x39, 0x3a, 0x8a, 0x2d, 0xf2, 0x43, 0xac, 0x80, 0x7d, 0xd3, 0xda, 0x4e, 0x45, 0xe7, 0x21, 0x0f,
+	0x2e, 0x5f, 0x6b, 0x7b, 0x1c, 0x73, 0xce, 0x3c, 0x30, 0x09, 0x91, 0x2b, 0xc0, 0xf0, 0xc4, 0x8d,
+	0x7b, 0x82, 0x17, 0xb2, 0x69, 0x45, 0x9e, 0x1b, 0xfb, 0xb2, 0x8c, 0xd2, 0x54, 0x0b, 0xe0, 0x4c,
+	0xa4, 0x49, 0xe4, 0x75, 0x47, 0x4a, 0xca, 0x3b, 0x35, 0x56, 0xba, 0x5e, 0xbd, 0xd9, 0xca, 0x44,
+	0xb9, 0x23, 0xb0, 0x46, 0xca, 0x42, 0x13, 0x77, 0x8d, 0x01, 0x22, 0x06, 0x9c, 0x2d, 0xec, 0x89,
+	0x5a, 0x87, 0xa9, 0x87, 0x25, 0x0a, 0x3f, 0x52, 0x07, 0x5b, 0xfc, 0xb8, 0x98, 0x2e, 0xa5, 0xbf,
+	0xdf, 0xbc, 0x60, 0xc3, 0xef, 0xd6, 0x56, 0x65, 0xd5, 0xd5, 0x17, 0x25, 0xad, 0x64, 0x4b, 0xfc,
+	0x5d, 0x7d, 0x52, 0xf8, 0x42, 0x83, 0x5a, 0xd9, 0x30, 0xa8, 0xff, 0xbb, 0xe6, 0xfb, 0xeb, 0x5e,
+	0xdb, 0x87, 0xd5, 0xb5, 0x8f, 0x46, 0xf8, 0x57, 0xfb, 0x1d, 0x77, 0x2e, 0xf4, 0xaf, 0x4c, 0x40,
+	0x53, 0xb5, 0x5c, 0x8f, 0x83, 0xe0, 0x24, 0x2e, 0x79, 0xb7, 0x60, 0x60, 0x99, 0x22, 0xb2, 0x4b,
+	0x2c, 0xf5, 0x45, 0x03, 0x22, 0x0c, 0x17, 0x18, 0x35, 0x13, 0x97, 0x1c, 0xd0, 0x74, 0x52, 0x59,
+	0x58, 0x97, 0x6e, 0xc0, 0x17, 0x11, 0xfe, 0x0d, 0x91, 0xba, 0x3f, 0x0b, 0xe8, 0x73, 0x55, 0xc5,
+	0xd4, 0x59, 0x78, 0x5c, 0xa7, 0x82, 0x89, 0xe0, 0x2e, 0xab, 0xdc, 0x4a, 0xf3, 0x11, 0x13, 0x24,
+	0xb1, 0xb9, 0xd3, 0x56, 0xe3, 0xba, 0x81, 0xf6, 0x52, 0xf2, 0xa6, 0xeb, 0x2a, 0x04, 0x86, 0xeb,
+	0x06, 0xb5, 0xbd, 0xca, 0xd6, 0x9d, 0x42, 0x17, 0x41, 0xa5, 0xb0, 0x4b, 0xe4, 0x28, 0x2d, 0xad,
+	0x12, 0xb3, 0x83, 0x9d, 0xa3, 0xb2, 0xf8, 0x04, 0xa7, 0x75, 0x8a, 0x1e, 0x3c, 0xd7, 0x9b, 0xc8,
+	0x77, 0xfd, 0xf7, 0x22, 0xa6, 0x36, 0x02, 0xf5, 0xc2, 0xb3, 0x6e, 0x5e, 0xac, 0xea, 0x77, 0xa1,
+	0x51, 0xcd, 0x1b, 0x08, 0x62, 0xeb, 0x69, 0xaa, 0x82, 0x00, 0x2c, 0xb0, 0x3a, 0x1c, 0x3b, 0x72,
+	0xd6, 0xd0, 0xd5, 0x12, 0x93, 0xaf, 0x3d, 0xa8, 0xa5, 0xfc, 0x2f, 0x4d, 0x9b, 0x83, 0x91, 0x1a,
+	0x6d, 0x91, 0x95, 0x08, 0x3b, 0x23, 0x66, 0x5b, 0x12, 0xd3, 0xcd, 0x05, 0xa2, 0xe2, 0xf4, 0xef,
+	0xf2, 0x3e, 0xab, 0xa1, 0x23, 0x10, 0x3f, 0x63, 0x93, 0x97, 0xd9, 0x3d, 0xa0, 0x63, 0x41, 0x0b,
+	0x12, 0x1f, 0xf7, 0x99, 0x8c, 0x8a, 0x5c, 0xb7, 0x71, 0x21, 0x4c, 0x11, 0xb5, 0x9f, 0x94, 0x9e,
+	0xb8, 0x77, 0xb8, 0x73, 0x54, 0x1e, 0xa1, 0xaf, 0xbb, 0x43, 0x7e, 0x7c, 0xe6, 0x27, 0xdd, 0xc0,
+	0xcd, 0x0b, 0x81, 0x72, 0x52, 0x7b, 0x9b, 0xd1, 0x9e, 0xd8, 0x89, 0x08, 0x03, 0x81, 0x0e, 0x30,
+	0xad, 0xc9, 0xad, 0xcb, 0xa3, 0x0c, 0xbc, 0xa9, 0x6f, 0xf1, 0xe0, 0xec, 0x66, 0xf5, 0x17, 0xcd,
+	0x03, 0x6e, 0x85, 0x56, 0xa5, 0xc1, 0x35, 0xd9, 0x7c, 0xa8, 0x5e, 0xb7, 0x40, 0x5c, 0x9a, 0xdb,
+	0xa3, 0x3a, 0x86, 0x95, 0x15, 0x2e, 0x39, 0xf8, 0x24, 0xb2, 0x01, 0xdb, 0x5f, 0x79, 0x76, 0x04,
+	0x00, 0xc4, 0x9b, 0x75, 0xe3, 0x79, 0x2f, 0xbc, 0xe9, 0xb5, 0x71, 0x0f, 0x5d, 0x71, 0x82, 0x02,
+	0x77, 0x5a, 0xa0, 0x1f, 0x08, 0x41, 0x92, 0xef, 0x39, 0xed, 0x97, 0x8e, 0xc5, 0xda, 0xa0, 0xc7,
+	0xe2, 0x94, 0xad, 0xfa, 0x3a, 0xbb, 0x7a, 0xdc, 0xe1, 0x51, 0x6f, 0x9f, 0xb0, 0x0e, 0x27, 0xf5,
+	0x31, 0xff, 0x03, 0xd4, 0xdf, 0xc0, 0x74, 0xb9, 0x1e, 0x2a, 0xed, 0xea, 0x0b, 0x39, 0xa7, 0x03,
+	0x8f, 0x31, 0xc5, 0x1e, 0xfc, 0x72, 0xad, 0x65, 0xe6, 0x9a, 0xe7, 0xea, 0xac, 0xf1, 0x38, 0xbb,
+	0xa1, 0xea, 0x4c, 0xb6, 0x47, 0x85, 0x3d, 0x4a, 0xad, 0xc7, 0x01, 0xb1, 0x30, 0xf1, 0xc1, 0xc8,
+	0xe5, 0xc3, 0x7e, 0xe6, 0xb6, 0x52, 0x33, 0xb4, 0x65, 0xef, 0xd2, 0xd4, 0xf4, 0x37, 0x16, 0xaf,
+	0x92, 0x1e, 0x22, 0x6e, 0xc9, 0xde, 0x57, 0x49, 0x46, 0x2b, 0xd5, 0xd0, 0xb2, 0xce, 0xb7, 0x8b,
+	0x49, 0x91, 0x86, 0x28, 0x68, 0xb7, 0x0b, 0xee, 0x46, 0x31, 0xc0, 0xb7, 0x48, 0x4b, 0xcf, 0x9d,
+	0x14, 0x46, 0x7d, 0x93, 0x56, 0x3d, 0x4e, 0xcc, 0xb1, 0xfd, 0xf9, 0x16, 0x9c, 0xc8, 0xc4, 0xca,
+	0xff, 0xf3, 0x9a, 0x00, 0x2d, 0x07, 0xf5, 0xe0, 0x4c, 0x48, 0x11, 0xa7, 0x72, 0xee, 0x75, 0xbe,
+	0xfb, 0x32, 0xe6, 0x02, 0xf1, 0x0e, 0xa0, 0x0a, 0xbd, 0x38, 0x0f, 0x7e, 0x96, 0x60, 0x1a, 0x1f,
+	0x12, 0xb7, 0x1f, 0x0d, 0xfa, 0xa3, 0x17, 0xf2, 0x3c, 0x18, 0x06, 0x22, 0xe0, 0x77, 0x08, 0xe6,
+	0x62, 0x72, 0x07, 0xcf, 0x47, 0x85, 0xde, 0x38, 0x3c, 0xd3, 0x3d, 0x41, 0x25, 0xed, 0xb9, 0x43,
+	0x75, 0x72, 0x57, 0xae, 0xc8, 0xa1, 0x67, 0xf3, 0x3d, 0xb0, 0xfa, 0x37, 0xef, 0x88, 0xee, 0xb6,
+	0xc8, 0xe2, 0x38, 0xf2, 0x46, 0x39, 0x4b, 0x82, 0xce, 0x76, 0x8d, 0xc0, 0x64, 0x39, 0x83, 0xb7,
+	0xcf, 0x3c, 0xfb, 0x77, 0x5a, 0x16, 0x0d, 0xeb, 0x95, 0x78, 0x01, 0x57, 0x00, 0x1b, 0x38, 0x77,
+	0x63, 0x1c, 0x49, 0xd9, 0xd0, 0xfb, 0x37, 0x70, 0x4c, 0x44, 0xad, 0xae, 0xc1, 0x46, 0x99, 0xa1,
+	0x40, 0xe4, 0x41, 0x58, 0x47, 0xda, 0xd2, 0x3a, 0xd4, 0x4f, 0x34, 0xef, 0x5b, 0x74, 0xe8, 0x74,
+	0x08, 0x76, 0x44, 0xcb, 0x8a, 0xa0, 0x0f, 0xe9, 0x07, 0x16, 0x74, 0xc0, 0xbf, 0xbd, 0x86, 0xc8,
+	0xb8, 0x52, 0x36, 0x12, 0x52, 0xfc, 0x9d, 0xc7, 0x3d, 0x01, 0xf2, 0x9f, 0x47, 0x29, 0x27, 0x0c,
+	0xc6, 0x0e, 0x1d, 0x39, 0x6a, 0x2c, 0xb4, 0xfa, 0x34, 0x72, 0x0e, 0xfd, 0xa3, 0x62, 0x94, 0x8e,
+	0x11, 0x38, 0xf2, 0xfb, 0x0a, 0x20, 0xc7, 0xd5, 0xb9, 0xa7, 0x0c, 0xcc, 0x77, 0xd7, 0xca, 0xb8,
+	0x2e, 0xfa, 0x82, 0x1b, 0x28, 0x14, 0x2d, 0x55, 0x71, 0xab, 0xc9, 0x9d, 0xfe, 0xce, 0x01, 0xe7,
+	0xfd, 0xb8, 0x0e, 0x39, 0x65, 0xd3, 0x8a, 0x12, 0x14, 0x9b, 0x11, 0x53, 0x1f, 0x14, 0x10, 0xe0
+};
+
+//the key table with its start repeated on the end, so 16 byte loads never wrap
+static const auto crypto_key = []
+{
+	auto key = std::array<uint8_t, 1024 + 16>{};
+	std::copy(begin(crypto_data), end(crypto_data), begin(key));
+	std::copy(begin(crypto_data), begin(crypto_data) + 16, begin(key) + 1024);
+	return key;
+}();
+
+//xor the buffer with the key table, buf[i] gets key byte (pos + i).
+//links use the frame length as the start position for the whole frame.
+void obfuscate(uint8_t *buf, size_t len, size_t pos)
 {
-	static const auto crypto_data = std::array<uint8_t, 1024>
+	size_t i = 0;
+#ifdef UTILS_X64
+	for (; i + 16 <= len; i += 16)
 	{
-		0x52, 0x68, 0x68, 0xf5, 0xc7, 0x59, 0x23, 0x68, 0x30, 0x2e, 0x02, 0xa8, 0x43, 0x97, 0x6f, 0xb8,
-		0x89, 0x97, 0x0d, 0x45, 0x81, 0x28, 0x42, 0x58, 0xf1, 0x1a, 0x5d, 0xee, 0x00, 0xb7, 0xbf, 0x41,
-		0x65, 0x98, 0x57, 0x23, 0x1d, 0x2d, 0x45, 0x41, 0x2d, 0xcc, 0x31, 0x9b, 0x7b, 0x0f, 0x3b, 0xfd,
-		0x9b, 0x81, 0x45, 0x50, 0xac, 0x49, 0x1c, 0xf9, 0x48, 0x48, 0x6b, 0x1d, 0x25, 0x1b, 0x32, 0x73,
-		0x76, 0xb5, 0x94, 0x6b, 0xc1, 0x24, 0xe9, 0xd1, 0xfa, 0x61, 0xc4, 0xf0, 0x47, 0xba, 0xb1, 0x71,
-		0x86, 0x29, 0x4e, 0x16, 0x24, 0x9a, 0x9c, 0x99, 0x38, 0x13, 0x1e, 0x9f, 0xbc, 0x81, 0x51, 0xbe,
-		0x3f, 0x49, 0x99, 0xc0, 0x39, 0xef, 0xf8, 0x81, 0x0a, 0xff, 0x7f, 0x1a, 0xc6, 0xae, 0x6d, 0x94,
-		0xb5, 0x1d, 0xa0, 0xee, 0x1d, 0x02, 0x4c, 0xb1, 0xa7, 0x80, 0xa7, 0x89, 0xe4, 0xd7, 0x8e, 0xfb,
-		0x52, 0x3f, 0x0d, 0xba, 0x06, 0x81, 0x48, 0xe9, 0xdd, 0x83, 0x2b, 0x0c, 0xe6, 0xbb, 0xc6, 0xad,
-		0x67, 0x2e, 0x21, 0x2c, 0x79, 0x0c, 0x4b, 0xf8, 0x05, 0x36, 0x39, 0x31, 0x18, 0xa1, 0x8d, 0x43,
-		0x4d, 0x0d, 0x9d, 0x78, 0xa1, 0x2e, 0xb0, 0x0b, 0xd4, 0x45, 0x4f, 0x33, 0x0d, 0xda, 0xf5, 0x08,
-		0x1f, 0x16, 0xd5, 0x02, 0xca, 0x6c, 0x28, 0x61, 0xf0, 0x5d, 0xfc, 0xf2, 0x24, 0x64, 0x23, 0xb7,
-		0x39, 0x3a, 0x8a, 0x2d, 0xf2, 0x43, 0xac, 0x80, 0x7d, 0xd3, 0xda, 0x4e, 0x45, 0xe7, 0x21, 0x0f,
-		0x2e, 0x5f, 0x6b, 0x7b, 0x1c, 0x73, 0xce, 0x3c, 0x30, 0x09, 0x91, 0x2b, 0xc0, 0xf0, 0xc4, 0x8d,
-		0x7b, 0x82, 0x17, 0xb2, 0x69, 0x45, 0x9e, 0x1b, 0xfb, 0xb2, 0x8c, 0xd2, 0x54, 0x0b, 0xe0, 0x4c,
-		0xa4, 0x49, 0xe4, 0x75, 0x47, 0x4a, 0xca, 0x3b, 0x35, 0x56, 0xba, 0x5e, 0xbd, 0xd9, 0xca, 0x44,
-		0xb9, 0x23, 0xb0, 0x46, 0xca, 0x42, 0x13, 0x77, 0x8d, 0x01, 0x22, 0x06, 0x9c, 0x2d, 0xec, 0x89,
-		0x5a, 0x87, 0xa9, 0x87, 0x25, 0x0a, 0x3f, 0x52, 0x07, 0x5b, 0xfc, 0xb8, 0x98, 0x2e, 0xa5, 0xbf,
-		0xdf, 0xbc, 0x60, 0xc3, 0xef, 0xd6, 0x56, 0x65, 0xd5, 0xd5, 0x17, 0x25, 0xad, 0x64, 0x4b, 0xfc,
-		0x5d, 0x7d, 0x52, 0xf8, 0x42, 0x83, 0x5a, 0xd9, 0x30, 0xa8, 0xff, 0xbb, 0xe6, 0xfb, 0xeb, 0x5e,
-		0xdb, 0x87, 0xd5, 0xb5, 0x8f, 0x46, 0xf8, 0x57, 0xfb, 0x1d, 0x77, 0x2e, 0xf4, 0xaf, 0x4c, 0x40,
-		0x53, 0xb5, 0x5c, 0x8f, 0x83, 0xe0, 0x24, 0x2e, 0x79, 0xb7, 0x60, 0x60, 0x99, 0x22, 0xb2, 0x4b,
-		0x2c, 0xf5, 0x45, 0x03, 0x22, 0x0c, 0x17, 0x18, 0x35, 0x13, 0x97, 0x1c, 0xd0, 0x74, 0x52, 0x59,
-		0x58, 0x97, 0x6e, 0xc0, 0x17, 0x11, 0xfe, 0x0d, 0x91, 0xba, 0x3f, 0x0b, 0xe8, 0x73, 0x55, 0xc5,
-		0xd4, 0x59, 0x78, 0x5c, 0xa7, 0x82, 0x89, 0xe0, 0x2e, 0xab, 0xdc, 0x4a, 0xf3, 0x11, 0x13, 0x24,
-		0xb1, 0xb9, 0xd3, 0x56, 0xe3, 0xba, 0x81, 0xf6, 0x52, 0xf2, 0xa6, 0xeb, 0x2a, 0x04, 0x86, 0xeb,
-		0x06, 0xb5, 0xbd, 0xca, 0xd6, 0x9d, 0x42, 0x17, 0x41, 0xa5, 0xb0, 0x4b, 0xe4, 0x28, 0x2d, 0xad,
-		0x12, 0xb3, 0x83, 0x9d, 0xa3, 0xb2, 0xf8, 0x04, 0xa7, 0x75, 0x8a, 0x1e, 0x3c, 0xd7, 0x9b, 0xc8,
-		0x77, 0xfd, 0xf7, 0x22, 0xa6, 0x36, 0x02, 0xf5, 0xc2, 0xb3, 0x6e, 0x5e, 0xac, 0xea, 0x77, 0xa1,
-		0x51, 0xcd, 0x1b, 0x08, 0x62, 0xeb, 0x69, 0xaa, 0x82, 0x00, 0x2c, 0xb0, 0x3a, 0x1c, 0x3b, 0x72,
-		0xd6, 0xd0, 0xd5, 0x12, 0x93, 0xaf, 0x3d, 0xa8, 0xa5, 0xfc, 0x2f, 0x4d, 0x9b, 0x83, 0x91, 0x1a,
-		0x6d, 0x91, 0x95, 0x08, 0x3b, 0x23, 0x66, 0x5b, 0x12, 0xd3, 0xcd, 0x05, 0xa2, 0xe2, 0xf4, 0xef,
-		0xf2, 0x3e, 0xab, 0xa1, 0x23, 0x10, 0x3f, 0x63, 0x93, 0x97, 0xd9, 0x3d, 0xa0, 0x63, 0x41, 0x0b,
-		0x12, 0x1f, 0xf7, 0x99, 0x8c, 0x8a, 0x5c, 0xb7, 0x71, 0x21, 0x4c, 0x11, 0xb5, 0x9f, 0x94, 0x9e,
-		0xb8, 0x77, 0xb8, 0x73, 0x54, 0x1e, 0xa1, 0xaf, 0xbb, 0x43, 0x7e, 0x7c, 0xe6, 0x27, 0xdd, 0xc0,
-		0xcd, 0x0b, 0x81, 0x72, 0x52, 0x7b, 0x9b, 0xd1, 0x9e, 0xd8, 0x89, 0x08, 0x03, 0x81, 0x0e, 0x30,
-		0xad, 0xc9, 0xad, 0xcb, 0xa3, 0x0c, 0xbc, 0xa9, 0x6f, 0xf1, 0xe0, 0xec, 0x66, 0xf5, 0x17, 0xcd,
-		0x03, 0x6e, 0x85, 0x56, 0xa5, 0xc1, 0x35, 0xd9, 0x7c, 0xa8, 0x5e, 0xb7, 0x40, 0x5c, 0x9a, 0xdb,
-		0xa3, 0x3a, 0x86, 0x95, 0x15, 0x2e, 0x39, 0xf8, 0x24, 0xb2, 0x01, 0xdb, 0x5f, 0x79, 0x76, 0x04,
-		0x00, 0xc4, 0x9b, 0x75, 0xe3, 0x79, 0x2f, 0xbc, 0xe9, 0xb5, 0x71, 0x0f, 0x5d, 0x71, 0x82, 0x02,
-		0x77, 0x5a, 0xa0, 0x1f, 0x08, 0x41, 0x92, 0xef, 0x39, 0xed, 0x97, 0x8e, 0xc5, 0xda, 0xa0, 0xc7,
-		0xe2, 0x94, 0xad, 0xfa, 0x3a, 0xbb, 0x7a, 0xdc, 0xe1, 0x51, 0x6f, 0x9f, 0xb0, 0x0e, 0x27, 0xf5,
-		0x31, 0xff, 0x03, 0xd4, 0xdf, 0xc0, 0x74, 0xb9, 0x1e, 0x2a, 0xed, 0xea, 0x0b, 0x39, 0xa7, 0x03,
-		0x8f, 0x31, 0xc5, 0x1e, 0xfc, 0x72, 0xad, 0x65, 0xe6, 0x9a, 0xe7, 0xea, 0xac, 0xf1, 0x38, 0xbb,
-		0xa1, 0xea, 0x4c, 0xb6, 0x47, 0x85, 0x3d, 0x4a, 0xad, 0xc7, 0x01, 0xb1, 0x30, 0xf1, 0xc1, 0xc8,
-		0xe5, 0xc3, 0x7e, 0xe6, 0xb6, 0x52, 0x33, 0xb4, 0x65, 0xef, 0xd2, 0xd4, 0xf4, 0x37, 0x16, 0xaf,
-		0x92, 0x1e, 0x22, 0x6e, 0xc9, 0xde, 0x57, 0x49, 0x46, 0x2b, 0xd5, 0xd0, 0xb2, 0xce, 0xb7, 0x8b,
-		0x49, 0x91, 0x86, 0x28, 0x68, 0xb7, 0x0b, 0xee, 0x46, 0x31, 0xc0, 0xb7, 0x48, 0x4b, 0xcf, 0x9d,
-		0x14, 0x46, 0x7d, 0x93, 0x56, 0x3d, 0x4e, 0xcc, 0xb1, 0xfd, 0xf9, 0x16, 0x9c, 0xc8, 0xc4, 0xca,
-		0xff, 0xf3, 0x9a, 0x00, 0x2d, 0x07, 0xf5, 0xe0, 0x4c, 0x48, 0x11, 0xa7, 0x72, 0xee, 0x75, 0xbe,
-		0xfb, 0x32, 0xe6, 0x02, 0xf1, 0x0e, 0xa0, 0x0a, 0xbd, 0x38, 0x0f, 0x7e, 0x96, 0x60, 0x1a, 0x1f,
-		0x12, 0xb7, 0x1f, 0x0d, 0xfa, 0xa3, 0x17, 0xf2, 0x3c, 0x18, 0x06, 0x22, 0xe0, 0x77, 0x08, 0xe6,
-		0x62, 0x72, 0x07, 0xcf, 0x47, 0x85, 0xde, 0x38, 0x3c, 0xd3, 0x3d, 0x41, 0x25, 0xed, 0xb9, 0x43,
-		0x75, 0x72, 0x57, 0xae, 0xc8, 0xa1, 0x67, 0xf3, 0x3d, 0xb0, 0xfa, 0x37, 0xef, 0x88, 0xee, 0xb6,
-		0xc8, 0xe2, 0x38, 0xf2, 0x46, 0x39, 0x4b, 0x82, 0xce, 0x76, 0x8d, 0xc0, 0x64, 0x39, 0x83, 0xb7,
-		0xcf, 0x3c, 0xfb, 0x77, 0x5a, 0x16, 0x0d, 0xeb, 0x95, 0x78, 0x01, 0x57, 0x00, 0x1b, 0x38, 0x77,
-		0x63, 0x1c, 0x49, 0xd9, 0xd0, 0xfb, 0x37, 0x70, 0x4c, 0x44, 0xad, 0xae, 0xc1, 0x46, 0x99, 0xa1,
-		0x40, 0xe4, 0x41, 0x58, 0x47, 0xda, 0xd2, 0x3a, 0xd4, 0x4f, 0x34, 0xef, 0x5b, 0x74, 0xe8, 0x74,
-		0x08, 0x76, 0x44, 0xcb, 0x8a, 0xa0, 0x0f, 0xe9, 0x07, 0x16, 0x74, 0xc0, 0xbf, 0xbd, 0x86, 0xc8,
-		0xb8, 0x52, 0x36, 0x12, 0x52, 0xfc, 0x9d, 0xc7, 0x3d, 0x01, 0xf2, 0x9f, 0x47, 0x29, 0x27, 0x0c,
-		0xc6, 0x0e, 0x1d, 0x39, 0x6a, 0x2c, 0xb4, 0xfa, 0x34, 0x72, 0x0e, 0xfd, 0xa3, 0x62, 0x94, 0x8e,
-		0x11, 0x38, 0xf2, 0xfb, 0x0a, 0x20, 0xc7, 0xd5, 0xb9, 0xa7, 0x0c, 0xcc, 0x77, 0xd7, 0xca, 0xb8,
-		0x2e, 0xfa, 0x82, 0x1b, 0x28, 0x14, 0x2d, 0x55, 0x71, 0xab, 0xc9, 0x9d, 0xfe, 0xce, 0x01, 0xe7,
-		0xfd, 0xb8, 0x0e, 0x39, 0x65, 0xd3, 0x8a, 0x12, 0x14, 0x9b, 0x11, 0x53, 0x1f, 0x14, 0x10, 0xe0
-	};
-	uint32_t i;
-	for(i = 0; i < len; ++i) key[i] = key[i] ^ crypto_data[(len + i) & (sizeof(crypto_data) - 1)];
+		auto key = _mm_loadu_si128((const __m128i*)&crypto_key[(pos + i) & 1023]);
+		auto data = _mm_loadu_si128((const __m128i*)(buf + i));
+		_mm_storeu_si128((__m128i*)(buf + i), _mm_xor_si128(data, key));
+	}
+#else
+	for (; i + 8 <= len; i += 8)
+	{
+		uint64_t key, data;
+		memcpy(&key, &crypto_key[(pos + i) & 1023], sizeof(key));
+		memcpy(&data, buf + i, sizeof(data));
+		data ^= key;
+		memcpy(buf + i, &data, sizeof(data));
+	}
+#endif
+	for (; i < len; ++i) buf[i] ^= crypto_data[(pos + i) & 1023];
+}
+
+#ifdef UTILS_X64
+TARGET_SSE42 static uint32_t obfuscate_crc32c_hw(uint8_t *buf, size_t len, size_t pos, bool decode)
+{
+	uint64_t crc64 = 0xffffffff;
+	size_t i = 0;
+	for (; i + 16 <= len; i += 16)
+	{
+		auto key = _mm_loadu_si128((const __m128i*)&crypto_key[(pos + i) & 1023]);
+		auto data = _mm_loadu_si128((const __m128i*)(buf + i));
+		auto out = _mm_xor_si128(data, key);
+		_mm_storeu_si128((__m128i*)(buf + i), out);
+		auto plain = decode ? out : data;
+		crc64 = _mm_crc32_u64(crc64, (uint64_t)_mm_cvtsi128_si64(plain));
+		crc64 = _mm_crc32_u64(crc64, (uint64_t)_mm_cvtsi128_si64(_mm_unpackhi_epi64(plain, plain)));
+	}
+	auto crc = (uint32_t)crc64;
+	for (; i < len; ++i)
+	{
+		auto data = buf[i];
+		auto out = uint8_t(data ^ crypto_data[(pos + i) & 1023]);
+		buf[i] = out;
+		crc = _mm_crc32_u8(crc, decode ? out : data);
+	}
+	return ~crc;
+}
+#endif
+
+//crc32c of the plain bytes and obfuscate in one pass over the buffer.
+//encode crcs then obfuscates, decode obfuscates then crcs.
+uint32_t obfuscate_crc32c(uint8_t *buf, size_t len, size_t pos, bool decode)
+{
+#ifdef UTILS_X64
+	if (has_sse42) return obfuscate_crc32c_hw(buf, len, pos, decode);
+#endif
+	//no crc instruction, so work in blocks that stay in L1 between the two steps
+	uint32_t crc = 0xffffffff;
+	for (size_t i = 0; i < len; i += 512)
+	{
+		auto block_len = std::min(len - i, size_t(512));
+		if (!decode) crc = crc32c_sw(crc, buf + i, block_len);
+		obfuscate(buf + i, block_len, pos + i);
+		if (decode) crc = crc32c_sw(crc, buf + i, block_len);
+	}
+	return ~crc;
 }
@@ -0,0 +1,2195 @@
+#include "../../lib/services/kernel_service.h"
+#include "../../lib/services/co_task.h"
+#include "../../lib/services/file_service.h"
+#include "../../lib/utils/executor.h"
+#include "../../lib/task/farm.h"
+#include "../../lib/links/ip_link.h"
+#include "../../lib/links/shm_link.h"
+#include "../../lib/links/memory_link.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <fstream>
+#include <future>
+#include <queue>
+#include <ctime>
+#include <cmath>
+#include <random>
+#include <filesystem>
+#ifdef __linux__
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+////////
+// bench
+////////
+
+std::unique_ptr<Router> global_router;
+std::thread::id global_kernel_thread_id;
+uint32_t arg_v = 0;
+
+//count every heap allocation so we can see what a msg costs
+static std::atomic<uint64_t> heap_allocs {0};
+
+void *operator new(size_t size)
+{
+	heap_allocs.fetch_add(1, std::memory_order_relaxed);
+	if (auto ptr = malloc(size ? size : 1)) return ptr;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+	free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+	free(ptr);
+}
+
+void ss_reset(std::stringstream &ss, std::string s)
+{
+	ss.str(s);
+	ss.clear();
+}
+
+void report(const std::string &name, uint64_t count, std::chrono::duration<double, std::milli> elapsed, const std::string &units = "msgs/s")
+{
+	std::cout << std::left << std::setw(40) << name
+		<< std::right << std::setw(12) << (uint64_t)(count * 1000.0 / elapsed.count())
+		<< " " << units << std::endl;
+}
+
+void report_per_msg(const std::string &name, uint64_t count, double value, const std::string &units)
+{
+	std::cout << std::left << std::setw(40) << name
+		<< std::right << std::setw(12) << std::fixed << std::setprecision(2)
+		<< value / count << " " << units << std::endl;
+}
+
+//////////////////////////////
+// mailbox producers/consumer
+//////////////////////////////
+
+//the std::list under a std::mutex mailbox we used to have, kept as the baseline
+template<class T>
+class Locked_Mbox
+{
+public:
+	T read()
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		while (m_mail.empty()) m_cv.wait(l);
+		auto msg = std::move(m_mail.front());
+		m_mail.pop_front();
+		return msg;
+	}
+	void post(T &msg)
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_mail.emplace_back(std::move(msg));
+		m_cv.notify_one();
+	}
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::list<T> m_mail;
+};
+
+template<class M>
+std::chrono::duration<double, std::milli> bench_mbox(uint32_t producers, uint64_t count)
+{
+	//each producer posts count msgs, the consumer reads them all
+	M mbox;
+	auto msg = std::make_shared<Msg>();
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<std::thread> threads;
+	for (auto i = 0u; i < producers; ++i)
+	{
+		threads.emplace_back([&]
+		{
+			for (auto j = 0u; j < count; ++j)
+			{
+				auto m = msg;
+				mbox.post(m);
+			}
+		});
+	}
+	for (auto j = 0u; j < count * producers; ++j) mbox.read();
+	auto finish = std::chrono::high_resolution_clock::now();
+	for (auto &t : threads) t.join();
+	return finish - start;
+}
+
+template<class M>
+std::chrono::duration<double, std::milli> bench_mbox_burst(uint64_t count)
+{
+	//posts and reads on the one thread in bursts that fit the ring, what a reader
+	//that keeps up sees, with no other core to race it
+	M mbox;
+	auto msg = std::make_shared<Msg>();
+	auto start = std::chrono::high_resolution_clock::now();
+	for (auto i = 0u; i < count; i += 32)
+	{
+		for (auto j = 0u; j < 32; ++j)
+		{
+			auto m = msg;
+			mbox.post(m);
+		}
+		for (auto j = 0u; j < 32; ++j) mbox.read();
+	}
+	return std::chrono::high_resolution_clock::now() - start;
+}
+
+void bench_mbox(uint64_t count)
+{
+	{
+		count = count / 32 * 32;
+		auto allocs = heap_allocs.load();
+		report("Locked_Mbox: bursts of 32", count, bench_mbox_burst<Locked_Mbox<std::shared_ptr<Msg>>>(count));
+		report_per_msg("Locked_Mbox: bursts of 32", count, heap_allocs.load() - allocs, "allocs/msg");
+		allocs = heap_allocs.load();
+		report("Mbox: bursts of 32", count, bench_mbox_burst<Mbox<std::shared_ptr<Msg>>>(count));
+		report_per_msg("Mbox: bursts of 32", count, heap_allocs.load() - allocs, "allocs/msg");
+	}
+	for (auto producers : {1u, 4u, 16u})
+	{
+		auto total = count * producers;
+		auto name = std::to_string(producers) + " producers";
+		//and the heap allocs each post costs, a list node for the locked one, none
+		//for the ring unless it's full and mail spills. on one core a producer fills
+		//the ring long before the reader gets a turn, so nearly all of it spills
+		auto allocs = heap_allocs.load();
+		report("Locked_Mbox: " + name, total, bench_mbox<Locked_Mbox<std::shared_ptr<Msg>>>(producers, count));
+		report_per_msg("Locked_Mbox: " + name, total, heap_allocs.load() - allocs, "allocs/msg");
+		allocs = heap_allocs.load();
+		report("Mbox: " + name, total, bench_mbox<Mbox<std::shared_ptr<Msg>>>(producers, count));
+		report_per_msg("Mbox: " + name, total, heap_allocs.load() - allocs, "allocs/msg");
+	}
+}
+
+/////////////////////////
+// router next hop links
+/////////////////////////
+
+//stand in for a link driver, the bench threads pull its messages directly
+class Null_Link : public Link
+{
+protected:
+	bool send(const std::shared_ptr<Msg> &msg) override { return true; }
+	std::shared_ptr<Msg> receive() override { return nullptr; }
+};
+
+void bench_router(uint32_t links, uint64_t count)
+{
+	//que a backlog of count msgs spread over the peers then have a thread per
+	//link drain its peer, then again with the links draining while being fed
+	std::vector<Dev_ID> peers;
+	std::vector<std::unique_ptr<Null_Link>> null_links;
+	for (auto i = 0u; i < links; ++i)
+	{
+		peers.push_back(Dev_ID::alloc());
+		null_links.emplace_back(std::make_unique<Null_Link>());
+		global_router->add_link(null_links.back().get(), peers.back());
+	}
+	auto body = Msg_Buf::create(64);
+	auto send = [&]
+	{
+		for (auto j = 0u; j < count; ++j)
+		{
+			auto msg = std::make_shared<Msg>(body);
+			msg->set_dest(Net_ID(peers[j % links], Mailbox_ID{1}));
+			global_router->send(msg);
+		}
+	};
+	std::atomic<uint64_t> received;
+	auto drain = [&]
+	{
+		received = 0;
+		std::vector<std::thread> threads;
+		for (auto i = 0u; i < links; ++i)
+		{
+			threads.emplace_back([&, i]
+			{
+				while (received < count)
+				{
+					if (global_router->get_next_msg(peers[i], std::chrono::milliseconds(1))) received++;
+				}
+			});
+		}
+		return threads;
+	};
+	auto name = std::to_string(links) + " links";
+	{
+		send();
+		auto start = std::chrono::high_resolution_clock::now();
+		for (auto &t : drain()) t.join();
+		auto finish = std::chrono::high_resolution_clock::now();
+		report("Router backlog: " + name, count, finish - start);
+	}
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		auto threads = drain();
+		send();
+		for (auto &t : threads) t.join();
+		auto finish = std::chrono::high_resolution_clock::now();
+		report("Router streaming: " + name, count, finish - start);
+	}
+	for (auto &link : null_links) global_router->sub_link(link.get());
+}
+
+///////////////////////////
+// local msg body allocation
+///////////////////////////
+
+void bench_alloc(uint64_t count)
+{
+	//send msgs of the farm job, farm reply and file chunk sizes to a local
+	//mailbox and read them back, counting the heap allocations per msg
+	auto id = global_router->alloc();
+	auto mbox = global_router->resolve(id);
+	for (auto size : {(size_t)64, (size_t)1024, (size_t)MAX_PACKET_SIZE})
+	{
+		auto allocs = heap_allocs.load();
+		auto start = std::chrono::high_resolution_clock::now();
+		for (auto j = 0u; j < count; ++j)
+		{
+			auto msg = std::make_shared<Msg>(size);
+			memset(msg->begin(), j, 64);
+			msg->set_dest(id);
+			global_router->send(msg);
+			mbox.read();
+		}
+		auto finish = std::chrono::high_resolution_clock::now();
+		auto name = "Local msg " + std::to_string(size) + " bytes";
+		report(name, count, finish - start);
+		report_per_msg(name, count, heap_allocs - allocs, "allocs/msg");
+	}
+	global_router->free(id);
+}
+
+/////////////////////////////
+// parcel fragment/reassemble
+/////////////////////////////
+
+void bench_parcel(uint64_t count)
+{
+	//send parcels to a peer, pull the fragments off its que and feed them back
+	//in as if they had arrived over a link, then read the parcel and touch it all
+	auto peer = Dev_ID::alloc();
+	auto null_link = std::make_unique<Null_Link>();
+	global_router->add_link(null_link.get(), peer);
+	auto id = global_router->alloc();
+	auto mbox = global_router->resolve(id);
+	for (auto size : {(size_t)64 << 10, (size_t)1 << 20})
+	{
+		auto n = std::max((uint64_t)1, count * 4096 / size);
+		auto start = std::chrono::high_resolution_clock::now();
+		for (auto j = 0u; j < n; ++j)
+		{
+			auto msg = std::make_shared<Msg>(size);
+			memset(msg->begin(), j, size);
+			msg->set_dest(Net_ID(peer, id.m_mailbox_id));
+			global_router->send(msg);
+			while (auto frag = global_router->get_next_msg(peer, std::chrono::milliseconds(0)))
+			{
+				//skip the router directory pings
+				if (frag->m_header.m_total_length != size) continue;
+				frag->m_header.m_dest = id;
+				global_router->send(frag);
+			}
+			auto parcel = mbox.read();
+			auto sum = 0u;
+			auto body_end = parcel->end();
+			for (auto itr = parcel->begin(); itr != body_end; itr += 64) sum += *itr;
+			if (sum == 1) std::cout << std::endl;
+		}
+		auto finish = std::chrono::high_resolution_clock::now();
+		auto name = "Parcel " + std::to_string(size >> 10) + "KB";
+		std::cout << std::left << std::setw(40) << name
+			<< std::right << std::setw(12) << std::fixed << std::setprecision(0)
+			<< n * size / 1048576.0 / (std::chrono::duration<double>(finish - start).count())
+			<< " MB/s" << std::endl;
+	}
+	global_router->free(id);
+	global_router->sub_link(null_link.get());
+}
+
+/////////////////////
+// ip link on loopback
+/////////////////////
+
+//ip link we can drive by hand
+class Bench_IP_Link : public IP_Link
+{
+public:
+	using IP_Link::IP_Link;
+	using IP_Link::send;
+	using IP_Link::receive;
+	void set_remote_dev_id(const Dev_ID &id) { m_remote_dev_id = id; }
+};
+
+void bench_ip(uint64_t count)
+{
+	//a link pair over a loopback socket, feed msgs to the sending link via its
+	//peer que and count them out of the receiving link, which we drive by hand
+	asio::io_context io_context;
+	auto work = asio::make_work_guard(io_context);
+	auto io_thread = std::thread([&] { io_context.run(); });
+	asio::ip::tcp::acceptor acceptor(io_context, asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+	for (auto size : {64u, 1024u, 4096u})
+	{
+		auto tx_socket = std::make_shared<asio::ip::tcp::socket>(io_context);
+		auto rx_socket = std::make_shared<asio::ip::tcp::socket>(io_context);
+		tx_socket->connect(acceptor.local_endpoint());
+		acceptor.accept(*rx_socket);
+		auto peer = Dev_ID::alloc();
+		auto tx = std::make_shared<Bench_IP_Link>(tx_socket);
+		Bench_IP_Link rx(rx_socket);
+		//hear from the peer first, as a live link would, so frames go out as crc32c.
+		//that adds the link under our own dev id, so take it off again
+		rx.send(std::make_shared<Msg>());
+		tx->receive();
+		global_router->sub_link(tx.get());
+		tx->set_remote_dev_id(peer);
+		global_router->add_link(tx.get(), peer);
+		tx->start_threads();
+		auto allocs = heap_allocs.load();
+		auto start = std::chrono::high_resolution_clock::now();
+		auto rx_thread = std::thread([&]
+		{
+			for (auto received = 0u; received < count;)
+			{
+				auto msg = rx.receive();
+				if (!msg) break;
+				if (msg->m_header.m_frag_length == size) received++;
+			}
+		});
+		for (auto j = 0u; j < count; ++j)
+		{
+			auto msg = std::make_shared<Msg>((size_t)size);
+			memset(msg->begin(), j, size);
+			msg->set_dest(Net_ID(peer, Mailbox_ID{1}));
+			global_router->send(msg);
+		}
+		rx_thread.join();
+		auto finish = std::chrono::high_resolution_clock::now();
+		auto name = "IP_Link loopback: " + std::to_string(size) + " bytes";
+		report(name, count, finish - start);
+		report_per_msg(name, count, heap_allocs - allocs, "allocs/msg");
+		tx->stop_threads();
+		tx->join_threads();
+	}
+	work.reset();
+	io_thread.join();
+}
+
+//////////////////////////////////
+// shm link against ip on loopback
+//////////////////////////////////
+
+//shm link we can drive by hand
+class Bench_Shm_Link : public Shm_Link
+{
+public:
+	using Shm_Link::Shm_Link;
+	using Shm_Link::send;
+	using Shm_Link::receive;
+	void set_remote_dev_id(const Dev_ID &id) { m_remote_dev_id = id; }
+};
+
+//bounce a msg back and forth between two hand driven links, time per round trip
+template<class T>
+void bench_round_trip(const std::string &name, T &a, T &b, uint64_t count)
+{
+	auto peer = Dev_ID::alloc();
+	auto echo = std::thread([&]
+	{
+		for (auto j = 0u; j < count; ++j)
+		{
+			auto msg = b.receive();
+			if (!msg) break;
+			b.send(msg);
+		}
+	});
+	auto start = std::chrono::high_resolution_clock::now();
+	for (auto j = 0u; j < count; ++j)
+	{
+		auto msg = std::make_shared<Msg>((size_t)64);
+		msg->set_dest(Net_ID(peer, Mailbox_ID{1}));
+		a.send(msg);
+		if (!a.receive()) break;
+	}
+	auto finish = std::chrono::high_resolution_clock::now();
+	echo.join();
+	std::chrono::duration<double, std::micro> elapsed = finish - start;
+	report_per_msg(name, count, elapsed.count(), "us/round trip");
+}
+
+#ifdef __linux__
+void bench_shm(uint64_t count)
+{
+	//round trip latency of a shm link pair and of an ip link pair on loopback
+	auto rounds = std::min(count, (uint64_t)100000);
+	{
+		int socks[2], fd;
+		socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, socks);
+		auto segment = Shm_Link::create_segment(fd);
+		Bench_Shm_Link a(segment, socks[0], false);
+		Bench_Shm_Link b(Shm_Link::open_segment(fd), socks[1], true);
+		close(fd);
+		a.m_running = b.m_running = true;
+		bench_round_trip("Shm_Link: 64 bytes", a, b, rounds);
+	}
+	{
+		asio::io_context io_context;
+		asio::ip::tcp::acceptor acceptor(io_context, asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+		auto a_socket = std::make_shared<asio::ip::tcp::socket>(io_context);
+		auto b_socket = std::make_shared<asio::ip::tcp::socket>(io_context);
+		a_socket->connect(acceptor.local_endpoint());
+		acceptor.accept(*b_socket);
+		Bench_IP_Link a(a_socket);
+		Bench_IP_Link b(b_socket);
+		bench_round_trip("IP_Link loopback: 64 bytes", a, b, rounds);
+	}
+
+	//throughput, the sending link takes msgs off its peer que, as bench_ip
+	for (auto size : {64u, 1024u, 4096u})
+	{
+		int socks[2], fd;
+		socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, socks);
+		auto segment = Shm_Link::create_segment(fd);
+		auto peer = Dev_ID::alloc();
+		auto tx = std::make_unique<Bench_Shm_Link>(segment, socks[0], false);
+		Bench_Shm_Link rx(Shm_Link::open_segment(fd), socks[1], true);
+		close(fd);
+		rx.m_running = true;
+		tx->set_remote_dev_id(peer);
+		global_router->add_link(tx.get(), peer);
+		tx->start_threads();
+		auto allocs = heap_allocs.load();
+		auto start = std::chrono::high_resolution_clock::now();
+		auto rx_thread = std::thread([&]
+		{
+			for (auto received = 0u; received < count;)
+			{
+				auto msg = rx.receive();
+				if (!msg) break;
+				if (msg->m_header.m_frag_length == size) received++;
+			}
+		});
+		for (auto j = 0u; j < count; ++j)
+		{
+			auto msg = std::make_shared<Msg>((size_t)size);
+			memset(msg->begin(), j, size);
+			msg->set_dest(Net_ID(peer, Mailbox_ID{1}));
+			global_router->send(msg);
+		}
+		rx_thread.join();
+		auto finish = std::chrono::high_resolution_clock::now();
+		auto name = "Shm_Link: " + std::to_string(size) + " bytes";
+		report(name, count, finish - start);
+		report_per_msg(name, count, heap_allocs - allocs, "allocs/msg");
+		tx->stop_threads();
+		tx->join_threads();
+	}
+}
+#else
+void bench_shm(uint64_t count)
+{
+	std::cout << "Shm_Link: not supported on this platform" << std::endl;
+}
+#endif
+
+////////////////////////
+// ip link manager scale
+////////////////////////
+
+//thread count and resident memory of this process, linux only
+void proc_status(uint64_t &threads, uint64_t &rss_kb)
+{
+	threads = rss_kb = 0;
+	std::ifstream status("/proc/self/status");
+	std::string key;
+	while (status >> key)
+	{
+		if (key == "Threads:") status >> threads;
+		else if (key == "VmRSS:") status >> rss_kb;
+	}
+}
+
+//bytes this process has read and written through file and socket calls, linux only
+void proc_io(uint64_t &read, uint64_t &written)
+{
+	read = written = 0;
+	std::ifstream io("/proc/self/io");
+	std::string key;
+	while (io >> key)
+	{
+		if (key == "rchar:") io >> read;
+		else if (key == "wchar:") io >> written;
+	}
+}
+
+void bench_links()
+{
+	//a server link manager with plain sockets dialed into it,
+	//see what each connection costs in threads and memory once its link is up
+	auto manager = std::make_unique<IP_Link_Manager>("server");
+	manager->start_thread();
+	asio::io_context io_context;
+	auto endpoint = asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), IP_LINK_PORT);
+	std::vector<std::unique_ptr<asio::ip::tcp::socket>> clients;
+	for (auto conns : {0u, 100u, 500u, 1000u})
+	{
+		while (clients.size() < conns)
+		{
+			auto socket = std::make_unique<asio::ip::tcp::socket>(io_context);
+			asio::error_code ec;
+			socket->connect(endpoint, ec);
+			if (ec) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			else clients.emplace_back(std::move(socket));
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(3000));
+		uint64_t threads, rss_kb;
+		proc_status(threads, rss_kb);
+		auto name = "IP_Link_Manager: " + std::to_string(conns) + " links";
+		std::cout << std::left << std::setw(40) << name
+			<< std::right << std::setw(12) << threads << " threads "
+			<< std::setw(8) << rss_kb / 1024 << " MB rss" << std::endl;
+	}
+	clients.clear();
+	manager->stop_thread();
+	manager->join_thread();
+}
+
+//////////////
+// frame codec
+//////////////
+
+//null link with its frame codec opened up
+class Codec_Link : public Null_Link
+{
+public:
+	using Link::encode_frame;
+	using Link::decode_frame;
+	void set_peer_crc32c(bool on) { m_peer_crc32c = on; }
+};
+
+void bench_codec(uint64_t count)
+{
+	//encode a batch of max size frames then decode them again, with the jenkins
+	//codec that old nodes speak and with the crc32c codec, rate is over the frame bytes
+	const auto batch = 64u;
+	auto len = (uint32_t)sizeof(Link_Buf);
+	auto frames = Msg_Buf::create(batch * len);
+	auto n = std::max((uint64_t)1, count / 16 / batch);
+	for (auto crc32c : {false, true})
+	{
+		Codec_Link link;
+		auto encode_time = std::chrono::duration<double>(0);
+		auto decode_time = std::chrono::duration<double>(0);
+		auto errors = 0u;
+		for (auto j = 0u; j < n; ++j)
+		{
+			memset(frames->begin(), j, batch * len);
+			link.set_peer_crc32c(crc32c);
+			auto start = std::chrono::high_resolution_clock::now();
+			for (auto f = 0u; f < batch; ++f) link.encode_frame((uint8_t*)frames->begin() + f * len, len);
+			auto mid = std::chrono::high_resolution_clock::now();
+			for (auto f = 0u; f < batch; ++f) errors += !link.decode_frame((uint8_t*)frames->begin() + f * len, len);
+			auto finish = std::chrono::high_resolution_clock::now();
+			encode_time += mid - start;
+			decode_time += finish - mid;
+		}
+		auto bytes = n * batch * len / 1073741824.0;
+		for (auto encode : {true, false})
+		{
+			auto name = std::string("Frame ") + (encode ? "encode " : "decode ") + (crc32c ? "crc32c" : "jenkins");
+			std::cout << std::left << std::setw(40) << name
+				<< std::right << std::setw(12) << std::fixed << std::setprecision(2)
+				<< bytes / (encode ? encode_time : decode_time).count()
+				<< " GB/s" << std::endl;
+		}
+		if (errors) std::cout << "Frame codec errors: " << errors << std::endl;
+	}
+}
+
+////////////////
+// kernel timers
+////////////////
+
+void bench_timers()
+{
+	//idle cpu with a thousand timers armed an hour out, the kernel should sleep
+	auto kernel = std::make_shared<Kernel_Service>();
+	kernel->start_thread();
+	auto id = global_router->alloc();
+	auto mbox = global_router->resolve(id);
+	for (auto i = 0u; i < 1000; ++i) Kernel_Service::timed_mail(id, std::chrono::hours(1), i);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	auto cpu_start = std::clock();
+	auto start = std::chrono::high_resolution_clock::now();
+	std::this_thread::sleep_for(std::chrono::milliseconds(5000));
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	auto cpu_ms = (std::clock() - cpu_start) * 1000.0 / CLOCKS_PER_SEC;
+	std::cout << std::left << std::setw(40) << "Kernel_Service: 1000 idle timers"
+		<< std::right << std::setw(12) << std::fixed << std::setprecision(3)
+		<< cpu_ms * 100.0 / elapsed.count() << " % cpu" << std::endl;
+
+	//re-arming them all replaces them, then see how late each goes off
+	//when spread over a second
+	auto armed = std::chrono::steady_clock::now();
+	for (auto i = 0u; i < 1000; ++i) Kernel_Service::timed_mail(id, std::chrono::milliseconds(i + 1), i);
+	auto late_sum = 0.0;
+	auto late_max = 0.0;
+	auto fired = 0u;
+	while (fired < 1000)
+	{
+		auto msg = mbox.read(std::chrono::milliseconds(5000));
+		if (!msg) break;
+		auto body = (Kernel_Service::Event_timed_mail*)msg->begin();
+		std::chrono::duration<double, std::milli> late = std::chrono::steady_clock::now()
+			- (armed + std::chrono::milliseconds(body->m_id + 1));
+		late_sum += late.count();
+		late_max = std::max(late_max, late.count());
+		fired++;
+	}
+	std::cout << std::left << std::setw(40) << "Kernel_Service: 1000 timers fired"
+		<< std::right << std::setw(12) << fired << " of 1000, late mean "
+		<< std::setprecision(2) << late_sum / std::max(fired, 1u) << " ms, max " << late_max << " ms" << std::endl;
+	global_router->free(id);
+	kernel->stop_thread();
+	kernel->join_thread();
+}
+
+//////////////////////
+// ping pong tasks
+//////////////////////
+
+//thread per task, pings its peer the given number of rounds after a kick
+class Ping_Task : public Task
+{
+public:
+	Net_ID m_peer;
+	uint32_t m_rounds = 0;
+	bool m_kicked = false;
+protected:
+	void run() override
+	{
+		auto mbox = m_router.resolve(m_net_id);
+		if (m_kicked) mbox.read();
+		for (auto i = 0u; i < m_rounds; ++i)
+		{
+			if (m_kicked) send();
+			mbox.read();
+			if (!m_kicked) send();
+		}
+	}
+	void send()
+	{
+		auto msg = std::make_shared<Msg>(sizeof(Event));
+		msg->set_dest(m_peer);
+		m_router.send(msg);
+	}
+};
+
+//the same as a coroutine task
+class Co_Ping_Task : public Co_Task
+{
+public:
+	Net_ID m_peer;
+	uint32_t m_rounds = 0;
+	bool m_kicked = false;
+protected:
+	Co_Routine run() override
+	{
+		if (m_kicked) co_await read(m_net_id);
+		for (auto i = 0u; i < m_rounds; ++i)
+		{
+			if (m_kicked) send();
+			co_await read(m_net_id);
+			if (!m_kicked) send();
+		}
+	}
+	void send()
+	{
+		auto msg = std::make_shared<Msg>(sizeof(Event));
+		msg->set_dest(m_peer);
+		m_router.send(msg);
+	}
+};
+
+template<class T, class S>
+void bench_tasks(const std::string &name, uint32_t tasks, uint32_t rounds, S start, std::function<void()> wait)
+{
+	//pairs of tasks, one kicked and one waiting, all started before any are kicked
+	std::vector<std::shared_ptr<T>> all;
+	for (auto i = 0u; i < tasks; ++i) all.emplace_back(std::make_shared<T>());
+	for (auto i = 0u; i < tasks; i += 2)
+	{
+		all[i]->m_peer = all[i + 1]->get_id();
+		all[i + 1]->m_peer = all[i]->get_id();
+		all[i]->m_kicked = true;
+		all[i]->m_rounds = all[i + 1]->m_rounds = rounds;
+	}
+	auto started = std::chrono::high_resolution_clock::now();
+	for (auto &task : all) start(task);
+	std::chrono::duration<double, std::milli> start_time = std::chrono::high_resolution_clock::now() - started;
+	uint64_t threads, rss_kb;
+	proc_status(threads, rss_kb);
+	auto begin = std::chrono::high_resolution_clock::now();
+	for (auto i = 0u; i < tasks; i += 2)
+	{
+		auto msg = std::make_shared<Msg>(sizeof(Task::Event));
+		msg->set_dest(all[i]->get_id());
+		global_router->send(msg);
+	}
+	wait();
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - begin;
+	auto label = name + ": " + std::to_string(tasks) + " tasks";
+	std::cout << std::left << std::setw(40) << label
+		<< std::right << std::setw(12) << (uint64_t)(tasks / 2 * (uint64_t)rounds * 1000.0 / elapsed.count())
+		<< " round trips/s " << std::setw(6) << threads << " threads "
+		<< std::setw(5) << rss_kb / 1024 << " MB rss "
+		<< std::setw(6) << (uint64_t)start_time.count() << " ms to start" << std::endl;
+}
+
+void bench_tasks(uint32_t rounds)
+{
+	//a kernel for the threads to say they're done to
+	auto kernel = std::make_shared<Kernel_Service>();
+	kernel->start_thread();
+	for (auto tasks : {1000u, 10000u})
+	{
+		std::vector<std::shared_ptr<Ping_Task>> threaded;
+		bench_tasks<Ping_Task>("Task", tasks, rounds,
+			[&] (auto &task) { task->start_thread(); threaded.push_back(task); },
+			[&] { for (auto &task : threaded) task->join_thread(); });
+		threaded.clear();
+		Co_Scheduler scheduler;
+		scheduler.start_threads();
+		bench_tasks<Co_Ping_Task>("Co_Task", tasks, rounds,
+			[&] (auto &task) { scheduler.start_task(task); },
+			[&] { while (scheduler.size()) std::this_thread::sleep_for(std::chrono::milliseconds(1)); });
+	}
+	kernel->stop_thread();
+	kernel->join_thread();
+}
+
+///////////
+// executor
+///////////
+
+//the mutex and std::queue thread pool the apps and file service each had, kept
+//as the baseline
+class Locked_Pool
+{
+public:
+	Locked_Pool(size_t threads)
+	{
+		for (auto i = 0u; i < threads; ++i) m_workers.emplace_back([this]
+		{
+			for (;;)
+			{
+				std::function<void()> task;
+				{
+					std::unique_lock<std::mutex> l(m_mutex);
+					m_cv.wait(l, [this] { return m_stop || !m_tasks.empty(); });
+					if (m_stop && m_tasks.empty()) return;
+					task = std::move(m_tasks.front());
+					m_tasks.pop();
+				}
+				task();
+			}
+		});
+	}
+	~Locked_Pool()
+	{
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			m_stop = true;
+		}
+		m_cv.notify_all();
+		for (auto &worker : m_workers) worker.join();
+	}
+	template<class F>
+	auto enqueue(F &&f)
+	{
+		auto task = std::make_shared<std::packaged_task<void()>>(std::bind(std::forward<F>(f)));
+		auto res = task->get_future();
+		{
+			std::lock_guard<std::mutex> l(m_mutex);
+			m_tasks.emplace([task] { (*task)(); });
+		}
+		m_cv.notify_one();
+		return res;
+	}
+private:
+	std::vector<std::thread> m_workers;
+	std::queue<std::function<void()>> m_tasks;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	bool m_stop = false;
+};
+
+template<class P, class F>
+void bench_executor(const std::string &name, P &pool, F post, uint64_t count)
+{
+	//jobs posted from outside, then jobs that post two more till count are done
+	std::atomic<uint64_t> done {0};
+	auto wait = [&] (uint64_t n) { while (done.load(std::memory_order_acquire) < n) std::this_thread::yield(); };
+	auto allocs = heap_allocs.load();
+	auto start = std::chrono::high_resolution_clock::now();
+	for (auto i = 0u; i < count; ++i) post(pool, [&] { done.fetch_add(1, std::memory_order_release); });
+	wait(count);
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	report(name + ": posted", count, elapsed, "jobs/s");
+	report_per_msg(name + ": posted", count, heap_allocs - allocs, "allocs/job");
+	done = 0;
+	std::function<void(uint64_t)> fork = [&] (uint64_t n)
+	{
+		if (n * 2 + 1 < count) post(pool, [&, n] { fork(n * 2 + 1); });
+		if (n * 2 + 2 < count) post(pool, [&, n] { fork(n * 2 + 2); });
+		done.fetch_add(1, std::memory_order_release);
+	};
+	start = std::chrono::high_resolution_clock::now();
+	post(pool, [&] { fork(0); });
+	wait(count);
+	elapsed = std::chrono::high_resolution_clock::now() - start;
+	report(name + ": forked", count, elapsed, "jobs/s");
+}
+
+void bench_executor(uint64_t count)
+{
+	{
+		Locked_Pool pool(16);
+		bench_executor("Locked_Pool(16)", pool, [] (auto &pool, auto job) { pool.enqueue(std::move(job)); }, count);
+	}
+	bench_executor("Executor::global()", Executor::global(), [] (auto &pool, auto job) { pool.post(std::move(job)); }, count);
+	//the thread count with both apps and a file service open, before and after
+	uint64_t threads, rss_kb;
+	proc_status(threads, rss_kb);
+	auto before = threads;
+	{
+		Locked_Pool mandelbrot(16), raymarch(16), files1(2), files2(1);
+		proc_status(threads, rss_kb);
+	}
+	auto pools = threads - before;
+	Executor::pool("file_service", 2);
+	Executor::pool("file_service_requests", 1);
+	proc_status(threads, rss_kb);
+	std::cout << std::left << std::setw(40) << "Threads: apps and file service"
+		<< std::right << std::setw(12) << pools << " pooled before "
+		<< Executor::global().size() + threads - before << " after" << std::endl;
+}
+
+///////
+// farm
+///////
+
+void bench_farm(uint32_t workers, uint32_t jobs)
+{
+	//workers that complete every job they are sent, as fast as the farm can deal them out
+	std::vector<Net_ID> ids;
+	std::vector<std::string> entries;
+	for (auto i = 0u; i < workers; ++i)
+	{
+		ids.push_back(global_router->alloc());
+		entries.push_back(global_router->declare(ids.back(), "bench_farm_worker", "Bench"));
+	}
+	auto farm = Farm(*global_router, "bench_farm_worker,", 16, std::chrono::milliseconds(60000),
+		[] (const Net_ID &, std::shared_ptr<Msg>) {});
+	for (auto i = 0u; i < jobs; ++i) farm.add_job(std::make_shared<Msg>(sizeof(Farm::Job)));
+	auto start = std::chrono::high_resolution_clock::now();
+	farm.refresh();
+	auto done = 0u;
+	while (done < jobs)
+	{
+		for (auto &id : ids)
+		{
+			auto mbox = global_router->resolve(id);
+			while (auto msg = mbox.poll())
+			{
+				//batches of jobs, cancels of stragglers' copies come back here too
+				auto before = done;
+				farm.complete_jobs(msg, [&] (const std::shared_ptr<Msg> &) { done++; });
+				//the apps refresh on a timer, say every 100 replies
+				if (done / 100 != before / 100) farm.refresh();
+			}
+		}
+	}
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	report("Farm: " + std::to_string(workers) + " workers, " + std::to_string(jobs) + " jobs", jobs, elapsed, "jobs/s");
+	for (auto &e : entries) global_router->forget(e);
+	for (auto &id : ids) global_router->free(id);
+}
+
+//mandelbrot shaped row jobs, the worker and the farm both on this thread, the worker
+//answers as the app does less the executor, heap allocations for each job from
+//being added to its reply being used
+void bench_farm_allocs(uint32_t jobs)
+{
+	struct Row_Job : public Farm::Job
+	{
+		Net_ID m_reply;
+		uint32_t m_x;
+		uint32_t m_y;
+		uint32_t m_x1;
+		uint32_t m_y1;
+		uint32_t m_cw;
+		uint32_t m_ch;
+		double m_cx;
+		double m_cy;
+		double m_z;
+	};
+	struct Row_Reply : public Farm::Job
+	{
+		uint32_t m_x;
+		uint32_t m_y;
+		uint32_t m_x1;
+		uint32_t m_y1;
+		uint8_t m_data[];
+	};
+	const auto width = 1600u;
+	auto worker_id = global_router->alloc();
+	auto reply_id = global_router->alloc();
+	auto entry = global_router->declare(worker_id, "bench_alloc_worker", Farm::worker_params("Bench"));
+	auto farm = Farm(*global_router, "bench_alloc_worker,", 16, std::chrono::milliseconds(60000),
+		[&] (const Net_ID &, std::shared_ptr<Msg> job) { ((Row_Job*)job->begin())->m_reply = reply_id; });
+	auto allocs = heap_allocs.load();
+	auto start = std::chrono::high_resolution_clock::now();
+	for (auto y = 0u; y < jobs; ++y)
+	{
+		auto job = std::make_shared<Msg>(sizeof(Row_Job));
+		auto body = (Row_Job*)job->begin();
+		body->m_x = 0;
+		body->m_y = y;
+		body->m_x1 = width;
+		body->m_y1 = y + 1;
+		farm.add_job(job);
+	}
+	farm.refresh();
+	auto worker = global_router->resolve(worker_id);
+	auto reply = global_router->resolve(reply_id);
+	Farm::Cancels cancels;
+	auto done = 0u;
+	while (done < jobs)
+	{
+		while (auto msg = worker.poll())
+		{
+			if (cancels.note(msg)) continue;
+			auto parts = Farm::unpack(msg);
+			auto replies = std::make_shared<Farm::Replies>(*global_router, parts.size());
+			for (auto i = 0u; i < parts.size(); ++i)
+			{
+				auto job_body = (Row_Job*)parts[i]->begin();
+				auto stride = job_body->m_x1 - job_body->m_x;
+				auto row = std::make_shared<Msg>(sizeof(Row_Reply) + stride * (job_body->m_y1 - job_body->m_y));
+				auto row_body = (Row_Reply*)row->begin();
+				memcpy(&row_body->m_worker, &job_body->m_worker, sizeof(Farm::Job));
+				row_body->m_x = job_body->m_x;
+				row_body->m_y = job_body->m_y;
+				row_body->m_x1 = job_body->m_x1;
+				row_body->m_y1 = job_body->m_y1;
+				memset(row_body->m_data, 0, stride * (job_body->m_y1 - job_body->m_y));
+				row->set_dest(job_body->m_reply);
+				replies->reply(i, row);
+			}
+		}
+		while (auto msg = reply.poll()) farm.complete_jobs(msg, [&] (const std::shared_ptr<Msg> &) { done++; });
+	}
+	auto finish = std::chrono::high_resolution_clock::now();
+	report("Farm: mandelbrot row job and reply", jobs, finish - start, "jobs/s");
+	report_per_msg("Farm: mandelbrot row job and reply", jobs, heap_allocs - allocs, "allocs/job");
+	global_router->forget(entry);
+	global_router->free(worker_id);
+	global_router->free(reply_id);
+}
+
+//workers of different speeds, one job at a time, a job costs a fixed overhead plus
+//its rows, which cost more through the middle of the frame like a set boundary
+void bench_granularity(bool adaptive, const std::string &name)
+{
+	const auto rows = 1600u;
+	const auto workers = 8u;
+	const auto overhead = std::chrono::microseconds(300);
+	auto row_cost = [&] (uint32_t y)
+	{
+		auto d = ((double)y - rows / 2.0) / (rows / 10.0);
+		return 20.0 + 1500.0 * std::exp(-d * d);
+	};
+	std::vector<Net_ID> ids;
+	std::vector<std::string> entries;
+	std::vector<std::thread> threads;
+	std::atomic<bool> running {true};
+	auto reply_id = global_router->alloc();
+	for (auto i = 0u; i < workers; ++i)
+	{
+		ids.push_back(global_router->alloc());
+		entries.push_back(global_router->declare(ids.back(), "bench_granularity_worker", "Bench"));
+		auto speed = 1.0 + i % 4;
+		threads.emplace_back([&, id = ids.back(), speed]
+		{
+			auto mbox = global_router->resolve(id);
+			while (running)
+			{
+				auto msg = mbox.read(std::chrono::milliseconds(10));
+				if (!msg) continue;
+				auto parts = Farm::unpack(msg);
+				if (parts.size() > 1)
+				{
+					//spread a batch back over the mailbox, a job at a time
+					for (auto &part : parts)
+					{
+						part->set_dest(id);
+						global_router->send(part);
+					}
+					continue;
+				}
+				auto body = (uint32_t*)(msg->begin() + sizeof(Farm::Job));
+				auto cost = 0.0;
+				for (auto y = body[0]; y < body[1]; ++y) cost += row_cost(y);
+				std::this_thread::sleep_for(overhead + std::chrono::microseconds((uint64_t)(cost / speed)));
+				msg->set_dest(reply_id);
+				global_router->send(msg);
+			}
+		});
+	}
+	auto make_job = [] (uint32_t y, uint32_t y1)
+	{
+		auto job = std::make_shared<Msg>(sizeof(Farm::Job) + 2 * sizeof(uint32_t));
+		auto body = (uint32_t*)(job->begin() + sizeof(Farm::Job));
+		body[0] = y;
+		body[1] = y1;
+		return job;
+	};
+	auto farm = Farm(*global_router, "bench_granularity_worker,", 16, std::chrono::milliseconds(60000),
+		[] (const Net_ID &, std::shared_ptr<Msg>) {});
+	if (adaptive) farm.add_range(0, rows, std::chrono::milliseconds(20), make_job);
+	else for (auto y = 0u; y < rows; ++y) farm.add_job(make_job(y, y + 1));
+	auto start = std::chrono::high_resolution_clock::now();
+	auto last = start;
+	farm.refresh();
+	auto reply = global_router->resolve(reply_id);
+	auto done = 0u;
+	auto msgs = 0u;
+	while (done < rows)
+	{
+		auto msg = reply.read(std::chrono::milliseconds(100));
+		if (!msg) { farm.refresh(); continue; }
+		if (!farm.validate_job(msg)) continue;
+		auto body = (uint32_t*)(msg->begin() + sizeof(Farm::Job));
+		done += body[1] - body[0];
+		msgs++;
+		last = std::chrono::high_resolution_clock::now();
+		farm.complete_job(msg);
+	}
+	std::chrono::duration<double, std::milli> elapsed = last - start;
+	std::cout << std::left << std::setw(40) << name
+		<< std::right << std::setw(12) << std::fixed << std::setprecision(0) << elapsed.count()
+		<< " ms/frame " << std::setw(6) << msgs << " jobs" << std::endl;
+	running = false;
+	for (auto &t : threads) t.join();
+	for (auto &e : entries) global_router->forget(e);
+	for (auto &id : ids) global_router->free(id);
+	global_router->free(reply_id);
+}
+
+void bench_speculate(bool dropped, bool on, const std::string &name)
+{
+	//a frame of rows on 8 workers, either one worker slows right down part way
+	//through, with or without copies of stragglers, or the frame is dropped part
+	//way through, with the workers ignoring or checking for cancels
+	const auto rows = 1600u;
+	const auto workers = 8u;
+	const auto row_cost = std::chrono::microseconds(100);
+	std::vector<Net_ID> ids;
+	std::vector<Net_ID> job_ids;
+	std::vector<std::string> entries;
+	std::vector<std::thread> threads;
+	std::atomic<bool> running {true};
+	std::atomic<uint32_t> jobs_worked {0};
+	std::atomic<uint32_t> rows_worked {0};
+	Farm::Cancels cancels;
+	auto reply_id = global_router->alloc();
+	for (auto i = 0u; i < workers; ++i)
+	{
+		ids.push_back(global_router->alloc());
+		job_ids.push_back(global_router->alloc());
+		entries.push_back(global_router->declare(ids.back(), "bench_speculate_worker", "Bench"));
+		//note cancels as they come in, pass jobs on
+		threads.emplace_back([&, id = ids.back(), job_id = job_ids.back()]
+		{
+			auto mbox = global_router->resolve(id);
+			while (running)
+			{
+				auto msg = mbox.read(std::chrono::milliseconds(10));
+				if (!msg || cancels.note(msg)) continue;
+				for (auto &part : Farm::unpack(msg))
+				{
+					part->set_dest(job_id);
+					global_router->send(part);
+				}
+			}
+		});
+		threads.emplace_back([&, i, job_id = job_ids.back()]
+		{
+			auto mbox = global_router->resolve(job_id);
+			auto jobs = 0u;
+			while (running)
+			{
+				auto msg = mbox.read(std::chrono::milliseconds(10));
+				if (!msg) continue;
+				auto job = (Farm::Job*)msg->begin();
+				auto body = (uint32_t*)(msg->begin() + sizeof(Farm::Job));
+				auto slow = (!dropped && i == 0 && ++jobs > 4) ? 30 : 1;
+				auto cancelled = false;
+				jobs_worked++;
+				for (auto y = body[0]; y < body[1]; ++y)
+				{
+					cancelled = (on || !dropped) && cancels.cancelled(*job);
+					if (cancelled) break;
+					std::this_thread::sleep_for(row_cost * slow);
+					rows_worked++;
+				}
+				if (cancelled) continue;
+				msg->set_dest(reply_id);
+				global_router->send(msg);
+			}
+		});
+	}
+	auto make_job = [] (uint32_t y, uint32_t y1)
+	{
+		auto job = std::make_shared<Msg>(sizeof(Farm::Job) + 2 * sizeof(uint32_t));
+		auto body = (uint32_t*)(job->begin() + sizeof(Farm::Job));
+		body[0] = y;
+		body[1] = y1;
+		return job;
+	};
+	auto farm = std::make_unique<Farm>(*global_router, "bench_speculate_worker,", 16, std::chrono::milliseconds(60000),
+		[] (const Net_ID &, std::shared_ptr<Msg>) {});
+	farm->speculate(on && !dropped);
+	farm->add_range(0, rows, std::chrono::milliseconds(5), make_job);
+	auto start = std::chrono::high_resolution_clock::now();
+	auto last = start;
+	farm->refresh();
+	auto reply = global_router->resolve(reply_id);
+	auto done = 0u;
+	while (done < rows)
+	{
+		if (dropped && std::chrono::high_resolution_clock::now() - start > std::chrono::milliseconds(10)) break;
+		auto msg = reply.read(std::chrono::milliseconds(1));
+		if (!msg) { farm->refresh(); continue; }
+		if (!farm->validate_job(msg)) continue;
+		auto body = (uint32_t*)(msg->begin() + sizeof(Farm::Job));
+		done += body[1] - body[0];
+		last = std::chrono::high_resolution_clock::now();
+		farm->complete_job(msg);
+	}
+	if (dropped)
+	{
+		//drop the frame, see how many more rows get worked on
+		auto rows_before = rows_worked.load();
+		farm.reset();
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		std::cout << std::left << std::setw(40) << name
+			<< std::right << std::setw(12) << rows_worked - rows_before
+			<< " rows worked after the drop" << std::endl;
+	}
+	else
+	{
+		std::chrono::duration<double, std::milli> elapsed = last - start;
+		std::cout << std::left << std::setw(40) << name
+			<< std::right << std::setw(12) << std::fixed << std::setprecision(0) << elapsed.count()
+			<< " ms/frame " << std::setw(6) << jobs_worked << " jobs " << std::setw(6) << rows_worked << " rows worked" << std::endl;
+	}
+	running = false;
+	for (auto &t : threads) t.join();
+	for (auto &e : entries) global_router->forget(e);
+	for (auto &id : ids) global_router->free(id);
+	for (auto &id : job_ids) global_router->free(id);
+	global_router->free(reply_id);
+}
+
+//two 8 core servers at twice the speed and six single core workers, with and
+//without their capacity in the directory params, a frame of jobs or of rows
+void bench_capacity(bool range, bool advertised, const std::string &name)
+{
+	const auto units = range ? 1600u : 4000u;
+	const auto unit_cost = range ? std::chrono::microseconds(1000) : std::chrono::microseconds(500);
+	struct spec { uint32_t m_cores; uint32_t m_speed; };
+	const auto specs = std::vector<spec>{{8, 2}, {8, 2}, {1, 1}, {1, 1}, {1, 1}, {1, 1}, {1, 1}, {1, 1}};
+	std::vector<Net_ID> ids;
+	std::vector<std::string> entries;
+	std::vector<std::thread> threads;
+	std::atomic<bool> running {true};
+	auto reply_id = global_router->alloc();
+	for (auto &s : specs)
+	{
+		ids.push_back(global_router->alloc());
+		auto params = std::string("Bench");
+		if (advertised) params += ",cores=" + std::to_string(s.m_cores) + ",score=" + std::to_string(s.m_speed * 1000);
+		entries.push_back(global_router->declare(ids.back(), "bench_capacity_worker", params));
+		//a thread per core, all taking jobs from the one mailbox
+		for (auto i = 0u; i < s.m_cores; ++i)
+		{
+			threads.emplace_back([&, id = ids.back(), speed = s.m_speed]
+			{
+				auto mbox = global_router->resolve(id);
+				while (running)
+				{
+					auto msg = mbox.read(std::chrono::milliseconds(10));
+					if (!msg) continue;
+					auto parts = Farm::unpack(msg);
+					if (parts.size() > 1)
+					{
+						//spread a batch back over the mailbox for all the cores
+						for (auto &part : parts)
+						{
+							part->set_dest(id);
+							global_router->send(part);
+						}
+						continue;
+					}
+					auto body = (uint32_t*)(msg->begin() + sizeof(Farm::Job));
+					std::this_thread::sleep_for(unit_cost * (body[1] - body[0]) / speed);
+					msg->set_dest(reply_id);
+					global_router->send(msg);
+				}
+			});
+		}
+	}
+	auto make_job = [] (uint32_t y, uint32_t y1)
+	{
+		auto job = std::make_shared<Msg>(sizeof(Farm::Job) + 2 * sizeof(uint32_t));
+		auto body = (uint32_t*)(job->begin() + sizeof(Farm::Job));
+		body[0] = y;
+		body[1] = y1;
+		return job;
+	};
+	auto farm = Farm(*global_router, "bench_capacity_worker,", 16, std::chrono::milliseconds(60000),
+		[] (const Net_ID &, std::shared_ptr<Msg>) {});
+	if (range) farm.add_range(0, units, std::chrono::milliseconds(5), make_job);
+	else for (auto y = 0u; y < units; ++y) farm.add_job(make_job(y, y + 1));
+	auto start = std::chrono::high_resolution_clock::now();
+	auto last = start;
+	farm.refresh();
+	auto reply = global_router->resolve(reply_id);
+	auto done = 0u;
+	while (done < units)
+	{
+		auto msg = reply.read(std::chrono::milliseconds(10));
+		if (!msg) { farm.refresh(); continue; }
+		if (!farm.validate_job(msg)) continue;
+		auto body = (uint32_t*)(msg->begin() + sizeof(Farm::Job));
+		done += body[1] - body[0];
+		last = std::chrono::high_resolution_clock::now();
+		farm.complete_job(msg);
+	}
+	std::chrono::duration<double, std::milli> elapsed = last - start;
+	std::cout << std::left << std::setw(40) << name
+		<< std::right << std::setw(12) << std::fixed << std::setprecision(0) << elapsed.count()
+		<< " ms/frame" << std::endl;
+	running = false;
+	for (auto &t : threads) t.join();
+	for (auto &e : entries) global_router->forget(e);
+	for (auto &id : ids) global_router->free(id);
+	global_router->free(reply_id);
+}
+
+//workers that echo every job straight back, so it's all msg overhead, with and
+//without batching of the jobs and replies
+void bench_batch(uint32_t batch, const std::string &name)
+{
+	const auto jobs = 200000u;
+	const auto workers = 8u;
+	std::vector<Net_ID> ids;
+	std::vector<std::string> entries;
+	std::vector<std::thread> threads;
+	std::atomic<bool> running {true};
+	std::atomic<uint32_t> msgs {0};
+	auto reply_id = global_router->alloc();
+	for (auto i = 0u; i < workers; ++i)
+	{
+		ids.push_back(global_router->alloc());
+		entries.push_back(global_router->declare(ids.back(), "bench_batch_worker", "Bench"));
+		threads.emplace_back([&, id = ids.back()]
+		{
+			auto mbox = global_router->resolve(id);
+			while (running)
+			{
+				auto msg = mbox.read(std::chrono::milliseconds(10));
+				if (!msg) continue;
+				msgs++;
+				auto parts = Farm::unpack(msg);
+				auto replies = Farm::Replies(*global_router, parts.size());
+				for (auto j = 0u; j < parts.size(); ++j)
+				{
+					parts[j]->set_dest(reply_id);
+					replies.reply(j, parts[j]);
+				}
+			}
+		});
+	}
+	auto farm = Farm(*global_router, "bench_batch_worker,", 16, std::chrono::milliseconds(60000),
+		[] (const Net_ID &, std::shared_ptr<Msg>) {});
+	farm.batch(batch);
+	for (auto i = 0u; i < jobs; ++i) farm.add_job(std::make_shared<Msg>(sizeof(Farm::Job) + 64));
+	auto start = std::chrono::high_resolution_clock::now();
+	farm.refresh();
+	auto reply = global_router->resolve(reply_id);
+	auto done = 0u;
+	while (done < jobs)
+	{
+		auto msg = reply.read(std::chrono::milliseconds(10));
+		if (!msg) { farm.refresh(); continue; }
+		msgs++;
+		farm.complete_jobs(msg, [&] (const std::shared_ptr<Msg> &) { done++; });
+	}
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	report(name, jobs, elapsed, "jobs/s");
+	report_per_msg(name, jobs, msgs, "msgs/job");
+	running = false;
+	for (auto &t : threads) t.join();
+	for (auto &e : entries) global_router->forget(e);
+	for (auto &id : ids) global_router->free(id);
+	global_router->free(reply_id);
+}
+
+////////////////
+// file transfer
+////////////////
+
+//file service over a folder of its own, tells us when a transfer is done,
+//and counts the sends that have finished with the router. transfers with a
+//ctx other than 0 have their finish time noted instead. keeps the last file list
+//page it was sent, and all the changes.
+class Bench_File_Service : public File_Service
+{
+public:
+	typedef std::chrono::high_resolution_clock::time_point Time;
+	Bench_File_Service(Router &router, const std::string &path)
+		: File_Service(router)
+		, m_path(path)
+	{}
+	void wait_sends(uint32_t count)
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		while (m_sends < count) m_cv.wait(l);
+	}
+	//finish times of transfers 1 to count, a failure has none
+	std::vector<std::pair<bool, Time>> wait_finished(int32_t count)
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		while ((int32_t)m_finished.size() < count) m_cv.wait(l);
+		auto finished = std::vector<std::pair<bool, Time>>{};
+		for (auto ctx = 1; ctx <= count; ++ctx) finished.push_back(m_finished[ctx]);
+		m_finished.clear();
+		return finished;
+	}
+	//wait for a page, false if it doesn't come
+	bool wait_list(std::vector<File_Info> &page, bool &more)
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		if (!m_cv.wait_for(l, std::chrono::seconds(10), [&] { return m_listed; })) return false;
+		m_listed = false;
+		page = std::move(m_page);
+		more = m_more;
+		return true;
+	}
+	//wait for a change to a file, false if it doesn't come
+	bool wait_change(const std::string &name, File_Info &change)
+	{
+		std::unique_lock<std::mutex> l(m_mutex);
+		auto found = [&]
+		{
+			auto itr = std::find_if(begin(m_changes), end(m_changes), [&] (auto &c) { return c.m_name == name; });
+			if (itr != end(m_changes)) change = *itr;
+			return itr != end(m_changes);
+		};
+		return m_cv.wait_for(l, std::chrono::seconds(10), found);
+	}
+	std::promise<bool> m_done;
+	std::atomic<int32_t> m_progress {0};
+	uint32_t m_sends = 0;
+protected:
+	std::string in_file_path() override { return m_path; }
+	void finished(int32_t ctx, bool ok)
+	{
+		if (!ctx) return m_done.set_value(ok);
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_finished[ctx] = {ok, std::chrono::high_resolution_clock::now()};
+		m_cv.notify_all();
+	}
+	void out_ok(const Net_ID &dst_id, const Net_ID &src_id, const std::string &dst_name, const std::string &src_name, int32_t ctx) override
+	{
+		finished(ctx, true);
+	}
+	void out_error(const Net_ID &dst_id, const Net_ID &src_id, const std::string &dst_name, const std::string &src_name, int32_t ctx) override
+	{
+		finished(ctx, false);
+	}
+	void out_progress(const Net_ID &dst_id, const Net_ID &src_id, const std::string &dst_name, const std::string &src_name, int32_t ctx, int32_t progress) override
+	{
+		m_progress = progress;
+	}
+	void out_file_list(const Net_ID &src_id, const std::vector<File_Info> &file_list, uint64_t version, bool more) override
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_page = file_list;
+		m_more = more;
+		m_listed = true;
+		m_cv.notify_all();
+	}
+	void out_file_changes(const Net_ID &src_id, const std::vector<File_Info> &changes, uint64_t version, bool more) override
+	{
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_changes.insert(end(m_changes), begin(changes), end(changes));
+		m_cv.notify_all();
+	}
+	void out_log(const std::string &log) override
+	{
+		if (!log.starts_with("Sent File") && !log.starts_with("Send File Error")) return;
+		std::lock_guard<std::mutex> l(m_mutex);
+		m_sends++;
+		m_cv.notify_all();
+	}
+	std::string m_path;
+	std::mutex m_mutex;
+	std::condition_variable m_cv;
+	std::map<int32_t, std::pair<bool, Time>> m_finished;
+	std::vector<File_Info> m_page;
+	std::vector<File_Info> m_changes;
+	bool m_more = false;
+	bool m_listed = false;
+};
+
+//pull a file from node a to node b once the links are up, MB/s from request to ok,
+//the bytes read and written by file and socket calls for each byte of the file,
+//and the heap allocations for each chunk, on both nodes and the links between
+void bench_transfer(const std::string &name, Router &a, Router &b, uint64_t size)
+{
+	auto nodes = &a == &b ? 1u : 2u;
+	auto a_kernel = std::make_shared<Kernel_Service>(a);
+	auto b_kernel = nodes == 1 ? a_kernel : std::make_shared<Kernel_Service>(b);
+	a_kernel->start_thread();
+	b_kernel->start_thread();
+	while (a.enquire("kernel,").size() < nodes || b.enquire("kernel,").size() < nodes)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	std::string a_path = "/tmp/chrysalib_bench_a_", b_path = "/tmp/chrysalib_bench_b_";
+	{
+		std::ofstream file(a_path + "file.bin", std::ios::binary);
+		std::vector<char> data(1 << 20);
+		for (auto i = 0u; i < data.size(); ++i) data[i] = (char)(i * 7);
+		for (auto i = 0u; i < size; i += data.size()) file.write(data.data(), std::min((uint64_t)data.size(), size - i));
+	}
+	auto a_files = std::make_shared<Bench_File_Service>(a, a_path);
+	auto b_files = std::make_shared<Bench_File_Service>(b, b_path);
+	a_files->start_thread();
+	b_files->start_thread();
+	auto done = b_files->m_done.get_future();
+	uint64_t read, written, read_after, written_after;
+	proc_io(read, written);
+	auto allocs = heap_allocs.load();
+	auto start = std::chrono::high_resolution_clock::now();
+	b_files->transfer_file(b_files->get_id(), a_files->get_id(), "copy.bin", "file.bin", 0);
+	auto ok = done.get();
+	auto finish = std::chrono::high_resolution_clock::now();
+	auto allocs_after = heap_allocs.load();
+	proc_io(read_after, written_after);
+	//the sender may still be waiting on the last acks
+	a_files->wait_sends(1);
+	std::ifstream copy(b_path + "copy.bin", std::ios::binary | std::ios::ate);
+	if (!ok || (uint64_t)copy.tellg() != size) std::cout << name << ": failed" << std::endl;
+	else
+	{
+		report(name, size / 1000000, finish - start, "MB/s");
+		report_per_msg(name, size, read_after - read, "bytes read/byte");
+		report_per_msg(name, size, written_after - written, "bytes written/byte");
+		auto chunk_length = MAX_PACKET_SIZE - sizeof(File_Service::send_file_chunk);
+		report_per_msg(name, (size + chunk_length - 1) / chunk_length, allocs_after - allocs, "allocs/chunk");
+	}
+	a_files->stop_thread();
+	b_files->stop_thread();
+	a_kernel->stop_thread();
+	if (nodes == 2) b_kernel->stop_thread();
+	a_files->join_thread();
+	b_files->join_thread();
+	a_kernel->join_thread();
+	if (nodes == 2) b_kernel->join_thread();
+	std::remove((a_path + "file.bin").data());
+	std::remove((b_path + "copy.bin").data());
+}
+
+void bench_transfer()
+{
+	//a big file on the one node, two nodes over ip links on loopback, then over
+	//memory links with 10ms each way
+	{
+		Router a;
+		bench_transfer("File: 512MB, same node", a, a, 512000000);
+	}
+	auto size = (uint64_t)32000000;
+	{
+		Router a, b;
+		asio::io_context io_context;
+		auto work = asio::make_work_guard(io_context);
+		auto io_thread = std::thread([&] { io_context.run(); });
+		asio::ip::tcp::acceptor acceptor(io_context, asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+		auto a_socket = std::make_shared<asio::ip::tcp::socket>(io_context);
+		auto b_socket = std::make_shared<asio::ip::tcp::socket>(io_context);
+		a_socket->connect(acceptor.local_endpoint());
+		acceptor.accept(*b_socket);
+		auto a_link = std::make_shared<IP_Link>(a_socket, std::chrono::microseconds(IP_LINK_FLUSH_DEADLINE), a);
+		auto b_link = std::make_shared<IP_Link>(b_socket, std::chrono::microseconds(IP_LINK_FLUSH_DEADLINE), b);
+		a_link->start_threads();
+		b_link->start_threads();
+		bench_transfer("File: 32MB, ip loopback", a, b, size);
+		a_link->stop_threads();
+		b_link->stop_threads();
+		a_link->join_threads();
+		b_link->join_threads();
+		work.reset();
+		io_thread.join();
+	}
+	for (auto loss : {0.0, 0.01})
+	{
+		Router a, b;
+		Memory_Link_Params params;
+		params.m_latency = std::chrono::milliseconds(10);
+		params.m_loss = loss;
+		auto links = Memory_Link::create_pair(a, b, params);
+		links.first->start_threads();
+		links.second->start_threads();
+		bench_transfer(loss ? "File: 32MB, 20ms rtt, 1% loss" : "File: 32MB, 20ms rtt", a, b, size);
+		links.first->stop_threads();
+		links.second->stop_threads();
+		links.first->join_threads();
+		links.second->join_threads();
+	}
+}
+
+//send a 32MB file over a 20ms link, then again once the receiver has it, unchanged and
+//with 1% changed and a few bytes let in part way, and 1% more with a timeout shorter
+//than the hashing and scanning take. then cut a transfer of another file half way
+//and finish it over a new link. MB/s from request to ok.
+void bench_delta()
+{
+	Router a, b;
+	auto a_kernel = std::make_shared<Kernel_Service>(a);
+	auto b_kernel = std::make_shared<Kernel_Service>(b);
+	a_kernel->start_thread();
+	b_kernel->start_thread();
+	Memory_Link_Params params;
+	params.m_latency = std::chrono::milliseconds(10);
+	auto links = Memory_Link::create_pair(a, b, params);
+	links.first->start_threads();
+	links.second->start_threads();
+	while (a.enquire("kernel,").size() < 2 || b.enquire("kernel,").size() < 2)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	std::string a_path = "/tmp/chrysalib_bench_a_", b_path = "/tmp/chrysalib_bench_b_";
+	auto size = (uint64_t)32000000;
+	auto data = std::vector<char>(size);
+	auto write_source = [&] (uint64_t seed)
+	{
+		std::mt19937_64 rng(seed);
+		for (auto i = 0u; i + 8 <= data.size(); i += 8)
+		{
+			auto v = rng();
+			memcpy(&data[i], &v, 8);
+		}
+		std::ofstream(a_path + "file.bin", std::ios::binary).write(data.data(), data.size());
+	};
+	auto a_files = std::make_shared<Bench_File_Service>(a, a_path);
+	auto b_files = std::make_shared<Bench_File_Service>(b, b_path);
+	a_files->start_thread();
+	b_files->start_thread();
+	auto start = std::chrono::high_resolution_clock::now();
+	auto request = [&]
+	{
+		a_files->m_sends = 0;
+		b_files->m_done = {};
+		b_files->m_progress = 0;
+		start = std::chrono::high_resolution_clock::now();
+		b_files->transfer_file(b_files->get_id(), a_files->get_id(), "copy.bin", "file.bin", 0);
+	};
+	auto finish = [&] (const std::string &name)
+	{
+		auto ok = b_files->m_done.get_future().get();
+		auto elapsed = std::chrono::high_resolution_clock::now() - start;
+		a_files->wait_sends(1);
+		std::ifstream copy(b_path + "copy.bin", std::ios::binary);
+		auto copy_data = std::vector<char>(data.size() + 1);
+		copy.read(copy_data.data(), copy_data.size());
+		if (!ok || (uint64_t)copy.gcount() != data.size() || memcmp(copy_data.data(), data.data(), data.size()))
+		{
+			std::cout << name << ": failed" << std::endl;
+		}
+		else report(name, size / 1000000, elapsed, "MB/s");
+	};
+	write_source(1);
+	request();
+	finish("File: 32MB, 20ms rtt, new");
+	request();
+	finish("File: 32MB, 20ms rtt, unchanged");
+	//change 1% in 32 places and push the back two thirds along by 1000 bytes
+	for (auto i = 0u; i < 32; ++i)
+	{
+		std::fill_n(begin(data) + i * (size / 32), 10000, (char)i);
+	}
+	data.insert(begin(data) + size / 3, 1000, 'x');
+	data.resize(size);
+	std::ofstream(a_path + "file.bin", std::ios::binary).write(data.data(), data.size());
+	request();
+	finish("File: 32MB, 20ms rtt, 1% changed");
+	//change another 1% and send it with a timeout well short of the time it takes to
+	//hash and scan 32MB, only the keepalives hold it together
+	for (auto i = 0u; i < 32; ++i)
+	{
+		std::fill_n(begin(data) + i * (size / 32) + 100000, 10000, (char)(i + 64));
+	}
+	std::ofstream(a_path + "file.bin", std::ios::binary).write(data.data(), data.size());
+	auto timeout = std::chrono::milliseconds(40);
+	a_files->set_timeout(timeout);
+	b_files->set_timeout(timeout);
+	request();
+	finish("File: 32MB, 20ms rtt, " + std::to_string(timeout.count()) + "ms timeout");
+	a_files->set_timeout(std::chrono::milliseconds(FILE_TRANSFER_TIMEOUT));
+	b_files->set_timeout(std::chrono::milliseconds(FILE_TRANSFER_TIMEOUT));
+	//cut the link half way through a new file, the receiver gives up after the
+	//transfer timeout and keeps what it has
+	std::remove((b_path + "copy.bin").data());
+	write_source(2);
+	request();
+	while (b_files->m_progress < 50) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	links.first->stop_threads();
+	links.second->stop_threads();
+	links.first->join_threads();
+	links.second->join_threads();
+	b_files->m_done.get_future().get();
+	a_files->wait_sends(1);
+	links = Memory_Link::create_pair(a, b, params);
+	links.first->start_threads();
+	links.second->start_threads();
+	//give the new links time to find each other
+	std::this_thread::sleep_for(std::chrono::milliseconds(LINK_PING_RATE * 2));
+	request();
+	finish("File: 32MB, 20ms rtt, resumed from 50%");
+	a_files->stop_thread();
+	b_files->stop_thread();
+	a_kernel->stop_thread();
+	b_kernel->stop_thread();
+	a_files->join_thread();
+	b_files->join_thread();
+	a_kernel->join_thread();
+	b_kernel->join_thread();
+	links.first->stop_threads();
+	links.second->stop_threads();
+	links.first->join_threads();
+	links.second->join_threads();
+	std::remove((a_path + "file.bin").data());
+	std::remove((b_path + "copy.bin").data());
+}
+
+void bench_swarm()
+{
+	//a receiver with a bandwidth capped link to each of 3 sources that hold the file
+	const auto sources = 3u;
+	Router b;
+	std::vector<std::unique_ptr<Router>> s;
+	for (auto i = 0u; i < sources; ++i) s.emplace_back(std::make_unique<Router>());
+	auto b_kernel = std::make_shared<Kernel_Service>(b);
+	b_kernel->start_thread();
+	std::vector<std::shared_ptr<Kernel_Service>> s_kernels;
+	for (auto &router : s)
+	{
+		s_kernels.emplace_back(std::make_shared<Kernel_Service>(*router));
+		s_kernels.back()->start_thread();
+	}
+	Memory_Link_Params params, slow_params;
+	params.m_latency = std::chrono::milliseconds(10);
+	params.m_bandwidth = 8000000;
+	slow_params.m_latency = std::chrono::milliseconds(10);
+	slow_params.m_bandwidth = 1000000;
+	std::vector<std::pair<std::unique_ptr<Memory_Link>, std::unique_ptr<Memory_Link>>> links;
+	auto connect = [&] (const Memory_Link_Params &last_params)
+	{
+		for (auto i = 0u; i < sources; ++i)
+		{
+			links.emplace_back(Memory_Link::create_pair(b, *s[i], i == sources - 1 ? last_params : params));
+			links.back().first->start_threads();
+			links.back().second->start_threads();
+		}
+		while (b.enquire("kernel,").size() < sources + 1)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+	};
+	auto disconnect = [&]
+	{
+		for (auto &link : links)
+		{
+			link.first->stop_threads();
+			link.second->stop_threads();
+		}
+		for (auto &link : links)
+		{
+			link.first->join_threads();
+			link.second->join_threads();
+		}
+		links.clear();
+	};
+	std::string b_path = "/tmp/chrysalib_bench_b_";
+	auto size = (uint64_t)16000000;
+	auto data = std::vector<char>(size);
+	std::mt19937_64 rng(1);
+	for (auto i = 0u; i + 8 <= data.size(); i += 8)
+	{
+		auto v = rng();
+		memcpy(&data[i], &v, 8);
+	}
+	std::vector<std::shared_ptr<Bench_File_Service>> s_files;
+	for (auto i = 0u; i < sources; ++i)
+	{
+		auto path = "/tmp/chrysalib_bench_s" + std::to_string(i) + "_";
+		std::ofstream(path + "file.bin", std::ios::binary).write(data.data(), data.size());
+		s_files.emplace_back(std::make_shared<Bench_File_Service>(*s[i], path));
+		s_files.back()->start_thread();
+	}
+	auto b_files = std::make_shared<Bench_File_Service>(b, b_path);
+	b_files->start_thread();
+	auto run = [&] (const std::string &name, bool swarm)
+	{
+		//a fresh copy each time, the file services find each other over the links
+		std::remove((b_path + "copy.bin").data());
+		while (b.enquire("file_service,").size() < sources + 1)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		for (auto &files : s_files) files->m_sends = 0;
+		b_files->m_done = {};
+		auto start = std::chrono::high_resolution_clock::now();
+		b_files->transfer_file(b_files->get_id(), s_files[0]->get_id(), "copy.bin", "file.bin", 0, swarm);
+		auto ok = b_files->m_done.get_future().get();
+		auto elapsed = std::chrono::high_resolution_clock::now() - start;
+		for (auto i = 0u; i < (swarm ? sources : 1); ++i) s_files[i]->wait_sends(1);
+		std::ifstream copy(b_path + "copy.bin", std::ios::binary);
+		auto copy_data = std::vector<char>(data.size() + 1);
+		copy.read(copy_data.data(), copy_data.size());
+		if (!ok || (uint64_t)copy.gcount() != data.size() || memcmp(copy_data.data(), data.data(), data.size()))
+		{
+			std::cout << name << ": failed" << std::endl;
+		}
+		else report(name, size / 1000000, elapsed, "MB/s");
+	};
+	connect(params);
+	run("File: 16MB, 8MB/s links, 1 source", false);
+	run("File: 16MB, 8MB/s links, 3 sources", true);
+	disconnect();
+	connect(slow_params);
+	std::this_thread::sleep_for(std::chrono::milliseconds(LINK_PING_RATE * 2));
+	run("File: 16MB, 8MB/s links, 3 sources, 1 at 1MB/s", true);
+	b_files->stop_thread();
+	b_kernel->stop_thread();
+	for (auto &files : s_files) files->stop_thread();
+	for (auto &kernel : s_kernels) kernel->stop_thread();
+	b_files->join_thread();
+	b_kernel->join_thread();
+	for (auto &files : s_files) files->join_thread();
+	for (auto &kernel : s_kernels) kernel->join_thread();
+	disconnect();
+	for (auto i = 0u; i < sources; ++i) std::remove(("/tmp/chrysalib_bench_s" + std::to_string(i) + "_file.bin").data());
+	std::remove((b_path + "copy.bin").data());
+}
+
+//one sender with a receiver on each of two 20ms links, the sends all driven by its
+//transfer engine. 8 files at once under a cap on all sends, MB/s of them all and how
+//far apart the first and last finish, a small file asked for while two big ones go,
+//and two files to each receiver under a cap on each peer.
+void bench_sched()
+{
+	Router a, b, c;
+	auto a_kernel = std::make_shared<Kernel_Service>(a);
+	auto b_kernel = std::make_shared<Kernel_Service>(b);
+	auto c_kernel = std::make_shared<Kernel_Service>(c);
+	a_kernel->start_thread();
+	b_kernel->start_thread();
+	c_kernel->start_thread();
+	Memory_Link_Params params;
+	params.m_latency = std::chrono::milliseconds(10);
+	auto ab_links = Memory_Link::create_pair(a, b, params);
+	auto ac_links = Memory_Link::create_pair(a, c, params);
+	for (auto link : {ab_links.first.get(), ab_links.second.get(), ac_links.first.get(), ac_links.second.get()}) link->start_threads();
+	while (a.enquire("kernel,").size() < 3)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	std::string a_path = "/tmp/chrysalib_bench_a_", b_path = "/tmp/chrysalib_bench_b_", c_path = "/tmp/chrysalib_bench_c_";
+	auto write_source = [&] (const std::string &name, uint64_t size)
+	{
+		std::vector<char> data(size);
+		std::mt19937_64 rng(size);
+		for (auto i = 0u; i + 8 <= data.size(); i += 8)
+		{
+			auto v = rng();
+			memcpy(&data[i], &v, 8);
+		}
+		std::ofstream(a_path + name, std::ios::binary).write(data.data(), data.size());
+	};
+	write_source("big.bin", 8000000);
+	write_source("mid.bin", 4000000);
+	write_source("small.bin", 500000);
+	auto a_files = std::make_shared<Bench_File_Service>(a, a_path);
+	auto b_files = std::make_shared<Bench_File_Service>(b, b_path);
+	auto c_files = std::make_shared<Bench_File_Service>(c, c_path);
+	a_files->start_thread();
+	b_files->start_thread();
+	c_files->start_thread();
+	auto copy_name = [] (int32_t ctx) { return "copy" + std::to_string(ctx) + ".bin"; };
+	auto request = [&] (Bench_File_Service &files, int32_t ctx, const std::string &name)
+	{
+		files.transfer_file(files.get_id(), a_files->get_id(), copy_name(ctx), name, ctx);
+	};
+	auto check = [&] (const std::string &name, const std::vector<std::pair<bool, Bench_File_Service::Time>> &finished)
+	{
+		auto ok = std::all_of(begin(finished), end(finished), [] (auto &f) { return f.first; });
+		if (!ok) std::cout << name << ": failed" << std::endl;
+		return ok;
+	};
+	{
+		//8 at once under 16MB/s
+		const auto files = 8;
+		a_files->set_send_rate(16000000, 0);
+		a_files->m_sends = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (auto ctx = 1; ctx <= files; ++ctx) request(*b_files, ctx, "mid.bin");
+		auto finished = b_files->wait_finished(files);
+		a_files->wait_sends(files);
+		if (check("Sched: 8 x 4MB, 16MB/s cap", finished))
+		{
+			auto first = std::min_element(begin(finished), end(finished))->second;
+			auto last = std::max_element(begin(finished), end(finished))->second;
+			report("Sched: 8 x 4MB, 16MB/s cap", files * 4, last - start, "MB/s");
+			report_per_msg("Sched: 8 x 4MB, first to last", 1, std::chrono::duration<double, std::milli>(last - first).count(), "ms");
+		}
+	}
+	{
+		//a small file asked for half a second after two big ones, under 8MB/s
+		a_files->set_send_rate(8000000, 0);
+		a_files->m_sends = 0;
+		request(*b_files, 1, "big.bin");
+		request(*b_files, 2, "big.bin");
+		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+		auto start = std::chrono::high_resolution_clock::now();
+		request(*b_files, 3, "small.bin");
+		auto finished = b_files->wait_finished(3);
+		a_files->wait_sends(3);
+		if (check("Sched: 500KB behind 2 x 8MB, 8MB/s cap", finished))
+		{
+			report_per_msg("Sched: 500KB behind 2 x 8MB, 8MB/s cap", 1, std::chrono::duration<double, std::milli>(finished[2].second - start).count(), "ms");
+		}
+	}
+	{
+		//two files to each receiver, under 4MB/s a peer
+		a_files->set_send_rate(0, 4000000);
+		a_files->m_sends = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (auto ctx = 1; ctx <= 2; ++ctx)
+		{
+			request(*b_files, ctx, "mid.bin");
+			request(*c_files, ctx, "mid.bin");
+		}
+		auto b_finished = b_files->wait_finished(2);
+		auto c_finished = c_files->wait_finished(2);
+		a_files->wait_sends(4);
+		if (check("Sched: 2 x 4MB to each of 2 peers, 4MB/s a peer", b_finished) && check("Sched: 2 x 4MB to each of 2 peers, 4MB/s a peer", c_finished))
+		{
+			report("Sched: 2 x 4MB to peer b, 4MB/s a peer", 8, std::max_element(begin(b_finished), end(b_finished))->second - start, "MB/s");
+			report("Sched: 2 x 4MB to peer c, 4MB/s a peer", 8, std::max_element(begin(c_finished), end(c_finished))->second - start, "MB/s");
+		}
+	}
+	a_files->stop_thread();
+	b_files->stop_thread();
+	c_files->stop_thread();
+	a_kernel->stop_thread();
+	b_kernel->stop_thread();
+	c_kernel->stop_thread();
+	a_files->join_thread();
+	b_files->join_thread();
+	c_files->join_thread();
+	a_kernel->join_thread();
+	b_kernel->join_thread();
+	c_kernel->join_thread();
+	for (auto link : {ab_links.first.get(), ab_links.second.get(), ac_links.first.get(), ac_links.second.get()}) link->stop_threads();
+	for (auto link : {ab_links.first.get(), ab_links.second.get(), ac_links.first.get(), ac_links.second.get()}) link->join_threads();
+	for (auto name : {"big.bin", "mid.bin", "small.bin"}) std::remove((a_path + name).data());
+	for (auto ctx = 1; ctx <= 8; ++ctx)
+	{
+		std::remove((b_path + copy_name(ctx)).data());
+		std::remove((c_path + copy_name(ctx)).data());
+	}
+}
+
+//a file service over a folder of 20k files, another on the same node asking it for
+//pages of its list. reading the whole folder, which is what each list cost before,
+//the first page, which builds the index, the whole list a page at a time, pages and
+//prefix pages a second, how long till every file is hashed, and how long till a
+//watcher hears of a new file.
+void bench_list()
+{
+	Router a;
+	auto kernel = std::make_shared<Kernel_Service>(a);
+	kernel->start_thread();
+	std::string path = "/tmp/chrysalib_bench_list/", b_path = "/tmp/chrysalib_bench_b_";
+	const auto files = 20000u;
+	auto file_name = [] (uint32_t i)
+	{
+		auto name = std::to_string(i);
+		return "f" + std::string(5 - name.size(), '0') + name + ".bin";
+	};
+	std::filesystem::create_directory(path);
+	for (auto i = 0u; i < files; ++i) std::ofstream(path + file_name(i), std::ios::binary) << file_name(i);
+	auto server = std::make_shared<Bench_File_Service>(a, path);
+	auto client = std::make_shared<Bench_File_Service>(a, b_path);
+	server->start_thread();
+	client->start_thread();
+	auto page = std::vector<File_Service::File_Info>{};
+	auto more = false;
+	auto get = [&] (const std::string &prefix, const std::string &after)
+	{
+		client->get_file_list(server->get_id(), prefix, after);
+		return client->wait_list(page, more);
+	};
+	auto ms = [] (auto elapsed) { return std::chrono::duration<double, std::milli>(elapsed).count(); };
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		auto list = std::vector<File_Service::File_Info>{};
+		for (auto &entry : std::filesystem::directory_iterator(path))
+		{
+			list.push_back({entry.path().filename().string(), entry.file_size(), entry.last_write_time().time_since_epoch().count()});
+		}
+		report_per_msg("List: 20k files, folder read", 1, ms(std::chrono::high_resolution_clock::now() - start), "ms");
+	}
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		if (!get("", "")) std::cout << "List: 20k files, first page: failed" << std::endl;
+		else report_per_msg("List: 20k files, first page", 1, ms(std::chrono::high_resolution_clock::now() - start), "ms");
+	}
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		auto count = size_t(0);
+		auto after = std::string();
+		while (get("", after))
+		{
+			count += page.size();
+			if (!more || page.empty()) break;
+			after = page.back().m_name;
+		}
+		if (count != files) std::cout << "List: 20k files, all pages: failed" << std::endl;
+		else report_per_msg("List: 20k files, all pages", 1, ms(std::chrono::high_resolution_clock::now() - start), "ms");
+	}
+	{
+		const auto pages = 1000u;
+		std::mt19937 rng(1);
+		auto start = std::chrono::high_resolution_clock::now();
+		for (auto i = 0u; i < pages; ++i) get("", file_name(rng() % files));
+		report("List: page of 1000", pages, std::chrono::high_resolution_clock::now() - start, "pages/s");
+		start = std::chrono::high_resolution_clock::now();
+		for (auto i = 0u; i < pages; ++i) get(file_name(rng() % files).substr(0, 4), "");
+		if (page.size() != 100) std::cout << "List: prefix page of 100: failed" << std::endl;
+		else report("List: prefix page of 100", pages, std::chrono::high_resolution_clock::now() - start, "pages/s");
+	}
+	{
+		//the hashes go in from when the index was made
+		auto start = std::chrono::high_resolution_clock::now();
+		for (;;)
+		{
+			auto hashed = 0u;
+			auto after = std::string();
+			while (get("", after))
+			{
+				hashed += std::count_if(begin(page), end(page), [] (auto &f) { return f.m_hash != 0; });
+				if (!more || page.empty()) break;
+				after = page.back().m_name;
+			}
+			if (hashed == files) break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		report_per_msg("List: 20k files, all hashed", 1, ms(std::chrono::high_resolution_clock::now() - start), "ms");
+	}
+	{
+		//the page after the watch says it's in place
+		client->watch_file_list(server->get_id(), "new");
+		get("new", "");
+		auto start = std::chrono::high_resolution_clock::now();
+		std::ofstream(path + "new.bin", std::ios::binary) << "new";
+		auto change = File_Service::File_Info{};
+		if (!client->wait_change("new.bin", change) || change.m_size != 3) std::cout << "List: new file to watcher: failed" << std::endl;
+		else report_per_msg("List: new file to watcher", 1, ms(std::chrono::high_resolution_clock::now() - start), "ms");
+	}
+	server->stop_thread();
+	client->stop_thread();
+	kernel->stop_thread();
+	server->join_thread();
+	client->join_thread();
+	kernel->join_thread();
+	std::filesystem::remove_all(path);
+}
+
+int32_t main(int32_t argc, char *argv[])
+{
+	//process comand args
+	std::string arg_mbox;
+	std::string arg_router;
+	std::string arg_alloc;
+	std::string arg_parcel;
+	std::string arg_ip;
+	std::string arg_codec;
+	std::string arg_links;
+	std::string arg_shm;
+	std::string arg_timers;
+	std::string arg_tasks;
+	std::string arg_executor;
+	std::string arg_farm;
+	std::string arg_granularity;
+	std::string arg_speculate;
+	std::string arg_capacity;
+	std::string arg_batch;
+	std::string arg_transfer;
+	std::string arg_delta;
+	std::string arg_swarm;
+	std::string arg_sched;
+	std::string arg_list;
+	auto arg_n = 1000000ULL;
+	std::stringstream ss;
+	for (auto i = 1; i < argc; ++i)
+	{
+		//switches only
+		std::string opt = argv[i];
+		while (!opt.empty() && opt[0] == '-') opt.erase(0, 1);
+		if (opt == "mbox") arg_mbox = "on";
+		else if (opt == "router") arg_router = "on";
+		else if (opt == "alloc") arg_alloc = "on";
+		else if (opt == "parcel") arg_parcel = "on";
+		else if (opt == "ip") arg_ip = "on";
+		else if (opt == "codec") arg_codec = "on";
+		else if (opt == "links") arg_links = "on";
+		else if (opt == "shm") arg_shm = "on";
+		else if (opt == "timers") arg_timers = "on";
+		else if (opt == "tasks") arg_tasks = "on";
+		else if (opt == "executor") arg_executor = "on";
+		else if (opt == "farm") arg_farm = "on";
+		else if (opt == "granularity") arg_granularity = "on";
+		else if (opt == "speculate") arg_speculate = "on";
+		else if (opt == "capacity") arg_capacity = "on";
+		else if (opt == "batch") arg_batch = "on";
+		else if (opt == "transfer") arg_transfer = "on";
+		else if (opt == "delta") arg_delta = "on";
+		else if (opt == "swarm") arg_swarm = "on";
+		else if (opt == "sched") arg_sched = "on";
+		else if (opt == "list") arg_list = "on";
+		else if (opt == "n")
+		{
+			if (++i >= argc) goto help;
+			ss_reset(ss, argv[i]);
+			ss >> arg_n;
+		}
+		else if (opt == "v")
+		{
+			if (++i >= argc) goto help;
+			ss_reset(ss, argv[i]);
+			ss >> arg_v;
+		}
+		else
+		{
+		help:
+			std::cout << "bench_node [switches]\n";
+			std::cout << "eg. bench_node -n 100000 -mbox\n";
+			std::cout << "-h:       this help info\n";
+			std::cout << "-v level: verbosity, default 0, ie none\n";
+			std::cout << "-n count: messages per run, default 1000000\n";
+			std::cout << "-mbox:    mailbox post/read, bursts on one thread, 1, 4 and 16 producers, and allocs per msg\n";
+			std::cout << "-router:  outgoing ques, 1 and 32 links\n";
+			std::cout << "-alloc:   local msg send/read, and a mandelbrot row job and reply, heap allocs per msg\n";
+			std::cout << "-parcel:  parcel fragment and reassemble, 64KB and 1MB\n";
+			std::cout << "-ip:      ip link pair on loopback, 64B, 1KB and 4KB msgs\n";
+			std::cout << "-codec:   link frame encode/decode, jenkins and crc32c\n";
+			std::cout << "-links:   ip link manager threads and memory, up to 1000 links\n";
+			std::cout << "-shm:     shm link round trip against ip loopback, 64B, 1KB and 4KB msgs\n";
+			std::cout << "-timers:  kernel idle cpu with 1000 timers armed, and firing lateness\n";
+			std::cout << "-tasks:   ping pong task pairs, thread per task and coroutine, 1000 and 10000 tasks\n";
+			std::cout << "-executor: work stealing executor against a locked pool, posted and forked jobs\n";
+			std::cout << "-farm:    farm dealing out 100k jobs to 10, 100 and 1000 workers\n";
+			std::cout << "-granularity: farm frame of 1600 rows on 8 mixed speed workers, row jobs and ranges\n";
+			std::cout << "-speculate: farm frame with a worker that slows down, and a frame that's dropped\n";
+			std::cout << "-capacity: farm frame on 2 big and 6 small workers, with and without adverts\n";
+			std::cout << "-batch:   farm of 200k echo jobs on 8 workers, unbatched and batched\n";
+			std::cout << "-transfer: 512MB file on one node, 32MB between two nodes, ip loopback and a 20ms link with and without loss, and allocs per chunk\n";
+			std::cout << "-delta:   32MB file over a 20ms link, new, resent unchanged, 1% changed and with a timeout short of the hashing, and resumed after a cut\n";
+			std::cout << "-swarm:   16MB file over 8MB/s links from 1 source, 3 sources, and 3 with one slow\n";
+			std::cout << "-sched:   8 files at once under a send cap, a small file behind two big ones, and a cap per peer\n";
+			std::cout << "-list:    20k file folder, first page, all pages, page rates, hashing and a watcher hearing of a new file\n";
+			exit(0);
+		}
+	}
+
+	//globals
+	global_kernel_thread_id = std::this_thread::get_id();
+	global_router = std::make_unique<Router>();
+
+	if (arg_mbox != "") bench_mbox(arg_n);
+	if (arg_router != "") for (auto links : {1u, 32u}) bench_router(links, arg_n);
+	if (arg_alloc != "")
+	{
+		bench_alloc(arg_n);
+		bench_farm_allocs(20000);
+	}
+	if (arg_parcel != "") bench_parcel(arg_n);
+	if (arg_ip != "") bench_ip(arg_n);
+	if (arg_codec != "") bench_codec(arg_n);
+	if (arg_links != "") bench_links();
+	if (arg_shm != "") bench_shm(arg_n);
+	if (arg_timers != "") bench_timers();
+	if (arg_tasks != "") bench_tasks(100);
+	if (arg_executor != "") bench_executor(arg_n);
+	if (arg_farm != "") for (auto workers : {10u, 100u, 1000u}) bench_farm(workers, 100000);
+	if (arg_granularity != "")
+	{
+		bench_granularity(false, "Farm: a job per row");
+		bench_granularity(true, "Farm: adaptive range");
+	}
+	if (arg_speculate != "")
+	{
+		bench_speculate(false, false, "Farm: slow worker, no copies");
+		bench_speculate(false, true, "Farm: slow worker, copies");
+		bench_speculate(true, false, "Farm: dropped frame, cancels ignored");
+		bench_speculate(true, true, "Farm: dropped frame, cancels checked");
+	}
+	if (arg_capacity != "")
+	{
+		bench_capacity(false, false, "Farm: 4000 jobs, capacity blind");
+		bench_capacity(false, true, "Farm: 4000 jobs, capacity advertised");
+		bench_capacity(true, false, "Farm: 1600 rows, capacity blind");
+		bench_capacity(true, true, "Farm: 1600 rows, capacity advertised");
+	}
+	if (arg_batch != "")
+	{
+		bench_batch(1, "Farm: echo jobs, unbatched");
+		bench_batch(16, "Farm: echo jobs, batches of 16");
+	}
+	if (arg_transfer != "") bench_transfer();
+	if (arg_delta != "") bench_delta();
+	if (arg_swarm != "") bench_swarm();
+	if (arg_sched != "") bench_sched();
+	if (arg_list != "") bench_list();
+
+	return 0;
+}
@@ -1,6 +1,7 @@
 #include "../../lib/services/kernel_service.h"
 #include "../../lib/services/file_service.h"
 #include "../../lib/links/ip_link.h"
+#include "../../lib/links/shm_link.h"
 #include <iostream>
 #include <sstream>
 
@@ -21,6 +22,7 @@ void ss_reset(std::stringstream &ss, std::string s)
 int32_t main(int32_t argc, char *argv[])
 {
 	//process comand args
+	std::string arg_shm;
 	auto arg_t = 0U;
 	std::vector<std::string> arg_dial;
 	std::stringstream ss;
@@ -31,7 +33,8 @@ int32_t main(int32_t argc, char *argv[])
 			//switch
 			std::string opt = argv[i];
 			while (!opt.empty() && opt[0] == '-') opt.erase(0, 1);
-			if (opt == "t")
+			if (opt == "shm") arg_shm = "client";
+			else if (opt == "t")
 			{
 				if (++i >= argc) goto help;
 				ss_reset(ss, argv[i]);
@@ -51,6 +54,7 @@ int32_t main(int32_t argc, char *argv[])
 				std::cout << "-h:       this help info\n";
 				std::cout << "-v level: verbosity, default 0, ie none\n";
 				std::cout << "-t ms:    exit timeout, default 0, ie never\n";
+				std::cout << "-shm:     link to the hub on this host over shared memory\n";
 				exit(0);
 			}
 		}
@@ -69,12 +73,19 @@ int32_t main(int32_t argc, char *argv[])
 	std::shared_ptr<Kernel_Service> m_kernel;
 	std::unique_ptr<File_Service> m_files;
 	std::unique_ptr<IP_Link_Manager> m_ip_link_manager;
+	std::unique_ptr<Shm_Link_Manager> m_shm_link_manager;
 
 	//startup, kernel is first service so it gets Mailbox_ID 0
 	m_kernel = std::make_shared<Kernel_Service>();
 	m_files = std::make_unique<File_Service>();
 	m_kernel->start_thread();
 	m_files->start_thread();
+	if (arg_shm != "")
+	{
+		if (arg_v > 1) std::cout << "Starting shm link manager" << std::endl;
+		m_shm_link_manager = std::make_unique<Shm_Link_Manager>(arg_shm);
+		m_shm_link_manager->start_thread();
+	}
 	if (!arg_dial.empty())
 	{
 		if (arg_v > 1) std::cout << "Starting IP link manager" << std::endl;
@@ -102,9 +113,11 @@ int32_t main(int32_t argc, char *argv[])
 
 	//shutdown
 	if (m_ip_link_manager) m_ip_link_manager->stop_thread();
+	if (m_shm_link_manager) m_shm_link_manager->stop_thread();
 	m_files->stop_thread();
 	m_kernel->stop_thread();
 	if (m_ip_link_manager) m_ip_link_manager->join_thread();
+	if (m_shm_link_manager) m_shm_link_manager->join_thread();
 	m_files->join_thread();
 	m_kernel->join_thread();
 
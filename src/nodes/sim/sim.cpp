@@ -0,0 +1,200 @@
+#include "../../lib/services/kernel_service.h"
+#include "../../lib/links/memory_link.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+
+//////////
+// sim app
+//////////
+
+//every node has its own router, there is no global one !
+std::unique_ptr<Router> global_router;
+std::thread::id global_kernel_thread_id;
+uint32_t arg_v = 0;
+
+void ss_reset(std::stringstream &ss, std::string s)
+{
+	ss.str(s);
+	ss.clear();
+}
+
+//simulated node, a router and its kernel
+struct Sim_Node
+{
+	std::unique_ptr<Router> m_router;
+	std::shared_ptr<Kernel_Service> m_kernel;
+};
+
+//list of node index pairs to link for a topology
+std::vector<std::pair<uint32_t, uint32_t>> topology(const std::string &name, uint32_t nodes)
+{
+	std::vector<std::pair<uint32_t, uint32_t>> edges;
+	if (name == "line" || name == "ring")
+	{
+		for (auto i = 1u; i < nodes; ++i) edges.emplace_back(i - 1, i);
+		if (name == "ring" && nodes > 2) edges.emplace_back(nodes - 1, 0);
+	}
+	else if (name == "star")
+	{
+		for (auto i = 1u; i < nodes; ++i) edges.emplace_back(0, i);
+	}
+	else if (name == "mesh")
+	{
+		for (auto i = 0u; i < nodes; ++i)
+			for (auto j = i + 1; j < nodes; ++j) edges.emplace_back(i, j);
+	}
+	return edges;
+}
+
+int32_t main(int32_t argc, char *argv[])
+{
+	//process comand args
+	std::string arg_topology = "line";
+	auto arg_nodes = 8U;
+	auto arg_latency = 0U;
+	auto arg_bandwidth = 0ULL;
+	auto arg_loss = 0.0;
+	auto arg_n = 10000U;
+	auto arg_size = 1024U;
+	auto arg_t = 30000U;
+	std::stringstream ss;
+	for (auto i = 1; i < argc; ++i)
+	{
+		//switches only
+		std::string opt = argv[i];
+		while (!opt.empty() && opt[0] == '-') opt.erase(0, 1);
+		if (opt == "line" || opt == "ring" || opt == "star" || opt == "mesh") arg_topology = opt;
+		else if (opt == "nodes" || opt == "latency" || opt == "bandwidth" || opt == "loss"
+			|| opt == "n" || opt == "size" || opt == "t" || opt == "v")
+		{
+			if (++i >= argc) goto help;
+			ss_reset(ss, argv[i]);
+			if (opt == "nodes") ss >> arg_nodes;
+			else if (opt == "latency") ss >> arg_latency;
+			else if (opt == "bandwidth") ss >> arg_bandwidth;
+			else if (opt == "loss") ss >> arg_loss;
+			else if (opt == "n") ss >> arg_n;
+			else if (opt == "size") ss >> arg_size;
+			else if (opt == "t") ss >> arg_t;
+			else ss >> arg_v;
+		}
+		else
+		{
+		help:
+			std::cout << "sim_node [switches]\n";
+			std::cout << "eg. sim_node -mesh -nodes 16 -latency 500 -loss 1\n";
+			std::cout << "-h:           this help info\n";
+			std::cout << "-v level:     verbosity, default 0, ie none\n";
+			std::cout << "-line:        nodes in a line, the default\n";
+			std::cout << "-ring:        nodes in a ring\n";
+			std::cout << "-star:        first node linked to all the others\n";
+			std::cout << "-mesh:        every node linked to every other\n";
+			std::cout << "-nodes count: number of nodes, default 8\n";
+			std::cout << "-latency us:  link latency, default 0\n";
+			std::cout << "-bandwidth b: link bytes per second, default 0, ie no limit\n";
+			std::cout << "-loss pct:    link packet loss percent, default 0\n";
+			std::cout << "-n count:     msgs sent end to end, default 10000\n";
+			std::cout << "-size bytes:  msg size, default 1024\n";
+			std::cout << "-t ms:        convergence and delivery timeout, default 30000\n";
+			exit(0);
+		}
+	}
+	if (arg_nodes < 2) arg_nodes = 2;
+
+	//globals
+	global_kernel_thread_id = std::this_thread::get_id();
+
+	//nodes, kernel is first service so it gets Mailbox_ID 0
+	std::vector<Sim_Node> nodes(arg_nodes);
+	for (auto &node : nodes)
+	{
+		node.m_router = std::make_unique<Router>();
+		node.m_kernel = std::make_shared<Kernel_Service>(*node.m_router);
+		node.m_kernel->start_thread();
+	}
+
+	//wire up the topology
+	Memory_Link_Params params;
+	params.m_latency = std::chrono::microseconds(arg_latency);
+	params.m_bandwidth = arg_bandwidth;
+	params.m_loss = arg_loss / 100.0;
+	auto edges = topology(arg_topology, arg_nodes);
+	std::vector<std::unique_ptr<Memory_Link>> links;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (auto &edge : edges)
+	{
+		auto pair = Memory_Link::create_pair(*nodes[edge.first].m_router, *nodes[edge.second].m_router, params);
+		links.emplace_back(std::move(pair.first));
+		links.emplace_back(std::move(pair.second));
+		links[links.size() - 2]->start_threads();
+		links[links.size() - 1]->start_threads();
+	}
+	std::cout << arg_topology << ": " << arg_nodes << " nodes, " << edges.size() << " links" << std::endl;
+
+	//wait for every directory to list every kernel
+	auto converged = false;
+	while (!converged)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		converged = std::all_of(begin(nodes), end(nodes), [&] (auto &node)
+		{
+			return node.m_router->enquire("kernel,").size() == arg_nodes;
+		});
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+		if (elapsed.count() > arg_t) break;
+	}
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	if (!converged) std::cout << "Directory: not converged after " << arg_t << " ms" << std::endl;
+	else std::cout << "Directory: converged in " << std::fixed << std::setprecision(0) << elapsed.count() << " ms" << std::endl;
+
+	//send msgs from the first node to the last
+	if (converged && arg_n)
+	{
+		auto &src = *nodes.front().m_router;
+		auto &dst = *nodes.back().m_router;
+		auto dst_id = dst.alloc();
+		auto dst_mbox = dst.resolve(dst_id);
+		auto received = 0U;
+		auto bytes = 0ULL;
+		auto start = std::chrono::high_resolution_clock::now();
+		auto finish = start;
+		auto rx_thread = std::thread([&]
+		{
+			while (received < arg_n)
+			{
+				auto msg = dst_mbox.read(std::chrono::milliseconds(arg_t));
+				if (!msg) break;
+				finish = std::chrono::high_resolution_clock::now();
+				bytes += msg->size();
+				received++;
+			}
+		});
+		for (auto i = 0U; i < arg_n; ++i)
+		{
+			auto msg = std::make_shared<Msg>((size_t)arg_size);
+			msg->set_dest(dst_id);
+			src.send(msg);
+		}
+		rx_thread.join();
+		std::chrono::duration<double, std::milli> elapsed = finish - start;
+		std::cout << "Throughput: " << received << " of " << arg_n << " msgs delivered";
+		if (received && elapsed.count() > 0)
+		{
+			std::cout << ", " << (uint64_t)(received * 1000.0 / elapsed.count()) << " msgs/s, "
+				<< std::setprecision(2) << bytes / elapsed.count() / 1000.0 << " MB/s";
+		}
+		std::cout << std::endl;
+		dst.free(dst_id);
+	}
+
+	//shutdown
+	for (auto &link : links) link->stop_threads();
+	for (auto &node : nodes) node.m_kernel->stop_thread();
+	for (auto &link : links) link->join_threads();
+	for (auto &node : nodes) node.m_kernel->join_thread();
+	links.clear();
+	nodes.clear();
+
+	return 0;
+}